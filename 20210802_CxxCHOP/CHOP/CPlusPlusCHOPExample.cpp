@@ -13,11 +13,15 @@
 */
 
 #include "CPlusPlusCHOPExample.h"
+#include "ThreadPool.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <cmath>
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
 
 // These functions are basic C function, which the DLL loader can find
 // much easier than finding a C++ Class.
@@ -58,6 +62,7 @@ CreateCHOPInstance(const OP_NodeInfo* info)
 {
 	// Return a new instance of your class every time this is called.
 	// It will be called once per CHOP that is using the .dll
+	ThreadPool::acquire();
 	return new CPlusPlusCHOPExample(info);
 }
 
@@ -69,6 +74,7 @@ DestroyCHOPInstance(CHOP_CPlusPlusBase* instance)
 	// Touch is shutting down, when the CHOP using that instance is deleted, or
 	// if the CHOP loads a different DLL
 	delete (CPlusPlusCHOPExample*)instance;
+	ThreadPool::release();
 }
 
 };
@@ -78,6 +84,44 @@ CPlusPlusCHOPExample::CPlusPlusCHOPExample(const OP_NodeInfo* info) : myNodeInfo
 {
 	myExecuteCount = 0;
 	myOffset = 0.0;
+	myWarning = nullptr;
+	myMode = CHOPMode::Signal;
+	myHeightsWidth = 0;
+	myHeightsHeight = 0;
+	myRequestWidth = 0;
+	myRequestHeight = 0;
+	myHeightmapCooks = -1;
+	myHeightmapPending = false;
+	myTerrainDirty = true;
+	myTerrainBuilds = 0;
+	myStatsRequestWidth = 0;
+	myStatsRequestHeight = 0;
+	myStatsCooks = -1;
+	myStatsPending = false;
+	myStatsValid = false;
+	myStatsPasses = 0;
+	InstanceBuilder::defaultRules(myInstanceRules);
+	myRulesWarning = nullptr;
+	myRulesDATId = 0;
+	myRulesDATCooks = -1;
+	myInstanceRequestWidth = 0;
+	myInstanceRequestHeight = 0;
+	myInstanceCooks = -1;
+	myInstancePending = false;
+	myInstanceRowsUpdated = 0;
+	myParticlesReset = true;
+	myParticlesSpawned = 0;
+	myParticlesKilled = 0;
+	myClothReset = true;
+	std::fill(myClothTimes, myClothTimes + ClothSolver::NumPhases, 0.0);
+	myClothCollisions = 0;
+	myRigidReset = true;
+	myRigidTime = 0.0;
+	myFluidReset = true;
+	myFluidTime = 0.0;
+	myPlexusWarning = nullptr;
+	myPlexusTime = 0.0;
+	myTrailsTime = 0.0;
 }
 
 CPlusPlusCHOPExample::~CPlusPlusCHOPExample()
@@ -95,7 +139,9 @@ CPlusPlusCHOPExample::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* i
 	// getOutputInfo() returns true, and likely also set the info->numSamples to how many
 	// samples you want to generate for this CHOP. Otherwise it'll take on length of the
 	// input CHOP, which may be timesliced.
-	ginfo->timeslice = true;
+	// Only the Signal mode is timesliced, the other modes output a fixed
+	// number of samples.
+	ginfo->timeslice = static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Signal;
 
 	ginfo->inputMatchIndex = 0;
 }
@@ -103,6 +149,126 @@ CPlusPlusCHOPExample::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* i
 bool
 CPlusPlusCHOPExample::getOutputInfo(CHOP_OutputInfo* info, const OP_Inputs* inputs, void* reserved1)
 {
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Terrain)
+	{
+		// One sample per terrain point. Without a heightmap that's a single
+		// point at the origin.
+		const OP_TOPInput* top = inputs->getParTOP("Heightmap");
+		int32_t width = top ? top->width : 1;
+		int32_t height = top ? top->height : 1;
+
+		info->numChannels = TerrainGenerator::NumChannels;
+		info->numSamples = TerrainGenerator::pointCount(width, height, getTerrainSettings(inputs));
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Stats)
+	{
+		// Every statistic of every component as one sample, or one sample
+		// per bin of each component's histogram
+		if (static_cast<StatsOutput>(inputs->getParInt("Statsoutput")) == StatsOutput::Histogram)
+		{
+			info->numChannels = TextureStats::NumComponents;
+			info->numSamples = std::max(1, inputs->getParInt("Bins"));
+		}
+		else
+		{
+			info->numChannels = TextureStats::NumComponents * TextureStats::NumStats;
+			info->numSamples = 1;
+		}
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Instances)
+	{
+		// One sample per pixel, a single default instance without a TOP
+		const OP_TOPInput* top = inputs->getParTOP("Instancetop");
+		info->numChannels = InstanceBuilder::NumChannels;
+		info->numSamples = top ? top->width * top->height : 1;
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Nearest)
+	{
+		// One sample per query point, px py pz then an index and distance
+		// channel per neighbour
+		const OP_CHOPInput* queries = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+		info->numChannels = 3 + 2 * inputs->getParInt("Neighbors");
+		info->numSamples = queries ? std::max(1, queries->numSamples) : 1;
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Raycast)
+	{
+		// One sample per ray
+		const OP_CHOPInput* rays = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+		info->numChannels = RaycastChannels;
+		info->numSamples = rays ? std::max(1, rays->numSamples) : 1;
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Particles)
+	{
+		// One sample per slot of the pool, dead or alive
+		info->numChannels = ParticlePool::NumChannels;
+		info->numSamples = std::max(1, inputs->getParInt("Maxparticles"));
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Cloth)
+	{
+		// One sample per particle, rows of the grid one after the other
+		const ClothGrid grid = getClothGrid(inputs);
+		info->numChannels = ClothSolver::NumChannels;
+		info->numSamples = grid.resolutionX * grid.resolutionY;
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Rigid)
+	{
+		// One sample per body
+		info->numChannels = RigidBodies::NumChannels;
+		info->numSamples = std::max(1, inputs->getParInt("Bodies"));
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Fluid)
+	{
+		// One sample per particle
+		info->numChannels = FluidSolver::NumChannels;
+		info->numSamples = std::max(1, inputs->getParInt("Fluidparticles"));
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Plexus)
+	{
+		// One sample per edge, which needs the edges found now
+		updatePlexus(inputs);
+		info->numChannels = ProximityEdges::NumChannels;
+		info->numSamples = std::max(1, myPlexus.numEdges());
+		info->startIndex = 0;
+		return true;
+	}
+
+	if (static_cast<CHOPMode>(inputs->getParInt("Mode")) == CHOPMode::Trails)
+	{
+		// Every vertex of every trail, one trail per input sample
+		const OP_CHOPInput* heads = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+		info->numChannels = RibbonTrails::NumChannels;
+		info->numSamples = std::max(1, RibbonTrails::vertexCount(heads ? heads->numSamples : 0, getTrailSettings(inputs)));
+		info->startIndex = 0;
+		return true;
+	}
+
 	// If there is an input connected, we are going to match it's channel names etc
 	// otherwise we'll specify our own.
 	if (inputs->getNumInputs() > 0)
@@ -127,7 +293,107 @@ CPlusPlusCHOPExample::getOutputInfo(CHOP_OutputInfo* info, const OP_Inputs* inpu
 void
 CPlusPlusCHOPExample::getChannelName(int32_t index, OP_String *name, const OP_Inputs* inputs, void* reserved1)
 {
-	name->setString("chan1");
+	static const char* components[TextureStats::NumComponents] = { "r", "g", "b", "a" };
+
+	CHOPMode mode = static_cast<CHOPMode>(inputs->getParInt("Mode"));
+	if (mode == CHOPMode::Terrain)
+	{
+		name->setString(TerrainGenerator::channelName(index));
+	}
+	else if (mode == CHOPMode::Stats)
+	{
+		if (static_cast<StatsOutput>(inputs->getParInt("Statsoutput")) == StatsOutput::Histogram)
+		{
+			name->setString(components[index]);
+			return;
+		}
+
+		// Grouped by component: r_min r_max r_mean r_p5 r_p50 r_p95 g_min ...
+		const char* component = components[index / TextureStats::NumStats];
+		int32_t stat = index % TextureStats::NumStats;
+
+		char tempBuffer[64];
+		if (stat >= TextureStats::Percentile1)
+		{
+			double percentiles[StatsSettings::NumPercentiles];
+			inputs->getParDouble3("Percentiles", percentiles[0], percentiles[1], percentiles[2]);
+			double p = percentiles[stat - TextureStats::Percentile1];
+#ifdef _WIN32
+			sprintf_s(tempBuffer, "%s_p%g", component, p);
+#else // macOS
+			snprintf(tempBuffer, sizeof(tempBuffer), "%s_p%g", component, p);
+#endif
+		}
+		else
+		{
+			static const char* stats[] = { "min", "max", "mean" };
+#ifdef _WIN32
+			sprintf_s(tempBuffer, "%s_%s", component, stats[stat]);
+#else // macOS
+			snprintf(tempBuffer, sizeof(tempBuffer), "%s_%s", component, stats[stat]);
+#endif
+		}
+		name->setString(tempBuffer);
+	}
+	else if (mode == CHOPMode::Instances)
+	{
+		name->setString(InstanceBuilder::channelName(index));
+	}
+	else if (mode == CHOPMode::Nearest)
+	{
+		static const char* position[] = { "px", "py", "pz" };
+		if (index < 3)
+		{
+			name->setString(position[index]);
+			return;
+		}
+
+		int32_t k = inputs->getParInt("Neighbors");
+		int32_t n = (index - 3) % k;
+		char tempBuffer[64];
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%s%d", index - 3 < k ? "index" : "dist", n);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%s%d", index - 3 < k ? "index" : "dist", n);
+#endif
+		name->setString(tempBuffer);
+	}
+	else if (mode == CHOPMode::Raycast)
+	{
+		static const char* names[RaycastChannels] =
+		{
+			"hit", "px", "py", "pz", "nx", "ny", "nz", "u", "v", "length", "prim"
+		};
+		name->setString(names[index]);
+	}
+	else if (mode == CHOPMode::Particles)
+	{
+		name->setString(ParticlePool::channelName(index));
+	}
+	else if (mode == CHOPMode::Cloth)
+	{
+		name->setString(ClothSolver::channelName(index));
+	}
+	else if (mode == CHOPMode::Rigid)
+	{
+		name->setString(RigidBodies::channelName(index));
+	}
+	else if (mode == CHOPMode::Fluid)
+	{
+		name->setString(FluidSolver::channelName(index));
+	}
+	else if (mode == CHOPMode::Plexus)
+	{
+		name->setString(ProximityEdges::channelName(index));
+	}
+	else if (mode == CHOPMode::Trails)
+	{
+		name->setString(RibbonTrails::channelName(index));
+	}
+	else
+	{
+		name->setString("chan1");
+	}
 }
 
 void
@@ -136,7 +402,183 @@ CPlusPlusCHOPExample::execute(CHOP_Output* output,
 							  void* reserved)
 {
 	myExecuteCount++;
-	
+	myWarning = nullptr;
+
+	myMode = static_cast<CHOPMode>(inputs->getParInt("Mode"));
+
+	const bool signal = myMode == CHOPMode::Signal;
+	inputs->enablePar("Speed", signal);
+	inputs->enablePar("Scale", signal);
+	inputs->enablePar("Cross", signal);
+	inputs->enablePar("Shape", signal);
+	inputs->enablePar("Reset", signal || myMode == CHOPMode::Particles || myMode == CHOPMode::Cloth ||
+					  myMode == CHOPMode::Rigid || myMode == CHOPMode::Fluid || myMode == CHOPMode::Trails);
+
+	const bool terrain = myMode == CHOPMode::Terrain;
+	inputs->enablePar("Heightmap", terrain);
+	inputs->enablePar("Heightscale", terrain);
+	inputs->enablePar("Size", terrain);
+	inputs->enablePar("Decimate", terrain);
+	inputs->enablePar("Lodlevels", terrain);
+
+	const bool stats = myMode == CHOPMode::Stats;
+	inputs->enablePar("Statstop", stats);
+	inputs->enablePar("Statsoutput", stats);
+	inputs->enablePar("Bins", stats);
+	inputs->enablePar("Range", stats);
+	inputs->enablePar("Percentiles", stats);
+
+	const bool instances = myMode == CHOPMode::Instances;
+	inputs->enablePar("Instancetop", instances);
+	inputs->enablePar("Rulesdat", instances);
+
+	const bool nearest = myMode == CHOPMode::Nearest;
+	inputs->enablePar("Pointsop", nearest);
+	inputs->enablePar("Neighbors", nearest);
+	inputs->enablePar("Maxdistance", nearest);
+
+	const bool raycast = myMode == CHOPMode::Raycast;
+	inputs->enablePar("Raysop", raycast);
+
+	const bool particles = myMode == CHOPMode::Particles;
+	inputs->enablePar("Maxparticles", particles);
+	inputs->enablePar("Emitrate", particles);
+	inputs->enablePar("Emitterpos", particles);
+	inputs->enablePar("Emitdir", particles);
+	inputs->enablePar("Emitspeed", particles);
+	inputs->enablePar("Spread", particles);
+	inputs->enablePar("Life", particles);
+	inputs->enablePar("Lifevariance", particles);
+	inputs->enablePar("Gravity", particles);
+	inputs->enablePar("Drag", particles);
+	inputs->enablePar("Childcount", particles);
+	inputs->enablePar("Generations", particles);
+	inputs->enablePar("Childspeed", particles);
+	inputs->enablePar("Childlife", particles);
+	inputs->enablePar("Substeps", particles);
+
+	const bool cloth = myMode == CHOPMode::Cloth;
+	inputs->enablePar("Clothresolution", cloth);
+	inputs->enablePar("Clothsize", cloth);
+	inputs->enablePar("Clothplane", cloth);
+	inputs->enablePar("Clothpins", cloth);
+	inputs->enablePar("Clothcenter", cloth);
+	inputs->enablePar("Iterations", cloth);
+	inputs->enablePar("Clothsubsteps", cloth);
+	inputs->enablePar("Stretchcompliance", cloth);
+	inputs->enablePar("Bendcompliance", cloth);
+	inputs->enablePar("Clothgravity", cloth);
+	inputs->enablePar("Damping", cloth);
+	inputs->enablePar("Collisionsop", cloth);
+	inputs->enablePar("Thickness", cloth);
+	inputs->enablePar("Friction", cloth);
+
+	const bool rigid = myMode == CHOPMode::Rigid;
+	inputs->enablePar("Bodies", rigid);
+	inputs->enablePar("Rigidshapes", rigid);
+	inputs->enablePar("Bodysize", rigid);
+	inputs->enablePar("Dropheight", rigid);
+	inputs->enablePar("Dropspread", rigid);
+	inputs->enablePar("Solveriterations", rigid);
+	inputs->enablePar("Rigidsubsteps", rigid);
+	inputs->enablePar("Rigidgravity", rigid);
+	inputs->enablePar("Rigidfriction", rigid);
+	inputs->enablePar("Restitution", rigid);
+	inputs->enablePar("Sleep", rigid);
+	inputs->enablePar("Sleepspeed", rigid);
+
+	const bool fluid = myMode == CHOPMode::Fluid;
+	inputs->enablePar("Fluidparticles", fluid);
+	inputs->enablePar("Particlespacing", fluid);
+	inputs->enablePar("Tanksize", fluid);
+	inputs->enablePar("Fluidgravity", fluid);
+	inputs->enablePar("Viscosity", fluid);
+	inputs->enablePar("Tolerance", fluid);
+	inputs->enablePar("Maxiterations", fluid);
+	inputs->enablePar("Sortinterval", fluid);
+
+	const bool plexus = myMode == CHOPMode::Plexus;
+	const PlexusSource source = static_cast<PlexusSource>(inputs->getParInt("Plexussource"));
+	inputs->enablePar("Plexussource", plexus);
+	inputs->enablePar("Plexusdat", plexus && source == PlexusSource::DAT);
+	inputs->enablePar("Plexussop", plexus && source == PlexusSource::SOP);
+	inputs->enablePar("Plexusradius", plexus);
+	inputs->enablePar("Maxperpoint", plexus);
+	inputs->enablePar("Maxedges", plexus);
+	inputs->enablePar("Fade", plexus);
+
+	const bool trails = myMode == CHOPMode::Trails;
+	inputs->enablePar("Traillength", trails);
+	inputs->enablePar("Trailshape", trails);
+	inputs->enablePar("Tubesides", trails && static_cast<TrailShape>(inputs->getParInt("Trailshape")) == TrailShape::Tube);
+	inputs->enablePar("Trailwidth", trails);
+
+	if (terrain)
+	{
+		executeTerrain(output, inputs);
+		return;
+	}
+
+	if (stats)
+	{
+		executeStats(output, inputs);
+		return;
+	}
+
+	if (instances)
+	{
+		executeInstances(output, inputs);
+		return;
+	}
+
+	if (nearest)
+	{
+		executeNearest(output, inputs);
+		return;
+	}
+
+	if (raycast)
+	{
+		executeRaycast(output, inputs);
+		return;
+	}
+
+	if (particles)
+	{
+		executeParticles(output, inputs);
+		return;
+	}
+
+	if (cloth)
+	{
+		executeCloth(output, inputs);
+		return;
+	}
+
+	if (rigid)
+	{
+		executeRigid(output, inputs);
+		return;
+	}
+
+	if (fluid)
+	{
+		executeFluid(output, inputs);
+		return;
+	}
+
+	if (plexus)
+	{
+		executePlexus(output, inputs);
+		return;
+	}
+
+	if (trails)
+	{
+		executeTrails(output, inputs);
+		return;
+	}
+
 	double	 scale = inputs->getParDouble("Scale");
 
 	// In this case we'll just take the first input and re-output it scaled.
@@ -231,153 +673,2571 @@ CPlusPlusCHOPExample::execute(CHOP_Output* output,
 	}
 }
 
-int32_t
-CPlusPlusCHOPExample::getNumInfoCHOPChans(void * reserved1)
+TerrainSettings
+CPlusPlusCHOPExample::getTerrainSettings(const OP_Inputs* inputs)
 {
-	// We return the number of channel we want to output to any Info CHOP
-	// connected to the CHOP. In this example we are just going to send one channel.
-	return 2;
+	TerrainSettings settings;
+	settings.heightScale = float(inputs->getParDouble("Heightscale"));
+
+	double sizeX, sizeZ;
+	inputs->getParDouble2("Size", sizeX, sizeZ);
+	settings.sizeX = float(sizeX);
+	settings.sizeZ = float(sizeZ);
+
+	settings.decimate = inputs->getParInt("Decimate");
+	settings.lodLevels = inputs->getParInt("Lodlevels");
+	return settings;
 }
 
 void
-CPlusPlusCHOPExample::getInfoCHOPChan(int32_t index,
-										OP_InfoCHOPChan* chan,
-										void* reserved1)
+CPlusPlusCHOPExample::executeTerrain(CHOP_Output* output, const OP_Inputs* inputs)
 {
-	// This function will be called once for each channel we said we'd want to return
-	// In this example it'll only be called once.
+	const OP_TOPInput* top = inputs->getParTOP("Heightmap");
+	const int32_t width = top ? top->width : 1;
+	const int32_t height = top ? top->height : 1;
 
-	if (index == 0)
+	if (!top)
+		myWarning = "Heightmap TOP is not set.";
+
+	TerrainSettings settings = getTerrainSettings(inputs);
+	if (settings != myTerrainSettings)
 	{
-		chan->name->setString("executeCount");
-		chan->value = (float)myExecuteCount;
+		myTerrainSettings = settings;
+		myTerrainDirty = true;
 	}
 
-	if (index == 1)
+	// Delayed downloads hand back the previous request's data, so after the
+	// TOP cooks we download once more on the next cook to pick up its result,
+	// and not at all while the TOP doesn't change.
+	if (top)
 	{
-		chan->name->setString("offset");
-		chan->value = (float)myOffset;
+		bool cooked = top->totalCooks != myHeightmapCooks;
+		if (cooked || myHeightmapPending)
+		{
+			myHeightmapCooks = top->totalCooks;
+			myHeightmapPending = cooked;
+
+			OP_TOPInputDownloadOptions options;
+			options.cpuMemPixelType = OP_CPUMemPixelType::R32Float;
+
+			const float* data = (const float*)inputs->getTOPDataInCPUMemory(top, &options);
+			if (data && myRequestWidth == width && myRequestHeight == height)
+			{
+				myHeights.assign(data, data + static_cast<size_t>(width) * height);
+				myHeightsWidth = width;
+				myHeightsHeight = height;
+				myTerrainDirty = true;
+			}
+			myRequestWidth = width;
+			myRequestHeight = height;
+		}
+	}
+
+	// Until a download of the current size arrives the terrain is flat
+	bool haveHeights = top && myHeightsWidth == width && myHeightsHeight == height;
+	if (myTerrainDirty || TerrainGenerator::pointCount(width, height, settings) != myTerrain.numPoints())
+	{
+		myTerrain.build(haveHeights ? myHeights.data() : nullptr, width, height, settings);
+		myTerrainDirty = false;
+		myTerrainBuilds++;
+	}
+
+	int32_t count = std::min(output->numSamples, myTerrain.numPoints());
+	for (int i = 0; i < output->numChannels && i < TerrainGenerator::NumChannels; i++)
+	{
+		const float* src = myTerrain.channel(i);
+		std::copy(src, src + count, output->channels[i]);
+		std::fill(output->channels[i] + count, output->channels[i] + output->numSamples, 0.0f);
 	}
 }
 
-bool		
-CPlusPlusCHOPExample::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1)
+StatsSettings
+CPlusPlusCHOPExample::getStatsSettings(const OP_Inputs* inputs)
 {
-	infoSize->rows = 2;
-	infoSize->cols = 2;
-	// Setting this to false means we'll be assigning values to the table
-	// one row at a time. True means we'll do it one column at a time.
-	infoSize->byColumn = false;
-	return true;
+	StatsSettings settings;
+	settings.bins = std::max(1, inputs->getParInt("Bins"));
+
+	double rangeMin, rangeMax;
+	inputs->getParDouble2("Range", rangeMin, rangeMax);
+	settings.rangeMin = float(rangeMin);
+	settings.rangeMax = float(rangeMax);
+
+	double p[StatsSettings::NumPercentiles];
+	inputs->getParDouble3("Percentiles", p[0], p[1], p[2]);
+	for (int i = 0; i < StatsSettings::NumPercentiles; i++)
+		settings.percentiles[i] = float(p[i]);
+	return settings;
 }
 
 void
-CPlusPlusCHOPExample::getInfoDATEntries(int32_t index,
-										int32_t nEntries,
-										OP_InfoDATEntries* entries, 
-										void* reserved1)
+CPlusPlusCHOPExample::executeStats(CHOP_Output* output, const OP_Inputs* inputs)
 {
-	char tempBuffer[4096];
+	const OP_TOPInput* top = inputs->getParTOP("Statstop");
+	if (!top)
+		myWarning = "Stats TOP is not set.";
+
+	StatsSettings settings = getStatsSettings(inputs);
+	bool settingsChanged = settings != myStatsSettings;
+	myStatsSettings = settings;
+
+	// The pixels are only valid during this cook, so they are reduced as soon
+	// as a download arrives. A settings change asks for the last download
+	// again rather than keeping a copy of it.
+	if (top)
+	{
+		bool cooked = top->totalCooks != myStatsCooks;
+		if (cooked || myStatsPending || settingsChanged)
+		{
+			myStatsCooks = top->totalCooks;
+			myStatsPending = cooked;
 
-	if (index == 0)
+			OP_TOPInputDownloadOptions options;
+			options.downloadType = OP_TOPInputDownloadType::Delayed;
+			options.cpuMemPixelType = OP_CPUMemPixelType::RGBA32Float;
+
+			const float* data = (const float*)inputs->getTOPDataInCPUMemory(top, &options);
+			if (data && myStatsRequestWidth == top->width && myStatsRequestHeight == top->height)
+			{
+				myStats.compute(data, top->width, top->height, settings);
+				myStatsValid = true;
+				myStatsPasses++;
+			}
+			myStatsRequestWidth = top->width;
+			myStatsRequestHeight = top->height;
+		}
+	}
+	else
 	{
-		// Set the value for the first column
-		entries->values[0]->setString("executeCount");
+		myStatsValid = false;
+	}
 
-		// Set the value for the second column
-#ifdef _WIN32
-		sprintf_s(tempBuffer, "%d", myExecuteCount);
-#else // macOS
-		snprintf(tempBuffer, sizeof(tempBuffer), "%d", myExecuteCount);
-#endif
-		entries->values[1]->setString(tempBuffer);
+	// Zeros until the first download has been reduced with these bins
+	const bool valid = myStatsValid && myStats.bins() == settings.bins;
+
+	if (static_cast<StatsOutput>(inputs->getParInt("Statsoutput")) == StatsOutput::Histogram)
+	{
+		// Fraction of the pixels in each bin
+		const float norm = valid && myStats.pixelCount() > 0 ? 1.0f / myStats.pixelCount() : 0.0f;
+		for (int i = 0; i < output->numChannels && i < TextureStats::NumComponents; i++)
+		{
+			const int32_t count = valid ? std::min(output->numSamples, myStats.bins()) : 0;
+			const uint32_t* hist = valid ? myStats.histogram(i) : nullptr;
+			for (int j = 0; j < count; j++)
+				output->channels[i][j] = hist[j] * norm;
+			std::fill(output->channels[i] + count, output->channels[i] + output->numSamples, 0.0f);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < output->numChannels && i < TextureStats::NumComponents * TextureStats::NumStats; i++)
+		{
+			TextureStats::Stat stat = static_cast<TextureStats::Stat>(i % TextureStats::NumStats);
+			float v = valid ? myStats.stat(i / TextureStats::NumStats, stat) : 0.0f;
+			std::fill(output->channels[i], output->channels[i] + output->numSamples, v);
+		}
 	}
+}
 
-	if (index == 1)
+void
+CPlusPlusCHOPExample::parseInstanceRules(const OP_DATInput* dat)
+{
+	InstanceBuilder::defaultRules(myInstanceRules);
+	myRulesWarning = nullptr;
+	if (!dat)
+		return;
+
+	for (int32_t r = 0; r < dat->numRows; r++)
 	{
-		// Set the value for the first column
-		entries->values[0]->setString("offset");
+		if (dat->numCols < 2)
+			break;
 
-		// Set the value for the second column
-#ifdef _WIN32
-		sprintf_s(tempBuffer, "%g", myOffset);
-#else // macOS
-		snprintf(tempBuffer, sizeof(tempBuffer), "%g", myOffset);
-#endif
-		entries->values[1]->setString( tempBuffer);
+		int32_t channel = InstanceBuilder::findChannel(dat->getCell(r, 0));
+		int32_t source = InstanceBuilder::findSource(dat->getCell(r, 1));
+		if (channel < 0 || source < 0)
+		{
+			// A header row is fine, anything else is worth a warning
+			if (r > 0)
+				myRulesWarning = "Rules DAT has rows with an unknown channel or source.";
+			continue;
+		}
+
+		InstanceRule& rule = myInstanceRules[channel];
+		rule.source = static_cast<InstanceSource>(source);
+		rule.gain = dat->numCols > 2 ? float(atof(dat->getCell(r, 2))) : 1.0f;
+		rule.offset = dat->numCols > 3 ? float(atof(dat->getCell(r, 3))) : 0.0f;
 	}
 }
 
 void
-CPlusPlusCHOPExample::setupParameters(OP_ParameterManager* manager, void *reserved1)
+CPlusPlusCHOPExample::executeInstances(CHOP_Output* output, const OP_Inputs* inputs)
 {
-	// speed
+	const OP_DATInput* rules = inputs->getParDAT("Rulesdat");
+	uint32_t rulesId = rules ? rules->opId : 0;
+	int64_t rulesCooks = rules ? rules->totalCooks : -1;
+	if (rulesId != myRulesDATId || rulesCooks != myRulesDATCooks)
 	{
-		OP_NumericParameter	np;
-
-		np.name = "Speed";
-		np.label = "Speed";
-		np.defaultValues[0] = 1.0;
-		np.minSliders[0] = -10.0;
-		np.maxSliders[0] =  10.0;
-		
-		OP_ParAppendResult res = manager->appendFloat(np);
-		assert(res == OP_ParAppendResult::Success);
+		myRulesDATId = rulesId;
+		myRulesDATCooks = rulesCooks;
+		parseInstanceRules(rules);
 	}
+	myWarning = myRulesWarning;
+	myInstances.setRules(myInstanceRules);
 
-	// scale
+	const OP_TOPInput* top = inputs->getParTOP("Instancetop");
+	myInstanceRowsUpdated = 0;
+
+	if (!top)
 	{
-		OP_NumericParameter	np;
+		myWarning = "Instance TOP is not set.";
+		myInstances.clear();
+	}
+	else
+	{
+		bool cooked = top->totalCooks != myInstanceCooks;
+		if (cooked || myInstancePending)
+		{
+			myInstanceCooks = top->totalCooks;
+			myInstancePending = cooked;
 
-		np.name = "Scale";
-		np.label = "Scale";
-		np.defaultValues[0] = 1.0;
-		np.minSliders[0] = -10.0;
-		np.maxSliders[0] =  10.0;
-		
-		OP_ParAppendResult res = manager->appendFloat(np);
-		assert(res == OP_ParAppendResult::Success);
+			OP_TOPInputDownloadOptions options;
+			options.cpuMemPixelType = OP_CPUMemPixelType::RGBA32Float;
+
+			const float* data = (const float*)inputs->getTOPDataInCPUMemory(top, &options);
+			if (data && myInstanceRequestWidth == top->width && myInstanceRequestHeight == top->height)
+				myInstanceRowsUpdated = myInstances.update(data, top->width, top->height);
+			myInstanceRequestWidth = top->width;
+			myInstanceRequestHeight = top->height;
+		}
+
+		// New rules with no new pixels rebuild from the last ones
+		myInstanceRowsUpdated += myInstances.refresh();
 	}
 
-	// cross
+	// Until the first download of this size arrives, every instance sits at
+	// the origin with the default rules' scale
+	const int32_t count = std::min(output->numSamples, myInstances.numInstances());
+	for (int i = 0; i < output->numChannels && i < InstanceBuilder::NumChannels; i++)
 	{
-		OP_NumericParameter	np;
+		float fill = 0.0f;
+		if (i >= InstanceBuilder::SX && i <= InstanceBuilder::SZ)
+			fill = 1.0f;
 
-		np.name = "Cross";
-		np.label = "Cross";
-		np.defaultValues[0] = 0.5;
-		np.minSliders[0] = 0.0;
-		np.maxSliders[0] = 1.0;
-		
-		OP_ParAppendResult res = manager->appendFloat(np);
-		assert(res == OP_ParAppendResult::Success);
+		const float* src = myInstances.channel(i);
+		std::copy(src, src + count, output->channels[i]);
+		std::fill(output->channels[i] + count, output->channels[i] + output->numSamples, fill);
 	}
+}
 
+void
+CPlusPlusCHOPExample::executeNearest(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	const OP_SOPInput* sop = inputs->getParSOP("Pointsop");
+	const OP_CHOPInput* queries = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+
+	for (int i = 0; i < output->numChannels; i++)
+		std::fill(output->channels[i], output->channels[i] + output->numSamples, 0.0f);
+
+	if (!sop)
+	{
+		myWarning = "Point SOP is not set.";
+		return;
+	}
+	if (!queries || queries->numChannels < 3)
+	{
+		myWarning = "Nearest mode needs an input CHOP with tx ty tz channels.";
+		return;
+	}
+
+	// Position is three packed floats
+	static_assert(sizeof(Position) == 3 * sizeof(float), "Position must be three floats");
+	myPointIndex.update(sop->opId, sop->totalCooks,
+						reinterpret_cast<const float*>(sop->getPointPositions()), sop->getNumPoints());
+
+	const int32_t count = std::min(output->numSamples, queries->numSamples);
+	const int32_t k = inputs->getParInt("Neighbors");
+	myQueries.resize(static_cast<size_t>(count) * 3);
+	myNearestIndices.resize(static_cast<size_t>(count) * k);
+	myNearestDistances.resize(static_cast<size_t>(count) * k);
+
+	for (int c = 0; c < 3; c++)
+	{
+		const float* src = queries->getChannelData(c);
+		for (int32_t i = 0; i < count; i++)
+			myQueries[i * 3 + c] = src[i];
+	}
+
+	myPointIndex.nearest(myQueries.data(), count, k, float(inputs->getParDouble("Maxdistance")),
+						myNearestIndices.data(), myNearestDistances.data());
+
+	const Position* points = sop->getPointPositions();
+	for (int32_t i = 0; i < count; i++)
+	{
+		const int32_t* idx = &myNearestIndices[static_cast<size_t>(i) * k];
+		const float* dist = &myNearestDistances[static_cast<size_t>(i) * k];
+
+		// Queries with nothing in range stay where they are
+		const float* nearestPos = idx[0] >= 0 ? &points[idx[0]].x : &myQueries[i * 3];
+		for (int c = 0; c < 3; c++)
+			output->channels[c][i] = nearestPos[c];
+
+		for (int32_t n = 0; n < k && 3 + k + n < output->numChannels; n++)
+		{
+			output->channels[3 + n][i] = float(idx[n]);
+			output->channels[3 + k + n][i] = dist[n];
+		}
+	}
+}
+
+void
+CPlusPlusCHOPExample::updateRayCaster(const OP_SOPInput* sop)
+{
+	if (!myRayCaster.needsBuild(sop->opId, sop->totalCooks))
+		return;
+
+	const int32_t numPrims = sop->getNumPrimitives();
+	myPolyOffsets.resize(numPrims);
+	myPolySizes.resize(numPrims);
+	for (int32_t i = 0; i < numPrims; i++)
+	{
+		const SOP_PrimitiveInfo prim = sop->getPrimitive(i);
+		myPolyOffsets[i] = prim.pointIndicesOffset;
+		myPolySizes[i] = prim.numVertices;
+	}
+
+	// getAllPrimPointIndices() only reads, it just isn't declared const
+	const int32_t* indices = const_cast<OP_SOPInput*>(sop)->getAllPrimPointIndices();
+
+	static_assert(sizeof(Position) == 3 * sizeof(float), "Position must be three floats");
+	myRayCaster.build(sop->opId, sop->totalCooks, reinterpret_cast<const float*>(sop->getPointPositions()),
+					indices, myPolyOffsets.data(), myPolySizes.data(), numPrims);
+}
+
+void
+CPlusPlusCHOPExample::executeRaycast(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	const OP_SOPInput* sop = inputs->getParSOP("Raysop");
+	const OP_CHOPInput* rays = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+
+	for (int i = 0; i < output->numChannels; i++)
+		std::fill(output->channels[i], output->channels[i] + output->numSamples, 0.0f);
+
+	if (!sop)
+	{
+		myWarning = "Ray SOP is not set.";
+		return;
+	}
+	if (!rays || rays->numChannels < 6)
+	{
+		myWarning = "Raycast mode needs an input CHOP with tx ty tz dx dy dz channels.";
+		return;
+	}
+
+	updateRayCaster(sop);
+
+	const int32_t count = std::min(output->numSamples, rays->numSamples);
+	myRayOrigins.resize(static_cast<size_t>(count) * 3);
+	myRayDirections.resize(static_cast<size_t>(count) * 3);
+	myRayHits.resize(count);
+
+	for (int c = 0; c < 3; c++)
+	{
+		const float* origin = rays->getChannelData(c);
+		const float* direction = rays->getChannelData(3 + c);
+		for (int32_t i = 0; i < count; i++)
+		{
+			myRayOrigins[i * 3 + c] = origin[i];
+			myRayDirections[i * 3 + c] = direction[i];
+		}
+	}
+
+	myRayCaster.cast(myRayOrigins.data(), myRayDirections.data(), count, myRayHits.data());
+
+	for (int32_t i = 0; i < count; i++)
+	{
+		const RayHit& hit = myRayHits[i];
+		if (hit.primitive < 0)
+		{
+			output->channels[RaycastPrim][i] = -1.0f;
+			continue;
+		}
+
+		output->channels[RaycastHit][i] = 1.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			output->channels[RaycastPX + c][i] = hit.position[c];
+			output->channels[RaycastNX + c][i] = hit.normal[c];
+		}
+		output->channels[RaycastU][i] = hit.u;
+		output->channels[RaycastV][i] = hit.v;
+		output->channels[RaycastLength][i] = hit.length;
+		output->channels[RaycastPrim][i] = float(hit.primitive);
+	}
+}
+
+ParticleSettings
+CPlusPlusCHOPExample::getParticleSettings(const OP_Inputs* inputs)
+{
+	ParticleSettings settings;
+	settings.rate = float(inputs->getParDouble("Emitrate"));
+	settings.speed = float(inputs->getParDouble("Emitspeed"));
+	settings.spread = float(inputs->getParDouble("Spread"));
+	settings.life = float(inputs->getParDouble("Life"));
+	settings.lifeVariance = float(inputs->getParDouble("Lifevariance"));
+	settings.drag = float(inputs->getParDouble("Drag"));
+	settings.childCount = inputs->getParInt("Childcount");
+	settings.generations = inputs->getParInt("Generations");
+	settings.childSpeed = float(inputs->getParDouble("Childspeed"));
+	settings.childLife = float(inputs->getParDouble("Childlife"));
+
+	double v[3];
+	inputs->getParDouble3("Emitterpos", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.position[i] = float(v[i]);
+	inputs->getParDouble3("Emitdir", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.direction[i] = float(v[i]);
+	inputs->getParDouble3("Gravity", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.gravity[i] = float(v[i]);
+	return settings;
+}
+
+void
+CPlusPlusCHOPExample::executeParticles(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	ParticleSettings settings = getParticleSettings(inputs);
+
+	// The input's tx ty tz, if there are any, move the emitter
+	const OP_CHOPInput* emitter = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+	if (emitter && emitter->numChannels >= 3 && emitter->numSamples > 0)
+	{
+		for (int i = 0; i < 3; i++)
+			settings.position[i] = emitter->getChannelData(i)[emitter->numSamples - 1];
+	}
+
+	if (myParticlesReset || myParticles.capacity() != output->numSamples)
+	{
+		myParticles.reset(output->numSamples);
+		myParticlesReset = false;
+	}
+
+	// Simulate the time since the last cook, capped so a long stall doesn't
+	// throw every particle across the scene in one step
+	const double seconds = std::min(inputs->getTimeInfo()->deltaMS / 1000.0, 0.25);
+	const int32_t substeps = std::max(1, inputs->getParInt("Substeps"));
+	int32_t spawned = 0;
+	int32_t killed = 0;
+	for (int32_t i = 0; i < substeps; i++)
+	{
+		myParticles.step(settings, float(seconds / substeps));
+		spawned += myParticles.spawned();
+		killed += myParticles.killed();
+	}
+	myParticlesSpawned = spawned;
+	myParticlesKilled = killed;
+
+	if (myParticles.dropped() > 0)
+		myWarning = "Particle pool is full, raise Max Particles.";
+
+	myParticles.writeChannels(output->channels, output->numSamples);
+}
+
+ClothGrid
+CPlusPlusCHOPExample::getClothGrid(const OP_Inputs* inputs)
+{
+	ClothGrid grid;
+	inputs->getParInt2("Clothresolution", grid.resolutionX, grid.resolutionY);
+	grid.resolutionX = std::max(2, grid.resolutionX);
+	grid.resolutionY = std::max(2, grid.resolutionY);
+
+	double sizeX, sizeY;
+	inputs->getParDouble2("Clothsize", sizeX, sizeY);
+	grid.sizeX = float(sizeX);
+	grid.sizeY = float(sizeY);
+
+	grid.plane = static_cast<ClothPlane>(inputs->getParInt("Clothplane"));
+	grid.pins = static_cast<ClothPins>(inputs->getParInt("Clothpins"));
+	return grid;
+}
+
+ClothSettings
+CPlusPlusCHOPExample::getClothSettings(const OP_Inputs* inputs)
+{
+	ClothSettings settings;
+	settings.iterations = inputs->getParInt("Iterations");
+	settings.stretchCompliance = float(inputs->getParDouble("Stretchcompliance"));
+	settings.bendCompliance = float(inputs->getParDouble("Bendcompliance"));
+	settings.damping = float(inputs->getParDouble("Damping"));
+	settings.thickness = float(inputs->getParDouble("Thickness"));
+	settings.friction = float(inputs->getParDouble("Friction"));
+
+	double v[3];
+	inputs->getParDouble3("Clothgravity", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.gravity[i] = float(v[i]);
+	inputs->getParDouble3("Clothcenter", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.center[i] = float(v[i]);
+	return settings;
+}
+
+void
+CPlusPlusCHOPExample::executeCloth(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	const ClothGrid grid = getClothGrid(inputs);
+	const ClothSettings settings = getClothSettings(inputs);
+
+	if (myClothReset || myCloth.needsBuild(grid))
+	{
+		myCloth.build(grid, settings.center);
+		myClothReset = false;
+	}
+
+	const OP_SOPInput* sop = inputs->getParSOP("Collisionsop");
+	if (sop)
+		updateRayCaster(sop);
+
+	// Many short steps keep the cloth stiffer than many iterations of one
+	// long step
+	const double seconds = std::min(inputs->getTimeInfo()->deltaMS / 1000.0, 0.1);
+	const int32_t substeps = std::max(1, inputs->getParInt("Clothsubsteps"));
+	std::fill(myClothTimes, myClothTimes + ClothSolver::NumPhases, 0.0);
+	myClothCollisions = 0;
+	for (int32_t i = 0; i < substeps; i++)
+	{
+		myCloth.step(settings, float(seconds / substeps), sop ? &myRayCaster : nullptr);
+		for (int32_t p = 0; p < ClothSolver::NumPhases; p++)
+			myClothTimes[p] += myCloth.phaseTime(static_cast<ClothSolver::Phase>(p));
+		myClothCollisions += myCloth.collisions();
+	}
+
+	myCloth.writeChannels(output->channels, output->numSamples);
+}
+
+RigidScene
+CPlusPlusCHOPExample::getRigidScene(const OP_Inputs* inputs)
+{
+	RigidScene scene;
+	scene.count = std::max(1, inputs->getParInt("Bodies"));
+	scene.shapes = static_cast<RigidShapes>(inputs->getParInt("Rigidshapes"));
+	scene.size = float(inputs->getParDouble("Bodysize"));
+	scene.dropHeight = float(inputs->getParDouble("Dropheight"));
+	scene.spread = float(inputs->getParDouble("Dropspread"));
+	return scene;
+}
+
+RigidSettings
+CPlusPlusCHOPExample::getRigidSettings(const OP_Inputs* inputs)
+{
+	RigidSettings settings;
+	settings.iterations = inputs->getParInt("Solveriterations");
+	settings.friction = float(inputs->getParDouble("Rigidfriction"));
+	settings.restitution = float(inputs->getParDouble("Restitution"));
+	settings.sleep = inputs->getParInt("Sleep") != 0;
+	settings.sleepSpeed = float(inputs->getParDouble("Sleepspeed"));
+
+	double v[3];
+	inputs->getParDouble3("Rigidgravity", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.gravity[i] = float(v[i]);
+	return settings;
+}
+
+void
+CPlusPlusCHOPExample::executeRigid(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	const RigidScene scene = getRigidScene(inputs);
+	const RigidSettings settings = getRigidSettings(inputs);
+
+	if (myRigidReset || myRigid.needsBuild(scene))
+	{
+		myRigid.build(scene);
+		myRigidReset = false;
+	}
+
+	const double seconds = std::min(inputs->getTimeInfo()->deltaMS / 1000.0, 0.1);
+	const int32_t substeps = std::max(1, inputs->getParInt("Rigidsubsteps"));
+	const auto start = std::chrono::steady_clock::now();
+	for (int32_t i = 0; i < substeps; i++)
+		myRigid.step(settings, float(seconds / substeps));
+	myRigidTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	myRigid.writeChannels(output->channels, output->numSamples);
+}
+
+FluidScene
+CPlusPlusCHOPExample::getFluidScene(const OP_Inputs* inputs)
+{
+	FluidScene scene;
+	scene.count = std::max(1, inputs->getParInt("Fluidparticles"));
+	scene.spacing = float(inputs->getParDouble("Particlespacing"));
+
+	double sizeX, sizeZ;
+	inputs->getParDouble2("Tanksize", sizeX, sizeZ);
+	scene.width = float(sizeX);
+	scene.depth = float(sizeZ);
+	return scene;
+}
+
+FluidSettings
+CPlusPlusCHOPExample::getFluidSettings(const OP_Inputs* inputs)
+{
+	FluidSettings settings;
+	settings.viscosity = float(inputs->getParDouble("Viscosity"));
+	settings.tolerance = float(inputs->getParDouble("Tolerance"));
+	settings.maxIterations = inputs->getParInt("Maxiterations");
+	settings.sortInterval = inputs->getParInt("Sortinterval");
+
+	double v[3];
+	inputs->getParDouble3("Fluidgravity", v[0], v[1], v[2]);
+	for (int i = 0; i < 3; i++)
+		settings.gravity[i] = float(v[i]);
+	return settings;
+}
+
+void
+CPlusPlusCHOPExample::executeFluid(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	const FluidScene scene = getFluidScene(inputs);
+	const FluidSettings settings = getFluidSettings(inputs);
+
+	if (myFluidReset || myFluid.needsBuild(scene))
+	{
+		myFluid.build(scene);
+		myFluidReset = false;
+	}
+
+	// The solver splits the step into as many substeps as the fastest
+	// particle needs
+	const double seconds = std::min(inputs->getTimeInfo()->deltaMS / 1000.0, 0.1);
+	const auto start = std::chrono::steady_clock::now();
+	myFluid.step(settings, float(seconds));
+	myFluidTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	myFluid.writeChannels(output->channels, output->numSamples);
+}
+
+EdgeSettings
+CPlusPlusCHOPExample::getEdgeSettings(const OP_Inputs* inputs)
+{
+	EdgeSettings settings;
+	settings.radius = float(inputs->getParDouble("Plexusradius"));
+	settings.maxPerPoint = inputs->getParInt("Maxperpoint");
+	settings.maxEdges = inputs->getParInt("Maxedges");
+	settings.fade = float(inputs->getParDouble("Fade"));
+	return settings;
+}
+
+void
+CPlusPlusCHOPExample::updatePlexus(const OP_Inputs* inputs)
+{
+	const auto start = std::chrono::steady_clock::now();
+	myPlexusWarning = nullptr;
+	myPlexusPoints.clear();
+
+	switch (static_cast<PlexusSource>(inputs->getParInt("Plexussource")))
+	{
+		case PlexusSource::CHOP:
+		{
+			const OP_CHOPInput* chop = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+			if (!chop || chop->numChannels < 3)
+			{
+				myPlexusWarning = "Plexus mode needs an input CHOP with tx ty tz channels.";
+				break;
+			}
+			myPlexusPoints.resize(static_cast<size_t>(chop->numSamples) * 3);
+			for (int c = 0; c < 3; c++)
+			{
+				const float* src = chop->getChannelData(c);
+				for (int32_t i = 0; i < chop->numSamples; i++)
+					myPlexusPoints[i * 3 + c] = src[i];
+			}
+			break;
+		}
+
+		case PlexusSource::DAT:
+		{
+			const OP_DATInput* dat = inputs->getParDAT("Plexusdat");
+			if (!dat || dat->numCols < 3)
+			{
+				myPlexusWarning = "Plexus DAT needs tx ty tz columns.";
+				break;
+			}
+			// A first row that isn't a number is a header
+			int32_t first = 0;
+			if (dat->numRows > 0)
+			{
+				const char* cell = dat->getCell(0, 0);
+				char* end = nullptr;
+				strtod(cell, &end);
+				first = end == cell ? 1 : 0;
+			}
+			myPlexusPoints.reserve(static_cast<size_t>(std::max(dat->numRows - first, 0)) * 3);
+			for (int32_t r = first; r < dat->numRows; r++)
+			{
+				for (int c = 0; c < 3; c++)
+					myPlexusPoints.push_back(float(atof(dat->getCell(r, c))));
+			}
+			break;
+		}
+
+		case PlexusSource::SOP:
+		{
+			const OP_SOPInput* sop = inputs->getParSOP("Plexussop");
+			if (!sop)
+			{
+				myPlexusWarning = "Plexus SOP is not set.";
+				break;
+			}
+			static_assert(sizeof(Position) == 3 * sizeof(float), "Position must be three floats");
+			const float* xyz = reinterpret_cast<const float*>(sop->getPointPositions());
+			myPlexusPoints.assign(xyz, xyz + static_cast<size_t>(sop->getNumPoints()) * 3);
+			break;
+		}
+	}
+
+	myPlexus.build(myPlexusPoints.data(), static_cast<int32_t>(myPlexusPoints.size() / 3), getEdgeSettings(inputs));
+	myPlexusTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void
+CPlusPlusCHOPExample::executePlexus(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	myWarning = myPlexusWarning;
+	myPlexus.writeChannels(output->channels, output->numSamples);
+}
+
+TrailSettings
+CPlusPlusCHOPExample::getTrailSettings(const OP_Inputs* inputs)
+{
+	TrailSettings settings;
+	settings.length = inputs->getParInt("Traillength");
+	settings.shape = static_cast<TrailShape>(inputs->getParInt("Trailshape"));
+	settings.sides = inputs->getParInt("Tubesides");
+	settings.width = float(inputs->getParDouble("Trailwidth"));
+	return settings;
+}
+
+void
+CPlusPlusCHOPExample::executeTrails(CHOP_Output* output, const OP_Inputs* inputs)
+{
+	const OP_CHOPInput* heads = inputs->getNumInputs() > 0 ? inputs->getInputCHOP(0) : nullptr;
+	if (!heads || heads->numChannels < 3)
+	{
+		myWarning = "Trails mode needs an input CHOP with tx ty tz channels.";
+		for (int i = 0; i < output->numChannels; i++)
+			std::fill(output->channels[i], output->channels[i] + output->numSamples, 0.0f);
+		return;
+	}
+
+	myTrailHeads.resize(static_cast<size_t>(heads->numSamples) * 3);
+	for (int c = 0; c < 3; c++)
+	{
+		const float* src = heads->getChannelData(c);
+		for (int32_t i = 0; i < heads->numSamples; i++)
+			myTrailHeads[i * 3 + c] = src[i];
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	myTrails.append(myTrailHeads.data(), heads->numSamples, getTrailSettings(inputs));
+	myTrailsTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	myTrails.writeChannels(output->channels, output->numSamples);
+}
+
+int32_t
+CPlusPlusCHOPExample::getNumInfoCHOPChans(void * reserved1)
+{
+	// We return the number of channel we want to output to any Info CHOP
+	// connected to the CHOP. The last ones depend on the mode.
+	switch (myMode)
+	{
+		case CHOPMode::Terrain:
+		case CHOPMode::Stats:
+		case CHOPMode::Instances:
+		case CHOPMode::Nearest:
+		case CHOPMode::Raycast:
+			return 4;
+		case CHOPMode::Particles:
+			return 5;
+		case CHOPMode::Cloth:
+			return 2 + 3 + ClothSolver::NumPhases;
+		case CHOPMode::Rigid:
+			return 7;
+		case CHOPMode::Fluid:
+			return 10 + FluidSolver::NumPhases;
+		case CHOPMode::Plexus:
+			return 7;
+		case CHOPMode::Trails:
+			return 6;
+		default:
+			return 2;
+	}
+}
+
+void
+CPlusPlusCHOPExample::getInfoCHOPChan(int32_t index,
+										OP_InfoCHOPChan* chan,
+										void* reserved1)
+{
+	// This function will be called once for each channel we said we'd want to return
+	// In this example it'll only be called once.
+
+	if (index == 0)
+	{
+		chan->name->setString("executeCount");
+		chan->value = (float)myExecuteCount;
+	}
+
+	if (index == 1)
+	{
+		chan->name->setString("offset");
+		chan->value = (float)myOffset;
+	}
+
+	if (myMode == CHOPMode::Terrain)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("terrainPoints");
+			chan->value = (float)myTerrain.numPoints();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("terrainBuilds");
+			chan->value = (float)myTerrainBuilds;
+		}
+	}
+
+	if (myMode == CHOPMode::Stats)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("statsPixels");
+			chan->value = (float)myStats.pixelCount();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("statsPasses");
+			chan->value = (float)myStatsPasses;
+		}
+	}
+
+	if (myMode == CHOPMode::Instances)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("instances");
+			chan->value = (float)myInstances.numInstances();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("instanceRowsUpdated");
+			chan->value = (float)myInstanceRowsUpdated;
+		}
+	}
+
+	if (myMode == CHOPMode::Nearest)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("indexedPoints");
+			chan->value = (float)myPointIndex.size();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("indexBuilds");
+			chan->value = (float)myPointIndex.builds();
+		}
+	}
+
+	if (myMode == CHOPMode::Raycast)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("triangles");
+			chan->value = (float)myRayCaster.numTriangles();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("bvhBuilds");
+			chan->value = (float)myRayCaster.builds();
+		}
+	}
+
+	if (myMode == CHOPMode::Particles)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("liveParticles");
+			chan->value = (float)myParticles.live();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("spawned");
+			chan->value = (float)myParticlesSpawned;
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("killed");
+			chan->value = (float)myParticlesKilled;
+		}
+	}
+
+	if (myMode == CHOPMode::Cloth)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("constraints");
+			chan->value = (float)myCloth.numConstraints();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("constraintColors");
+			chan->value = (float)myCloth.numColors();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("collisions");
+			chan->value = (float)myClothCollisions;
+		}
+
+		// Milliseconds per phase, summed over the substeps
+		static const char* phases[ClothSolver::NumPhases] =
+		{
+			"predictMs", "stretchMs", "bendMs", "collideMs"
+		};
+		if (index >= 5 && index < 5 + ClothSolver::NumPhases)
+		{
+			chan->name->setString(phases[index - 5]);
+			chan->value = (float)myClothTimes[index - 5];
+		}
+	}
+
+	if (myMode == CHOPMode::Rigid)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("awakeBodies");
+			chan->value = (float)myRigid.awake();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("pairs");
+			chan->value = (float)myRigid.pairs();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("contacts");
+			chan->value = (float)myRigid.contacts();
+		}
+
+		if (index == 5)
+		{
+			chan->name->setString("islands");
+			chan->value = (float)myRigid.islands();
+		}
+
+		if (index == 6)
+		{
+			chan->name->setString("stepMs");
+			chan->value = (float)myRigidTime;
+		}
+	}
+
+	if (myMode == CHOPMode::Fluid)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("substeps");
+			chan->value = (float)myFluid.substeps();
+		}
+
+		// Most of any substep
+		if (index == 3)
+		{
+			chan->name->setString("densityIterations");
+			chan->value = (float)myFluid.iterations();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("divergenceIterations");
+			chan->value = (float)myFluid.divergenceIterations();
+		}
+
+		if (index == 5)
+		{
+			chan->name->setString("densityError");
+			chan->value = myFluid.densityError();
+		}
+
+		if (index == 6)
+		{
+			chan->name->setString("neighbors");
+			chan->value = myFluid.meanNeighbors();
+		}
+
+		if (index == 7)
+		{
+			chan->name->setString("usedCells");
+			chan->value = (float)myFluid.usedCells();
+		}
+
+		if (index == 8)
+		{
+			chan->name->setString("sorts");
+			chan->value = (float)myFluid.sorts();
+		}
+
+		if (index == 9)
+		{
+			chan->name->setString("stepMs");
+			chan->value = (float)myFluidTime;
+		}
+
+		// Milliseconds per phase, summed over the substeps
+		static const char* phases[FluidSolver::NumPhases] =
+		{
+			"neighborsMs", "forcesMs", "pressureMs", "divergenceMs"
+		};
+		if (index >= 10 && index < 10 + FluidSolver::NumPhases)
+		{
+			chan->name->setString(phases[index - 10]);
+			chan->value = (float)myFluid.phaseTime(FluidSolver::Phase(index - 10));
+		}
+	}
+
+	if (myMode == CHOPMode::Plexus)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("points");
+			chan->value = (float)myPlexus.numPoints();
+		}
+
+		if (index == 3)
+		{
+			chan->name->setString("edges");
+			chan->value = (float)myPlexus.numEdges();
+		}
+
+		// Pairs within the radius left out by Max Per Point or Max Edges
+		if (index == 4)
+		{
+			chan->name->setString("droppedEdges");
+			chan->value = (float)myPlexus.droppedEdges();
+		}
+
+		if (index == 5)
+		{
+			chan->name->setString("usedCells");
+			chan->value = (float)myPlexus.usedCells();
+		}
+
+		if (index == 6)
+		{
+			chan->name->setString("buildMs");
+			chan->value = (float)myPlexusTime;
+		}
+	}
+
+	if (myMode == CHOPMode::Trails)
+	{
+		if (index == 2)
+		{
+			chan->name->setString("trails");
+			chan->value = (float)myTrails.trajectories();
+		}
+
+		// Cross sections built in the last cook, new samples and rebuilds
+		if (index == 3)
+		{
+			chan->name->setString("sectionsBuilt");
+			chan->value = (float)myTrails.sectionsBuilt();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("retired");
+			chan->value = (float)myTrails.retired();
+		}
+
+		if (index == 5)
+		{
+			chan->name->setString("appendMs");
+			chan->value = (float)myTrailsTime;
+		}
+	}
+}
+
+bool		
+CPlusPlusCHOPExample::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1)
+{
+	infoSize->rows = 2;
+	infoSize->cols = 2;
+	// Setting this to false means we'll be assigning values to the table
+	// one row at a time. True means we'll do it one column at a time.
+	infoSize->byColumn = false;
+	return true;
+}
+
+void
+CPlusPlusCHOPExample::getInfoDATEntries(int32_t index,
+										int32_t nEntries,
+										OP_InfoDATEntries* entries, 
+										void* reserved1)
+{
+	char tempBuffer[4096];
+
+	if (index == 0)
+	{
+		// Set the value for the first column
+		entries->values[0]->setString("executeCount");
+
+		// Set the value for the second column
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%d", myExecuteCount);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%d", myExecuteCount);
+#endif
+		entries->values[1]->setString(tempBuffer);
+	}
+
+	if (index == 1)
+	{
+		// Set the value for the first column
+		entries->values[0]->setString("offset");
+
+		// Set the value for the second column
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%g", myOffset);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%g", myOffset);
+#endif
+		entries->values[1]->setString( tempBuffer);
+	}
+}
+
+void
+CPlusPlusCHOPExample::getWarningString(OP_String* warning, void* reserved1)
+{
+	if (myWarning)
+		warning->setString(myWarning);
+}
+
+void
+CPlusPlusCHOPExample::setupParameters(OP_ParameterManager* manager, void *reserved1)
+{
+	// mode
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Mode";
+		sp.label = "Mode";
+
+		sp.defaultValue = "Signal";
+
+		const char *names[] = { "Signal", "Terrain", "Stats", "Instances", "Nearest", "Raycast", "Particles", "Cloth", "Rigid", "Fluid", "Plexus", "Trails" };
+		const char *labels[] = { "Signal", "Terrain", "Stats", "Instances", "Nearest", "Raycast", "Particles", "Cloth", "Rigid", "Fluid", "Plexus", "Trails" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 12, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// speed
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Speed";
+		np.label = "Speed";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = -10.0;
+		np.maxSliders[0] =  10.0;
+		
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// scale
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Scale";
+		np.label = "Scale";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = -10.0;
+		np.maxSliders[0] =  10.0;
+		
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// cross
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cross";
+		np.label = "Cross";
+		np.defaultValues[0] = 0.5;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+		
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+
+	// shape
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Shape";
+		sp.label = "Shape";
+
+		sp.defaultValue = "Sine";
+
+		const char *names[] = { "Sine", "Square", "Ramp" };
+		const char *labels[] = { "Sine", "Square", "Ramp" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// pulse
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Reset";
+		np.label = "Reset";
+		
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// heightmap
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Heightmap";
+		sp.label = "Heightmap TOP";
+		sp.page = "Terrain";
+
+		OP_ParAppendResult res = manager->appendTOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// height scale, applied to the red channel
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Heightscale";
+		np.label = "Height Scale";
+		np.page = "Terrain";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// terrain size in x and z
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Size";
+		np.label = "Size";
+		np.page = "Terrain";
+
+		for (int i=0; i<2; i++)
+		{
+			np.defaultValues[i] = 10.0;
+			np.minSliders[i] = 0.0;
+			np.maxSliders[i] = 100.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// pixel step of the finest level
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Decimate";
+		np.label = "Decimate";
+		np.page = "Terrain";
+		np.defaultValues[0] = 4;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 32;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// number of LOD levels, each with twice the step of the previous one
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Lodlevels";
+		np.label = "LOD Levels";
+		np.page = "Terrain";
+		np.defaultValues[0] = 1;
+		np.minValues[0] = 1;
+		np.maxValues[0] = 8;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 8;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// TOP to reduce
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Statstop";
+		sp.label = "Stats TOP";
+		sp.page = "Stats";
+
+		OP_ParAppendResult res = manager->appendTOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// statistics or histograms
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Statsoutput";
+		sp.label = "Output";
+		sp.page = "Stats";
+
+		sp.defaultValue = "Statistics";
+
+		const char *names[] = { "Statistics", "Histogram" };
+		const char *labels[] = { "Statistics", "Histogram" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// histogram bins
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Bins";
+		np.label = "Bins";
+		np.page = "Stats";
+		np.defaultValues[0] = 256;
+		np.minValues[0] = 1;
+		np.maxValues[0] = 65536;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 16;
+		np.maxSliders[0] = 1024;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// value range the histogram covers
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Range";
+		np.label = "Range";
+		np.page = "Stats";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 1.0;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minSliders[i] = 0.0;
+			np.maxSliders[i] = 1.0;
+		}
+
+		OP_ParAppendResult res = manager->appendFloat(np, 2);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// percentiles, in percent
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Percentiles";
+		np.label = "Percentiles";
+		np.page = "Stats";
+		np.defaultValues[0] = 5.0;
+		np.defaultValues[1] = 50.0;
+		np.defaultValues[2] = 95.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minValues[i] = 0.0;
+			np.maxValues[i] = 100.0;
+			np.clampMins[i] = true;
+			np.clampMaxes[i] = true;
+			np.minSliders[i] = 0.0;
+			np.maxSliders[i] = 100.0;
+		}
+
+		OP_ParAppendResult res = manager->appendFloat(np, 3);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// TOP whose pixels become instances
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Instancetop";
+		sp.label = "Instance TOP";
+		sp.page = "Instances";
+
+		OP_ParAppendResult res = manager->appendTOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// channel rules
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Rulesdat";
+		sp.label = "Rules DAT";
+		sp.page = "Instances";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// SOP whose points are searched
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Pointsop";
+		sp.label = "Point SOP";
+		sp.page = "Nearest";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// neighbours found per query
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Neighbors";
+		np.label = "Neighbors";
+		np.page = "Nearest";
+		np.defaultValues[0] = 1;
+		np.minValues[0] = 1;
+		np.maxValues[0] = 32;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 16;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// points further than this are not neighbours
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Maxdistance";
+		np.label = "Max Distance";
+		np.page = "Nearest";
+		np.defaultValues[0] = 1000.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// SOP whose polygons rays are cast against
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Raysop";
+		sp.label = "Ray SOP";
+		sp.page = "Raycast";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// size of the particle pool
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Maxparticles";
+		np.label = "Max Particles";
+		np.page = "Particles";
+		np.defaultValues[0] = 10000;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 100000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// particles per second from the emitter
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Emitrate";
+		np.label = "Emit Rate";
+		np.page = "Particles";
+		np.defaultValues[0] = 200.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 5000.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// emitter position, replaced by the input's tx ty tz
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Emitterpos";
+		np.label = "Emitter Position";
+		np.page = "Particles";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 0.0;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -10.0;
+			np.maxSliders[i] = 10.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// emission direction
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Emitdir";
+		np.label = "Emit Direction";
+		np.page = "Particles";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 1.0;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -1.0;
+			np.maxSliders[i] = 1.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// emission speed
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Emitspeed";
+		np.label = "Emit Speed";
+		np.page = "Particles";
+		np.defaultValues[0] = 4.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 20.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// half angle of the emission cone, in degrees
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Spread";
+		np.label = "Spread";
+		np.page = "Particles";
+		np.defaultValues[0] = 20.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 180.0;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 180.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// lifetime in seconds
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Life";
+		np.label = "Life";
+		np.page = "Particles";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// random lifetime change, as a fraction of it
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Lifevariance";
+		np.label = "Life Variance";
+		np.page = "Particles";
+		np.defaultValues[0] = 0.3;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 1.0;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// acceleration
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Gravity";
+		np.label = "Gravity";
+		np.page = "Particles";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = -9.8;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -20.0;
+			np.maxSliders[i] = 20.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// velocity lost per second, as a rate
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Drag";
+		np.label = "Drag";
+		np.page = "Particles";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// particles spawned where a particle dies
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Childcount";
+		np.label = "Child Count";
+		np.page = "Particles";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 64;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 64;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// generations of children, counting the emitter's
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Generations";
+		np.label = "Generations";
+		np.page = "Particles";
+		np.defaultValues[0] = 2;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 16;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 16;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// speed of the children relative to their parent
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Childspeed";
+		np.label = "Child Speed";
+		np.page = "Particles";
+		np.defaultValues[0] = 2.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 20.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// lifetime of the children relative to their parent
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Childlife";
+		np.label = "Child Life";
+		np.page = "Particles";
+		np.defaultValues[0] = 0.5;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 2.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// simulation steps per cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Substeps";
+		np.label = "Substeps";
+		np.page = "Particles";
+		np.defaultValues[0] = 1;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 16;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 16;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// particles along each side
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Clothresolution";
+		np.label = "Resolution";
+		np.page = "Cloth";
+		np.defaultValues[0] = 64;
+		np.defaultValues[1] = 64;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minValues[i] = 2;
+			np.clampMins[i] = true;
+			np.minSliders[i] = 2;
+			np.maxSliders[i] = 256;
+		}
+
+		OP_ParAppendResult res = manager->appendInt(np, 2);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// size of the cloth at rest
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Clothsize";
+		np.label = "Size";
+		np.page = "Cloth";
+		np.defaultValues[0] = 2.0;
+		np.defaultValues[1] = 2.0;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minValues[i] = 0.0;
+			np.clampMins[i] = true;
+			np.minSliders[i] = 0.0;
+			np.maxSliders[i] = 10.0;
+		}
+
+		OP_ParAppendResult res = manager->appendFloat(np, 2);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// plane the cloth starts in
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Clothplane";
+		sp.label = "Plane";
+		sp.page = "Cloth";
+
+		sp.defaultValue = "XY";
+
+		const char *names[] = { "XY", "XZ" };
+		const char *labels[] = { "XY (Hanging)", "XZ (Flat)" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// particles held in place
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Clothpins";
+		sp.label = "Pins";
+		sp.page = "Cloth";
+
+		sp.defaultValue = "Corners";
+
+		const char *names[] = { "None", "Corners", "Topedge" };
+		const char *labels[] = { "None", "Top Corners", "Top Edge" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// center of the cloth, pins follow it
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Clothcenter";
+		np.label = "Center";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 0.0;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -10.0;
+			np.maxSliders[i] = 10.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// constraint iterations per substep
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Iterations";
+		np.label = "Iterations";
+		np.page = "Cloth";
+		np.defaultValues[0] = 2;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 20;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// simulation steps per cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Clothsubsteps";
+		np.label = "Substeps";
+		np.page = "Cloth";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 32;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// inverse stiffness of the stretch constraints
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Stretchcompliance";
+		np.label = "Stretch Compliance";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.01;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// inverse stiffness of the bending constraints
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Bendcompliance";
+		np.label = "Bend Compliance";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.001;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// acceleration
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Clothgravity";
+		np.label = "Gravity";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = -9.8;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -20.0;
+			np.maxSliders[i] = 20.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// velocity lost per second, as a rate
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Damping";
+		np.label = "Damping";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.1;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// SOP whose polygons the cloth collides with
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Collisionsop";
+		sp.label = "Collision SOP";
+		sp.page = "Cloth";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// distance kept from the collision SOP
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Thickness";
+		np.label = "Thickness";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.01;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.1;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// sliding removed on contact, 1 sticks
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Friction";
+		np.label = "Friction";
+		np.page = "Cloth";
+		np.defaultValues[0] = 0.5;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 1.0;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
 
-	// shape
+	// bodies dropped
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Bodies";
+		np.label = "Bodies";
+		np.page = "Rigid";
+		np.defaultValues[0] = 200;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 2000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// shapes of the bodies
 	{
 		OP_StringParameter	sp;
 
-		sp.name = "Shape";
-		sp.label = "Shape";
+		sp.name = "Rigidshapes";
+		sp.label = "Shapes";
+		sp.page = "Rigid";
 
-		sp.defaultValue = "Sine";
+		sp.defaultValue = "Boxes";
 
-		const char *names[] = { "Sine", "Square", "Ramp" };
-		const char *labels[] = { "Sine", "Square", "Ramp" };
+		const char *names[] = { "Boxes", "Spheres", "Mixed" };
+		const char *labels[] = { "Boxes", "Spheres", "Boxes and Spheres" };
 
 		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
 		assert(res == OP_ParAppendResult::Success);
 	}
 
-	// pulse
+	// average size, bodies vary around it
 	{
 		OP_NumericParameter	np;
 
-		np.name = "Reset";
-		np.label = "Reset";
-		
-		OP_ParAppendResult res = manager->appendPulse(np);
+		np.name = "Bodysize";
+		np.label = "Body Size";
+		np.page = "Rigid";
+		np.defaultValues[0] = 0.5;
+		np.minValues[0] = 0.01;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.01;
+		np.maxSliders[0] = 2.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// height of the lowest layer of bodies
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Dropheight";
+		np.label = "Drop Height";
+		np.page = "Rigid";
+		np.defaultValues[0] = 2.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// half size of the square the bodies are dropped over
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Dropspread";
+		np.label = "Drop Spread";
+		np.page = "Rigid";
+		np.defaultValues[0] = 2.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// solver iterations per substep
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Solveriterations";
+		np.label = "Solver Iterations";
+		np.page = "Rigid";
+		np.defaultValues[0] = 10;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 50;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// simulation steps per cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Rigidsubsteps";
+		np.label = "Substeps";
+		np.page = "Rigid";
+		np.defaultValues[0] = 2;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 8;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// acceleration
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Rigidgravity";
+		np.label = "Gravity";
+		np.page = "Rigid";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = -9.8;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -20.0;
+			np.maxSliders[i] = 20.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// friction coefficient of every contact
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Rigidfriction";
+		np.label = "Friction";
+		np.page = "Rigid";
+		np.defaultValues[0] = 0.6;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fraction of the approach speed bounced back
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Restitution";
+		np.label = "Restitution";
+		np.page = "Rigid";
+		np.defaultValues[0] = 0.1;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 1.0;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// let settled bodies sleep
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sleep";
+		np.label = "Sleep";
+		np.page = "Rigid";
+		np.defaultValues[0] = 1;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// speed below which bodies may fall asleep
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sleepspeed";
+		np.label = "Sleep Speed";
+		np.page = "Rigid";
+		np.defaultValues[0] = 0.05;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.5;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fluid particles
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fluidparticles";
+		np.label = "Particles";
+		np.page = "Fluid";
+		np.defaultValues[0] = 20000;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1000;
+		np.maxSliders[0] = 100000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// distance between the particles at rest
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Particlespacing";
+		np.label = "Particle Spacing";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.02;
+		np.minValues[0] = 0.001;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.005;
+		np.maxSliders[0] = 0.1;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// width and depth of the tank
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Tanksize";
+		np.label = "Tank Size";
+		np.page = "Fluid";
+		np.defaultValues[0] = 2.0;
+		np.defaultValues[1] = 1.0;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minValues[i] = 0.01;
+			np.clampMins[i] = true;
+			np.minSliders[i] = 0.1;
+			np.maxSliders[i] = 5.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// acceleration
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fluidgravity";
+		np.label = "Gravity";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = -9.8;
+		np.defaultValues[2] = 0.0;
+
+		for (int i=0; i<3; i++)
+		{
+			np.minSliders[i] = -20.0;
+			np.maxSliders[i] = 20.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXYZ(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// kinematic viscosity
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Viscosity";
+		np.label = "Viscosity";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.001;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.05;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// mean density error left by the pressure solves
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Tolerance";
+		np.label = "Tolerance";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.001;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0001;
+		np.maxSliders[0] = 0.01;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// most iterations of either solve per substep
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Maxiterations";
+		np.label = "Max Iterations";
+		np.page = "Fluid";
+		np.defaultValues[0] = 50;
+		np.minValues[0] = 2;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 2;
+		np.maxSliders[0] = 100;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// substeps between Morton re-sorts of the particles
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sortinterval";
+		np.label = "Sort Interval";
+		np.page = "Fluid";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 32;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// where the plexus points come from
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Plexussource";
+		sp.label = "Points From";
+		sp.page = "Plexus";
+
+		sp.defaultValue = "CHOP";
+
+		const char *names[] = { "CHOP", "DAT", "SOP" };
+		const char *labels[] = { "Input CHOP", "Plexus DAT", "Plexus SOP" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// table of points, a row each
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Plexusdat";
+		sp.label = "Plexus DAT";
+		sp.page = "Plexus";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// SOP whose points are joined
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Plexussop";
+		sp.label = "Plexus SOP";
+		sp.page = "Plexus";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// distance under which points are joined
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Plexusradius";
+		np.label = "Radius";
+		np.page = "Plexus";
+		np.defaultValues[0] = 0.5;
+		np.minValues[0] = 0.0001;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 2.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// most edges at any point
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Maxperpoint";
+		np.label = "Max Per Point";
+		np.page = "Plexus";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 32;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// most edges in all
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Maxedges";
+		np.label = "Max Edges";
+		np.page = "Plexus";
+		np.defaultValues[0] = 10000;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 100000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// exponent of the alpha fading out to the radius
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fade";
+		np.label = "Fade";
+		np.page = "Plexus";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 4.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// samples each trail keeps
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Traillength";
+		np.label = "Trail Length";
+		np.page = "Trails";
+		np.defaultValues[0] = 100;
+		np.minValues[0] = 2;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 2;
+		np.maxSliders[0] = 1000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// cross section of the trails
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Trailshape";
+		sp.label = "Shape";
+		sp.page = "Trails";
+
+		sp.defaultValue = "Ribbon";
+
+		const char *names[] = { "Ribbon", "Tube" };
+		const char *labels[] = { "Ribbon", "Tube" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// vertices around a tube
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Tubesides";
+		np.label = "Tube Sides";
+		np.page = "Trails";
+		np.defaultValues[0] = 6;
+		np.minValues[0] = 3;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 3;
+		np.maxSliders[0] = 16;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// across a ribbon or a tube
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Trailwidth";
+		np.label = "Width";
+		np.page = "Trails";
+		np.defaultValues[0] = 0.05;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.5;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
 		assert(res == OP_ParAppendResult::Success);
 	}
 
@@ -389,6 +3249,11 @@ CPlusPlusCHOPExample::pulsePressed(const char* name, void* reserved1)
 	if (!strcmp(name, "Reset"))
 	{
 		myOffset = 0.0;
+		myParticlesReset = true;
+		myClothReset = true;
+		myRigidReset = true;
+		myFluidReset = true;
+		myTrails.reset();
 	}
 }
 
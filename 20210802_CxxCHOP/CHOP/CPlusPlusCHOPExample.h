@@ -13,6 +13,17 @@
 */
 
 #include "CHOP_CPlusPlusBase.h"
+#include "TerrainGenerator.h"
+#include "TextureStats.h"
+#include "InstanceBuilder.h"
+#include "PointIndex.h"
+#include "RayCaster.h"
+#include "ParticlePool.h"
+#include "ClothSolver.h"
+#include "RigidBodies.h"
+#include "FluidSolver.h"
+#include "ProximityEdges.h"
+#include "RibbonTrails.h"
 
 /*
 
@@ -27,8 +38,103 @@ will look wierd since depending on the timeslice size some number of the first s
 of the input will get used.
 
 If no input is connected then the node will output a smooth sine wave at 120hz.
+
+The Mode menu switches the node to other, non-timesliced outputs:
+
+Terrain samples the TOP in the Heightmap parameter and outputs one sample per
+terrain point, with channels meant for instancing (see TerrainGenerator.h).
+
+Stats reduces the TOP in the Stats TOP parameter to per-channel min, max,
+mean and percentiles (one sample), or to its histograms (one sample per bin),
+see TextureStats.h.
+
+Instances turns every pixel of the Instance TOP into one instance with
+tx ty tz rx ry rz sx sy sz r g b channels, following the rules in the Rules
+DAT (see InstanceBuilder.h). Only rows of pixels that changed are rebuilt.
+
+Nearest looks up, for every sample of the input CHOP's first three channels
+(tx ty tz), the nearest points of the Point SOP. It outputs the position of
+the nearest one and the index and distance of each of the nearest ones.
+The SOP's points are indexed once per SOP cook (see PointIndex.h).
+
+Raycast casts one ray per sample of the input CHOP's first six channels
+(tx ty tz dx dy dz) against the polygons of the Ray SOP and outputs, like
+OP_SOPInput::sendRay(), whether it hit, where, the normal, u and v, the
+distance and the primitive index. The SOP is put in a BVH once per SOP cook
+(see RayCaster.h).
+
+Particles runs a pooled particle system, e.g. fireworks sparks, and outputs
+one sample per particle slot with channels meant for instancing (see
+ParticlePool.h). If the input CHOP has tx ty tz channels, they move the
+emitter. Reset kills every particle.
+
+Cloth simulates a grid of cloth (see ClothSolver.h) and outputs one sample
+per particle with position, normal and uv channels. It collides with the
+polygons of the Collision SOP, which share the Raycast mode's BVH. Reset
+puts the cloth back at rest.
+
+Rigid drops boxes and spheres on a ground plane (see RigidBodies.h) and
+outputs one sample per body with channels meant for instancing. Bodies that
+settle fall asleep until something wakes them. Reset drops them again.
+
+Fluid breaks a dam of SPH particles in a tank (see FluidSolver.h) and
+outputs one sample per particle with position, velocity and density
+channels. Reset puts the column back up.
+
+Plexus joins points closer than a radius with line segments (see
+ProximityEdges.h) and outputs one sample per edge with both ends and a fade
+alpha. The points are the first three channels of the input CHOP, the first
+three columns of the Plexus DAT (e.g. the DAT example's boids) or the points
+of the Plexus SOP. The edges are found in getOutputInfo(), so the output is
+exactly as long as the edges found.
+
+Trails grows a ribbon or tube behind every sample of the input CHOP's first
+three channels (see RibbonTrails.h), one trajectory per sample, adding one
+position to each per cook. It outputs one sample per vertex with position,
+normal and uv channels. Reset clears the trails.
 */
 
+enum class CHOPMode
+{
+	Signal = 0,
+	Terrain,
+	Stats,
+	Instances,
+	Nearest,
+	Raycast,
+	Particles,
+	Cloth,
+	Rigid,
+	Fluid,
+	Plexus,
+	Trails,
+};
+
+enum class StatsOutput
+{
+	Statistics = 0,
+	Histogram,
+};
+
+enum class PlexusSource
+{
+	CHOP = 0,
+	DAT,
+	SOP,
+};
+
+// Output channels of the Raycast mode
+enum RaycastChannel
+{
+	RaycastHit = 0,
+	RaycastPX, RaycastPY, RaycastPZ,
+	RaycastNX, RaycastNY, RaycastNZ,
+	RaycastU, RaycastV,
+	RaycastLength,
+	RaycastPrim,
+	RaycastChannels
+};
+
 
 // To get more help about these functions, look at CHOP_CPlusPlusBase.h
 class CPlusPlusCHOPExample : public CHOP_CPlusPlusBase
@@ -57,10 +163,45 @@ public:
 											OP_InfoDATEntries* entries,
 											void* reserved1) override;
 
+	virtual void		getWarningString(OP_String* warning, void* reserved1) override;
+
 	virtual void		setupParameters(OP_ParameterManager* manager, void *reserved1) override;
 	virtual void		pulsePressed(const char* name, void* reserved1) override;
 
 private:
+	void				executeTerrain(CHOP_Output*, const OP_Inputs*);
+	void				executeStats(CHOP_Output*, const OP_Inputs*);
+	void				executeInstances(CHOP_Output*, const OP_Inputs*);
+	void				executeNearest(CHOP_Output*, const OP_Inputs*);
+	void				executeRaycast(CHOP_Output*, const OP_Inputs*);
+	void				executeParticles(CHOP_Output*, const OP_Inputs*);
+	void				executeCloth(CHOP_Output*, const OP_Inputs*);
+	void				executeRigid(CHOP_Output*, const OP_Inputs*);
+	void				executeFluid(CHOP_Output*, const OP_Inputs*);
+	void				executePlexus(CHOP_Output*, const OP_Inputs*);
+	void				executeTrails(CHOP_Output*, const OP_Inputs*);
+
+	// Gathers the Plexus source's points and finds their edges
+	void				updatePlexus(const OP_Inputs*);
+
+	// Rebuilds myRayCaster from the SOP's polygons if it cooked since
+	void				updateRayCaster(const OP_SOPInput*);
+
+	// Rules DAT rows are 'channel source [gain] [offset]', channels it
+	// doesn't list keep their default rule
+	void				parseInstanceRules(const OP_DATInput*);
+
+	static TerrainSettings	getTerrainSettings(const OP_Inputs*);
+	static StatsSettings	getStatsSettings(const OP_Inputs*);
+	static ParticleSettings	getParticleSettings(const OP_Inputs*);
+	static ClothGrid		getClothGrid(const OP_Inputs*);
+	static ClothSettings	getClothSettings(const OP_Inputs*);
+	static RigidScene		getRigidScene(const OP_Inputs*);
+	static RigidSettings	getRigidSettings(const OP_Inputs*);
+	static FluidScene		getFluidScene(const OP_Inputs*);
+	static FluidSettings	getFluidSettings(const OP_Inputs*);
+	static EdgeSettings		getEdgeSettings(const OP_Inputs*);
+	static TrailSettings	getTrailSettings(const OP_Inputs*);
 
 	// We don't need to store this pointer, but we do for the example.
 	// The OP_NodeInfo class store information about the node that's using
@@ -74,5 +215,95 @@ private:
 
 	double				myOffset;
 
+	const char*			myWarning;
+
+	CHOPMode			myMode;
+
+	TerrainGenerator	myTerrain;
+	TerrainSettings		myTerrainSettings;
+	// Last heights downloaded from the Heightmap TOP, and its size
+	std::vector<float>	myHeights;
+	int32_t				myHeightsWidth;
+	int32_t				myHeightsHeight;
+	// Size of the last download request. Delayed downloads return the data
+	// of the previous request, so it is only used if the size still matches.
+	int32_t				myRequestWidth;
+	int32_t				myRequestHeight;
+	int64_t				myHeightmapCooks;
+	bool				myHeightmapPending;
+	bool				myTerrainDirty;
+	int32_t				myTerrainBuilds;
+
+	TextureStats		myStats;
+	StatsSettings		myStatsSettings;
+	// Same scheme as the heightmap download above
+	int32_t				myStatsRequestWidth;
+	int32_t				myStatsRequestHeight;
+	int64_t				myStatsCooks;
+	bool				myStatsPending;
+	bool				myStatsValid;
+	int32_t				myStatsPasses;
+
+	InstanceBuilder		myInstances;
+	InstanceRule		myInstanceRules[InstanceBuilder::NumChannels];
+	const char*			myRulesWarning;
+	uint32_t			myRulesDATId;
+	int64_t				myRulesDATCooks;
+	// Same scheme as the heightmap download above
+	int32_t				myInstanceRequestWidth;
+	int32_t				myInstanceRequestHeight;
+	int64_t				myInstanceCooks;
+	bool				myInstancePending;
+	int32_t				myInstanceRowsUpdated;
+
+	PointIndex			myPointIndex;
+	// Query positions and results, kept to avoid reallocating every cook
+	std::vector<float>	myQueries;
+	std::vector<int32_t>	myNearestIndices;
+	std::vector<float>	myNearestDistances;
+
+	RayCaster			myRayCaster;
+	// Polygon offsets and sizes gathered from the SOP for a rebuild, and the
+	// rays and hits, kept to avoid reallocating every cook
+	std::vector<int32_t>	myPolyOffsets;
+	std::vector<int32_t>	myPolySizes;
+	std::vector<float>	myRayOrigins;
+	std::vector<float>	myRayDirections;
+	std::vector<RayHit>	myRayHits;
+
+	ParticlePool		myParticles;
+	bool				myParticlesReset;
+	// Totals over the substeps of the last cook
+	int32_t				myParticlesSpawned;
+	int32_t				myParticlesKilled;
+
+	ClothSolver			myCloth;
+	bool				myClothReset;
+	// Totals over the substeps of the last cook
+	double				myClothTimes[ClothSolver::NumPhases];
+	int32_t				myClothCollisions;
+
+	RigidBodies			myRigid;
+	bool				myRigidReset;
+	// Milliseconds spent over the substeps of the last cook
+	double				myRigidTime;
+
+	FluidSolver			myFluid;
+	bool				myFluidReset;
+	// Milliseconds spent on the step of the last cook
+	double				myFluidTime;
+
+	ProximityEdges		myPlexus;
+	// Points gathered from the source, kept to avoid reallocating every cook
+	std::vector<float>	myPlexusPoints;
+	// Set by updatePlexus(), which runs before execute() clears myWarning
+	const char*			myPlexusWarning;
+	double				myPlexusTime;
+
+	RibbonTrails		myTrails;
+	// Head positions gathered from the input, kept to avoid reallocating
+	// every cook
+	std::vector<float>	myTrailHeads;
+	double				myTrailsTime;
 
 };
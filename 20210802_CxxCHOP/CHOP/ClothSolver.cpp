@@ -0,0 +1,450 @@
+/*
+ * See ClothSolver.h
+ */
+
+#include "ClothSolver.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Colours tracked per particle while colouring, constraints that don't fit
+// in any of them go into one last colour that is projected serially
+static const int32_t MaxColors = 63;
+
+// Constraints or particles per parallel task, below this a loop isn't worth
+// sending to other threads
+static const int32_t MinPerTask = 2048;
+
+// Steps shorter than this don't need a ray
+static const float MinMove = 1.0e-7f;
+
+bool
+ClothGrid::operator==(const ClothGrid& other) const
+{
+	return resolutionX == other.resolutionX &&
+		resolutionY == other.resolutionY &&
+		sizeX == other.sizeX &&
+		sizeY == other.sizeY &&
+		plane == other.plane &&
+		pins == other.pins;
+}
+
+const char*
+ClothSolver::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"nx", "ny", "nz",
+		"u", "v"
+	};
+	return names[channel];
+}
+
+ClothSolver::ClothSolver() :
+	myValid(false),
+	myCollisions(0)
+{
+	std::fill(myPhaseTimes, myPhaseTimes + NumPhases, 0.0);
+}
+
+int32_t
+ClothSolver::numConstraints() const
+{
+	return static_cast<int32_t>(myStretch.constraints.size() + myBend.constraints.size());
+}
+
+int32_t
+ClothSolver::numColors() const
+{
+	return static_cast<int32_t>(myStretch.colorOffsets.size() + myBend.colorOffsets.size()) - 2;
+}
+
+void
+ClothSolver::pinTarget(int32_t i, const float center[3], float out[3]) const
+{
+	const int32_t x = i % myGrid.resolutionX;
+	const int32_t y = i / myGrid.resolutionX;
+	const float u = myGrid.resolutionX > 1 ? float(x) / (myGrid.resolutionX - 1) : 0.5f;
+	const float v = myGrid.resolutionY > 1 ? float(y) / (myGrid.resolutionY - 1) : 0.5f;
+
+	out[0] = center[0] + (u - 0.5f) * myGrid.sizeX;
+	if (myGrid.plane == ClothPlane::XY)
+	{
+		// Row 0 at the top
+		out[1] = center[1] + (0.5f - v) * myGrid.sizeY;
+		out[2] = center[2];
+	}
+	else
+	{
+		out[1] = center[1];
+		out[2] = center[2] + (v - 0.5f) * myGrid.sizeY;
+	}
+}
+
+void
+ClothSolver::addConstraint(ConstraintSet& set, int32_t a, int32_t b)
+{
+	Constraint c;
+	c.a = a;
+	c.b = b;
+	float d2 = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		const float d = myX[a * 3 + k] - myX[b * 3 + k];
+		d2 += d * d;
+	}
+	c.rest = std::sqrt(d2);
+	set.constraints.push_back(c);
+}
+
+void
+ClothSolver::colorConstraints(ConstraintSet& set)
+{
+	// Each particle remembers the colours of the constraints it's in, a
+	// constraint takes the first colour neither of its particles has
+	std::vector<uint64_t> used(myInvMass.size(), 0);
+	std::vector<int32_t> colors(set.constraints.size());
+	int32_t numColors = 0;
+	for (size_t i = 0; i < set.constraints.size(); i++)
+	{
+		const Constraint& c = set.constraints[i];
+		const uint64_t taken = used[c.a] | used[c.b];
+		int32_t color = 0;
+		while (color < MaxColors && (taken & (uint64_t(1) << color)))
+			color++;
+		if (color < MaxColors)
+		{
+			used[c.a] |= uint64_t(1) << color;
+			used[c.b] |= uint64_t(1) << color;
+		}
+		colors[i] = color;
+		numColors = std::max(numColors, color + 1);
+	}
+
+	// Counting sort by colour
+	set.colorOffsets.assign(numColors + 1, 0);
+	for (int32_t color : colors)
+		set.colorOffsets[color + 1]++;
+	for (int32_t c = 0; c < numColors; c++)
+		set.colorOffsets[c + 1] += set.colorOffsets[c];
+
+	std::vector<int32_t> next(set.colorOffsets.begin(), set.colorOffsets.end() - 1);
+	std::vector<Constraint> sorted(set.constraints.size());
+	for (size_t i = 0; i < set.constraints.size(); i++)
+		sorted[next[colors[i]]++] = set.constraints[i];
+	set.constraints.swap(sorted);
+	set.lambdas.assign(set.constraints.size(), 0.0f);
+}
+
+void
+ClothSolver::build(const ClothGrid& grid, const float center[3])
+{
+	myGrid = grid;
+	myGrid.resolutionX = std::max(grid.resolutionX, 2);
+	myGrid.resolutionY = std::max(grid.resolutionY, 2);
+	myValid = true;
+
+	const int32_t nx = myGrid.resolutionX;
+	const int32_t ny = myGrid.resolutionY;
+	const int32_t count = nx * ny;
+
+	myX.resize(static_cast<size_t>(count) * 3);
+	myP.resize(myX.size());
+	myV.assign(myX.size(), 0.0f);
+	myInvMass.assign(count, 1.0f);
+	myPinned.clear();
+
+	for (int32_t i = 0; i < count; i++)
+		pinTarget(i, center, &myX[static_cast<size_t>(i) * 3]);
+
+	if (myGrid.pins == ClothPins::Corners)
+	{
+		myPinned.push_back(0);
+		myPinned.push_back(nx - 1);
+	}
+	else if (myGrid.pins == ClothPins::TopEdge)
+	{
+		for (int32_t x = 0; x < nx; x++)
+			myPinned.push_back(x);
+	}
+	for (int32_t i : myPinned)
+		myInvMass[i] = 0.0f;
+
+	auto index = [nx](int32_t x, int32_t y) { return y * nx + x; };
+
+	// Rows, columns and both diagonals keep the cloth from stretching and
+	// shearing
+	myStretch.constraints.clear();
+	for (int32_t y = 0; y < ny; y++)
+	{
+		for (int32_t x = 0; x < nx; x++)
+		{
+			if (x + 1 < nx)
+				addConstraint(myStretch, index(x, y), index(x + 1, y));
+			if (y + 1 < ny)
+				addConstraint(myStretch, index(x, y), index(x, y + 1));
+			if (x + 1 < nx && y + 1 < ny)
+			{
+				addConstraint(myStretch, index(x, y), index(x + 1, y + 1));
+				addConstraint(myStretch, index(x + 1, y), index(x, y + 1));
+			}
+		}
+	}
+	colorConstraints(myStretch);
+
+	// Particles two apart resist folding between them
+	myBend.constraints.clear();
+	for (int32_t y = 0; y < ny; y++)
+	{
+		for (int32_t x = 0; x < nx; x++)
+		{
+			if (x + 2 < nx)
+				addConstraint(myBend, index(x, y), index(x + 2, y));
+			if (y + 2 < ny)
+				addConstraint(myBend, index(x, y), index(x, y + 2));
+		}
+	}
+	colorConstraints(myBend);
+}
+
+void
+ClothSolver::project(ConstraintSet& set, float compliance, float dt)
+{
+	const float alpha = compliance / (dt * dt);
+	const int32_t numColors = static_cast<int32_t>(set.colorOffsets.size()) - 1;
+
+	auto solve = [&](int32_t begin, int32_t end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const Constraint& c = set.constraints[i];
+			const float wa = myInvMass[c.a];
+			const float wb = myInvMass[c.b];
+			const float w = wa + wb;
+			if (w == 0.0f)
+				continue;
+
+			float* pa = &myP[static_cast<size_t>(c.a) * 3];
+			float* pb = &myP[static_cast<size_t>(c.b) * 3];
+			const float d[3] = { pa[0] - pb[0], pa[1] - pb[1], pa[2] - pb[2] };
+			const float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if (length < 1.0e-9f)
+				continue;
+
+			const float dLambda = (c.rest - length - alpha * set.lambdas[i]) / (w + alpha);
+			set.lambdas[i] += dLambda;
+			const float s = dLambda / length;
+			for (int k = 0; k < 3; k++)
+			{
+				pa[k] += wa * s * d[k];
+				pb[k] -= wb * s * d[k];
+			}
+		}
+	};
+
+	for (int32_t color = 0; color < numColors; color++)
+	{
+		const int32_t first = set.colorOffsets[color];
+		const int32_t last = set.colorOffsets[color + 1];
+
+		// The overflow colour can share particles
+		if (color == MaxColors)
+		{
+			solve(first, last);
+			continue;
+		}
+
+		parallelFor(last - first, [&](int begin, int end)
+		{
+			solve(first + begin, first + end);
+		}, MinPerTask);
+	}
+}
+
+void
+ClothSolver::collide(const RayCaster& collider, float thickness, float friction)
+{
+	const int32_t count = numParticles();
+
+	myMoving.clear();
+	myRayOrigins.clear();
+	myRayDirections.clear();
+	for (int32_t i = 0; i < count; i++)
+	{
+		if (myInvMass[i] == 0.0f)
+			continue;
+		const float* x = &myX[static_cast<size_t>(i) * 3];
+		const float* p = &myP[static_cast<size_t>(i) * 3];
+		const float d[3] = { p[0] - x[0], p[1] - x[1], p[2] - x[2] };
+		if (std::fabs(d[0]) + std::fabs(d[1]) + std::fabs(d[2]) < MinMove)
+			continue;
+		myMoving.push_back(i);
+		myRayOrigins.insert(myRayOrigins.end(), x, x + 3);
+		myRayDirections.insert(myRayDirections.end(), d, d + 3);
+	}
+
+	const int32_t moving = static_cast<int32_t>(myMoving.size());
+	myRayHits.resize(moving);
+	collider.cast(myRayOrigins.data(), myRayDirections.data(), moving, myRayHits.data());
+
+	int32_t collisions = 0;
+	for (int32_t r = 0; r < moving; r++)
+	{
+		const RayHit& hit = myRayHits[r];
+		if (hit.primitive < 0)
+			continue;
+
+		const float* d = &myRayDirections[static_cast<size_t>(r) * 3];
+		const float move = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		if (hit.length > move + thickness)
+			continue;
+
+		// Keep the particle on the side it came from
+		float n[3] = { hit.normal[0], hit.normal[1], hit.normal[2] };
+		if (n[0] * d[0] + n[1] * d[1] + n[2] * d[2] > 0.0f)
+		{
+			for (int k = 0; k < 3; k++)
+				n[k] = -n[k];
+		}
+		float* p = &myP[static_cast<size_t>(myMoving[r]) * 3];
+		const float height = (p[0] - hit.position[0]) * n[0] +
+			(p[1] - hit.position[1]) * n[1] +
+			(p[2] - hit.position[2]) * n[2];
+		if (height >= thickness)
+			continue;
+		for (int k = 0; k < 3; k++)
+			p[k] += n[k] * (thickness - height);
+
+		// Friction, against the part of the step along the surface
+		const float* x = &myRayOrigins[static_cast<size_t>(r) * 3];
+		const float step[3] = { p[0] - x[0], p[1] - x[1], p[2] - x[2] };
+		const float normal = step[0] * n[0] + step[1] * n[1] + step[2] * n[2];
+		for (int k = 0; k < 3; k++)
+			p[k] -= friction * (step[k] - normal * n[k]);
+		collisions++;
+	}
+	myCollisions += collisions;
+}
+
+void
+ClothSolver::step(const ClothSettings& settings, float dt, const RayCaster* collider)
+{
+	std::fill(myPhaseTimes, myPhaseTimes + NumPhases, 0.0);
+	myCollisions = 0;
+	if (!myValid || dt <= 0.0f)
+		return;
+
+	typedef std::chrono::steady_clock Clock;
+	auto elapsed = [](Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	};
+
+	const int32_t count = numParticles();
+	const float damping = std::exp(-std::max(settings.damping, 0.0f) * dt);
+
+	Clock::time_point start = Clock::now();
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			float* x = &myX[static_cast<size_t>(i) * 3];
+			float* v = &myV[static_cast<size_t>(i) * 3];
+			float* p = &myP[static_cast<size_t>(i) * 3];
+			if (myInvMass[i] == 0.0f)
+			{
+				std::copy(x, x + 3, p);
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				v[k] = (v[k] + settings.gravity[k] * dt) * damping;
+				p[k] = x[k] + v[k] * dt;
+			}
+		}
+	}, MinPerTask);
+
+	// Pins follow the center
+	for (int32_t i : myPinned)
+		pinTarget(i, settings.center, &myP[static_cast<size_t>(i) * 3]);
+
+	std::fill(myStretch.lambdas.begin(), myStretch.lambdas.end(), 0.0f);
+	std::fill(myBend.lambdas.begin(), myBend.lambdas.end(), 0.0f);
+	myPhaseTimes[Predict] = elapsed(start);
+
+	const int32_t iterations = std::max(settings.iterations, 1);
+	for (int32_t it = 0; it < iterations; it++)
+	{
+		start = Clock::now();
+		project(myStretch, std::max(settings.stretchCompliance, 0.0f), dt);
+		myPhaseTimes[Stretch] += elapsed(start);
+
+		start = Clock::now();
+		project(myBend, std::max(settings.bendCompliance, 0.0f), dt);
+		myPhaseTimes[Bend] += elapsed(start);
+	}
+
+	// Collisions last, so the constraints can't push particles back through
+	start = Clock::now();
+	if (collider && collider->numTriangles() > 0)
+		collide(*collider, std::max(settings.thickness, 0.0f),
+				std::min(std::max(settings.friction, 0.0f), 1.0f));
+	myPhaseTimes[Collide] = elapsed(start);
+
+	start = Clock::now();
+	const float invDt = 1.0f / dt;
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+		{
+			myV[i] = (myP[i] - myX[i]) * invDt;
+			myX[i] = myP[i];
+		}
+	}, MinPerTask);
+	myPhaseTimes[Predict] += elapsed(start);
+}
+
+void
+ClothSolver::writeChannels(float* const* channels, int32_t count) const
+{
+	const int32_t nx = myGrid.resolutionX;
+	const int32_t ny = myGrid.resolutionY;
+	count = std::min(count, numParticles());
+
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const int32_t x = i % nx;
+			const int32_t y = i / nx;
+			const float* p = &myX[static_cast<size_t>(i) * 3];
+
+			// Central differences, one sided at the borders
+			const float* left = &myX[static_cast<size_t>(y * nx + std::max(x - 1, 0)) * 3];
+			const float* right = &myX[static_cast<size_t>(y * nx + std::min(x + 1, nx - 1)) * 3];
+			const float* up = &myX[static_cast<size_t>(std::max(y - 1, 0) * nx + x) * 3];
+			const float* down = &myX[static_cast<size_t>(std::min(y + 1, ny - 1) * nx + x) * 3];
+			const float du[3] = { right[0] - left[0], right[1] - left[1], right[2] - left[2] };
+			const float dv[3] = { up[0] - down[0], up[1] - down[1], up[2] - down[2] };
+			float n[3] =
+			{
+				du[1] * dv[2] - du[2] * dv[1],
+				du[2] * dv[0] - du[0] * dv[2],
+				du[0] * dv[1] - du[1] * dv[0]
+			};
+			const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+
+			for (int k = 0; k < 3; k++)
+			{
+				channels[TX + k][i] = p[k];
+				channels[NX + k][i] = n[k] * scale;
+			}
+			channels[U][i] = float(x) / (nx - 1);
+			channels[V][i] = 1.0f - float(y) / (ny - 1);
+		}
+	}, MinPerTask);
+}
@@ -0,0 +1,163 @@
+/*
+ * Position based cloth for the CHOP's Cloth mode, solved with XPBD.
+ *
+ * The cloth is a grid of particles held together by distance constraints
+ * along its rows, columns and diagonals and by bending constraints between
+ * particles two apart, whose stiffness is given as XPBD compliance so it
+ * doesn't depend on the iteration count. Pinned particles have no mass and
+ * follow the cloth's center.
+ *
+ * Every constraint set is graph colored once when the grid is built: no two
+ * constraints of a colour share a particle, so each colour is projected in
+ * parallel without locks, one colour after the other.
+ *
+ * Collisions are against the polygons of a SOP, through the RayCaster's BVH:
+ * each moving particle casts a ray along its step and is pushed out along the
+ * surface normal, keeping 'thickness' away, if it would cross it. Friction
+ * then takes away part of its sliding along the surface.
+ */
+
+#ifndef __ClothSolver__
+#define __ClothSolver__
+
+#include "RayCaster.h"
+
+#include <stdint.h>
+#include <vector>
+
+enum class ClothPlane
+{
+	// Hangs down from the top row
+	XY = 0,
+	// Lies flat
+	XZ,
+};
+
+enum class ClothPins
+{
+	None = 0,
+	Corners,
+	TopEdge,
+};
+
+// What the particles and constraints are built from, changing any of it
+// rebuilds the cloth
+struct ClothGrid
+{
+	int32_t		resolutionX = 64;
+	int32_t		resolutionY = 64;
+	float		sizeX = 2.0f;
+	float		sizeY = 2.0f;
+	ClothPlane	plane = ClothPlane::XY;
+	ClothPins	pins = ClothPins::Corners;
+
+	bool		operator==(const ClothGrid& other) const;
+	bool		operator!=(const ClothGrid& other) const { return !(*this == other); }
+};
+
+struct ClothSettings
+{
+	int32_t		iterations = 2;
+	// Inverse stiffness, 0 is rigid
+	float		stretchCompliance = 0.0f;
+	float		bendCompliance = 1.0e-3f;
+	float		gravity[3] = { 0.0f, -9.8f, 0.0f };
+	// Velocity lost per second, as a rate
+	float		damping = 0.1f;
+	// Distance particles keep from the collision SOP
+	float		thickness = 0.01f;
+	// Fraction of the sliding along the SOP removed on contact, 1 sticks
+	float		friction = 0.5f;
+	float		center[3] = { 0.0f, 0.0f, 0.0f };
+};
+
+class ClothSolver
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		NX, NY, NZ,
+		U, V,
+		NumChannels
+	};
+
+	// Phases timed by step()
+	enum Phase
+	{
+		Predict = 0,
+		Stretch,
+		Bend,
+		Collide,
+		NumPhases
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	ClothSolver();
+
+	// Rebuilds the particles and constraints, resting at 'center'
+	void			build(const ClothGrid& grid, const float center[3]);
+	bool			needsBuild(const ClothGrid& grid) const { return !myValid || grid != myGrid; }
+
+	// Advances by 'dt', colliding with 'collider' unless it is nullptr
+	void			step(const ClothSettings& settings, float dt, const RayCaster* collider);
+
+	// Writes every particle into the NumChannels arrays, at most 'count'
+	void			writeChannels(float* const* channels, int32_t count) const;
+
+	int32_t			numParticles() const { return static_cast<int32_t>(myInvMass.size()); }
+	int32_t			numConstraints() const;
+	int32_t			numColors() const;
+	// Milliseconds spent in 'phase' over the last step
+	double			phaseTime(Phase phase) const { return myPhaseTimes[phase]; }
+	int32_t			collisions() const { return myCollisions; }
+
+private:
+	struct Constraint
+	{
+		int32_t		a;
+		int32_t		b;
+		float		rest;
+	};
+
+	// Constraints sorted by colour, colour c being [colorOffsets[c],
+	// colorOffsets[c + 1])
+	struct ConstraintSet
+	{
+		std::vector<Constraint>	constraints;
+		std::vector<float>		lambdas;
+		std::vector<int32_t>	colorOffsets;
+	};
+
+	void			addConstraint(ConstraintSet& set, int32_t a, int32_t b);
+	// Greedy colouring, sorts the set's constraints by colour
+	void			colorConstraints(ConstraintSet& set);
+	void			project(ConstraintSet& set, float compliance, float dt);
+	void			collide(const RayCaster& collider, float thickness, float friction);
+	void			pinTarget(int32_t i, const float center[3], float out[3]) const;
+
+	ClothGrid				myGrid;
+	bool					myValid;
+
+	// Positions, predicted positions and velocities, 3 floats per particle
+	std::vector<float>		myX;
+	std::vector<float>		myP;
+	std::vector<float>		myV;
+	std::vector<float>		myInvMass;
+	std::vector<int32_t>	myPinned;
+
+	ConstraintSet			myStretch;
+	ConstraintSet			myBend;
+
+	// Rays of the particles that moved, kept to avoid reallocating
+	std::vector<int32_t>	myMoving;
+	std::vector<float>		myRayOrigins;
+	std::vector<float>		myRayDirections;
+	std::vector<RayHit>		myRayHits;
+
+	double					myPhaseTimes[NumPhases];
+	int32_t					myCollisions;
+};
+
+#endif
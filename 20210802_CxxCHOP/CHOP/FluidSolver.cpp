@@ -0,0 +1,795 @@
+/*
+ * See FluidSolver.h
+ */
+
+#include "FluidSolver.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+static const float Pi = 3.14159265358979f;
+
+// Density of water, sets the particles' mass
+static const float WaterDensity = 1000.0f;
+// Iterations run whatever the error
+static const int32_t MinIterations = 2;
+// Fraction of the stiffness a Jacobi iteration asks for it applies, as
+// neighbours asking for the same push would otherwise overshoot together
+static const float Relaxation = 0.5f;
+// Spacings the fastest particle may move in a substep, and the most substeps
+// a step is split into
+static const float CourantNumber = 0.4f;
+static const int32_t MaxSubsteps = 16;
+// Particles per parallel task, below this a loop isn't worth sending to
+// other threads
+static const int32_t MinPerTask = 1024;
+static const uint64_t EmptyKey = ~0ull;
+// Samples of the walls' terms, over a kernel radius from them
+static const int32_t WallSamples = 64;
+
+// Spreads the low 21 bits of v out to every third bit, and back
+static inline uint64_t
+expandBits(uint64_t v)
+{
+	v &= 0x1FFFFF;
+	v = (v | v << 32) & 0x1F00000000FFFFull;
+	v = (v | v << 16) & 0x1F0000FF0000FFull;
+	v = (v | v << 8) & 0x100F00F00F00F00Full;
+	v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+static inline uint64_t
+compactBits(uint64_t v)
+{
+	v &= 0x1249249249249249ull;
+	v = (v | v >> 2) & 0x10C30C30C30C30C3ull;
+	v = (v | v >> 4) & 0x100F00F00F00F00Full;
+	v = (v | v >> 8) & 0x1F0000FF0000FFull;
+	v = (v | v >> 16) & 0x1F00000000FFFFull;
+	v = (v | v >> 32) & 0x1FFFFF;
+	return v;
+}
+
+static inline uint64_t
+cellKey(int32_t x, int32_t y, int32_t z)
+{
+	return expandBits(static_cast<uint64_t>(x)) | expandBits(static_cast<uint64_t>(y)) << 1 |
+		expandBits(static_cast<uint64_t>(z)) << 2;
+}
+
+static inline uint32_t
+hashKey(uint64_t key, int32_t bits)
+{
+	return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+// Poly6 for densities, the spiky kernel's gradient for pressure and the
+// viscosity kernel's Laplacian, all with support h
+struct Kernels
+{
+	float		h;
+	float		h2;
+	float		poly6;
+	float		spiky;
+	float		viscosity;
+
+	explicit Kernels(float support) :
+		h(support),
+		h2(support * support),
+		poly6(315.0f / (64.0f * Pi * std::pow(support, 9.0f))),
+		spiky(-45.0f / (Pi * std::pow(support, 6.0f))),
+		viscosity(45.0f / (Pi * std::pow(support, 6.0f)))
+	{
+	}
+
+	float		density(float r2) const
+	{
+		const float d = h2 - r2;
+		return d > 0.0f ? poly6 * d * d * d : 0.0f;
+	}
+
+	// Gradient along the unit offset, times r so no division is needed for
+	// the direction: grad W = gradient(r) * offset
+	float		gradient(float r) const
+	{
+		return r > 0.0f && r < h ? spiky * (h - r) * (h - r) / r : 0.0f;
+	}
+
+	float		laplacian(float r) const
+	{
+		return r < h ? viscosity * (h - r) : 0.0f;
+	}
+};
+
+bool
+FluidScene::operator==(const FluidScene& other) const
+{
+	return count == other.count &&
+		spacing == other.spacing &&
+		width == other.width &&
+		depth == other.depth;
+}
+
+const char*
+FluidSolver::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"vx", "vy", "vz",
+		"density"
+	};
+	return names[channel];
+}
+
+FluidSolver::FluidSolver() :
+	myValid(false),
+	myMass(0.0f),
+	myRadius(0.0f),
+	myRestDensity(WaterDensity),
+	myTableBits(1),
+	myCellCount(0),
+	mySinceSort(0),
+	myIterations(0),
+	myDivergenceIterations(0),
+	myDensityError(0.0f),
+	mySorts(0),
+	mySubsteps(0)
+{
+	std::fill(myPhaseTimes, myPhaseTimes + NumPhases, 0.0);
+}
+
+float
+FluidSolver::meanNeighbors() const
+{
+	const int32_t n = numParticles();
+	return n > 0 ? float(myNeighbors.size()) / n : 0.0f;
+}
+
+void
+FluidSolver::build(const FluidScene& scene)
+{
+	myScene = scene;
+	myScene.count = std::max(scene.count, 1);
+	myScene.spacing = std::max(scene.spacing, 1.0e-3f);
+	myScene.width = std::max(scene.width, 2.0f * myScene.spacing);
+	myScene.depth = std::max(scene.depth, 2.0f * myScene.spacing);
+	myValid = true;
+
+	const float s = myScene.spacing;
+	myRadius = 2.0f * s;
+	myMass = WaterDensity * s * s * s;
+
+	// The rest density is that inside the lattice the fluid starts on, so it
+	// starts at rest
+	const Kernels kernels(myRadius);
+	myRestDensity = 0.0f;
+	for (int32_t z = -2; z <= 2; z++)
+	for (int32_t y = -2; y <= 2; y++)
+	for (int32_t x = -2; x <= 2; x++)
+		myRestDensity += myMass * kernels.density((x * x + y * y + z * z) * s * s);
+
+	// The walls as the same lattice carried on past them, so a particle
+	// half a spacing from a wall sees a full neighbourhood. Sampled by the
+	// distance to the wall, the gradient being along its normal.
+	myWallDensity.assign(WallSamples + 1, 0.0f);
+	myWallGradient.assign(WallSamples + 1, 0.0f);
+	for (int32_t i = 0; i <= WallSamples; i++)
+	{
+		const float distance = myRadius * i / WallSamples;
+		for (int32_t layer = 0; layer < 2; layer++)
+		for (int32_t b = -2; b <= 2; b++)
+		for (int32_t a = -2; a <= 2; a++)
+		{
+			const float normal = distance + (layer + 0.5f) * s;
+			const float r2 = (a * a + b * b) * s * s + normal * normal;
+			myWallDensity[i] += myMass * kernels.density(r2);
+			myWallGradient[i] += kernels.gradient(std::sqrt(r2)) * normal;
+		}
+	}
+
+	// A column against the -x wall, as deep as the tank and twice as high as
+	// it's wide, but never wider than half the tank
+	const int32_t n = myScene.count;
+	const int32_t nz = std::max(1, static_cast<int32_t>(myScene.depth / s));
+	const int32_t nx = std::min(std::max(1, static_cast<int32_t>(std::sqrt(0.5f * n / nz))),
+		std::max(1, static_cast<int32_t>(0.5f * myScene.width / s)));
+	myX.resize(static_cast<size_t>(n) * 3);
+	myV.assign(static_cast<size_t>(n) * 3, 0.0f);
+	myIds.resize(n);
+	for (int32_t i = 0; i < n; i++)
+	{
+		myX[i * 3 + 0] = -0.5f * myScene.width + (i % nx + 0.5f) * s;
+		myX[i * 3 + 1] = (i / (nx * nz) + 0.5f) * s;
+		myX[i * 3 + 2] = -0.5f * myScene.depth + ((i / nx) % nz + 0.5f) * s;
+		myIds[i] = i;
+	}
+	myForces.assign(static_cast<size_t>(n) * 3, 0.0f);
+	myDensity.assign(n, myRestDensity);
+	myFactors.assign(n, 0.0f);
+	myStiffness.assign(n, 0.0f);
+	myWallGradients.assign(static_cast<size_t>(n) * 3, 0.0f);
+	myKeys.resize(n);
+	myParticleCell.resize(n);
+	myCellParticles.resize(n);
+
+	// Room for twice as many cells as particles
+	int32_t bits = 1;
+	while ((1 << bits) < 2 * n)
+		bits++;
+	myTableKeys.assign(static_cast<size_t>(1) << bits, EmptyKey);
+	myTableCells.assign(static_cast<size_t>(1) << bits, -1);
+	myTableBits = bits;
+
+	myIterations = 0;
+	myDivergenceIterations = 0;
+	myDensityError = 0.0f;
+	findNeighbors(1);
+	computeDensities();
+	computeFactors();
+	mySorts = 0;
+}
+
+float
+FluidSolver::addWalls(const float* p, float* gradient) const
+{
+	// No lid, so nothing is ever near the top
+	const float low[3] = { -0.5f * myScene.width, 0.0f, -0.5f * myScene.depth };
+	const float high[3] = { 0.5f * myScene.width, std::numeric_limits<float>::infinity(), 0.5f * myScene.depth };
+	const float samples = WallSamples / myRadius;
+
+	// Each wall's lattice also covers what lies behind the walls beside it,
+	// so rather than summed, the walls' shares of a full neighbourhood are
+	// combined as if independent, which stays within a percent in corners
+	float shares[6];
+	float gradients[6];
+	float empty = 1.0f;
+	for (int w = 0; w < 6; w++)
+	{
+		const int k = w / 2;
+		const float at = std::max(w % 2 == 0 ? p[k] - low[k] : high[k] - p[k], 0.0f) * samples;
+		shares[w] = 0.0f;
+		gradients[w] = 0.0f;
+		if (at >= WallSamples)
+			continue;
+		const int32_t i = static_cast<int32_t>(at);
+		const float t = at - i;
+		shares[w] = (myWallDensity[i] + t * (myWallDensity[i + 1] - myWallDensity[i])) / myRestDensity;
+		gradients[w] = myWallGradient[i] + t * (myWallGradient[i + 1] - myWallGradient[i]);
+		empty *= 1.0f - shares[w];
+	}
+
+	if (gradient)
+	{
+		for (int w = 0; w < 6; w++)
+		{
+			if (gradients[w] != 0.0f)
+			{
+				const float g = gradients[w] * empty / (1.0f - shares[w]);
+				gradient[w / 2] += w % 2 == 0 ? g : -g;
+			}
+		}
+	}
+	return myRestDensity * (1.0f - empty);
+}
+
+void
+FluidSolver::confine(float* p, float* v) const
+{
+	const float margin = 0.5f * myScene.spacing;
+	const float low[3] = { -0.5f * myScene.width + margin, margin, -0.5f * myScene.depth + margin };
+	const float high[3] = { 0.5f * myScene.width - margin, std::numeric_limits<float>::infinity(), 0.5f * myScene.depth - margin };
+	for (int k = 0; k < 3; k++)
+	{
+		if (p[k] < low[k])
+		{
+			p[k] = low[k];
+			if (v)
+				v[k] = std::max(v[k], 0.0f);
+		}
+		else if (p[k] > high[k])
+		{
+			p[k] = high[k];
+			if (v)
+				v[k] = std::min(v[k], 0.0f);
+		}
+	}
+}
+
+void
+FluidSolver::computeKeys()
+{
+	// Cells are counted from one below the tank's corner, so they are never
+	// negative
+	const float inverse = 1.0f / myRadius;
+	const float origin[3] = { -0.5f * myScene.width - myRadius, -myRadius, -0.5f * myScene.depth - myRadius };
+	parallelFor(numParticles(), [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			int32_t c[3];
+			for (int k = 0; k < 3; k++)
+				c[k] = std::min(std::max(static_cast<int32_t>((myX[i * 3 + k] - origin[k]) * inverse), 0), 0x1FFFFF);
+			myKeys[i] = cellKey(c[0], c[1], c[2]);
+		}
+	}, MinPerTask);
+}
+
+void
+FluidSolver::sortParticles()
+{
+	const int32_t n = numParticles();
+	myOrder.resize(n);
+	for (int32_t i = 0; i < n; i++)
+		myOrder[i] = { myKeys[i], i };
+	std::sort(myOrder.begin(), myOrder.end());
+
+	// Only what carries over between steps needs to move
+	myScratch.resize(static_cast<size_t>(n) * 6);
+	myScratchIds.resize(n);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const int32_t from = myOrder[i].second;
+			for (int k = 0; k < 3; k++)
+			{
+				myScratch[i * 6 + k] = myX[from * 3 + k];
+				myScratch[i * 6 + 3 + k] = myV[from * 3 + k];
+			}
+			myScratchIds[i] = myIds[from];
+		}
+	}, MinPerTask);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				myX[i * 3 + k] = myScratch[i * 6 + k];
+				myV[i * 3 + k] = myScratch[i * 6 + 3 + k];
+			}
+			myKeys[i] = myOrder[i].first;
+		}
+	}, MinPerTask);
+	myIds.swap(myScratchIds);
+
+	mySinceSort = 0;
+	mySorts++;
+}
+
+int32_t
+FluidSolver::findCell(uint64_t key) const
+{
+	const uint32_t mask = static_cast<uint32_t>(myTableKeys.size() - 1);
+	for (uint32_t slot = hashKey(key, myTableBits); ; slot = (slot + 1) & mask)
+	{
+		if (myTableKeys[slot] == key)
+			return myTableCells[slot];
+		if (myTableKeys[slot] == EmptyKey)
+			return -1;
+	}
+}
+
+void
+FluidSolver::buildGrid()
+{
+	const int32_t n = numParticles();
+	std::fill(myTableKeys.begin(), myTableKeys.end(), EmptyKey);
+	myCellKeys.clear();
+	myCellStart.clear();
+
+	// Give each used cell an index as it's first met. Particles of a cell
+	// mostly follow each other, so most skip the table.
+	const uint32_t mask = static_cast<uint32_t>(myTableKeys.size() - 1);
+	uint64_t lastKey = EmptyKey;
+	int32_t lastCell = -1;
+	for (int32_t i = 0; i < n; i++)
+	{
+		const uint64_t key = myKeys[i];
+		if (key != lastKey)
+		{
+			uint32_t slot = hashKey(key, myTableBits);
+			while (myTableKeys[slot] != EmptyKey && myTableKeys[slot] != key)
+				slot = (slot + 1) & mask;
+			if (myTableKeys[slot] == EmptyKey)
+			{
+				myTableKeys[slot] = key;
+				myTableCells[slot] = static_cast<int32_t>(myCellKeys.size());
+				myCellKeys.push_back(key);
+				myCellStart.push_back(0);
+			}
+			lastKey = key;
+			lastCell = myTableCells[slot];
+		}
+		myParticleCell[i] = lastCell;
+		myCellStart[lastCell]++;
+	}
+	myCellCount = static_cast<int32_t>(myCellKeys.size());
+
+	// Counting sort of the particles into their cells
+	int32_t offset = 0;
+	for (int32_t c = 0; c < myCellCount; c++)
+	{
+		const int32_t count = myCellStart[c];
+		myCellStart[c] = offset;
+		offset += count;
+	}
+	myCellStart.push_back(offset);
+	{
+		std::vector<int32_t> fill(myCellStart.begin(), myCellStart.end() - 1);
+		for (int32_t i = 0; i < n; i++)
+			myCellParticles[fill[myParticleCell[i]]++] = i;
+	}
+}
+
+template <typename F>
+void
+FluidSolver::forNeighbors(int32_t c, F&& fn) const
+{
+	const float h2 = myRadius * myRadius;
+	const uint64_t key = myCellKeys[c];
+	const int32_t cx = static_cast<int32_t>(compactBits(key));
+	const int32_t cy = static_cast<int32_t>(compactBits(key >> 1));
+	const int32_t cz = static_cast<int32_t>(compactBits(key >> 2));
+	int32_t around[27];
+	int32_t found = 0;
+	for (int32_t dz = -1; dz <= 1; dz++)
+	for (int32_t dy = -1; dy <= 1; dy++)
+	for (int32_t dx = -1; dx <= 1; dx++)
+	{
+		if (cx + dx < 0 || cy + dy < 0 || cz + dz < 0)
+			continue;
+		const int32_t other = findCell(cellKey(cx + dx, cy + dy, cz + dz));
+		if (other >= 0)
+			around[found++] = other;
+	}
+
+	for (int32_t s = myCellStart[c]; s < myCellStart[c + 1]; s++)
+	{
+		const int32_t i = myCellParticles[s];
+		const float* p = &myX[i * 3];
+		for (int32_t a = 0; a < found; a++)
+		{
+			for (int32_t t = myCellStart[around[a]]; t < myCellStart[around[a] + 1]; t++)
+			{
+				const int32_t j = myCellParticles[t];
+				const float* q = &myX[j * 3];
+				const float x = q[0] - p[0];
+				const float y = q[1] - p[1];
+				const float z = q[2] - p[2];
+				if (x * x + y * y + z * z < h2)
+					fn(i, j);
+			}
+		}
+	}
+}
+
+void
+FluidSolver::buildNeighbors()
+{
+	const int32_t n = numParticles();
+
+	// Count, then fill, one cell per task. Lists include the particle itself.
+	myNeighborStart.assign(static_cast<size_t>(n) + 1, 0);
+	parallelFor(myCellCount, [&](int begin, int end)
+	{
+		for (int32_t c = begin; c < end; c++)
+			forNeighbors(c, [&](int32_t i, int32_t) { myNeighborStart[i + 1]++; });
+	}, 64);
+	for (int32_t i = 0; i < n; i++)
+		myNeighborStart[i + 1] += myNeighborStart[i];
+
+	myNeighbors.resize(myNeighborStart[n]);
+	parallelFor(myCellCount, [&](int begin, int end)
+	{
+		for (int32_t c = begin; c < end; c++)
+		{
+			int32_t last = -1;
+			int32_t* out = nullptr;
+			forNeighbors(c, [&](int32_t i, int32_t j)
+			{
+				if (i != last)
+				{
+					last = i;
+					out = &myNeighbors[myNeighborStart[i]];
+				}
+				*out++ = j;
+			});
+		}
+	}, 64);
+}
+
+void
+FluidSolver::computeDensities()
+{
+	const Kernels kernels(myRadius);
+	parallelFor(numParticles(), [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float* p = &myX[i * 3];
+			float density = 0.0f;
+			for (int32_t e = myNeighborStart[i]; e < myNeighborStart[i + 1]; e++)
+			{
+				const float* q = &myX[myNeighbors[e] * 3];
+				const float x = q[0] - p[0];
+				const float y = q[1] - p[1];
+				const float z = q[2] - p[2];
+				density += kernels.density(x * x + y * y + z * z);
+			}
+			myDensity[i] = density * myMass + addWalls(p, nullptr);
+		}
+	}, MinPerTask);
+}
+
+void
+FluidSolver::computeFactors()
+{
+	const Kernels kernels(myRadius);
+	myGradients.resize(myNeighbors.size() * 3);
+	parallelFor(numParticles(), [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float* p = &myX[i * 3];
+			float sum[3] = { 0.0f, 0.0f, 0.0f };
+			float squares = 0.0f;
+			for (int32_t e = myNeighborStart[i]; e < myNeighborStart[i + 1]; e++)
+			{
+				const float* q = &myX[myNeighbors[e] * 3];
+				const float d[3] = { p[0] - q[0], p[1] - q[1], p[2] - q[2] };
+				const float g = myMass * kernels.gradient(std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+				for (int k = 0; k < 3; k++)
+				{
+					myGradients[e * 3 + k] = g * d[k];
+					sum[k] += g * d[k];
+					squares += g * g * d[k] * d[k];
+				}
+			}
+
+			float* wall = &myWallGradients[i * 3];
+			std::fill(wall, wall + 3, 0.0f);
+			addWalls(p, wall);
+			for (int k = 0; k < 3; k++)
+			{
+				wall[k] *= myMass;
+				sum[k] += wall[k];
+			}
+
+			const float term = sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2] + squares;
+			myFactors[i] = term > 0.0f ? 1.0f / term : 0.0f;
+		}
+	}, MinPerTask);
+}
+
+void
+FluidSolver::computeForces(const FluidSettings& settings)
+{
+	const Kernels kernels(myRadius);
+	const float viscosity = std::max(settings.viscosity, 0.0f) * myMass;
+	parallelFor(numParticles(), [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float* p = &myX[i * 3];
+			const float* v = &myV[i * 3];
+			float f[3] = { settings.gravity[0], settings.gravity[1], settings.gravity[2] };
+			for (int32_t e = myNeighborStart[i]; e < myNeighborStart[i + 1]; e++)
+			{
+				const int32_t j = myNeighbors[e];
+				if (j == i)
+					continue;
+				const float* q = &myX[j * 3];
+				const float* w = &myV[j * 3];
+				const float x = q[0] - p[0];
+				const float y = q[1] - p[1];
+				const float z = q[2] - p[2];
+				const float scale = viscosity * kernels.laplacian(std::sqrt(x * x + y * y + z * z)) / myDensity[j];
+				for (int k = 0; k < 3; k++)
+					f[k] += scale * (w[k] - v[k]);
+			}
+			for (int k = 0; k < 3; k++)
+				myForces[i * 3 + k] = f[k];
+		}
+	}, MinPerTask);
+}
+
+int32_t
+FluidSolver::solve(float dt, bool density, float tolerance, int32_t maxIterations, float& error)
+{
+	const int32_t n = numParticles();
+	const float inverse = 1.0f / (dt * dt);
+	int32_t iterations = 0;
+	while (true)
+	{
+		// How far over the rest density each particle will be, or how much
+		// denser it's getting, with the velocities as they are
+		std::mutex lock;
+		double total = 0.0;
+		parallelFor(n, [&](int begin, int end)
+		{
+			double local = 0.0;
+			for (int32_t i = begin; i < end; i++)
+			{
+				const float* v = &myV[i * 3];
+				const float* wall = &myWallGradients[i * 3];
+				float change = v[0] * wall[0] + v[1] * wall[1] + v[2] * wall[2];
+				for (int32_t e = myNeighborStart[i]; e < myNeighborStart[i + 1]; e++)
+				{
+					const float* w = &myV[myNeighbors[e] * 3];
+					const float* g = &myGradients[e * 3];
+					change += (v[0] - w[0]) * g[0] + (v[1] - w[1]) * g[1] + (v[2] - w[2]) * g[2];
+				}
+				const float over = std::max((density ? myDensity[i] - myRestDensity : 0.0f) + dt * change, 0.0f);
+				myStiffness[i] = Relaxation * over * inverse * myFactors[i];
+				local += over;
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			total += local;
+		}, MinPerTask);
+
+		error = n > 0 ? static_cast<float>(total / n) / myRestDensity : 0.0f;
+		if ((iterations >= MinIterations && error <= tolerance) || iterations >= maxIterations)
+			break;
+		iterations++;
+
+		// Each particle's stiffness pushes it and its neighbours apart, and
+		// it away from the walls
+		parallelFor(n, [&](int begin, int end)
+		{
+			for (int32_t i = begin; i < end; i++)
+			{
+				const float* wall = &myWallGradients[i * 3];
+				float push[3] = { myStiffness[i] * wall[0], myStiffness[i] * wall[1], myStiffness[i] * wall[2] };
+				for (int32_t e = myNeighborStart[i]; e < myNeighborStart[i + 1]; e++)
+				{
+					const float k = myStiffness[i] + myStiffness[myNeighbors[e]];
+					const float* g = &myGradients[e * 3];
+					push[0] += k * g[0];
+					push[1] += k * g[1];
+					push[2] += k * g[2];
+				}
+				for (int k = 0; k < 3; k++)
+					myNextV[i * 3 + k] = myV[i * 3 + k] - dt * push[k];
+			}
+		}, MinPerTask);
+		myV.swap(myNextV);
+	}
+	return iterations;
+}
+
+void
+FluidSolver::findNeighbors(int32_t sortInterval)
+{
+	computeKeys();
+	if (++mySinceSort >= std::max(sortInterval, 1))
+		sortParticles();
+	buildGrid();
+	buildNeighbors();
+}
+
+void
+FluidSolver::step(const FluidSettings& settings, float dt)
+{
+	std::fill(myPhaseTimes, myPhaseTimes + NumPhases, 0.0);
+	myIterations = 0;
+	myDivergenceIterations = 0;
+	myDensityError = 0.0f;
+	mySubsteps = 0;
+	if (!myValid || dt <= 0.0f)
+		return;
+
+	// Equal substeps as short as the fastest particle needs. A short one
+	// after long ones would have to undo their density error in much less
+	// time, and kick the particles apart to do it.
+	const float reach = CourantNumber * myScene.spacing;
+	const float steps = std::ceil(dt * maxSpeed() / reach);
+	const int32_t count = std::min(std::max(static_cast<int32_t>(std::min(steps, 1e6f)), 1), MaxSubsteps);
+	for (mySubsteps = 0; mySubsteps < count; mySubsteps++)
+		advance(settings, dt / count);
+}
+
+float
+FluidSolver::maxSpeed() const
+{
+	std::mutex lock;
+	float largest = 0.0f;
+	parallelFor(numParticles(), [&](int begin, int end)
+	{
+		float local = 0.0f;
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float* v = &myV[i * 3];
+			local = std::max(local, v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		largest = std::max(largest, local);
+	}, MinPerTask);
+	return std::sqrt(largest);
+}
+
+void
+FluidSolver::advance(const FluidSettings& settings, float dt)
+{
+	typedef std::chrono::steady_clock Clock;
+	auto elapsed = [](Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	};
+
+	const int32_t n = numParticles();
+	const float tolerance = std::max(settings.tolerance, 0.0f);
+	const int32_t maxIterations = std::max(settings.maxIterations, MinIterations);
+	myNextV.resize(static_cast<size_t>(n) * 3);
+
+	// The neighbourhoods are those the last step ended with
+	Clock::time_point start = Clock::now();
+	computeForces(settings);
+	parallelFor(n * 3, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+			myV[i] += dt * myForces[i];
+	}, MinPerTask * 3);
+	myPhaseTimes[Forces] += elapsed(start);
+
+	start = Clock::now();
+	float error = 0.0f;
+	myIterations = std::max(myIterations, solve(dt, true, tolerance, maxIterations, error));
+	myDensityError = std::max(myDensityError, error);
+	myPhaseTimes[Pressure] += elapsed(start);
+
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			for (int k = 0; k < 3; k++)
+				myX[i * 3 + k] += dt * myV[i * 3 + k];
+			confine(&myX[i * 3], &myV[i * 3]);
+		}
+	}, MinPerTask);
+
+	start = Clock::now();
+	findNeighbors(settings.sortInterval);
+	myPhaseTimes[Neighbors] += elapsed(start);
+
+	start = Clock::now();
+	computeDensities();
+	computeFactors();
+	myPhaseTimes[Forces] += elapsed(start);
+
+	start = Clock::now();
+	myDivergenceIterations = std::max(myDivergenceIterations, solve(dt, false, tolerance, maxIterations, error));
+	myPhaseTimes[Divergence] += elapsed(start);
+}
+
+void
+FluidSolver::writeChannels(float* const* channels, int32_t count) const
+{
+	count = std::min(count, numParticles());
+	const float inverse = 1.0f / myRestDensity;
+
+	// Scattered back to the order the particles were built in
+	parallelFor(numParticles(), [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const int32_t id = myIds[i];
+			if (id >= count)
+				continue;
+			channels[TX][id] = myX[i * 3 + 0];
+			channels[TY][id] = myX[i * 3 + 1];
+			channels[TZ][id] = myX[i * 3 + 2];
+			channels[VX][id] = myV[i * 3 + 0];
+			channels[VY][id] = myV[i * 3 + 1];
+			channels[VZ][id] = myV[i * 3 + 2];
+			channels[Density][id] = myDensity[i] * inverse;
+		}
+	}, 4096);
+}
@@ -0,0 +1,206 @@
+/*
+ * Particle fluid for the CHOP's Fluid mode, solved with divergence-free SPH
+ * (DFSPH).
+ *
+ * Each particle stands for a cube of fluid 'spacing' wide at the rest
+ * density, and sees the particles within twice that. Every step, after
+ * gravity and viscosity, two pressure solves correct the velocities. Before
+ * the particles move, the density solve pushes apart those that would end
+ * up denser than the rest density, and after they've moved, the divergence
+ * solve stops those still closing in on each other. Both are Jacobi
+ * iterations, run until the mean error left is under 'tolerance', and only
+ * ever push, so the free surface doesn't clump. The kernel gradients between
+ * neighbours are computed once after the particles move, so an iteration is
+ * only a pass over the neighbour lists.
+ *
+ * Steps are split into equal substeps, short enough that no particle moves
+ * more than a fraction of the spacing in one.
+ *
+ * Neighbours come from a compact hashed grid. Only cells that hold particles
+ * are stored, found through a hash table of their cell coordinates, so the
+ * grid costs the same however far the fluid splashes. Every 'sortInterval'
+ * substeps the particles are re-sorted by the Morton code of their cell, so
+ * particles close in space are close in memory, and the neighbour lists
+ * built each substep stay cache friendly.
+ *
+ * The fluid starts as a column against one side of an open tank. Its walls
+ * act as more of the particles' lattice carried on behind them, adding to
+ * the density of the particles near them and pushing back in the pressure
+ * solves, so the fluid rests on the floor without piling into it.
+ */
+
+#ifndef __FluidSolver__
+#define __FluidSolver__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// What the particles are made from, changing any of it starts over
+struct FluidScene
+{
+	int32_t		count = 20000;
+	float		spacing = 0.02f;
+	// Of the tank, which stands on y = 0 centered on the origin
+	float		width = 2.0f;
+	float		depth = 1.0f;
+
+	bool		operator==(const FluidScene& other) const;
+	bool		operator!=(const FluidScene& other) const { return !(*this == other); }
+};
+
+struct FluidSettings
+{
+	float		gravity[3] = { 0.0f, -9.8f, 0.0f };
+	// Kinematic viscosity
+	float		viscosity = 0.001f;
+	// Mean density error the solves leave, as a fraction of the rest density
+	float		tolerance = 0.001f;
+	int32_t		maxIterations = 50;
+	// Substeps between Morton re-sorts
+	int32_t		sortInterval = 8;
+};
+
+class FluidSolver
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		VX, VY, VZ,
+		// Relative to the rest density
+		Density,
+		NumChannels
+	};
+
+	// Phases timed by step()
+	enum Phase
+	{
+		Neighbors = 0,
+		Forces,
+		Pressure,
+		Divergence,
+		NumPhases
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	FluidSolver();
+
+	void			build(const FluidScene& scene);
+	bool			needsBuild(const FluidScene& scene) const { return !myValid || scene != myScene; }
+
+	void			step(const FluidSettings& settings, float dt);
+
+	// Writes every particle into the NumChannels arrays, at most 'count',
+	// in the order they were built in
+	void			writeChannels(float* const* channels, int32_t count) const;
+
+	int32_t			numParticles() const { return static_cast<int32_t>(myIds.size()); }
+	// Of the last step, times summed and the rest the most of any substep
+	double			phaseTime(Phase phase) const { return myPhaseTimes[phase]; }
+	int32_t			substeps() const { return mySubsteps; }
+	int32_t			iterations() const { return myIterations; }
+	int32_t			divergenceIterations() const { return myDivergenceIterations; }
+	float			densityError() const { return myDensityError; }
+	float			meanNeighbors() const;
+	int32_t			usedCells() const { return myCellCount; }
+	// Sorts since the build
+	int32_t			sorts() const { return mySorts; }
+
+private:
+	void			advance(const FluidSettings& settings, float dt);
+	float			maxSpeed() const;
+
+	// Keys, a sort if one is due, the grid and the neighbour lists
+	void			findNeighbors(int32_t sortInterval);
+	// Key of every particle's cell
+	void			computeKeys();
+	// Particles sorted by their cell's key, which is its Morton code
+	void			sortParticles();
+	void			buildGrid();
+	void			buildNeighbors();
+	// Calls fn(i, j) for every particle j within reach of a particle i of
+	// cell c, looking each of the 27 cells around c up once
+	template <typename F>
+	void			forNeighbors(int32_t c, F&& fn) const;
+
+	void			computeDensities();
+	// Kernel gradients to the neighbours and walls, and the factor turning a
+	// particle's density error into its stiffness
+	void			computeFactors();
+	void			computeForces(const FluidSettings& settings);
+	// Iterates on the velocities until the mean density error, or with
+	// 'density' false the mean rate the density grows at over dt, is under
+	// 'tolerance'. Returns the iterations and sets the error left.
+	int32_t			solve(float dt, bool density, float tolerance, int32_t maxIterations, float& error);
+
+	// Density the walls add at p, and the sum of their kernel gradients
+	// added to 'gradient' if it isn't null
+	float			addWalls(const float* p, float* gradient) const;
+	void			confine(float* p, float* v) const;
+	// Index of the used cell with this key, -1 if there's none
+	int32_t			findCell(uint64_t key) const;
+
+	FluidScene				myScene;
+	bool					myValid;
+
+	float					myMass;
+	float					myRadius;
+	float					myRestDensity;
+	// Walls' density and gradient by the distance to them, over the kernel
+	// radius
+	std::vector<float>		myWallDensity;
+	std::vector<float>		myWallGradient;
+
+	// 3 floats per particle
+	std::vector<float>		myX;
+	std::vector<float>		myV;
+	std::vector<float>		myForces;
+	std::vector<float>		myWallGradients;
+	// 1 per particle
+	std::vector<float>		myDensity;
+	std::vector<float>		myFactors;
+	// Pressure over density squared, of the solve's last iteration
+	std::vector<float>		myStiffness;
+	// Index each particle had when built
+	std::vector<int32_t>	myIds;
+
+	// Used cells, the particles of cell c being
+	// myCellParticles[myCellStart[c] .. myCellStart[c + 1] - 1]
+	std::vector<uint64_t>	myCellKeys;
+	std::vector<int32_t>	myCellStart;
+	std::vector<int32_t>	myCellParticles;
+	std::vector<int32_t>	myParticleCell;
+	// Key of each particle's cell
+	std::vector<uint64_t>	myKeys;
+	// Open addressing from a cell's key to its index in the used cells
+	std::vector<uint64_t>	myTableKeys;
+	std::vector<int32_t>	myTableCells;
+	int32_t					myTableBits;
+	int32_t					myCellCount;
+
+	// Particle i's neighbours are
+	// myNeighbors[myNeighborStart[i] .. myNeighborStart[i + 1] - 1], with
+	// the mass times the kernel gradient to each, 3 floats per neighbour
+	std::vector<int32_t>	myNeighborStart;
+	std::vector<int32_t>	myNeighbors;
+	std::vector<float>		myGradients;
+
+	std::vector<std::pair<uint64_t, int32_t>>	myOrder;
+	std::vector<float>		myScratch;
+	std::vector<int32_t>	myScratchIds;
+	// Velocities of the solve's next iteration, 3 floats per particle
+	std::vector<float>		myNextV;
+	// Substeps since the last sort
+	int32_t					mySinceSort;
+
+	double					myPhaseTimes[NumPhases];
+	int32_t					myIterations;
+	int32_t					myDivergenceIterations;
+	float					myDensityError;
+	int32_t					mySorts;
+	int32_t					mySubsteps;
+};
+
+#endif
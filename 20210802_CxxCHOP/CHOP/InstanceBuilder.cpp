@@ -0,0 +1,228 @@
+/*
+ * See InstanceBuilder.h
+ */
+
+#include "InstanceBuilder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
+static const char* SourceNames[static_cast<int>(InstanceSource::NumSources)] =
+{
+	"zero", "one",
+	"r", "g", "b", "a",
+	"lum",
+	"u", "v",
+	"x", "y"
+};
+
+bool
+InstanceRule::operator==(const InstanceRule& other) const
+{
+	return source == other.source &&
+		gain == other.gain &&
+		offset == other.offset;
+}
+
+const char*
+InstanceBuilder::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"rx", "ry", "rz",
+		"sx", "sy", "sz",
+		"r", "g", "b"
+	};
+	return names[channel];
+}
+
+int32_t
+InstanceBuilder::findChannel(const char* name)
+{
+	for (int32_t c = 0; c < NumChannels; c++)
+	{
+		if (!strcmp(name, channelName(c)))
+			return c;
+	}
+	return -1;
+}
+
+int32_t
+InstanceBuilder::findSource(const char* name)
+{
+	for (int32_t s = 0; s < static_cast<int32_t>(InstanceSource::NumSources); s++)
+	{
+		if (!strcmp(name, SourceNames[s]))
+			return s;
+	}
+	return -1;
+}
+
+void
+InstanceBuilder::defaultRules(InstanceRule rules[NumChannels])
+{
+	for (int32_t c = 0; c < NumChannels; c++)
+		rules[c] = InstanceRule();
+
+	rules[TX].source = InstanceSource::X;
+	rules[TY].source = InstanceSource::Y;
+	rules[SX].source = InstanceSource::One;
+	rules[SY].source = InstanceSource::One;
+	rules[SZ].source = InstanceSource::One;
+	rules[R].source = InstanceSource::Red;
+	rules[G].source = InstanceSource::Green;
+	rules[B].source = InstanceSource::Blue;
+}
+
+InstanceBuilder::InstanceBuilder() :
+	myWidth(0),
+	myHeight(0),
+	myAllDirty(true)
+{
+	defaultRules(myRules);
+}
+
+void
+InstanceBuilder::setRules(const InstanceRule rules[NumChannels])
+{
+	for (int32_t c = 0; c < NumChannels; c++)
+	{
+		if (rules[c] != myRules[c])
+		{
+			myRules[c] = rules[c];
+			myAllDirty = true;
+		}
+	}
+}
+
+void
+InstanceBuilder::clear()
+{
+	myWidth = 0;
+	myHeight = 0;
+	myAllDirty = true;
+	myPixels.clear();
+	for (int32_t c = 0; c < NumChannels; c++)
+		myChannels[c].clear();
+}
+
+void
+InstanceBuilder::buildRow(int32_t y, const float* row)
+{
+	const size_t first = static_cast<size_t>(y) * myWidth;
+	const float invW = myWidth > 1 ? 1.0f / (myWidth - 1) : 0.0f;
+	const float v = myHeight > 1 ? float(y) / (myHeight - 1) : 0.0f;
+
+	// One channel at a time, so the inner loops don't branch on the source
+	for (int32_t c = 0; c < NumChannels; c++)
+	{
+		const InstanceRule& rule = myRules[c];
+		float* dst = myChannels[c].data() + first;
+
+		switch (rule.source)
+		{
+			case InstanceSource::Red:
+			case InstanceSource::Green:
+			case InstanceSource::Blue:
+			case InstanceSource::Alpha:
+			{
+				const int comp = static_cast<int>(rule.source) - static_cast<int>(InstanceSource::Red);
+				for (int32_t x = 0; x < myWidth; x++)
+					dst[x] = row[x * 4 + comp] * rule.gain + rule.offset;
+				break;
+			}
+
+			case InstanceSource::Luminance:
+				for (int32_t x = 0; x < myWidth; x++)
+				{
+					const float* p = row + x * 4;
+					dst[x] = (0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2]) * rule.gain + rule.offset;
+				}
+				break;
+
+			case InstanceSource::U:
+			case InstanceSource::X:
+			{
+				const float shift = rule.source == InstanceSource::X ? -0.5f : 0.0f;
+				for (int32_t x = 0; x < myWidth; x++)
+					dst[x] = (x * invW + shift) * rule.gain + rule.offset;
+				break;
+			}
+
+			case InstanceSource::V:
+			case InstanceSource::Y:
+			{
+				const float shift = rule.source == InstanceSource::Y ? -0.5f : 0.0f;
+				std::fill(dst, dst + myWidth, (v + shift) * rule.gain + rule.offset);
+				break;
+			}
+
+			case InstanceSource::One:
+				std::fill(dst, dst + myWidth, rule.gain + rule.offset);
+				break;
+
+			case InstanceSource::Zero:
+			default:
+				std::fill(dst, dst + myWidth, rule.offset);
+				break;
+		}
+	}
+}
+
+int32_t
+InstanceBuilder::update(const float* pixels, int32_t width, int32_t height)
+{
+	if (width != myWidth || height != myHeight)
+	{
+		myWidth = width;
+		myHeight = height;
+		myPixels.resize(static_cast<size_t>(width) * height * 4);
+		for (int32_t c = 0; c < NumChannels; c++)
+			myChannels[c].resize(static_cast<size_t>(width) * height);
+		myAllDirty = true;
+	}
+
+	const size_t rowFloats = static_cast<size_t>(width) * 4;
+	const bool all = myAllDirty;
+	std::atomic<int32_t> rowsUpdated(0);
+
+	parallelFor(height, [&](int begin, int end)
+	{
+		int32_t updated = 0;
+		for (int y = begin; y < end; y++)
+		{
+			const float* src = pixels + y * rowFloats;
+			float* kept = myPixels.data() + y * rowFloats;
+			if (!all && !memcmp(src, kept, rowFloats * sizeof(float)))
+				continue;
+
+			memcpy(kept, src, rowFloats * sizeof(float));
+			buildRow(y, kept);
+			updated++;
+		}
+		rowsUpdated += updated;
+	}, 16);
+
+	myAllDirty = false;
+	return rowsUpdated;
+}
+
+int32_t
+InstanceBuilder::refresh()
+{
+	if (!myAllDirty || myPixels.empty())
+		return 0;
+
+	const size_t rowFloats = static_cast<size_t>(myWidth) * 4;
+	parallelFor(myHeight, [&](int begin, int end)
+	{
+		for (int y = begin; y < end; y++)
+			buildRow(y, myPixels.data() + y * rowFloats);
+	}, 16);
+
+	myAllDirty = false;
+	return myHeight;
+}
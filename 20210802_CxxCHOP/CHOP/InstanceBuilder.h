@@ -0,0 +1,98 @@
+/*
+ * Builds per-instance transform and color channels from the pixels of an
+ * image, for the CHOP's Instances mode.
+ *
+ * Every pixel is one instance, in row order from the bottom row up. Each
+ * output channel is given by a rule: a per-pixel source (a color component,
+ * luminance, uv or the centered grid position) times a gain plus an offset.
+ * A copy of the last image is kept, so an update only recomputes the rows
+ * whose pixels changed. A change of rules or size recomputes everything.
+ */
+
+#ifndef __InstanceBuilder__
+#define __InstanceBuilder__
+
+#include <stdint.h>
+#include <vector>
+
+enum class InstanceSource
+{
+	Zero = 0,
+	One,
+	Red,
+	Green,
+	Blue,
+	Alpha,
+	Luminance,
+	U,
+	V,
+	// u - 0.5 and v - 0.5
+	X,
+	Y,
+	NumSources
+};
+
+struct InstanceRule
+{
+	InstanceSource	source = InstanceSource::Zero;
+	float			gain = 1.0f;
+	float			offset = 0.0f;
+
+	bool		operator==(const InstanceRule& other) const;
+	bool		operator!=(const InstanceRule& other) const { return !(*this == other); }
+};
+
+class InstanceBuilder
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		RX, RY, RZ,
+		SX, SY, SZ,
+		R, G, B,
+		NumChannels
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	// Name lookups for parsing rules, return -1 if unknown
+	static int32_t		findChannel(const char* name);
+	static int32_t		findSource(const char* name);
+
+	// A grid of unit size in xy, unit scale, colored by the pixels
+	static void			defaultRules(InstanceRule rules[NumChannels]);
+
+	InstanceBuilder();
+
+	void			setRules(const InstanceRule rules[NumChannels]);
+
+	// 'pixels' is width * height RGBA32F pixels. Recomputes the rows that
+	// differ from the last update and returns how many that were.
+	int32_t			update(const float* pixels, int32_t width, int32_t height);
+
+	// Rebuilds everything from the kept copy of the pixels if the rules
+	// changed since the last update. Returns the number of rows rebuilt.
+	int32_t			refresh();
+
+	// Drops the instances, e.g. when the TOP is unset
+	void			clear();
+
+	int32_t			numInstances() const { return myWidth * myHeight; }
+	const float*	channel(int32_t c) const { return myChannels[c].data(); }
+
+private:
+	void			buildRow(int32_t y, const float* row);
+
+	InstanceRule			myRules[NumChannels];
+
+	int32_t					myWidth;
+	int32_t					myHeight;
+	bool					myAllDirty;
+
+	// The pixels the channels were last built from
+	std::vector<float>		myPixels;
+	std::vector<float>		myChannels[NumChannels];
+};
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * See ParticlePool.h
+ */
+
+#include "ParticlePool.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float Pi = 3.14159265358979f;
+
+// Most children a single death can spawn, and deepest generation, so the
+// generation fits in a byte
+static const int32_t MaxChildren = 64;
+static const int32_t MaxGenerations = 16;
+
+const char*
+ParticlePool::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"vx", "vy", "vz",
+		"age",
+		"alive",
+		"generation"
+	};
+	return names[channel];
+}
+
+ParticlePool::ParticlePool() :
+	mySpawnCarry(0.0),
+	myRandom(0x2545F491u),
+	mySpawned(0),
+	myKilled(0),
+	myDropped(0)
+{
+}
+
+void
+ParticlePool::reset(int32_t capacity)
+{
+	capacity = std::max(capacity, 1);
+	const size_t size = static_cast<size_t>(capacity);
+
+	myPX.assign(size, 0.0f);
+	myPY.assign(size, 0.0f);
+	myPZ.assign(size, 0.0f);
+	myVX.assign(size, 0.0f);
+	myVY.assign(size, 0.0f);
+	myVZ.assign(size, 0.0f);
+	myAge.assign(size, 0.0f);
+	myLife.assign(size, 1.0f);
+	myGeneration.assign(size, 0);
+	myAlive.assign(size, 0);
+
+	// Pushed in reverse so slot 0 is handed out first
+	myFree.resize(size);
+	for (int32_t i = 0; i < capacity; i++)
+		myFree[i] = capacity - 1 - i;
+
+	mySpawnCarry = 0.0;
+	mySpawned = 0;
+	myKilled = 0;
+	myDropped = 0;
+}
+
+float
+ParticlePool::random()
+{
+	// xorshift32, only used from the serial part of the step
+	myRandom ^= myRandom << 13;
+	myRandom ^= myRandom >> 17;
+	myRandom ^= myRandom << 5;
+	return (myRandom >> 8) / float(1 << 24);
+}
+
+void
+ParticlePool::randomDirection(const float direction[3], float spread, float out[3])
+{
+	float d[3] = { direction[0], direction[1], direction[2] };
+	float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	if (length < 1.0e-6f)
+	{
+		d[0] = 0.0f;
+		d[1] = 1.0f;
+		d[2] = 0.0f;
+	}
+	else
+	{
+		for (int i = 0; i < 3; i++)
+			d[i] /= length;
+	}
+
+	// Two axes perpendicular to d
+	float a[3];
+	if (std::fabs(d[0]) < 0.9f)
+	{
+		a[0] = 0.0f;
+		a[1] = d[2];
+		a[2] = -d[1];
+	}
+	else
+	{
+		a[0] = -d[2];
+		a[1] = 0.0f;
+		a[2] = d[0];
+	}
+	length = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+	for (int i = 0; i < 3; i++)
+		a[i] /= length;
+	const float b[3] =
+	{
+		d[1] * a[2] - d[2] * a[1],
+		d[2] * a[0] - d[0] * a[2],
+		d[0] * a[1] - d[1] * a[0]
+	};
+
+	// Uniform over the spherical cap
+	const float angle = std::min(std::max(spread, 0.0f), 180.0f) * Pi / 180.0f;
+	const float cosTheta = 1.0f - random() * (1.0f - std::cos(angle));
+	const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+	const float phi = 2.0f * Pi * random();
+	const float ca = sinTheta * std::cos(phi);
+	const float cb = sinTheta * std::sin(phi);
+	for (int i = 0; i < 3; i++)
+		out[i] = d[i] * cosTheta + a[i] * ca + b[i] * cb;
+}
+
+int32_t
+ParticlePool::allocate()
+{
+	if (myFree.empty())
+		return -1;
+	const int32_t slot = myFree.back();
+	myFree.pop_back();
+	return slot;
+}
+
+void
+ParticlePool::spawn(const float position[3], const float velocity[3], float life, uint8_t generation)
+{
+	const int32_t slot = allocate();
+	if (slot < 0)
+	{
+		myDropped++;
+		return;
+	}
+
+	myPX[slot] = position[0];
+	myPY[slot] = position[1];
+	myPZ[slot] = position[2];
+	myVX[slot] = velocity[0];
+	myVY[slot] = velocity[1];
+	myVZ[slot] = velocity[2];
+	myAge[slot] = 0.0f;
+	myLife[slot] = std::max(life, 1.0e-3f);
+	myGeneration[slot] = generation;
+	myAlive[slot] = 1;
+	mySpawned++;
+}
+
+void
+ParticlePool::step(const ParticleSettings& settings, float dt)
+{
+	mySpawned = 0;
+	myKilled = 0;
+	myDropped = 0;
+
+	const int32_t count = capacity();
+	if (count == 0 || dt <= 0.0f)
+		return;
+
+	// Integrate every live slot, each partition collecting its own deaths so
+	// the workers never share a list
+	const int32_t partitions = std::min(parallelWorkerCount(), std::max(1, count / 4096));
+	if (static_cast<int32_t>(myDeaths.size()) < partitions)
+		myDeaths.resize(partitions);
+
+	const float damping = std::exp(-std::max(settings.drag, 0.0f) * dt);
+	const float gx = settings.gravity[0] * dt;
+	const float gy = settings.gravity[1] * dt;
+	const float gz = settings.gravity[2] * dt;
+
+	parallelFor(partitions, [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			std::vector<int32_t>& deaths = myDeaths[p];
+			deaths.clear();
+			const int32_t first = static_cast<int32_t>(static_cast<int64_t>(count) * p / partitions);
+			const int32_t last = static_cast<int32_t>(static_cast<int64_t>(count) * (p + 1) / partitions);
+			for (int32_t i = first; i < last; i++)
+			{
+				if (!myAlive[i])
+					continue;
+				myVX[i] = myVX[i] * damping + gx;
+				myVY[i] = myVY[i] * damping + gy;
+				myVZ[i] = myVZ[i] * damping + gz;
+				myPX[i] += myVX[i] * dt;
+				myPY[i] += myVY[i] * dt;
+				myPZ[i] += myVZ[i] * dt;
+				myAge[i] += dt;
+				if (myAge[i] >= myLife[i])
+					deaths.push_back(i);
+			}
+		}
+	}, 1);
+
+	// Retire the dead, spawning their children where they died
+	const int32_t children = std::min(std::max(settings.childCount, 0), MaxChildren);
+	const int32_t generations = std::min(std::max(settings.generations, 1), MaxGenerations);
+	for (int32_t p = 0; p < partitions; p++)
+	{
+		for (int32_t i : myDeaths[p])
+		{
+			const float position[3] = { myPX[i], myPY[i], myPZ[i] };
+			const float velocity[3] = { myVX[i], myVY[i], myVZ[i] };
+			const float life = myLife[i];
+			const int32_t generation = myGeneration[i] + 1;
+
+			myAlive[i] = 0;
+			myFree.push_back(i);
+			myKilled++;
+
+			if (generation >= generations)
+				continue;
+			for (int32_t c = 0; c < children; c++)
+			{
+				float direction[3];
+				randomDirection(velocity, 180.0f, direction);
+				float childVelocity[3];
+				for (int k = 0; k < 3; k++)
+					childVelocity[k] = velocity[k] + direction[k] * settings.childSpeed;
+				const float variance = 1.0f + settings.lifeVariance * (2.0f * random() - 1.0f);
+				spawn(position, childVelocity, life * settings.childLife * variance, static_cast<uint8_t>(generation));
+			}
+		}
+	}
+
+	// Emit, spreading the new particles over the step so they don't bunch up
+	mySpawnCarry += std::max(settings.rate, 0.0f) * dt;
+	const int64_t emit = static_cast<int64_t>(mySpawnCarry);
+	mySpawnCarry -= static_cast<double>(emit);
+	for (int64_t n = 0; n < emit; n++)
+	{
+		float direction[3];
+		randomDirection(settings.direction, settings.spread, direction);
+		float velocity[3];
+		for (int k = 0; k < 3; k++)
+			velocity[k] = direction[k] * settings.speed;
+		const float offset = random() * dt;
+		const float position[3] =
+		{
+			settings.position[0] + velocity[0] * offset,
+			settings.position[1] + velocity[1] * offset,
+			settings.position[2] + velocity[2] * offset
+		};
+		const float variance = 1.0f + settings.lifeVariance * (2.0f * random() - 1.0f);
+		spawn(position, velocity, settings.life * variance, 0);
+	}
+}
+
+void
+ParticlePool::writeChannels(float* const* channels, int32_t count) const
+{
+	count = std::min(count, capacity());
+
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			if (!myAlive[i])
+			{
+				for (int c = 0; c < NumChannels; c++)
+					channels[c][i] = 0.0f;
+				continue;
+			}
+			channels[TX][i] = myPX[i];
+			channels[TY][i] = myPY[i];
+			channels[TZ][i] = myPZ[i];
+			channels[VX][i] = myVX[i];
+			channels[VY][i] = myVY[i];
+			channels[VZ][i] = myVZ[i];
+			channels[Age][i] = std::min(myAge[i] / myLife[i], 1.0f);
+			channels[Alive][i] = 1.0f;
+			channels[Generation][i] = static_cast<float>(myGeneration[i]);
+		}
+	}, 4096);
+}
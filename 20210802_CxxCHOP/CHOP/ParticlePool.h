@@ -0,0 +1,113 @@
+/*
+ * Fixed-capacity particle engine for the CHOP's Particles mode, e.g. the
+ * sparks of a sparkler.
+ *
+ * Particles live in a pool of structure-of-arrays slots allocated once for
+ * the capacity. Dead slots go on a free list and new particles are taken
+ * from it, so spawning and dying never allocate. When the free list is empty
+ * new particles are dropped.
+ *
+ * The emitter spawns generation 0 particles at a steady rate. A particle
+ * that dies spawns childCount children at its last position while its
+ * generation is below 'generations', which gives branching sparks. Motion is
+ * integrated in parallel with gravity and linear drag.
+ *
+ * The output has one sample per slot, dead slots have every channel at 0, so
+ * the 'alive' channel can be used as the instance scale.
+ */
+
+#ifndef __ParticlePool__
+#define __ParticlePool__
+
+#include <stdint.h>
+#include <vector>
+
+struct ParticleSettings
+{
+	// Particles per second from the emitter
+	float		rate = 200.0f;
+	float		position[3] = { 0.0f, 0.0f, 0.0f };
+	float		direction[3] = { 0.0f, 1.0f, 0.0f };
+	float		speed = 4.0f;
+	// Half angle of the emission cone, in degrees
+	float		spread = 20.0f;
+	// Lifetime in seconds, varied by up to +-lifeVariance of itself
+	float		life = 1.0f;
+	float		lifeVariance = 0.3f;
+	float		gravity[3] = { 0.0f, -9.8f, 0.0f };
+	float		drag = 1.0f;
+
+	// Children spawned by each dying particle below 'generations'
+	int32_t		childCount = 8;
+	int32_t		generations = 2;
+	float		childSpeed = 2.0f;
+	// Child lifetime as a fraction of the parent's
+	float		childLife = 0.5f;
+};
+
+class ParticlePool
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		VX, VY, VZ,
+		// Age over lifetime, 0 to 1
+		Age,
+		Alive,
+		Generation,
+		NumChannels
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	ParticlePool();
+
+	// Kills every particle and resizes the pool if 'capacity' changed
+	void			reset(int32_t capacity);
+
+	void			step(const ParticleSettings& settings, float dt);
+
+	// Writes every slot into the NumChannels arrays, at most 'count' slots
+	void			writeChannels(float* const* channels, int32_t count) const;
+
+	int32_t			capacity() const { return static_cast<int32_t>(myAlive.size()); }
+	int32_t			live() const { return capacity() - static_cast<int32_t>(myFree.size()); }
+	// Counts of the last step
+	int32_t			spawned() const { return mySpawned; }
+	int32_t			killed() const { return myKilled; }
+	int32_t			dropped() const { return myDropped; }
+
+private:
+	// Takes a slot off the free list, -1 if there is none
+	int32_t			allocate();
+	void			spawn(const float position[3], const float velocity[3], float life, uint8_t generation);
+
+	float			random();
+	// Random unit vector within 'spread' degrees of 'direction'
+	void			randomDirection(const float direction[3], float spread, float out[3]);
+
+	// Slots
+	std::vector<float>		myPX, myPY, myPZ;
+	std::vector<float>		myVX, myVY, myVZ;
+	std::vector<float>		myAge;
+	std::vector<float>		myLife;
+	std::vector<uint8_t>	myGeneration;
+	std::vector<uint8_t>	myAlive;
+
+	// Free slots, used as a stack so recently freed ones are reused first
+	std::vector<int32_t>	myFree;
+
+	// Slots that died in the last integration, per partition
+	std::vector<std::vector<int32_t>>	myDeaths;
+
+	// Fraction of a particle the emitter owes from the last step
+	double					mySpawnCarry;
+	uint32_t				myRandom;
+
+	int32_t					mySpawned;
+	int32_t					myKilled;
+	int32_t					myDropped;
+};
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * See ProximityEdges.h
+ */
+
+#include "ProximityEdges.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Points per parallel task, below this a loop isn't worth sending to other
+// threads
+static const int32_t MinPerTask = 256;
+static const uint64_t EmptyKey = ~0ull;
+// Cell coordinates are stored in 21 bits each, offset to be positive
+static const int32_t CellBits = 21;
+static const int32_t CellOffset = 1 << (CellBits - 1);
+
+static inline int32_t
+cellCoord(float v, float inverse)
+{
+	const float c = std::floor(v * inverse);
+	return static_cast<int32_t>(std::min(std::max(c, float(-CellOffset)), float(CellOffset - 1)));
+}
+
+static inline uint64_t
+cellKey(int32_t x, int32_t y, int32_t z)
+{
+	const uint64_t mask = (1ull << CellBits) - 1;
+	return (uint64_t(x + CellOffset) & mask) |
+		(uint64_t(y + CellOffset) & mask) << CellBits |
+		(uint64_t(z + CellOffset) & mask) << (2 * CellBits);
+}
+
+static inline uint64_t
+hashKey(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return key;
+}
+
+const char*
+ProximityEdges::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"x1", "y1", "z1",
+		"x2", "y2", "z2",
+		"alpha",
+		"point1",
+		"point2"
+	};
+	return names[channel];
+}
+
+ProximityEdges::ProximityEdges() :
+	myDropped(0)
+{
+}
+
+int32_t
+ProximityEdges::findCell(uint64_t key) const
+{
+	const size_t mask = myTableKeys.size() - 1;
+	for (size_t slot = hashKey(key) & mask; ; slot = (slot + 1) & mask)
+	{
+		if (myTableKeys[slot] == key)
+			return myTableCells[slot];
+		if (myTableKeys[slot] == EmptyKey)
+			return -1;
+	}
+}
+
+void
+ProximityEdges::buildGrid(float radius)
+{
+	const int32_t n = numPoints();
+	const float inverse = 1.0f / radius;
+
+	myOrder.resize(n);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float* p = &myPoints[i * 3];
+			myOrder[i] = std::make_pair(cellKey(cellCoord(p[0], inverse), cellCoord(p[1], inverse),
+				cellCoord(p[2], inverse)), i);
+		}
+	}, MinPerTask);
+	std::sort(myOrder.begin(), myOrder.end());
+
+	myCellStart.clear();
+	for (int32_t i = 0; i < n; i++)
+	{
+		if (i == 0 || myOrder[i].first != myOrder[i - 1].first)
+			myCellStart.push_back(i);
+	}
+	const int32_t cells = static_cast<int32_t>(myCellStart.size());
+	myCellStart.push_back(n);
+
+	// At most half full
+	size_t size = 16;
+	while (size < static_cast<size_t>(cells) * 2)
+		size *= 2;
+	myTableKeys.assign(size, EmptyKey);
+	myTableCells.resize(size);
+	for (int32_t c = 0; c < cells; c++)
+	{
+		const uint64_t key = myOrder[myCellStart[c]].first;
+		size_t slot = hashKey(key) & (size - 1);
+		while (myTableKeys[slot] != EmptyKey)
+			slot = (slot + 1) & (size - 1);
+		myTableKeys[slot] = key;
+		myTableCells[slot] = c;
+	}
+}
+
+void
+ProximityEdges::build(const float* xyz, int32_t count, const EdgeSettings& settings)
+{
+	mySettings = settings;
+	mySettings.radius = std::max(settings.radius, 1.0e-6f);
+	mySettings.maxPerPoint = std::max(settings.maxPerPoint, 1);
+	mySettings.maxEdges = std::max(settings.maxEdges, 0);
+
+	const int32_t n = std::max(count, 0);
+	myPoints.assign(xyz, xyz + static_cast<size_t>(n) * 3);
+	myEdges.clear();
+	myDropped = 0;
+	buildGrid(mySettings.radius);
+
+	// Each point's nearest points after it, found in parallel. The count
+	// keeps every pair found, so the ones the limits drop can be counted.
+	const int32_t slots = mySettings.maxPerPoint;
+	const float radius = mySettings.radius;
+	const float inverse = 1.0f / radius;
+	myCandidates.resize(static_cast<size_t>(n) * slots);
+	myCandidateCounts.assign(n, 0);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float* p = &myPoints[i * 3];
+			const int32_t cx = cellCoord(p[0], inverse);
+			const int32_t cy = cellCoord(p[1], inverse);
+			const int32_t cz = cellCoord(p[2], inverse);
+			Edge* nearest = &myCandidates[static_cast<size_t>(i) * slots];
+			int32_t found = 0;
+
+			for (int32_t dz = -1; dz <= 1; dz++)
+			for (int32_t dy = -1; dy <= 1; dy++)
+			for (int32_t dx = -1; dx <= 1; dx++)
+			{
+				const int32_t c = findCell(cellKey(cx + dx, cy + dy, cz + dz));
+				if (c < 0)
+					continue;
+				for (int32_t k = myCellStart[c]; k < myCellStart[c + 1]; k++)
+				{
+					const int32_t j = myOrder[k].second;
+					if (j <= i)
+						continue;
+					const float* q = &myPoints[j * 3];
+					const float d[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+					const float d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+					if (d2 >= radius * radius)
+						continue;
+
+					// Insertion into the nearest so far, dropping the furthest
+					// once they're full
+					const float distance = std::sqrt(d2);
+					int32_t slot = std::min(found, slots);
+					if (slot == slots && distance >= nearest[slots - 1].distance)
+					{
+						found++;
+						continue;
+					}
+					if (slot == slots)
+						slot--;
+					while (slot > 0 && nearest[slot - 1].distance > distance)
+					{
+						nearest[slot] = nearest[slot - 1];
+						slot--;
+					}
+					nearest[slot] = Edge{ i, j, distance };
+					found++;
+				}
+			}
+			myCandidateCounts[i] = found;
+		}
+	}, MinPerTask);
+
+	// Accepted in point order, nearest first, while both ends have room
+	myDegrees.assign(n, 0);
+	int64_t pairs = 0;
+	for (int32_t i = 0; i < n; i++)
+	{
+		pairs += myCandidateCounts[i];
+		const Edge* nearest = &myCandidates[static_cast<size_t>(i) * slots];
+		const int32_t candidates = std::min(myCandidateCounts[i], slots);
+		for (int32_t c = 0; c < candidates; c++)
+		{
+			const Edge& edge = nearest[c];
+			if (static_cast<int32_t>(myEdges.size()) >= mySettings.maxEdges)
+				break;
+			if (myDegrees[edge.a] >= slots || myDegrees[edge.b] >= slots)
+				continue;
+			myDegrees[edge.a]++;
+			myDegrees[edge.b]++;
+			myEdges.push_back(edge);
+		}
+	}
+	myDropped = static_cast<int32_t>(std::min<int64_t>(pairs - static_cast<int64_t>(myEdges.size()),
+		std::numeric_limits<int32_t>::max()));
+}
+
+void
+ProximityEdges::writeChannels(float* const* channels, int32_t count) const
+{
+	const int32_t edges = std::min(numEdges(), count);
+	const float fade = std::max(mySettings.fade, 0.0f);
+	parallelFor(edges, [&](int begin, int end)
+	{
+		for (int32_t e = begin; e < end; e++)
+		{
+			const Edge& edge = myEdges[e];
+			const float* a = &myPoints[edge.a * 3];
+			const float* b = &myPoints[edge.b * 3];
+			for (int k = 0; k < 3; k++)
+			{
+				channels[X1 + k][e] = a[k];
+				channels[X2 + k][e] = b[k];
+			}
+			const float closeness = std::max(1.0f - edge.distance / mySettings.radius, 0.0f);
+			channels[Alpha][e] = fade > 0.0f ? std::pow(closeness, fade) : 1.0f;
+			channels[Point1][e] = float(edge.a);
+			channels[Point2][e] = float(edge.b);
+		}
+	}, MinPerTask);
+
+	for (int32_t c = 0; c < NumChannels; c++)
+		std::fill(channels[c] + edges, channels[c] + count, 0.0f);
+}
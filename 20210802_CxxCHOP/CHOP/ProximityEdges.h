@@ -0,0 +1,98 @@
+/*
+ * Edges between points closer than a radius, for the CHOP's Plexus mode.
+ *
+ * The points are hashed into a grid of cells one radius wide, so the points
+ * within the radius of any point are in its own cell or the 26 around it.
+ * Only cells that hold points are stored: the points are sorted by their
+ * cell's key and a hash table finds where a cell's run starts, so the grid
+ * costs the same however far apart the points are.
+ *
+ * Every point looks for the points after it within the radius, in parallel,
+ * and keeps the nearest 'maxPerPoint' as candidates. The candidates are then
+ * accepted in point order while neither end has 'maxPerPoint' edges yet, up
+ * to 'maxEdges' in all, so the output stays bounded however dense the points
+ * get and the same points always give the same edges.
+ *
+ * The output has one sample per edge with both ends, an alpha fading from 1
+ * for touching points to 0 at the radius, and the indices of the two points.
+ */
+
+#ifndef __ProximityEdges__
+#define __ProximityEdges__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+struct EdgeSettings
+{
+	float		radius = 0.5f;
+	int32_t		maxPerPoint = 8;
+	int32_t		maxEdges = 10000;
+	// Exponent of the fade, 0 keeps every edge opaque
+	float		fade = 1.0f;
+};
+
+class ProximityEdges
+{
+public:
+	enum Channel
+	{
+		X1 = 0, Y1, Z1,
+		X2, Y2, Z2,
+		Alpha,
+		Point1,
+		Point2,
+		NumChannels
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	ProximityEdges();
+
+	// Finds the edges between 'count' points, 3 floats each
+	void			build(const float* xyz, int32_t count, const EdgeSettings& settings);
+
+	// Writes every edge into the NumChannels arrays, at most 'count', and
+	// zeroes the samples past the last edge
+	void			writeChannels(float* const* channels, int32_t count) const;
+
+	int32_t			numEdges() const { return static_cast<int32_t>(myEdges.size()); }
+	int32_t			numPoints() const { return static_cast<int32_t>(myPoints.size() / 3); }
+	int32_t			usedCells() const { return static_cast<int32_t>(myCellStart.empty() ? 0 : myCellStart.size() - 1); }
+	// Pairs within the radius that a limit left out
+	int32_t			droppedEdges() const { return myDropped; }
+
+private:
+	struct Edge
+	{
+		int32_t		a;
+		int32_t		b;
+		float		distance;
+	};
+
+	void			buildGrid(float radius);
+	// Index of the used cell with this key, -1 if there's none
+	int32_t			findCell(uint64_t key) const;
+
+	EdgeSettings			mySettings;
+	std::vector<float>		myPoints;
+
+	// Points sorted by their cell's key, the points of used cell c being
+	// myOrder[myCellStart[c] .. myCellStart[c + 1] - 1]
+	std::vector<std::pair<uint64_t, int32_t>>	myOrder;
+	std::vector<int32_t>	myCellStart;
+	// Open addressing from a cell's key to its index in the used cells
+	std::vector<uint64_t>	myTableKeys;
+	std::vector<int32_t>	myTableCells;
+
+	// Nearest candidates of each point, maxPerPoint slots per point
+	std::vector<Edge>		myCandidates;
+	std::vector<int32_t>	myCandidateCounts;
+	std::vector<int32_t>	myDegrees;
+
+	std::vector<Edge>		myEdges;
+	int32_t					myDropped;
+};
+
+#endif
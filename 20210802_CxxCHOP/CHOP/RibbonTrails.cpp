@@ -0,0 +1,337 @@
+/*
+ * See RibbonTrails.h
+ */
+
+#include "RibbonTrails.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+static const float Pi = 3.14159265358979f;
+
+// Trajectories per parallel task
+static const int32_t MinPerTask = 16;
+// Moves shorter than this keep the last frame, their direction is noise
+static const float MinStep = 1.0e-6f;
+
+static inline float
+dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void
+cross(const float* a, const float* b, float* out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline void
+normalize(float* v)
+{
+	const float length = std::sqrt(dot(v, v));
+	if (length > 0.0f)
+	{
+		for (int k = 0; k < 3; k++)
+			v[k] /= length;
+	}
+}
+
+// Any unit vector perpendicular to the unit vector t
+static inline void
+perpendicular(const float* t, float* out)
+{
+	const float axis[3] = { std::abs(t[0]) < 0.9f ? 1.0f : 0.0f, std::abs(t[0]) < 0.9f ? 0.0f : 1.0f, 0.0f };
+	cross(t, axis, out);
+	normalize(out);
+}
+
+int32_t
+TrailSettings::sectionSize() const
+{
+	return shape == TrailShape::Tube ? std::max(sides, 3) : 2;
+}
+
+bool
+TrailSettings::changesSections(const TrailSettings& other) const
+{
+	return shape != other.shape || sectionSize() != other.sectionSize() || width != other.width;
+}
+
+const char*
+RibbonTrails::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"nx", "ny", "nz",
+		"u", "v"
+	};
+	return names[channel];
+}
+
+RibbonTrails::RibbonTrails() :
+	myCount(0),
+	mySectionsBuilt(0),
+	myRetired(0)
+{
+}
+
+int32_t
+RibbonTrails::vertexCount(int32_t trajectories, const TrailSettings& settings)
+{
+	return std::max(trajectories, 0) * std::max(settings.length, 2) * settings.sectionSize();
+}
+
+void
+RibbonTrails::reset()
+{
+	myCount = 0;
+	myHeads.clear();
+	mySizes.clear();
+}
+
+void
+RibbonTrails::transportFrame(int32_t t, int32_t slot, int32_t previous)
+{
+	// Double reflection: the first reflection, in the plane between the two
+	// positions, takes the old tangent close to the new one, and the second
+	// lines them up exactly. The normal follows both.
+	const size_t i0 = slotIndex(t, previous) * 3;
+	const size_t i1 = slotIndex(t, slot) * 3;
+	const float* x0 = &myPositions[i0];
+	const float* x1 = &myPositions[i1];
+	const float* t0 = &myTangents[i0];
+	const float* r0 = &myNormals[i0];
+	const float* t1 = &myTangents[i1];
+	float* r1 = &myNormals[i1];
+
+	const float v1[3] = { x1[0] - x0[0], x1[1] - x0[1], x1[2] - x0[2] };
+	const float c1 = dot(v1, v1);
+	float rL[3], tL[3];
+	for (int k = 0; k < 3; k++)
+	{
+		rL[k] = r0[k] - (2.0f / c1) * dot(v1, r0) * v1[k];
+		tL[k] = t0[k] - (2.0f / c1) * dot(v1, t0) * v1[k];
+	}
+	const float v2[3] = { t1[0] - tL[0], t1[1] - tL[1], t1[2] - tL[2] };
+	const float c2 = dot(v2, v2);
+	for (int k = 0; k < 3; k++)
+		r1[k] = c2 > 0.0f ? rL[k] - (2.0f / c2) * dot(v2, rL) * v2[k] : rL[k];
+
+	// Keeps rounding from building up along long trails
+	const float along = dot(r1, t1);
+	for (int k = 0; k < 3; k++)
+		r1[k] -= along * t1[k];
+	normalize(r1);
+}
+
+void
+RibbonTrails::buildSection(int32_t t, int32_t slot)
+{
+	const int32_t size = mySettings.sectionSize();
+	const size_t index = slotIndex(t, slot);
+	const float* p = &myPositions[index * 3];
+	const float* n = &myNormals[index * 3];
+	float b[3];
+	cross(&myTangents[index * 3], n, b);
+
+	const float half = 0.5f * mySettings.width;
+	float* out = &myVertices[index * size * 6];
+	for (int32_t s = 0; s < size; s++)
+	{
+		// A ribbon's two edges face along the normal, a tube's vertices face
+		// out from its middle
+		float offset[3], normal[3];
+		if (mySettings.shape == TrailShape::Tube)
+		{
+			const float angle = 2.0f * Pi * s / size;
+			for (int k = 0; k < 3; k++)
+				offset[k] = normal[k] = std::cos(angle) * n[k] + std::sin(angle) * b[k];
+		}
+		else
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				offset[k] = s == 0 ? -b[k] : b[k];
+				normal[k] = n[k];
+			}
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			out[s * 6 + k] = p[k] + half * offset[k];
+			out[s * 6 + 3 + k] = normal[k];
+		}
+	}
+}
+
+void
+RibbonTrails::append(const float* xyz, int32_t count, const TrailSettings& settings)
+{
+	TrailSettings clamped = settings;
+	clamped.length = std::max(settings.length, 2);
+	clamped.sides = std::max(settings.sides, 3);
+	clamped.width = std::max(settings.width, 0.0f);
+	count = std::max(count, 0);
+
+	mySectionsBuilt = 0;
+	myRetired = 0;
+
+	const int32_t length = clamped.length;
+	if (count != myCount || length != mySettings.length || myHeads.size() != static_cast<size_t>(count))
+	{
+		mySettings = clamped;
+		myCount = count;
+		myHeads.assign(count, -1);
+		mySizes.assign(count, 0);
+		const size_t slots = static_cast<size_t>(count) * length;
+		myPositions.resize(slots * 3);
+		myTangents.resize(slots * 3);
+		myNormals.resize(slots * 3);
+		myVertices.resize(slots * mySettings.sectionSize() * 6);
+	}
+	else if (clamped.changesSections(mySettings))
+	{
+		// The frames stay, only the sections around them change
+		mySettings = clamped;
+		myVertices.resize(static_cast<size_t>(count) * length * mySettings.sectionSize() * 6);
+		parallelFor(count, [&](int begin, int end)
+		{
+			for (int32_t t = begin; t < end; t++)
+			{
+				for (int32_t i = 0; i < mySizes[t]; i++)
+					buildSection(t, (myHeads[t] - i + length) % length);
+			}
+		}, MinPerTask);
+		for (int32_t t = 0; t < count; t++)
+			mySectionsBuilt += mySizes[t];
+	}
+	else
+		mySettings = clamped;
+
+	std::mutex lock;
+	parallelFor(count, [&](int begin, int end)
+	{
+		int32_t built = 0;
+		int32_t retired = 0;
+		for (int32_t t = begin; t < end; t++)
+		{
+			const float* p = &xyz[t * 3];
+			const int32_t head = myHeads[t];
+			const int32_t slot = (head + 1) % length;
+			const size_t index = slotIndex(t, slot) * 3;
+			for (int k = 0; k < 3; k++)
+				myPositions[index + k] = p[k];
+
+			if (mySizes[t] == 0)
+			{
+				// Nothing to point along yet, any frame will do until the
+				// next sample replaces it
+				const float tangent[3] = { 0.0f, 0.0f, 1.0f };
+				for (int k = 0; k < 3; k++)
+					myTangents[index + k] = tangent[k];
+				perpendicular(tangent, &myNormals[index]);
+			}
+			else
+			{
+				const size_t last = slotIndex(t, head) * 3;
+				float d[3];
+				for (int k = 0; k < 3; k++)
+					d[k] = p[k] - myPositions[last + k];
+
+				if (dot(d, d) < MinStep * MinStep)
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						myTangents[index + k] = myTangents[last + k];
+						myNormals[index + k] = myNormals[last + k];
+					}
+				}
+				else
+				{
+					normalize(d);
+					for (int k = 0; k < 3; k++)
+						myTangents[index + k] = d[k];
+
+					// The first sample's frame was a placeholder, it takes
+					// the first segment's direction
+					if (mySizes[t] == 1)
+					{
+						for (int k = 0; k < 3; k++)
+							myTangents[last + k] = d[k];
+						perpendicular(d, &myNormals[last]);
+						buildSection(t, head);
+						built++;
+					}
+					transportFrame(t, slot, head);
+				}
+			}
+
+			buildSection(t, slot);
+			built++;
+			if (mySizes[t] == length)
+				retired++;
+			myHeads[t] = slot;
+			mySizes[t] = std::min(mySizes[t] + 1, length);
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		mySectionsBuilt += built;
+		myRetired += retired;
+	}, MinPerTask);
+}
+
+void
+RibbonTrails::writeChannels(float* const* channels, int32_t count) const
+{
+	const int32_t length = mySettings.length;
+	const int32_t size = mySettings.sectionSize();
+	const int32_t vertices = std::min(numVertices(), count);
+	const int32_t perTrail = length * size;
+
+	parallelFor(myCount, [&](int begin, int end)
+	{
+		for (int32_t t = begin; t < end; t++)
+		{
+			const int32_t kept = mySizes[t];
+			if (kept == 0)
+				continue;
+			const int32_t oldest = (myHeads[t] - kept + 1 + length) % length;
+			for (int32_t i = 0; i < length; i++)
+			{
+				// Trails not yet full start with copies of their oldest sample
+				const int32_t k = std::max(i - (length - kept), 0);
+				const int32_t slot = (oldest + k) % length;
+				const float u = kept > 1 ? float(k) / (kept - 1) : 1.0f;
+				const float* section = &myVertices[slotIndex(t, slot) * size * 6];
+				for (int32_t s = 0; s < size; s++)
+				{
+					const int32_t v = t * perTrail + i * size + s;
+					if (v >= vertices)
+						return;
+					for (int c = 0; c < 6; c++)
+						channels[TX + c][v] = section[s * 6 + c];
+					channels[U][v] = u;
+					channels[V][v] = mySettings.shape == TrailShape::Tube ? float(s) / size : float(s);
+				}
+			}
+		}
+	}, MinPerTask);
+
+	// Trajectories with no samples yet, and whatever is past the trails
+	for (int32_t t = 0; t < myCount; t++)
+	{
+		if (mySizes[t] == 0)
+		{
+			const int32_t first = std::min(t * perTrail, vertices);
+			const int32_t last = std::min(first + perTrail, vertices);
+			for (int32_t c = 0; c < NumChannels; c++)
+				std::fill(channels[c] + first, channels[c] + last, 0.0f);
+		}
+	}
+	for (int32_t c = 0; c < NumChannels; c++)
+		std::fill(channels[c] + vertices, channels[c] + count, 0.0f);
+}
@@ -0,0 +1,115 @@
+/*
+ * Ribbon or tube meshes trailing behind moving points, for the CHOP's Trails
+ * mode, e.g. the heads of the LightTrail and LorenzAttractor scenes.
+ *
+ * Every trajectory keeps the last 'length' positions it was given in a ring
+ * buffer. append() adds one position to each, retiring the oldest once the
+ * ring is full, and only works out the frame and the cross section of the
+ * new sample. The frames are parallel transported along the trail with the
+ * double reflection method, so they don't twist or flip where the path
+ * curves, and a sample's cross section never changes after it was added.
+ * Writing the channels only copies the cached vertices out oldest first, so
+ * the cost of a cook follows the samples added, not the length of the
+ * trails.
+ *
+ * The output has one sample per vertex, trajectory after trajectory, each
+ * trail from its oldest sample to its newest and every sample's cross
+ * section in order: 2 vertices across a ribbon or 'sides' around a tube.
+ * Trails not yet full repeat their oldest sample. u runs from 0 at the
+ * oldest sample to 1 at the newest and v across or around the section.
+ */
+
+#ifndef __RibbonTrails__
+#define __RibbonTrails__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum class TrailShape
+{
+	Ribbon = 0,
+	Tube,
+};
+
+struct TrailSettings
+{
+	// Samples each trail keeps, changing it starts the trails over
+	int32_t		length = 100;
+	TrailShape	shape = TrailShape::Ribbon;
+	// Vertices around a tube
+	int32_t		sides = 6;
+	// Across a ribbon or a tube
+	float		width = 0.05f;
+
+	// Vertices in each sample's cross section
+	int32_t		sectionSize() const;
+	// True if going from 'other' to these changes the cached cross sections
+	bool		changesSections(const TrailSettings& other) const;
+};
+
+class RibbonTrails
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		NX, NY, NZ,
+		U, V,
+		NumChannels
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	RibbonTrails();
+
+	// Forgets every trail, the next append() starts them over
+	void			reset();
+
+	// Adds one position (3 floats) to each of 'count' trajectories. A new
+	// count or length starts the trails over, other new settings rebuild the
+	// cross sections already cached.
+	void			append(const float* xyz, int32_t count, const TrailSettings& settings);
+
+	// Writes every vertex into the NumChannels arrays, at most 'count', and
+	// zeroes the samples past the last one
+	void			writeChannels(float* const* channels, int32_t count) const;
+
+	int32_t			trajectories() const { return myCount; }
+	int32_t			numVertices() const { return myCount * mySettings.length * mySettings.sectionSize(); }
+	// Cross sections built by the last append(), new samples and rebuilds
+	int32_t			sectionsBuilt() const { return mySectionsBuilt; }
+	// Samples dropped off the end of full trails by the last append()
+	int32_t			retired() const { return myRetired; }
+
+	// Vertices for an output of 'trajectories' trails with these settings
+	static int32_t	vertexCount(int32_t trajectories, const TrailSettings& settings);
+
+private:
+	// Frame of 'slot' in trajectory 't' from the slot before it
+	void			transportFrame(int32_t t, int32_t slot, int32_t previous);
+	// Caches the vertices of the cross section at 'slot' in trajectory 't'
+	void			buildSection(int32_t t, int32_t slot);
+
+	// Index of a trajectory's slot in the per-slot arrays
+	size_t			slotIndex(int32_t t, int32_t slot) const { return static_cast<size_t>(t) * mySettings.length + slot; }
+
+	TrailSettings			mySettings;
+	int32_t					myCount;
+
+	// Per trajectory, the slot of the newest sample and how many are kept
+	std::vector<int32_t>	myHeads;
+	std::vector<int32_t>	mySizes;
+
+	// 3 floats per slot
+	std::vector<float>		myPositions;
+	std::vector<float>		myTangents;
+	std::vector<float>		myNormals;
+	// Cross section of each slot, position and normal per vertex
+	std::vector<float>		myVertices;
+
+	int32_t					mySectionsBuilt;
+	int32_t					myRetired;
+};
+
+#endif
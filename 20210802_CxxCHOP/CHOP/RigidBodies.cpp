@@ -0,0 +1,1223 @@
+/*
+ * See RigidBodies.h
+ */
+
+#include "RigidBodies.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const float Pi = 3.14159265358979f;
+
+// Bodies closer than this get contacts before they touch, so contacts don't
+// flicker on and off as resting bodies settle. The solver lets such a
+// contact close its gap within the step, but no further.
+static const float Margin = 0.02f;
+// Penetration left alone so resting contacts stay in contact, and the part
+// of the rest pushed out per step
+static const float Slop = 0.005f;
+static const float Baumgarte = 0.2f;
+// Approach speed below which nothing bounces
+static const float BounceSpeed = 0.5f;
+// A contact this close to one of the last step, in the first body's frame,
+// is taken to be the same one and starts from its impulses
+static const float WarmStartDistance = 0.05f;
+// Seconds every body of an island has to be slow for before it sleeps
+static const float TimeToSleep = 0.5f;
+// Velocity lost per second, as a rate
+static const float LinearDamping = 0.05f;
+static const float AngularDamping = 0.1f;
+// Torque against the rolling of a sphere, as a fraction of its radius times
+// the normal force, or spheres roll on forever and never let an island sleep
+static const float RollingResistance = 0.05f;
+
+static const int32_t Ground = -1;
+static const int32_t MaxContacts = 4;
+
+struct Vec3
+{
+	float		x;
+	float		y;
+	float		z;
+
+	float&			operator[](int i) { return (&x)[i]; }
+	const float&	operator[](int i) const { return (&x)[i]; }
+};
+
+static inline Vec3 operator+(const Vec3& a, const Vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+static inline Vec3 operator-(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+static inline Vec3 operator-(const Vec3& a) { return { -a.x, -a.y, -a.z }; }
+static inline Vec3 operator*(const Vec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+static inline Vec3& operator+=(Vec3& a, const Vec3& b) { a = a + b; return a; }
+static inline Vec3& operator-=(Vec3& a, const Vec3& b) { a = a - b; return a; }
+static inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline float length(const Vec3& a) { return std::sqrt(dot(a, a)); }
+
+static inline Vec3
+cross(const Vec3& a, const Vec3& b)
+{
+	return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// Rows
+struct Mat3
+{
+	Vec3		r[3];
+
+	Vec3		column(int i) const { return { r[0][i], r[1][i], r[2][i] }; }
+};
+
+static inline Vec3 operator*(const Mat3& m, const Vec3& v) { return { dot(m.r[0], v), dot(m.r[1], v), dot(m.r[2], v) }; }
+// Transpose times v
+static inline Vec3 mulT(const Mat3& m, const Vec3& v) { return m.r[0] * v.x + m.r[1] * v.y + m.r[2] * v.z; }
+
+struct Quat
+{
+	float		w;
+	float		x;
+	float		y;
+	float		z;
+};
+
+static inline Quat
+operator*(const Quat& a, const Quat& b)
+{
+	return
+	{
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+	};
+}
+
+static inline Quat
+normalize(const Quat& q)
+{
+	const float s = 1.0f / std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+	return { q.w * s, q.x * s, q.y * s, q.z * s };
+}
+
+static Mat3
+toMatrix(const Quat& q)
+{
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	Mat3 m;
+	m.r[0] = { 1.0f - 2.0f * (yy + zz), 2.0f * (xy - wz), 2.0f * (xz + wy) };
+	m.r[1] = { 2.0f * (xy + wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz - wx) };
+	m.r[2] = { 2.0f * (xz - wy), 2.0f * (yz + wx), 1.0f - 2.0f * (xx + yy) };
+	return m;
+}
+
+struct RigidBody
+{
+	Vec3		position;
+	Quat		orientation;
+	// From the orientation, its columns are the body's axes
+	Mat3		rotation;
+	Vec3		velocity;
+	Vec3		angularVelocity;
+
+	bool		sphere;
+	// Half size of a box, x is the radius of a sphere
+	Vec3		halfExtents;
+
+	float		invMass;
+	// Diagonal of the inverse inertia in the body's frame, and in the world
+	Vec3		invInertia;
+	Mat3		invInertiaWorld;
+
+	Vec3		boundsMin;
+	Vec3		boundsMax;
+
+	// Seconds the body has been slow for
+	float		sleepTime;
+	bool		asleep;
+
+	void		updateRotation()
+	{
+		rotation = toMatrix(orientation);
+		// R diag(invInertia) R^T
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				invInertiaWorld.r[i][j] = rotation.r[i][0] * invInertia.x * rotation.r[j][0] +
+					rotation.r[i][1] * invInertia.y * rotation.r[j][1] +
+					rotation.r[i][2] * invInertia.z * rotation.r[j][2];
+			}
+		}
+	}
+};
+
+struct RigidContact
+{
+	Vec3		position;
+	// Position in the first body's frame (the world's for the ground)
+	Vec3		local;
+	float		depth;
+
+	Vec3		rA;
+	Vec3		rB;
+	Vec3		tangents[2];
+	float		normalMass;
+	float		tangentMass[2];
+	// Separating speed the solver aims for
+	float		bias;
+
+	float		normalImpulse;
+	float		tangentImpulses[2];
+};
+
+struct RigidManifold
+{
+	// a < b, a is Ground for contacts with the ground
+	int32_t			a;
+	int32_t			b;
+	// From a to b
+	Vec3			normal;
+	int32_t			count;
+	RigidContact	contacts[MaxContacts];
+
+	// Rolling resistance, for pairs with a sphere
+	float			rollingRadius;
+	float			rollingMass;
+	Vec3			rollingImpulse;
+};
+
+static inline uint64_t
+pairKey(int32_t a, int32_t b)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(a + 1)) << 32) | static_cast<uint32_t>(b + 1);
+}
+
+// Keeps the deepest contact and then each time the one furthest from those
+// kept, so the kept ones span the contact area
+static int32_t
+reduceContacts(const Vec3* positions, const float* depths, int32_t count, int32_t* kept)
+{
+	if (count <= MaxContacts)
+	{
+		for (int32_t i = 0; i < count; i++)
+			kept[i] = i;
+		return count;
+	}
+
+	int32_t first = 0;
+	for (int32_t i = 1; i < count; i++)
+	{
+		if (depths[i] > depths[first])
+			first = i;
+	}
+	kept[0] = first;
+
+	float distances[16];
+	for (int32_t i = 0; i < count; i++)
+	{
+		const Vec3 d = positions[i] - positions[first];
+		distances[i] = dot(d, d);
+	}
+	for (int32_t k = 1; k < MaxContacts; k++)
+	{
+		int32_t furthest = 0;
+		for (int32_t i = 1; i < count; i++)
+		{
+			if (distances[i] > distances[furthest])
+				furthest = i;
+		}
+		kept[k] = furthest;
+		for (int32_t i = 0; i < count; i++)
+		{
+			const Vec3 d = positions[i] - positions[furthest];
+			distances[i] = std::min(distances[i], dot(d, d));
+		}
+	}
+	return MaxContacts;
+}
+
+static void
+addContacts(RigidManifold& m, const Vec3* positions, const float* depths, int32_t count)
+{
+	int32_t kept[MaxContacts];
+	const int32_t n = reduceContacts(positions, depths, count, kept);
+	for (int32_t i = 0; i < n; i++)
+	{
+		m.contacts[i].position = positions[kept[i]];
+		m.contacts[i].depth = depths[kept[i]];
+	}
+	m.count = n;
+}
+
+static void
+collideGroundSphere(const RigidBody& s, RigidManifold& m)
+{
+	const float r = s.halfExtents.x;
+	const float depth = r - s.position.y;
+	if (depth < -Margin)
+		return;
+
+	m.normal = { 0.0f, 1.0f, 0.0f };
+	const Vec3 position = { s.position.x, -depth * 0.5f, s.position.z };
+	addContacts(m, &position, &depth, 1);
+}
+
+static void
+collideGroundBox(const RigidBody& box, RigidManifold& m)
+{
+	Vec3 positions[8];
+	float depths[8];
+	int32_t count = 0;
+	for (int32_t i = 0; i < 8; i++)
+	{
+		const Vec3 local =
+		{
+			i & 1 ? box.halfExtents.x : -box.halfExtents.x,
+			i & 2 ? box.halfExtents.y : -box.halfExtents.y,
+			i & 4 ? box.halfExtents.z : -box.halfExtents.z
+		};
+		const Vec3 corner = box.position + box.rotation * local;
+		if (corner.y > Margin)
+			continue;
+		positions[count] = { corner.x, corner.y * 0.5f, corner.z };
+		depths[count] = -corner.y;
+		count++;
+	}
+	if (count == 0)
+		return;
+
+	m.normal = { 0.0f, 1.0f, 0.0f };
+	addContacts(m, positions, depths, count);
+}
+
+static void
+collideSpheres(const RigidBody& a, const RigidBody& b, RigidManifold& m)
+{
+	const Vec3 d = b.position - a.position;
+	const float distance = length(d);
+	const float depth = a.halfExtents.x + b.halfExtents.x - distance;
+	if (depth < -Margin)
+		return;
+
+	m.normal = distance > 1.0e-6f ? d * (1.0f / distance) : Vec3{ 0.0f, 1.0f, 0.0f };
+	const Vec3 position = a.position + m.normal * (a.halfExtents.x - depth * 0.5f);
+	addContacts(m, &position, &depth, 1);
+}
+
+// Normal from the box to the sphere
+static void
+collideBoxSphere(const RigidBody& box, const RigidBody& s, RigidManifold& m)
+{
+	const float r = s.halfExtents.x;
+	const Vec3 center = mulT(box.rotation, s.position - box.position);
+	Vec3 closest;
+	for (int i = 0; i < 3; i++)
+		closest[i] = std::min(std::max(center[i], -box.halfExtents[i]), box.halfExtents[i]);
+
+	Vec3 normal;
+	float depth;
+	const Vec3 d = center - closest;
+	const float distance = length(d);
+	if (distance > 1.0e-6f)
+	{
+		depth = r - distance;
+		if (depth < -Margin)
+			return;
+		normal = box.rotation * (d * (1.0f / distance));
+	}
+	else
+	{
+		// Center inside the box, out through the nearest face
+		int32_t axis = 0;
+		float nearest = FLT_MAX;
+		for (int i = 0; i < 3; i++)
+		{
+			const float gap = box.halfExtents[i] - std::fabs(center[i]);
+			if (gap < nearest)
+			{
+				nearest = gap;
+				axis = i;
+			}
+		}
+		const float side = center[axis] < 0.0f ? -1.0f : 1.0f;
+		closest[axis] = side * box.halfExtents[axis];
+		normal = box.rotation.column(axis) * side;
+		depth = r + nearest;
+	}
+
+	const Vec3 onBox = box.position + box.rotation * closest;
+	const Vec3 onSphere = s.position - normal * r;
+	const Vec3 position = (onBox + onSphere) * 0.5f;
+	m.normal = normal;
+	addContacts(m, &position, &depth, 1);
+}
+
+// Clips the convex polygon 'in' to dot(p, n) <= offset
+static int32_t
+clipPolygon(const Vec3* in, int32_t count, const Vec3& n, float offset, Vec3* out)
+{
+	int32_t result = 0;
+	for (int32_t i = 0; i < count; i++)
+	{
+		const Vec3& p = in[i];
+		const Vec3& q = in[(i + 1) % count];
+		const float dp = dot(p, n) - offset;
+		const float dq = dot(q, n) - offset;
+		if (dp <= 0.0f)
+			out[result++] = p;
+		if ((dp < 0.0f) != (dq < 0.0f))
+			out[result++] = p + (q - p) * (dp / (dp - dq));
+	}
+	return result;
+}
+
+// Separating axis test over the 15 axes of two boxes. The contacts come from
+// clipping the incident face against the reference face, or from the closest
+// points of two edges.
+static void
+collideBoxes(const RigidBody& a, const RigidBody& b, RigidManifold& m)
+{
+	const Vec3 axesA[3] = { a.rotation.column(0), a.rotation.column(1), a.rotation.column(2) };
+	const Vec3 axesB[3] = { b.rotation.column(0), b.rotation.column(1), b.rotation.column(2) };
+	const Vec3 t = b.position - a.position;
+
+	float best = FLT_MAX;
+	Vec3 bestNormal = { 0.0f, 1.0f, 0.0f };
+	// 0-2 faces of a, 3-5 faces of b, 6-14 edge pairs
+	int32_t bestAxis = -1;
+
+	auto test = [&](Vec3 axis, int32_t index) -> bool
+	{
+		const float len = length(axis);
+		if (len < 1.0e-5f)
+			return true;	// parallel edges, covered by the faces
+		axis = axis * (1.0f / len);
+
+		float ra = 0.0f;
+		float rb = 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			ra += a.halfExtents[i] * std::fabs(dot(axesA[i], axis));
+			rb += b.halfExtents[i] * std::fabs(dot(axesB[i], axis));
+		}
+		const float distance = dot(t, axis);
+		const float overlap = ra + rb - std::fabs(distance);
+		if (overlap < -Margin)
+			return false;
+
+		// Faces give steadier contacts, edges only win when clearly shallower
+		const bool better = index < 6 ? overlap < best : overlap < best - 0.05f * std::fabs(best) - 1.0e-3f;
+		if (better)
+		{
+			best = overlap;
+			bestNormal = distance < 0.0f ? -axis : axis;
+			bestAxis = index;
+		}
+		return true;
+	};
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (!test(axesA[i], i))
+			return;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		if (!test(axesB[i], 3 + i))
+			return;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			if (!test(cross(axesA[i], axesB[j]), 6 + i * 3 + j))
+				return;
+		}
+	}
+	if (bestAxis < 0)
+		return;
+
+	m.normal = bestNormal;
+
+	if (bestAxis >= 6)
+	{
+		const int32_t i = (bestAxis - 6) / 3;
+		const int32_t j = (bestAxis - 6) % 3;
+
+		// The edge of each box nearest the other
+		Vec3 pa = a.position;
+		Vec3 pb = b.position;
+		for (int k = 0; k < 3; k++)
+		{
+			if (k != i)
+				pa += axesA[k] * (dot(axesA[k], bestNormal) > 0.0f ? a.halfExtents[k] : -a.halfExtents[k]);
+			if (k != j)
+				pb += axesB[k] * (dot(axesB[k], bestNormal) < 0.0f ? b.halfExtents[k] : -b.halfExtents[k]);
+		}
+
+		// Closest points of the two edge lines, kept on the edges
+		const Vec3& da = axesA[i];
+		const Vec3& db = axesB[j];
+		const Vec3 r = pa - pb;
+		const float c = dot(da, db);
+		const float denom = 1.0f - c * c;
+		float s = 0.0f;
+		float u = 0.0f;
+		if (denom > 1.0e-6f)
+		{
+			s = (c * dot(db, r) - dot(da, r)) / denom;
+			u = (dot(db, r) - c * dot(da, r)) / denom;
+		}
+		s = std::min(std::max(s, -a.halfExtents[i]), a.halfExtents[i]);
+		u = std::min(std::max(u, -b.halfExtents[j]), b.halfExtents[j]);
+
+		const Vec3 position = (pa + da * s + pb + db * u) * 0.5f;
+		addContacts(m, &position, &best, 1);
+		return;
+	}
+
+	// Reference face on the box owning the axis, facing the other box
+	const bool referenceIsA = bestAxis < 3;
+	const RigidBody& ref = referenceIsA ? a : b;
+	const RigidBody& inc = referenceIsA ? b : a;
+	const Vec3* refAxes = referenceIsA ? axesA : axesB;
+	const Vec3* incAxes = referenceIsA ? axesB : axesA;
+	const int32_t refAxis = bestAxis % 3;
+	const Vec3 normal = referenceIsA ? bestNormal : -bestNormal;
+	const Vec3 refCenter = ref.position + normal * ref.halfExtents[refAxis];
+
+	// Incident face, the one of the other box facing most against it
+	int32_t incAxis = 0;
+	float most = -1.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		const float d = std::fabs(dot(incAxes[k], normal));
+		if (d > most)
+		{
+			most = d;
+			incAxis = k;
+		}
+	}
+	const float side = dot(incAxes[incAxis], normal) > 0.0f ? -1.0f : 1.0f;
+	const Vec3 incCenter = inc.position + incAxes[incAxis] * (side * inc.halfExtents[incAxis]);
+	const int32_t u = (incAxis + 1) % 3;
+	const int32_t v = (incAxis + 2) % 3;
+	const Vec3 eu = incAxes[u] * inc.halfExtents[u];
+	const Vec3 ev = incAxes[v] * inc.halfExtents[v];
+
+	Vec3 polygon[16] =
+	{
+		incCenter + eu + ev,
+		incCenter - eu + ev,
+		incCenter - eu - ev,
+		incCenter + eu - ev
+	};
+	Vec3 clipped[16];
+	int32_t count = 4;
+
+	// Against the four sides of the reference face
+	for (int k = 0; k < 3 && count > 0; k++)
+	{
+		if (k == refAxis)
+			continue;
+		const float offset = dot(ref.position, refAxes[k]);
+		count = clipPolygon(polygon, count, refAxes[k], offset + ref.halfExtents[k], clipped);
+		count = clipPolygon(clipped, count, -refAxes[k], -offset + ref.halfExtents[k], polygon);
+	}
+
+	Vec3 positions[16];
+	float depths[16];
+	int32_t contacts = 0;
+	for (int32_t k = 0; k < count; k++)
+	{
+		const float separation = dot(polygon[k] - refCenter, normal);
+		if (separation > Margin)
+			continue;
+		positions[contacts] = polygon[k] - normal * (separation * 0.5f);
+		depths[contacts] = -separation;
+		contacts++;
+	}
+	if (contacts > 0)
+		addContacts(m, positions, depths, contacts);
+}
+
+static void
+collide(const RigidBody* a, const RigidBody& b, RigidManifold& m)
+{
+	m.count = 0;
+	if (!a)
+	{
+		if (b.sphere)
+			collideGroundSphere(b, m);
+		else
+			collideGroundBox(b, m);
+	}
+	else if (a->sphere && b.sphere)
+	{
+		collideSpheres(*a, b, m);
+	}
+	else if (!a->sphere && b.sphere)
+	{
+		collideBoxSphere(*a, b, m);
+	}
+	else if (a->sphere && !b.sphere)
+	{
+		collideBoxSphere(b, *a, m);
+		m.normal = -m.normal;
+	}
+	else
+	{
+		collideBoxes(*a, b, m);
+	}
+}
+
+bool
+RigidScene::operator==(const RigidScene& other) const
+{
+	return count == other.count &&
+		shapes == other.shapes &&
+		size == other.size &&
+		dropHeight == other.dropHeight &&
+		spread == other.spread;
+}
+
+const char*
+RigidBodies::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"rx", "ry", "rz",
+		"sx", "sy", "sz",
+		"shape",
+		"asleep"
+	};
+	return names[channel];
+}
+
+RigidBodies::RigidBodies() :
+	myValid(false),
+	mySweepAxis(-1),
+	myAwake(0),
+	myContacts(0),
+	myIslands(0)
+{
+}
+
+RigidBodies::~RigidBodies()
+{
+}
+
+int32_t
+RigidBodies::numBodies() const
+{
+	return static_cast<int32_t>(myBodies.size());
+}
+
+void
+RigidBodies::build(const RigidScene& scene)
+{
+	myScene = scene;
+	myValid = true;
+
+	const int32_t count = std::max(scene.count, 0);
+	const float size = std::max(scene.size, 0.01f);
+	myBodies.resize(count);
+
+	uint32_t seed = 0x9E3779B9u;
+	auto random = [&seed]()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return (seed >> 8) / float(1 << 24);
+	};
+
+	// Layers of cells wide enough that no two bodies start overlapping,
+	// whatever their size and orientation
+	const float cell = 2.5f * size;
+	const int32_t side = std::max(1, static_cast<int32_t>(2.0f * scene.spread / cell));
+	const float origin = -0.5f * side * cell;
+
+	for (int32_t i = 0; i < count; i++)
+	{
+		RigidBody& body = myBodies[i];
+		body.sphere = scene.shapes == RigidShapes::Spheres || (scene.shapes == RigidShapes::Mixed && (i & 1));
+
+		float mass;
+		if (body.sphere)
+		{
+			const float r = 0.5f * size * (0.6f + 0.8f * random());
+			body.halfExtents = { r, r, r };
+			mass = 4.0f / 3.0f * Pi * r * r * r;
+			const float inertia = 0.4f * mass * r * r;
+			body.invInertia = { 1.0f / inertia, 1.0f / inertia, 1.0f / inertia };
+		}
+		else
+		{
+			const Vec3 h =
+			{
+				0.5f * size * (0.6f + 0.8f * random()),
+				0.5f * size * (0.6f + 0.8f * random()),
+				0.5f * size * (0.6f + 0.8f * random())
+			};
+			body.halfExtents = h;
+			mass = 8.0f * h.x * h.y * h.z;
+			body.invInertia =
+			{
+				3.0f / (mass * (h.y * h.y + h.z * h.z)),
+				3.0f / (mass * (h.x * h.x + h.z * h.z)),
+				3.0f / (mass * (h.x * h.x + h.y * h.y))
+			};
+		}
+		body.invMass = 1.0f / mass;
+
+		const int32_t layer = i / (side * side);
+		const int32_t cx = i % side;
+		const int32_t cz = (i / side) % side;
+		body.position =
+		{
+			origin + (cx + 0.5f) * cell,
+			scene.dropHeight + (layer + 0.5f) * cell,
+			origin + (cz + 0.5f) * cell
+		};
+		body.orientation = normalize(Quat{ random() - 0.5f, random() - 0.5f, random() - 0.5f, random() - 0.5f });
+		body.velocity = { 0.0f, 0.0f, 0.0f };
+		body.angularVelocity = { 0.0f, 0.0f, 0.0f };
+		body.sleepTime = 0.0f;
+		body.asleep = false;
+		body.updateRotation();
+	}
+
+	// Sorted along whichever axis the first broadphase sweeps
+	mySweepOrder.resize(count);
+	for (int32_t i = 0; i < count; i++)
+		mySweepOrder[i] = i;
+	mySweepAxis = -1;
+	updateBounds();
+
+	myPairs.clear();
+	myManifolds.clear();
+	myLastManifolds.clear();
+	myLastKeys.clear();
+	myAwake = count;
+	myContacts = 0;
+	myIslands = 0;
+}
+
+void
+RigidBodies::updateBounds()
+{
+	const int32_t count = numBodies();
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			RigidBody& body = myBodies[i];
+			if (body.asleep)
+				continue;
+			Vec3 extent;
+			for (int k = 0; k < 3; k++)
+			{
+				extent[k] = body.sphere ? body.halfExtents.x :
+					std::fabs(body.rotation.r[k][0]) * body.halfExtents.x +
+					std::fabs(body.rotation.r[k][1]) * body.halfExtents.y +
+					std::fabs(body.rotation.r[k][2]) * body.halfExtents.z;
+			}
+			for (int k = 0; k < 3; k++)
+				extent[k] += Margin;
+			body.boundsMin = body.position - extent;
+			body.boundsMax = body.position + extent;
+		}
+	}, 1024);
+}
+
+void
+RigidBodies::broadphase()
+{
+	const int32_t count = numBodies();
+	myPairs.clear();
+
+	// Ground contacts first, the solver works up the stacks from them
+	for (int32_t i = 0; i < count; i++)
+	{
+		if (!myBodies[i].asleep && myBodies[i].boundsMin.y <= 0.0f)
+			myPairs.emplace_back(Ground, i);
+	}
+
+	// Sweep along the axis the bodies are most spread over, where the
+	// fewest bounds overlap
+	Vec3 sum = { 0.0f, 0.0f, 0.0f };
+	Vec3 sum2 = { 0.0f, 0.0f, 0.0f };
+	for (const RigidBody& body : myBodies)
+	{
+		sum += body.position;
+		for (int k = 0; k < 3; k++)
+			sum2[k] += body.position[k] * body.position[k];
+	}
+	Vec3 variance;
+	for (int k = 0; k < 3; k++)
+		variance[k] = sum2[k] - sum[k] * sum[k] / std::max(count, 1);
+	int32_t axis = 0;
+	for (int k = 1; k < 3; k++)
+	{
+		if (variance[k] > variance[axis])
+			axis = k;
+	}
+	// Changing axis costs a full sort, so the sweep stays on its axis until
+	// another is clearly more spread
+	if (mySweepAxis >= 0 && variance[axis] < 1.5f * variance[mySweepAxis])
+		axis = mySweepAxis;
+
+	// Only the swept axis is kept sorted. Re-sorting it is close to linear as
+	// bodies move little between steps.
+	std::vector<int32_t>& order = mySweepOrder;
+	if (axis != mySweepAxis)
+	{
+		std::sort(order.begin(), order.end(), [&](int32_t l, int32_t r)
+		{
+			return myBodies[l].boundsMin[axis] < myBodies[r].boundsMin[axis];
+		});
+		mySweepAxis = axis;
+	}
+	else
+	{
+		for (int32_t i = 1; i < count; i++)
+		{
+			const int32_t body = order[i];
+			const float key = myBodies[body].boundsMin[axis];
+			int32_t j = i - 1;
+			while (j >= 0 && myBodies[order[j]].boundsMin[axis] > key)
+			{
+				order[j + 1] = order[j];
+				j--;
+			}
+			order[j + 1] = body;
+		}
+	}
+
+	const int32_t other1 = (axis + 1) % 3;
+	const int32_t other2 = (axis + 2) % 3;
+
+	for (int32_t i = 0; i < count; i++)
+	{
+		const RigidBody& a = myBodies[order[i]];
+		for (int32_t j = i + 1; j < count; j++)
+		{
+			const RigidBody& b = myBodies[order[j]];
+			if (b.boundsMin[axis] > a.boundsMax[axis])
+				break;
+			if (a.asleep && b.asleep)
+				continue;
+			if (b.boundsMin[other1] > a.boundsMax[other1] || a.boundsMin[other1] > b.boundsMax[other1] ||
+				b.boundsMin[other2] > a.boundsMax[other2] || a.boundsMin[other2] > b.boundsMax[other2])
+				continue;
+			myPairs.emplace_back(std::min(order[i], order[j]), std::max(order[i], order[j]));
+		}
+	}
+}
+
+void
+RigidBodies::narrowphase()
+{
+	const int32_t count = static_cast<int32_t>(myPairs.size());
+	myManifolds.resize(count);
+
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t p = begin; p < end; p++)
+		{
+			RigidManifold& m = myManifolds[p];
+			m.a = myPairs[p].first;
+			m.b = myPairs[p].second;
+			const RigidBody* a = m.a == Ground ? nullptr : &myBodies[m.a];
+			const RigidBody& b = myBodies[m.b];
+			collide(a, b, m);
+			if (m.count == 0)
+				continue;
+
+			// Start from the impulses of the same contacts last step
+			const uint64_t key = pairKey(m.a, m.b);
+			auto last = std::lower_bound(myLastKeys.begin(), myLastKeys.end(), std::make_pair(key, int32_t(-1)));
+			const RigidManifold* previous = last != myLastKeys.end() && last->first == key ?
+				&myLastManifolds[last->second] : nullptr;
+
+			for (int32_t c = 0; c < m.count; c++)
+			{
+				RigidContact& contact = m.contacts[c];
+				contact.local = a ? mulT(a->rotation, contact.position - a->position) : contact.position;
+				contact.normalImpulse = 0.0f;
+				contact.tangentImpulses[0] = 0.0f;
+				contact.tangentImpulses[1] = 0.0f;
+				if (!previous)
+					continue;
+				for (int32_t o = 0; o < previous->count; o++)
+				{
+					const RigidContact& old = previous->contacts[o];
+					const Vec3 d = old.local - contact.local;
+					if (dot(d, d) < WarmStartDistance * WarmStartDistance)
+					{
+						contact.normalImpulse = old.normalImpulse;
+						contact.tangentImpulses[0] = old.tangentImpulses[0];
+						contact.tangentImpulses[1] = old.tangentImpulses[1];
+						break;
+					}
+				}
+			}
+		}
+	}, 256);
+}
+
+static int32_t
+findRoot(std::vector<int32_t>& parents, int32_t i)
+{
+	while (parents[i] != i)
+	{
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+bool
+RigidBodies::buildIslands()
+{
+	const int32_t count = numBodies();
+	myParents.resize(count);
+	for (int32_t i = 0; i < count; i++)
+		myParents[i] = i;
+
+	// The ground doesn't join islands, or everything on it would be one
+	for (const RigidManifold& m : myManifolds)
+	{
+		if (m.count == 0 || m.a == Ground)
+			continue;
+		const int32_t ra = findRoot(myParents, m.a);
+		const int32_t rb = findRoot(myParents, m.b);
+		if (ra != rb)
+			myParents[ra] = rb;
+	}
+
+	// An island with an awake body wakes up whole
+	std::vector<int32_t>& islands = myIslandOf;
+	std::vector<uint8_t>& awake = myIslandAwake;
+	awake.assign(count, 0);
+	islands.resize(count);
+	myIslands = 0;
+	for (int32_t i = 0; i < count; i++)
+	{
+		islands[i] = findRoot(myParents, i);
+		if (islands[i] == i)
+			myIslands++;
+		if (!myBodies[i].asleep)
+			awake[islands[i]] = 1;
+	}
+	bool woke = false;
+	for (int32_t i = 0; i < count; i++)
+	{
+		RigidBody& body = myBodies[i];
+		if (body.asleep && awake[islands[i]])
+		{
+			body.asleep = false;
+			body.sleepTime = 0.0f;
+			woke = true;
+		}
+	}
+	return woke;
+}
+
+static inline Vec3
+velocityAt(const RigidBody* body, const Vec3& r)
+{
+	return body ? body->velocity + cross(body->angularVelocity, r) : Vec3{ 0.0f, 0.0f, 0.0f };
+}
+
+static inline void
+applyImpulse(RigidBody* a, RigidBody& b, const Vec3& rA, const Vec3& rB, const Vec3& impulse)
+{
+	if (a)
+	{
+		a->velocity -= impulse * a->invMass;
+		a->angularVelocity -= a->invInertiaWorld * cross(rA, impulse);
+	}
+	b.velocity += impulse * b.invMass;
+	b.angularVelocity += b.invInertiaWorld * cross(rB, impulse);
+}
+
+static inline float
+effectiveMass(const RigidBody* a, const RigidBody& b, const Vec3& rA, const Vec3& rB, const Vec3& n)
+{
+	float k = b.invMass + dot(cross(b.invInertiaWorld * cross(rB, n), rB), n);
+	if (a)
+		k += a->invMass + dot(cross(a->invInertiaWorld * cross(rA, n), rA), n);
+	return k > 0.0f ? 1.0f / k : 0.0f;
+}
+
+void
+RigidBodies::solve(const RigidSettings& settings, float dt)
+{
+	const float friction = std::max(settings.friction, 0.0f);
+	const float restitution = std::min(std::max(settings.restitution, 0.0f), 1.0f);
+	myContacts = 0;
+
+	// Effective masses and targets
+	for (RigidManifold& m : myManifolds)
+	{
+		if (m.count == 0)
+			continue;
+		RigidBody* a = m.a == Ground ? nullptr : &myBodies[m.a];
+		RigidBody& b = myBodies[m.b];
+		const Vec3& n = m.normal;
+
+		const Vec3 t0 = std::fabs(n.x) < 0.57f ? cross(n, Vec3{ 1.0f, 0.0f, 0.0f }) : cross(n, Vec3{ 0.0f, 1.0f, 0.0f });
+		const Vec3 t1 = t0 * (1.0f / length(t0));
+		const Vec3 t2 = cross(n, t1);
+
+		for (int32_t c = 0; c < m.count; c++)
+		{
+			RigidContact& contact = m.contacts[c];
+			contact.rA = a ? contact.position - a->position : contact.position;
+			contact.rB = contact.position - b.position;
+			contact.tangents[0] = t1;
+			contact.tangents[1] = t2;
+			contact.normalMass = effectiveMass(a, b, contact.rA, contact.rB, n);
+			contact.tangentMass[0] = effectiveMass(a, b, contact.rA, contact.rB, t1);
+			contact.tangentMass[1] = effectiveMass(a, b, contact.rA, contact.rB, t2);
+
+			// A gap may close this step, a penetration is pushed out slowly
+			if (contact.depth < 0.0f)
+				contact.bias = contact.depth / dt;
+			else
+				contact.bias = Baumgarte / dt * std::max(contact.depth - Slop, 0.0f);
+			const float approach = dot(velocityAt(&b, contact.rB) - velocityAt(a, contact.rA), n);
+			if (approach < -BounceSpeed)
+				contact.bias = std::max(contact.bias, -restitution * approach);
+		}
+		myContacts += m.count;
+
+		m.rollingRadius = 0.0f;
+		if (b.sphere || (a && a->sphere))
+		{
+			m.rollingRadius = std::min(b.sphere ? b.halfExtents.x : FLT_MAX, a && a->sphere ? a->halfExtents.x : FLT_MAX);
+			// Average inverse inertia, exact for a sphere on the ground
+			float k = b.invInertiaWorld.r[0].x + b.invInertiaWorld.r[1].y + b.invInertiaWorld.r[2].z;
+			if (a)
+				k += a->invInertiaWorld.r[0].x + a->invInertiaWorld.r[1].y + a->invInertiaWorld.r[2].z;
+			m.rollingMass = 3.0f / k;
+		}
+		m.rollingImpulse = { 0.0f, 0.0f, 0.0f };
+	}
+
+	// Only once every bounce was measured, or the warm start would fake some
+	for (RigidManifold& m : myManifolds)
+	{
+		RigidBody* a = m.a == Ground ? nullptr : &myBodies[m.a];
+		RigidBody& b = myBodies[m.b];
+		for (int32_t c = 0; c < m.count; c++)
+		{
+			const RigidContact& contact = m.contacts[c];
+			const Vec3 impulse = m.normal * contact.normalImpulse + contact.tangents[0] * contact.tangentImpulses[0] +
+				contact.tangents[1] * contact.tangentImpulses[1];
+			applyImpulse(a, b, contact.rA, contact.rB, impulse);
+		}
+	}
+
+	const int32_t iterations = std::max(settings.iterations, 1);
+	for (int32_t it = 0; it < iterations; it++)
+	{
+		for (RigidManifold& m : myManifolds)
+		{
+			if (m.count == 0)
+				continue;
+			RigidBody* a = m.a == Ground ? nullptr : &myBodies[m.a];
+			RigidBody& b = myBodies[m.b];
+			const Vec3& n = m.normal;
+
+			for (int32_t c = 0; c < m.count; c++)
+			{
+				RigidContact& contact = m.contacts[c];
+
+				// Friction, inside the cone of the current normal impulse
+				const float limit = friction * contact.normalImpulse;
+				for (int k = 0; k < 2; k++)
+				{
+					const Vec3& t = contact.tangents[k];
+					const Vec3 dv = velocityAt(&b, contact.rB) - velocityAt(a, contact.rA);
+					const float lambda = -dot(dv, t) * contact.tangentMass[k];
+					const float old = contact.tangentImpulses[k];
+					contact.tangentImpulses[k] = std::min(std::max(old + lambda, -limit), limit);
+					applyImpulse(a, b, contact.rA, contact.rB, t * (contact.tangentImpulses[k] - old));
+				}
+
+				const Vec3 dv = velocityAt(&b, contact.rB) - velocityAt(a, contact.rA);
+				const float lambda = (contact.bias - dot(dv, n)) * contact.normalMass;
+				const float old = contact.normalImpulse;
+				contact.normalImpulse = std::max(old + lambda, 0.0f);
+				applyImpulse(a, b, contact.rA, contact.rB, n * (contact.normalImpulse - old));
+			}
+
+			if (m.rollingRadius > 0.0f)
+			{
+				const Vec3 dw = a ? b.angularVelocity - a->angularVelocity : b.angularVelocity;
+				const Vec3 old = m.rollingImpulse;
+				m.rollingImpulse -= dw * m.rollingMass;
+				const float limit = RollingResistance * m.rollingRadius * m.contacts[0].normalImpulse;
+				const float magnitude = length(m.rollingImpulse);
+				if (magnitude > limit)
+					m.rollingImpulse = m.rollingImpulse * (limit / magnitude);
+				const Vec3 impulse = m.rollingImpulse - old;
+				if (a)
+					a->angularVelocity -= a->invInertiaWorld * impulse;
+				b.angularVelocity += b.invInertiaWorld * impulse;
+			}
+		}
+	}
+}
+
+void
+RigidBodies::updateSleep(const RigidSettings& settings, float dt)
+{
+	const std::vector<int32_t>& islands = myIslandOf;
+	const int32_t count = numBodies();
+	const float speed2 = settings.sleepSpeed * settings.sleepSpeed;
+
+	// The island sleeps once its restless body has been slow long enough
+	myIslandTimes.assign(count, FLT_MAX);
+	for (int32_t i = 0; i < count; i++)
+	{
+		RigidBody& body = myBodies[i];
+		if (body.asleep)
+			continue;
+		// Spinning is measured by how fast the body's furthest point moves
+		const float reach = body.sphere ? body.halfExtents.x : length(body.halfExtents);
+		if (settings.sleep && dot(body.velocity, body.velocity) < speed2 &&
+			dot(body.angularVelocity, body.angularVelocity) * reach * reach < speed2)
+			body.sleepTime += dt;
+		else
+			body.sleepTime = 0.0f;
+		myIslandTimes[islands[i]] = std::min(myIslandTimes[islands[i]], body.sleepTime);
+	}
+
+	myAwake = 0;
+	for (int32_t i = 0; i < count; i++)
+	{
+		RigidBody& body = myBodies[i];
+		if (!body.asleep && myIslandTimes[islands[i]] >= TimeToSleep)
+		{
+			body.asleep = true;
+			body.velocity = { 0.0f, 0.0f, 0.0f };
+			body.angularVelocity = { 0.0f, 0.0f, 0.0f };
+		}
+		if (!body.asleep)
+			myAwake++;
+	}
+}
+
+void
+RigidBodies::step(const RigidSettings& settings, float dt)
+{
+	if (!myValid || dt <= 0.0f)
+		return;
+
+	const int32_t count = numBodies();
+	const Vec3 gravity = { settings.gravity[0], settings.gravity[1], settings.gravity[2] };
+	const float linearDamping = std::exp(-LinearDamping * dt);
+	const float angularDamping = std::exp(-AngularDamping * dt);
+
+	for (RigidBody& body : myBodies)
+	{
+		if (body.asleep)
+			continue;
+		body.velocity = (body.velocity + gravity * dt) * linearDamping;
+		body.angularVelocity = body.angularVelocity * angularDamping;
+	}
+
+	// The broadphase skips the pairs of sleeping bodies, so bodies that
+	// just woke need theirs collected again before the solve, or they'd sink
+	// into the ground and each other for a step. Their new pairs can wake
+	// more islands in turn.
+	do
+	{
+		broadphase();
+		narrowphase();
+	} while (buildIslands());
+	solve(settings, dt);
+
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			RigidBody& body = myBodies[i];
+			if (body.asleep)
+				continue;
+			body.position += body.velocity * dt;
+			const Vec3& w = body.angularVelocity;
+			const Quat spin = Quat{ 0.0f, w.x, w.y, w.z } * body.orientation;
+			const Quat& q = body.orientation;
+			body.orientation = normalize(Quat{ q.w + 0.5f * dt * spin.w, q.x + 0.5f * dt * spin.x,
+				q.y + 0.5f * dt * spin.y, q.z + 0.5f * dt * spin.z });
+			body.updateRotation();
+		}
+	}, 1024);
+	updateBounds();
+
+	updateSleep(settings, dt);
+
+	// Keep this step's contacts for the next warm start
+	myLastManifolds.swap(myManifolds);
+	myLastKeys.clear();
+	for (int32_t i = 0; i < static_cast<int32_t>(myLastManifolds.size()); i++)
+	{
+		const RigidManifold& m = myLastManifolds[i];
+		if (m.count > 0)
+			myLastKeys.emplace_back(pairKey(m.a, m.b), i);
+	}
+	std::sort(myLastKeys.begin(), myLastKeys.end());
+}
+
+void
+RigidBodies::writeChannels(float* const* channels, int32_t count) const
+{
+	count = std::min(count, numBodies());
+	const float degrees = 180.0f / Pi;
+
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const RigidBody& body = myBodies[i];
+			const Mat3& r = body.rotation;
+
+			// R = Rz Ry Rx, TouchDesigner's xyz rotate order
+			float rx, ry, rz;
+			const float sy = std::min(std::max(-r.r[2][0], -1.0f), 1.0f);
+			ry = std::asin(sy);
+			if (std::fabs(sy) < 0.9999f)
+			{
+				rx = std::atan2(r.r[2][1], r.r[2][2]);
+				rz = std::atan2(r.r[1][0], r.r[0][0]);
+			}
+			else
+			{
+				rx = 0.0f;
+				rz = std::atan2(-r.r[0][1], r.r[1][1]);
+			}
+
+			channels[TX][i] = body.position.x;
+			channels[TY][i] = body.position.y;
+			channels[TZ][i] = body.position.z;
+			channels[RX][i] = rx * degrees;
+			channels[RY][i] = ry * degrees;
+			channels[RZ][i] = rz * degrees;
+			// For a unit box, or a sphere of radius 0.5
+			channels[SX][i] = 2.0f * body.halfExtents.x;
+			channels[SY][i] = 2.0f * body.halfExtents.y;
+			channels[SZ][i] = 2.0f * body.halfExtents.z;
+			channels[Shape][i] = body.sphere ? 1.0f : 0.0f;
+			channels[Asleep][i] = body.asleep ? 1.0f : 0.0f;
+		}
+	}, 4096);
+}
@@ -0,0 +1,142 @@
+/*
+ * Box and sphere rigid bodies dropped on a ground plane, for the CHOP's Rigid
+ * mode.
+ *
+ * Each step runs:
+ *  - a sweep and prune broadphase over the bodies' bounding boxes, along the
+ *    axis the bodies are most spread over. The bodies stay sorted along it
+ *    between steps, so re-sorting them is close to linear while the axis
+ *    doesn't change, and the other two axes reject pairs by their bounds,
+ *  - contact generation, in parallel over the pairs: separating axis tests
+ *    for boxes, with the incident face clipped against the reference face for
+ *    up to four contacts, and closest points for spheres,
+ *  - a sequential impulse solver with friction, warm started from the
+ *    impulses of the contacts found at the same place in the last step,
+ *  - islands of touching bodies, which fall asleep together once all of them
+ *    have been slow for a while. Sleeping bodies aren't integrated, and pairs
+ *    of them aren't tested or solved, so a settled stack costs almost nothing
+ *    until something awake touches it.
+ *
+ * The output has one sample per body with its translate, rotate (degrees,
+ * rotate order xyz) and scale for instancing, the shape and whether it sleeps.
+ */
+
+#ifndef __RigidBodies__
+#define __RigidBodies__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+enum class RigidShapes
+{
+	Boxes = 0,
+	Spheres,
+	Mixed,
+};
+
+// How the bodies are dropped, changing any of it drops them again
+struct RigidScene
+{
+	int32_t		count = 200;
+	RigidShapes	shapes = RigidShapes::Boxes;
+	float		size = 0.5f;
+	float		dropHeight = 2.0f;
+	// Half size of the square the bodies are dropped over
+	float		spread = 2.0f;
+
+	bool		operator==(const RigidScene& other) const;
+	bool		operator!=(const RigidScene& other) const { return !(*this == other); }
+};
+
+struct RigidSettings
+{
+	int32_t		iterations = 10;
+	float		gravity[3] = { 0.0f, -9.8f, 0.0f };
+	float		friction = 0.6f;
+	float		restitution = 0.1f;
+	bool		sleep = true;
+	// Speed, of its center or furthest point, below which a body may fall
+	// asleep
+	float		sleepSpeed = 0.05f;
+};
+
+struct RigidBody;
+struct RigidManifold;
+
+class RigidBodies
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		RX, RY, RZ,
+		SX, SY, SZ,
+		// 0 box, 1 sphere
+		Shape,
+		Asleep,
+		NumChannels
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	RigidBodies();
+	~RigidBodies();
+
+	// Drops the scene's bodies from the start
+	void			build(const RigidScene& scene);
+	bool			needsBuild(const RigidScene& scene) const { return !myValid || scene != myScene; }
+
+	void			step(const RigidSettings& settings, float dt);
+
+	// Writes every body into the NumChannels arrays, at most 'count'
+	void			writeChannels(float* const* channels, int32_t count) const;
+
+	int32_t			numBodies() const;
+	// Counts of the last step
+	int32_t			awake() const { return myAwake; }
+	int32_t			pairs() const { return static_cast<int32_t>(myPairs.size()); }
+	int32_t			contacts() const { return myContacts; }
+	int32_t			islands() const { return myIslands; }
+
+private:
+	void			updateBounds();
+	// Sorts along the sweep axis and collects the pairs whose bounds overlap
+	void			broadphase();
+	void			narrowphase();
+	// Finds the island of each body and wakes those with an awake body.
+	// Returns true if it woke any.
+	bool			buildIslands();
+	void			solve(const RigidSettings& settings, float dt);
+	void			updateSleep(const RigidSettings& settings, float dt);
+
+	RigidScene					myScene;
+	bool						myValid;
+
+	std::vector<RigidBody>		myBodies;
+	// Body indices sorted by the lower bound along mySweepAxis, -1 until
+	// the first broadphase
+	std::vector<int32_t>		mySweepOrder;
+	int32_t						mySweepAxis;
+
+	// Overlapping pairs, the ground being body -1, and their contacts
+	std::vector<std::pair<int32_t, int32_t>>	myPairs;
+	std::vector<RigidManifold>	myManifolds;
+	// Contacts of the last step, for warm starting, and their pair keys
+	// sorted with the manifold each belongs to
+	std::vector<RigidManifold>	myLastManifolds;
+	std::vector<std::pair<uint64_t, int32_t>>	myLastKeys;
+
+	// Union-find parents while building islands, the island of each body
+	// (its root) and, by root, whether it's awake and its shortest sleep time
+	std::vector<int32_t>		myParents;
+	std::vector<int32_t>		myIslandOf;
+	std::vector<uint8_t>		myIslandAwake;
+	std::vector<float>			myIslandTimes;
+
+	int32_t						myAwake;
+	int32_t						myContacts;
+	int32_t						myIslands;
+};
+
+#endif
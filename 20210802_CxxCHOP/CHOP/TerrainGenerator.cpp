@@ -0,0 +1,157 @@
+/*
+ * See TerrainGenerator.h
+ */
+
+#include "TerrainGenerator.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool
+TerrainSettings::operator==(const TerrainSettings& other) const
+{
+	return heightScale == other.heightScale &&
+		sizeX == other.sizeX &&
+		sizeZ == other.sizeZ &&
+		decimate == other.decimate &&
+		lodLevels == other.lodLevels;
+}
+
+const char*
+TerrainGenerator::channelName(int32_t channel)
+{
+	static const char* names[NumChannels] =
+	{
+		"tx", "ty", "tz",
+		"nx", "ny", "nz",
+		"u", "v",
+		"lod",
+		"scale"
+	};
+	return names[channel];
+}
+
+TerrainGenerator::TerrainGenerator() :
+	myNumPoints(0)
+{
+}
+
+void
+TerrainGenerator::planLevels(int32_t width, int32_t height, const TerrainSettings& settings,
+							std::vector<Level>& levels, int32_t& numPoints)
+{
+	levels.clear();
+	numPoints = 0;
+	if (width <= 0 || height <= 0)
+		return;
+
+	int32_t step = std::max(1, settings.decimate);
+	for (int32_t l = 0; l < std::max(1, settings.lodLevels); l++)
+	{
+		Level level;
+		level.step = step;
+		level.cols = (width - 1) / step + 1;
+		level.rows = (height - 1) / step + 1;
+		level.first = numPoints;
+		levels.push_back(level);
+		numPoints += level.cols * level.rows;
+
+		// Stop once a level is a single point, coarser ones would be the same
+		if (level.cols == 1 && level.rows == 1)
+			break;
+		step *= 2;
+	}
+}
+
+int32_t
+TerrainGenerator::pointCount(int32_t width, int32_t height, const TerrainSettings& settings)
+{
+	std::vector<Level> levels;
+	int32_t numPoints;
+	planLevels(width, height, settings, levels, numPoints);
+	return numPoints;
+}
+
+void
+TerrainGenerator::build(const float* heights, int32_t width, int32_t height, const TerrainSettings& settings)
+{
+	planLevels(width, height, settings, myLevels, myNumPoints);
+	for (int32_t c = 0; c < NumChannels; c++)
+		myChannels[c].resize(myNumPoints);
+
+	if (myNumPoints == 0)
+		return;
+
+	// World size of one pixel. The image's bottom row is the near (+z) edge.
+	const float cellX = width > 1 ? settings.sizeX / (width - 1) : 0.0f;
+	const float cellZ = height > 1 ? settings.sizeZ / (height - 1) : 0.0f;
+	const float invW = width > 1 ? 1.0f / (width - 1) : 0.0f;
+	const float invH = height > 1 ? 1.0f / (height - 1) : 0.0f;
+
+	auto sample = [&](int32_t x, int32_t y) -> float
+	{
+		if (!heights)
+			return 0.0f;
+		x = std::min(std::max(x, 0), width - 1);
+		y = std::min(std::max(y, 0), height - 1);
+		return heights[static_cast<size_t>(y) * width + x] * settings.heightScale;
+	};
+
+	// All rows of all levels form one flat list of jobs so the small, coarse
+	// levels share the workers with the finest one.
+	std::vector<int32_t> rowStart(myLevels.size() + 1, 0);
+	for (size_t l = 0; l < myLevels.size(); l++)
+		rowStart[l + 1] = rowStart[l] + myLevels[l].rows;
+
+	parallelFor(rowStart.back(), [&](int begin, int end)
+	{
+		size_t l = std::upper_bound(rowStart.begin(), rowStart.end(), begin) - rowStart.begin() - 1;
+
+		for (int job = begin; job < end; job++)
+		{
+			while (job >= rowStart[l + 1])
+				l++;
+
+			const Level& level = myLevels[l];
+			const int32_t row = job - rowStart[l];
+			const int32_t y = row * level.step;
+			const int32_t yD = std::max(0, y - level.step);
+			const int32_t yU = std::min(height - 1, y + level.step);
+
+			for (int32_t col = 0; col < level.cols; col++)
+			{
+				const int32_t x = col * level.step;
+				const int32_t xL = std::max(0, x - level.step);
+				const int32_t xR = std::min(width - 1, x + level.step);
+				const size_t i = level.first + static_cast<size_t>(row) * level.cols + col;
+
+				float h = sample(x, y);
+
+				// Central differences over the level's spacing, one-sided at
+				// the borders
+				float dhdx = xR > xL ? (sample(xR, y) - sample(xL, y)) / ((xR - xL) * cellX) : 0.0f;
+				float dhdz = yU > yD ? (sample(x, yU) - sample(x, yD)) / (-(yU - yD) * cellZ) : 0.0f;
+				if (!std::isfinite(dhdx))
+					dhdx = 0.0f;
+				if (!std::isfinite(dhdz))
+					dhdz = 0.0f;
+				float invLen = 1.0f / std::sqrt(dhdx * dhdx + 1.0f + dhdz * dhdz);
+
+				float u = x * invW;
+				float v = y * invH;
+
+				myChannels[TX][i] = (u - 0.5f) * settings.sizeX;
+				myChannels[TY][i] = h;
+				myChannels[TZ][i] = (0.5f - v) * settings.sizeZ;
+				myChannels[NX][i] = -dhdx * invLen;
+				myChannels[NY][i] = invLen;
+				myChannels[NZ][i] = -dhdz * invLen;
+				myChannels[U][i] = u;
+				myChannels[V][i] = v;
+				myChannels[Lod][i] = static_cast<float>(l);
+				myChannels[Scale][i] = level.step * cellX;
+			}
+		}
+	}, 8);
+}
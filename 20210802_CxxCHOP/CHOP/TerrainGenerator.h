@@ -0,0 +1,74 @@
+/*
+ * Turns a heightfield image into terrain points for the CHOP's Terrain mode.
+ *
+ * Each LOD level samples every (decimate * 2^level)th pixel of the image and
+ * produces one point per sample with its position, a central-difference
+ * normal taken over the same spacing, uv, level and cell size. The levels are
+ * concatenated, finest first, so a Geometry COMP can instance all of them
+ * from one CHOP and select a level with the 'lod' channel.
+ */
+
+#ifndef __TerrainGenerator__
+#define __TerrainGenerator__
+
+#include <stdint.h>
+#include <vector>
+
+struct TerrainSettings
+{
+	float		heightScale = 1.0f;
+	float		sizeX = 10.0f;
+	float		sizeZ = 10.0f;
+	int32_t		decimate = 1;
+	int32_t		lodLevels = 1;
+
+	bool		operator==(const TerrainSettings& other) const;
+	bool		operator!=(const TerrainSettings& other) const { return !(*this == other); }
+};
+
+class TerrainGenerator
+{
+public:
+	enum Channel
+	{
+		TX = 0, TY, TZ,
+		NX, NY, NZ,
+		U, V,
+		Lod,
+		Scale,
+		NumChannels
+	};
+
+	static const char*	channelName(int32_t channel);
+
+	// Number of points build() produces for an image of the given size
+	static int32_t		pointCount(int32_t width, int32_t height, const TerrainSettings& settings);
+
+	TerrainGenerator();
+
+	// 'heights' is one float per pixel, rows bottom to top. Pass nullptr for
+	// a flat grid, e.g. until the first download of the TOP arrives.
+	void			build(const float* heights, int32_t width, int32_t height, const TerrainSettings& settings);
+
+	int32_t			numPoints() const { return myNumPoints; }
+	const float*	channel(int32_t c) const { return myChannels[c].data(); }
+
+private:
+	struct Level
+	{
+		int32_t		step;
+		int32_t		cols;
+		int32_t		rows;
+		// Index of the level's first point
+		int32_t		first;
+	};
+
+	static void		planLevels(int32_t width, int32_t height, const TerrainSettings& settings,
+								std::vector<Level>& levels, int32_t& numPoints);
+
+	std::vector<float>	myChannels[NumChannels];
+	std::vector<Level>	myLevels;
+	int32_t				myNumPoints;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * See TextureStats.h
+ */
+
+#include "TextureStats.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <string.h>
+
+bool
+StatsSettings::operator==(const StatsSettings& other) const
+{
+	for (int32_t i = 0; i < NumPercentiles; i++)
+	{
+		if (percentiles[i] != other.percentiles[i])
+			return false;
+	}
+	return bins == other.bins &&
+		rangeMin == other.rangeMin &&
+		rangeMax == other.rangeMax;
+}
+
+TextureStats::TextureStats() :
+	myBins(0),
+	myPartitions(parallelWorkerCount()),
+	myPixelCount(0)
+{
+	memset(myStats, 0, sizeof(myStats));
+}
+
+void
+TextureStats::resize(int32_t bins)
+{
+	if (bins == myBins)
+		return;
+
+	myBins = bins;
+	myPartitionHistograms.assign(static_cast<size_t>(myPartitions) * NumComponents * bins, 0);
+	myHistogram.assign(static_cast<size_t>(NumComponents) * bins, 0);
+	myPartials.resize(myPartitions);
+}
+
+// Min, max and sum of rows [y0, y1) into 'partial', and the histograms of
+// those rows into 'hist' (NumComponents runs of 'bins').
+static void
+scanRows(const float* pixels, int32_t width, int32_t y0, int32_t y1,
+		int32_t bins, float rangeMin, float binScale, uint32_t* hist, float* minOut, float* maxOut, double* sumOut)
+{
+	uint32_t* h[4] = { hist, hist + bins, hist + 2 * bins, hist + 3 * bins };
+
+#if SIMD_X86
+	// An RGBA pixel is exactly one SSE register, every component is handled
+	// in the same instruction
+	const __m128 lo = _mm_set1_ps(rangeMin);
+	const __m128 scale = _mm_set1_ps(binScale);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lastBin = _mm_set1_ps(float(bins - 1));
+
+	__m128 mn = _mm_loadu_ps(minOut);
+	__m128 mx = _mm_loadu_ps(maxOut);
+
+	for (int32_t y = y0; y < y1; y++)
+	{
+		const float* row = pixels + static_cast<size_t>(y) * width * 4;
+
+		// Summed in float per row, then added to the double total
+		__m128 rowSum = zero;
+		for (int32_t x = 0; x < width; x++)
+		{
+			__m128 v = _mm_loadu_ps(row + x * 4);
+			mn = _mm_min_ps(mn, v);
+			mx = _mm_max_ps(mx, v);
+			rowSum = _mm_add_ps(rowSum, v);
+
+			// _mm_max_ps returns its second operand for NaN, so those land in bin 0
+			__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(v, lo), scale), zero), lastBin);
+			alignas(16) int32_t idx[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_cvttps_epi32(b));
+			h[0][idx[0]]++;
+			h[1][idx[1]]++;
+			h[2][idx[2]]++;
+			h[3][idx[3]]++;
+		}
+
+		alignas(16) float s[4];
+		_mm_store_ps(s, rowSum);
+		for (int c = 0; c < 4; c++)
+			sumOut[c] += s[c];
+	}
+
+	_mm_storeu_ps(minOut, mn);
+	_mm_storeu_ps(maxOut, mx);
+#else
+	for (int32_t y = y0; y < y1; y++)
+	{
+		const float* row = pixels + static_cast<size_t>(y) * width * 4;
+
+		float rowSum[4] = {};
+		for (int32_t x = 0; x < width; x++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				const float v = row[x * 4 + c];
+				minOut[c] = std::min(minOut[c], v);
+				maxOut[c] = std::max(maxOut[c], v);
+				rowSum[c] += v;
+
+				float b = (v - rangeMin) * binScale;
+				b = b > 0.0f ? b : 0.0f;
+				b = std::min(b, float(bins - 1));
+				h[c][static_cast<int32_t>(b)]++;
+			}
+		}
+
+		for (int c = 0; c < 4; c++)
+			sumOut[c] += rowSum[c];
+	}
+#endif
+}
+
+void
+TextureStats::compute(const float* pixels, int32_t width, int32_t height, const StatsSettings& settings)
+{
+	resize(std::max(1, settings.bins));
+
+	const float span = settings.rangeMax - settings.rangeMin;
+	const float binScale = span > 0.0f ? myBins / span : 0.0f;
+	const size_t histSize = static_cast<size_t>(NumComponents) * myBins;
+
+	parallelFor(myPartitions, [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			uint32_t* hist = &myPartitionHistograms[p * histSize];
+			memset(hist, 0, histSize * sizeof(uint32_t));
+
+			Partial& partial = myPartials[p];
+			for (int c = 0; c < NumComponents; c++)
+			{
+				partial.min[c] = 3.4e38f;
+				partial.max[c] = -3.4e38f;
+				partial.sum[c] = 0.0;
+			}
+
+			const int32_t y0 = static_cast<int32_t>(static_cast<int64_t>(height) * p / myPartitions);
+			const int32_t y1 = static_cast<int32_t>(static_cast<int64_t>(height) * (p + 1) / myPartitions);
+			scanRows(pixels, width, y0, y1, myBins, settings.rangeMin, binScale,
+					hist, partial.min, partial.max, partial.sum);
+		}
+	});
+
+	// Merge the partitions' histograms, a slice of bins per thread
+	parallelFor(static_cast<int>(histSize), [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			uint32_t total = 0;
+			for (int32_t p = 0; p < myPartitions; p++)
+				total += myPartitionHistograms[p * histSize + i];
+			myHistogram[i] = total;
+		}
+	}, 1024);
+
+	myPixelCount = static_cast<int64_t>(width) * height;
+	const float binWidth = span / myBins;
+
+	for (int c = 0; c < NumComponents; c++)
+	{
+		float mn = 3.4e38f;
+		float mx = -3.4e38f;
+		double sum = 0.0;
+		for (const Partial& partial : myPartials)
+		{
+			mn = std::min(mn, partial.min[c]);
+			mx = std::max(mx, partial.max[c]);
+			sum += partial.sum[c];
+		}
+
+		if (myPixelCount == 0)
+		{
+			mn = 0.0f;
+			mx = 0.0f;
+		}
+
+		myStats[c][Min] = mn;
+		myStats[c][Max] = mx;
+		myStats[c][Mean] = myPixelCount > 0 ? float(sum / myPixelCount) : 0.0f;
+
+		const uint32_t* hist = histogram(c);
+		for (int32_t i = 0; i < StatsSettings::NumPercentiles; i++)
+		{
+			const double target = std::min(std::max(settings.percentiles[i], 0.0f), 100.0f) * 0.01 * myPixelCount;
+
+			// First bin the cumulative count reaches the target in
+			int64_t cumulative = 0;
+			int32_t b = 0;
+			while (b < myBins - 1 && cumulative + hist[b] < target)
+				cumulative += hist[b++];
+
+			const float frac = hist[b] > 0 ? float((target - cumulative) / hist[b]) : 0.0f;
+			const float value = settings.rangeMin + (b + std::min(frac, 1.0f)) * binWidth;
+			myStats[c][Percentile1 + i] = std::min(std::max(value, mn), mx);
+		}
+	}
+}
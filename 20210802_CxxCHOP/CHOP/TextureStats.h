@@ -0,0 +1,87 @@
+/*
+ * Histogram and summary statistics of an RGBA32F image, for the CHOP's
+ * Stats mode.
+ *
+ * One pass over the pixels, split into a fixed number of row ranges, finds
+ * the per-component min, max and sum and fills a histogram of each
+ * component over [rangeMin, rangeMax]. Every range has its own histograms,
+ * which are merged at the end; percentiles are read off the merged
+ * histogram, interpolating inside the bin. Values outside the range are
+ * counted in the first or last bin.
+ *
+ * All buffers are sized by the first compute() and only reallocated when
+ * the bin count changes.
+ */
+
+#ifndef __TextureStats__
+#define __TextureStats__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct StatsSettings
+{
+	static const int32_t	NumPercentiles = 3;
+
+	int32_t		bins = 256;
+	float		rangeMin = 0.0f;
+	float		rangeMax = 1.0f;
+	// In percent
+	float		percentiles[NumPercentiles] = { 5.0f, 50.0f, 95.0f };
+
+	bool		operator==(const StatsSettings& other) const;
+	bool		operator!=(const StatsSettings& other) const { return !(*this == other); }
+};
+
+class TextureStats
+{
+public:
+	static const int32_t	NumComponents = 4;
+
+	enum Stat
+	{
+		Min = 0,
+		Max,
+		Mean,
+		Percentile1,
+		Percentile2,
+		Percentile3,
+		NumStats
+	};
+
+	TextureStats();
+
+	// 'pixels' is width * height RGBA32F pixels
+	void			compute(const float* pixels, int32_t width, int32_t height, const StatsSettings& settings);
+
+	// Bins of the last compute(), as counts of pixels
+	int32_t			bins() const { return myBins; }
+	const uint32_t*	histogram(int32_t component) const { return &myHistogram[static_cast<size_t>(component) * myBins]; }
+
+	float			stat(int32_t component, Stat s) const { return myStats[component][s]; }
+	int64_t			pixelCount() const { return myPixelCount; }
+
+private:
+	void			resize(int32_t bins);
+
+	int32_t					myBins;
+	int32_t					myPartitions;
+
+	// NumComponents histograms of myBins per partition, then the merged ones
+	std::vector<uint32_t>	myPartitionHistograms;
+	std::vector<uint32_t>	myHistogram;
+
+	struct Partial
+	{
+		float		min[NumComponents];
+		float		max[NumComponents];
+		double		sum[NumComponents];
+	};
+	std::vector<Partial>	myPartials;
+
+	float					myStats[NumComponents][NumStats];
+	int64_t					myPixelCount;
+};
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * See AttractorDensity.h
+ */
+
+#include "AttractorDensity.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+static const float Pi = 3.14159265358979f;
+static const float TwoPi = 6.28318530717959f;
+static const float HalfPi = 1.57079632679490f;
+
+// Chains further out than this have diverged and restart
+static const float ChainLimit = 1.0e6f;
+// Pixel coordinates beyond this aren't converted to int
+static const float PixelLimit = 1.0e9f;
+
+// Steps a chain takes after (re)starting before its points are counted
+static const int64_t WarmupSteps = 256;
+
+// Steps of each chain in a batch, about a millisecond for a group, so a time
+// budget can stop close to its end
+static const int64_t StepsPerBatch = 1 << 14;
+
+// What the kernels need to know, the map and the attractor to pixel mapping
+struct ChainParams
+{
+	AttractorType	type;
+	float			a;
+	float			b;
+	float			c;
+	float			d;
+	float			scaleX;
+	float			offsetX;
+	float			scaleY;
+	float			offsetY;
+	int32_t			width;
+	int32_t			height;
+};
+
+// One chain at a time, used when AVX2 isn't available
+namespace AttractorScalar
+{
+	typedef float		VF;
+	typedef int32_t		VI;
+	typedef bool		Mask;
+
+	static inline VF	vf(float v) { return v; }
+	static inline VF	vfloor(VF v) { return std::floor(v); }
+	static inline VI	vtoi(VF v) { return static_cast<VI>(v); }
+	static inline VF	vabs(VF v) { return std::fabs(v); }
+	static inline Mask	vlt(VF a, VF b) { return a < b; }
+	static inline VF	vselect(Mask m, VF a, VF b) { return m ? a : b; }
+	static inline VF	loadf(const float* p) { return *p; }
+	static inline void	storef(float* p, VF v) { *p = v; }
+	static inline void	storei(int32_t* p, VI v) { *p = v; }
+
+	#define ATTRACTOR_TARGET
+	#define ATTRACTOR_LANES 1
+	#include "AttractorKernels.inl"
+	#undef ATTRACTOR_TARGET
+	#undef ATTRACTOR_LANES
+}
+
+#if SIMD_X86
+// Eight chains per call
+namespace AttractorAVX2
+{
+	struct VF { __m256 v; };
+	struct VI { __m256i v; };
+	typedef VF Mask;
+
+	SIMD_TARGET_AVX2 static inline VF operator+(VF a, VF b) { return { _mm256_add_ps(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VF operator-(VF a, VF b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VF operator*(VF a, VF b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VF operator&(VF a, VF b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+	SIMD_TARGET_AVX2 static inline VF	vf(float v) { return { _mm256_set1_ps(v) }; }
+	SIMD_TARGET_AVX2 static inline VF	vfloor(VF v) { return { _mm256_floor_ps(v.v) }; }
+	SIMD_TARGET_AVX2 static inline VI	vtoi(VF v) { return { _mm256_cvttps_epi32(v.v) }; }
+	SIMD_TARGET_AVX2 static inline VF	vabs(VF v) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v.v) }; }
+	SIMD_TARGET_AVX2 static inline Mask	vlt(VF a, VF b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	SIMD_TARGET_AVX2 static inline VF	vselect(Mask m, VF a, VF b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+	SIMD_TARGET_AVX2 static inline VF	loadf(const float* p) { return { _mm256_loadu_ps(p) }; }
+	SIMD_TARGET_AVX2 static inline void	storef(float* p, VF v) { _mm256_storeu_ps(p, v.v); }
+	SIMD_TARGET_AVX2 static inline void	storei(int32_t* p, VI v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v.v); }
+
+	#define ATTRACTOR_TARGET SIMD_TARGET_AVX2
+	#define ATTRACTOR_LANES 8
+	#include "AttractorKernels.inl"
+	#undef ATTRACTOR_TARGET
+	#undef ATTRACTOR_LANES
+}
+#endif
+
+bool
+AttractorSettings::operator==(const AttractorSettings& other) const
+{
+	return type == other.type &&
+		a == other.a &&
+		b == other.b &&
+		c == other.c &&
+		d == other.d &&
+		zoom == other.zoom;
+}
+
+AttractorDensity::AttractorDensity() :
+	myValid(false),
+	myWidth(0),
+	myHeight(0),
+	myExposure(-1.0f),
+	myMaxDensity(0),
+	myTotalSamples(0),
+	mySamplesPerSecond(0.0),
+	myOutputValid(false)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		myColor1[i] = -1.0f;
+		myColor2[i] = -1.0f;
+	}
+}
+
+void
+AttractorDensity::reset()
+{
+	myValid = false;
+}
+
+// Starting point of chain 'chain', spread over a small range so no two
+// chains follow the same orbit
+static inline float
+chainSeed(int32_t chain)
+{
+	uint32_t h = static_cast<uint32_t>(chain) * 0x9E3779B1u + 0x7F4A7C15u;
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	return (h & 0xFFFFFF) / float(0x1000000) * 0.2f + 0.05f;
+}
+
+void
+AttractorDensity::restart(int32_t width, int32_t height)
+{
+	myWidth = width;
+	myHeight = height;
+	myTotalSamples = 0;
+	myMaxDensity = 0;
+
+	const int32_t groups = parallelWorkerCount();
+	const size_t pixels = static_cast<size_t>(width) * height;
+
+	myDensity.assign(pixels, 0);
+	myHistograms.resize(groups);
+	for (std::vector<uint32_t>& histogram : myHistograms)
+		histogram.assign(pixels, 0);
+
+	myChains.resize(static_cast<size_t>(groups) * ChainsPerGroup * 3);
+	for (int32_t g = 0; g < groups; g++)
+	{
+		float* chain = &myChains[static_cast<size_t>(g) * ChainsPerGroup * 3];
+		for (int32_t l = 0; l < ChainsPerGroup; l++)
+		{
+			const float seed = chainSeed(g * ChainsPerGroup + l);
+			chain[l] = seed;
+			chain[ChainsPerGroup + l] = seed;
+			chain[2 * ChainsPerGroup + l] = seed;
+		}
+	}
+
+	iterate(WarmupSteps * groups * ChainsPerGroup, false);
+}
+
+void
+AttractorDensity::iterate(int64_t samples, bool splat, TaskGraph::Clock::time_point deadline)
+{
+	const AttractorSettings settings = mySettings;
+
+	// Fit the attractor's usual extent to the shorter side of the image
+	float centerX = 0.0f;
+	float centerY = 0.0f;
+	float extent = 2.0f;
+	if (settings.type == AttractorType::Clifford)
+	{
+		extent = 1.0f + std::max(std::fabs(settings.c), std::fabs(settings.d));
+	}
+	else if (settings.type == AttractorType::Lorenz)
+	{
+		centerY = 25.0f;
+		extent = 30.0f;
+	}
+
+	ChainParams p;
+	p.type = settings.type;
+	p.a = settings.a;
+	p.b = settings.b;
+	p.c = settings.c;
+	p.d = settings.d;
+	p.width = myWidth;
+	p.height = myHeight;
+	p.scaleX = settings.zoom * std::min(myWidth, myHeight) / (2.0f * extent);
+	p.scaleY = p.scaleX;
+	p.offsetX = myWidth * 0.5f - centerX * p.scaleX;
+	p.offsetY = myHeight * 0.5f - centerY * p.scaleY;
+
+	const int32_t groups = static_cast<int32_t>(myHistograms.size());
+	const int64_t perChain = std::max<int64_t>(1, samples / (static_cast<int64_t>(groups) * ChainsPerGroup));
+	const bool useAVX2 = simdHasAVX2();
+
+	auto runGroup = [&](int32_t g, int64_t steps)
+	{
+		float seeds[ChainsPerGroup];
+		float* chain = &myChains[static_cast<size_t>(g) * ChainsPerGroup * 3];
+		float* x = chain;
+		float* y = chain + ChainsPerGroup;
+		float* z = chain + 2 * ChainsPerGroup;
+		uint32_t* histogram = splat ? myHistograms[g].data() : nullptr;
+		for (int32_t l = 0; l < ChainsPerGroup; l++)
+			seeds[l] = chainSeed(g * ChainsPerGroup + l);
+
+#if SIMD_X86
+		if (useAVX2)
+		{
+			AttractorAVX2::iterateChains(p, x, y, z, seeds, steps, histogram);
+			return;
+		}
+#endif
+		for (int32_t l = 0; l < ChainsPerGroup; l++)
+			AttractorScalar::iterateChains(p, x + l, y + l, z + l, seeds + l, steps, histogram);
+	};
+
+	// A group's batches run one after the other. Every first batch is
+	// queued ahead of the later ones, which give way to other work too.
+	const int64_t batches = (perChain + StepsPerBatch - 1) / StepsPerBatch;
+	TaskGraph graph;
+	std::vector<int64_t> batchSteps;
+	for (int32_t g = 0; g < groups; g++)
+	{
+		int32_t previous = -1;
+		for (int64_t b = 0; b < batches; b++)
+		{
+			const int64_t steps = perChain * (b + 1) / batches - perChain * b / batches;
+			const int32_t task = graph.add([&runGroup, g, steps]() { runGroup(g, steps); },
+				b == 0 ? TaskPriority::High : TaskPriority::Low);
+			if (previous >= 0)
+				graph.precede(previous, task);
+			previous = task;
+			batchSteps.push_back(steps);
+		}
+	}
+	graph.run(deadline);
+
+	if (splat)
+	{
+		for (int32_t task = 0; task < graph.size(); task++)
+		{
+			if (graph.ran(task))
+				myTotalSamples += batchSteps[task] * ChainsPerGroup;
+		}
+	}
+}
+
+void
+AttractorDensity::merge()
+{
+	const int32_t groups = static_cast<int32_t>(myHistograms.size());
+	std::mutex lock;
+
+	parallelFor(myHeight, [&](int begin, int end)
+	{
+		uint64_t localMax = 0;
+		const size_t first = static_cast<size_t>(begin) * myWidth;
+		const size_t last = static_cast<size_t>(end) * myWidth;
+		for (int32_t g = 0; g < groups; g++)
+		{
+			uint32_t* histogram = myHistograms[g].data();
+			for (size_t i = first; i < last; i++)
+				myDensity[i] += histogram[i];
+			std::fill(histogram + first, histogram + last, 0u);
+		}
+		for (size_t i = first; i < last; i++)
+			localMax = std::max(localMax, myDensity[i]);
+
+		std::lock_guard<std::mutex> guard(lock);
+		myMaxDensity = std::max(myMaxDensity, localMax);
+	}, 16);
+}
+
+void
+AttractorDensity::toneMap(const ImageView& output) const
+{
+	const float scale = myMaxDensity > 0 ? myExposure / std::log1p(float(myMaxDensity)) : 0.0f;
+
+	parallelFor(output.height, [&](int begin, int end)
+	{
+		for (int32_t y = begin; y < end; y++)
+		{
+			const uint64_t* src = &myDensity[static_cast<size_t>(y) * myWidth];
+			float* dst = output.row(y);
+			for (int32_t x = 0; x < myWidth; x++)
+			{
+				// Fades in from black through color 1 to color 2
+				const float t = std::min(1.0f, std::log1p(float(src[x])) * scale);
+				for (int c = 0; c < 3; c++)
+					dst[x * 4 + c] = t * (myColor1[c] + (myColor2[c] - myColor1[c]) * t);
+				dst[x * 4 + 3] = 1.0f;
+			}
+		}
+	}, 16);
+}
+
+bool
+AttractorDensity::cook(const AttractorSettings& settings, int64_t samples, int64_t sampleLimit, double budget,
+						float exposure, const float color1[3], const float color2[3], const ImageView& output)
+{
+	const bool restarted = !myValid || settings != mySettings ||
+		output.width != myWidth || output.height != myHeight;
+	if (restarted)
+	{
+		mySettings = settings;
+		myValid = true;
+		restart(output.width, output.height);
+	}
+
+	bool toneChanged = restarted || exposure != myExposure;
+	myExposure = exposure;
+	for (int c = 0; c < 3; c++)
+	{
+		if (color1[c] != myColor1[c] || color2[c] != myColor2[c])
+			toneChanged = true;
+		myColor1[c] = color1[c];
+		myColor2[c] = color2[c];
+	}
+
+	const bool iterating = samples > 0 && myTotalSamples < sampleLimit;
+	if (iterating)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const int64_t before = myTotalSamples;
+		TaskGraph::Clock::time_point deadline = TaskGraph::Clock::time_point::max();
+		if (budget > 0.0)
+			deadline = start + std::chrono::duration_cast<TaskGraph::Clock::duration>(std::chrono::duration<double>(budget));
+		iterate(std::min(samples, sampleLimit - myTotalSamples), true, deadline);
+		merge();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		mySamplesPerSecond = seconds > 0.0 ? (myTotalSamples - before) / seconds : 0.0;
+	}
+
+	if (!iterating && !toneChanged && myOutputValid)
+		return false;
+
+	toneMap(output);
+	myOutputValid = true;
+	return true;
+}
@@ -0,0 +1,109 @@
+/*
+ * Density renderer for strange attractors, for the TOP's Attractor mode.
+ *
+ * Every worker thread runs a group of independent chains of the map, one per
+ * SIMD lane (8 with AVX2), and counts the pixels they land on in its own
+ * 32-bit histogram. After each cook's iterations the histograms are merged
+ * into a 64-bit density image, which is log tone mapped into the output.
+ *
+ * The chains and the density are kept between cooks, so while the settings
+ * and the resolution stay the same every cook adds more samples and the
+ * image converges. Colours and exposure only re-run the tone mapping.
+ *
+ * A cook can be given a time budget. Each group runs its samples in short
+ * batches, chained in a TaskGraph since they continue the same orbits,
+ * and the batches that haven't started when the budget runs out are left
+ * for the next cook. The first batch of every group has priority over the
+ * others, so even a short budget adds samples from all the chains.
+ */
+
+#ifndef __AttractorDensity__
+#define __AttractorDensity__
+
+#include "ResourceCache.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+enum class AttractorType
+{
+	// x' = sin(a y) + c cos(a x), y' = sin(b x) + d cos(b y)
+	Clifford = 0,
+	// x' = sin(a y) - cos(b x), y' = sin(c x) - cos(d y)
+	DeJong,
+	// Euler steps of the Lorenz system with sigma a, rho b, beta c and time
+	// step d, seen along y
+	Lorenz
+};
+
+struct AttractorSettings
+{
+	AttractorType	type = AttractorType::Clifford;
+	float			a = -1.4f;
+	float			b = 1.6f;
+	float			c = 1.0f;
+	float			d = 0.7f;
+	float			zoom = 1.0f;
+
+	bool		operator==(const AttractorSettings& other) const;
+	bool		operator!=(const AttractorSettings& other) const { return !(*this == other); }
+};
+
+class AttractorDensity
+{
+public:
+	// Chains per worker, the widest lane count
+	static const int32_t	ChainsPerGroup = 8;
+
+	AttractorDensity();
+
+	// Adds 'samples' more points, unless 'sampleLimit' were already added,
+	// and tone maps the density into 'output'. With a 'budget' (in seconds,
+	// 0 for none) the points that don't fit in it are left out. Starts over
+	// when the settings or the output size changed. Returns false without
+	// touching 'output' when nothing was added and the colours are unchanged.
+	bool		cook(const AttractorSettings& settings, int64_t samples, int64_t sampleLimit, double budget,
+					float exposure, const float color1[3], const float color2[3], const ImageView& output);
+
+	// Forces the next cook to start over
+	void		reset();
+	// Makes the next cook tone map into the output again, keeping the
+	// density, for when something else drew over it
+	void		invalidate() { myOutputValid = false; }
+
+	int64_t		totalSamples() const { return myTotalSamples; }
+	// Iteration rate of the last cook that added samples
+	double		samplesPerSecond() const { return mySamplesPerSecond; }
+
+private:
+	void		restart(int32_t width, int32_t height);
+	// Runs about 'samples' steps spread over the chains, skipping the
+	// batches that haven't started by 'deadline'
+	void		iterate(int64_t samples, bool splat,
+						TaskGraph::Clock::time_point deadline = TaskGraph::Clock::time_point::max());
+	// Adds the worker histograms to the density and clears them
+	void		merge();
+	void		toneMap(const ImageView& output) const;
+
+	AttractorSettings	mySettings;
+	bool				myValid;
+	int32_t				myWidth;
+	int32_t				myHeight;
+
+	float				myExposure;
+	float				myColor1[3];
+	float				myColor2[3];
+
+	// Chain state, x, y and z of ChainsPerGroup chains per group
+	std::vector<float>	myChains;
+	std::vector<std::vector<uint32_t>>	myHistograms;
+	std::vector<uint64_t>	myDensity;
+	uint64_t			myMaxDensity;
+
+	int64_t				myTotalSamples;
+	double				mySamplesPerSecond;
+	// Whether 'output' still holds the last tone mapping
+	bool				myOutputValid;
+};
+
+#endif
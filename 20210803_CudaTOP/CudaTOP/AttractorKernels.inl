@@ -0,0 +1,110 @@
+/*
+ * Attractor chain kernels, written once against a small lane abstraction and
+ * included by AttractorDensity.cpp once per instruction set.
+ *
+ * Before including, define:
+ *   ATTRACTOR_TARGET   attribute applied to every function (e.g. SIMD_TARGET_AVX2)
+ *   ATTRACTOR_LANES    number of chains per VF
+ * and provide, in the enclosing namespace, the types VF (floats), VI (int32)
+ * and Mask, plus the helpers used below (vf, vfloor, vtoi, vabs, vlt,
+ * vselect, loadf, storef, storei).
+ */
+
+// sin(x) for any x: reduced to [-pi, pi], folded into [-pi/2, pi/2] and
+// evaluated with a polynomial accurate to a few 1e-6
+ATTRACTOR_TARGET static inline VF
+vsin(VF x)
+{
+	x = x - vf(TwoPi) * vfloor(x * vf(1.0f / TwoPi) + vf(0.5f));
+	x = vselect(vlt(vf(HalfPi), x), vf(Pi) - x, x);
+	x = vselect(vlt(x, vf(-HalfPi)), vf(-Pi) - x, x);
+	VF s = x * x;
+	return x * (vf(1.0f) + s * (vf(-1.0f / 6.0f) + s * (vf(1.0f / 120.0f) +
+		s * (vf(-1.0f / 5040.0f) + s * vf(1.0f / 362880.0f)))));
+}
+
+ATTRACTOR_TARGET static inline VF
+vcos(VF x)
+{
+	return vsin(x + vf(HalfPi));
+}
+
+// Advances ATTRACTOR_LANES chains, whose state starts at x, y and z, by
+// 'iterations' steps, counting every point in 'histogram' unless it is
+// nullptr. Chains that blow up or turn NaN restart from 'seed'.
+ATTRACTOR_TARGET static void
+iterateChains(const ChainParams& p, float* x, float* y, float* z, const float* seed,
+				int64_t iterations, uint32_t* histogram)
+{
+	VF cx = loadf(x);
+	VF cy = loadf(y);
+	VF cz = loadf(z);
+	const VF s = loadf(seed);
+	const VF a = vf(p.a), b = vf(p.b), c = vf(p.c), d = vf(p.d);
+	const VF limit = vf(ChainLimit);
+
+	int32_t px[ATTRACTOR_LANES];
+	int32_t py[ATTRACTOR_LANES];
+
+	for (int64_t i = 0; i < iterations; i++)
+	{
+		VF sx;
+		VF sy;
+		if (p.type == AttractorType::Clifford)
+		{
+			VF nx = vsin(a * cy) + c * vcos(a * cx);
+			VF ny = vsin(b * cx) + d * vcos(b * cy);
+			cx = nx;
+			cy = ny;
+			sx = cx;
+			sy = cy;
+		}
+		else if (p.type == AttractorType::DeJong)
+		{
+			VF nx = vsin(a * cy) - vcos(b * cx);
+			VF ny = vsin(c * cx) - vcos(d * cy);
+			cx = nx;
+			cy = ny;
+			sx = cx;
+			sy = cy;
+		}
+		else
+		{
+			VF dx = a * (cy - cx);
+			VF dy = cx * (b - cz) - cy;
+			VF dz = cx * cy - c * cz;
+			cx = cx + d * dx;
+			cy = cy + d * dy;
+			cz = cz + d * dz;
+			sx = cx;
+			sy = cz;
+		}
+
+		// NaN fails every comparison, so it restarts too
+		Mask ok = vlt(vabs(cx), limit) & vlt(vabs(cy), limit) & vlt(vabs(cz), limit);
+		cx = vselect(ok, cx, s);
+		cy = vselect(ok, cy, s);
+		cz = vselect(ok, cz, s);
+
+		if (!histogram)
+			continue;
+
+		// Points of restarted chains, and ones too far out to convert to
+		// int, go to pixel -1 which is skipped below
+		VF fx = vfloor(sx * vf(p.scaleX) + vf(p.offsetX));
+		VF fy = vfloor(sy * vf(p.scaleY) + vf(p.offsetY));
+		Mask inside = ok & vlt(vabs(fx), vf(PixelLimit)) & vlt(vabs(fy), vf(PixelLimit));
+		storei(px, vtoi(vselect(inside, fx, vf(-1.0f))));
+		storei(py, vtoi(vselect(inside, fy, vf(-1.0f))));
+		for (int l = 0; l < ATTRACTOR_LANES; l++)
+		{
+			if (static_cast<uint32_t>(px[l]) < static_cast<uint32_t>(p.width) &&
+				static_cast<uint32_t>(py[l]) < static_cast<uint32_t>(p.height))
+				histogram[static_cast<size_t>(py[l]) * p.width + px[l]]++;
+		}
+	}
+
+	storef(x, cx);
+	storef(y, cy);
+	storef(z, cz);
+}
@@ -0,0 +1,384 @@
+/*
+ * See ClipCache.h
+ */
+
+#include "ClipCache.h"
+
+#include <algorithm>
+#include <string.h>
+
+ClipCache&
+ClipCache::instance()
+{
+	static ClipCache cache;
+	return cache;
+}
+
+ClipCache::ClipCache() :
+	myAttached(0),
+	myStopping(false),
+	myBudget(int64_t(1024) << 20),
+	myResidentBytes(0),
+	myHeadFrames(30),
+	myClock(0),
+	myHeadHits(0),
+	myHeadMisses(0),
+	myEvictedFrames(0)
+{
+}
+
+ClipCache::~ClipCache()
+{
+	// The last detach() already stopped the worker
+}
+
+void
+ClipCache::attach()
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	if (myAttached++ == 0)
+	{
+		myStopping = false;
+		myWorker = std::thread(&ClipCache::workerLoop, this);
+	}
+}
+
+void
+ClipCache::detach()
+{
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		if (--myAttached > 0)
+			return;
+		myStopping = true;
+	}
+	myJobReady.notify_all();
+	myWorker.join();
+
+	// Nobody plays anything anymore, unmap everything
+	std::lock_guard<std::mutex> lock(myMutex);
+	myJobs.clear();
+	myCues.clear();
+	myClips.clear();
+	myResidentBytes = 0;
+}
+
+std::shared_ptr<CachedClip>
+ClipCache::openLocked(const std::string& path, const char*& error)
+{
+	auto it = myClips.find(path);
+	if (it != myClips.end())
+		return it->second;
+
+	std::shared_ptr<CachedClip> clip = std::make_shared<CachedClip>();
+	if (!clip->myContainer.open(path.c_str()))
+	{
+		error = clip->myContainer.error();
+		return nullptr;
+	}
+	resizeHead(*clip);
+	myClips[path] = clip;
+	return clip;
+}
+
+std::shared_ptr<CachedClip>
+ClipCache::acquire(const std::string& path, const char*& error)
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	error = nullptr;
+	std::shared_ptr<CachedClip> clip = openLocked(path, error);
+	if (clip)
+		clip->myLastUsed = ++myClock;
+	dropUnused();
+	return clip;
+}
+
+void
+ClipCache::resizeHead(CachedClip& clip)
+{
+	const size_t frames = static_cast<size_t>(std::min(myHeadFrames, clip.myContainer.frameCount()));
+	for (size_t f = frames; f < clip.myHead.size(); f++)
+	{
+		if (clip.myHead[f])
+		{
+			clip.myResident--;
+			myResidentBytes -= clip.myContainer.frameBytes();
+		}
+	}
+	clip.myHead.resize(frames);
+}
+
+void
+ClipCache::queueHead(const std::shared_ptr<CachedClip>& clip)
+{
+	// Drop what's queued for it already, then queue every missing frame in order
+	myJobs.erase(std::remove_if(myJobs.begin(), myJobs.end(),
+					[&](const Job& job) { return job.clip == clip; }), myJobs.end());
+	for (int32_t f = 0; f < static_cast<int32_t>(clip->myHead.size()); f++)
+	{
+		if (!clip->myHead[f])
+			myJobs.push_back({ clip, f });
+	}
+	myJobReady.notify_all();
+}
+
+void
+ClipCache::setCues(const void* owner, const std::vector<std::string>& paths,
+					const std::vector<int32_t>& priorities)
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+
+	std::vector<std::pair<std::string, int32_t>>& cues = myCues[owner];
+	cues.clear();
+	for (size_t i = 0; i < paths.size(); i++)
+		cues.emplace_back(paths[i], i < priorities.size() ? priorities[i] : 0);
+	if (cues.empty())
+		myCues.erase(owner);
+
+	for (auto& it : myClips)
+	{
+		it.second->myCued = false;
+		it.second->myPriority = 0;
+	}
+
+	// A clip cued by several owners gets the highest priority any gave it
+	std::vector<std::shared_ptr<CachedClip>> cued;
+	for (const auto& list : myCues)
+	{
+		for (const auto& cue : list.second)
+		{
+			const char* error = nullptr;
+			std::shared_ptr<CachedClip> clip = openLocked(cue.first, error);
+			if (!clip)
+				continue;
+			if (!clip->myCued)
+			{
+				clip->myCued = true;
+				clip->myPriority = cue.second;
+				cued.push_back(clip);
+			}
+			else
+			{
+				clip->myPriority = std::max(clip->myPriority, cue.second);
+			}
+		}
+	}
+
+	// Highest priority clips warm up first
+	std::stable_sort(cued.begin(), cued.end(),
+		[](const std::shared_ptr<CachedClip>& a, const std::shared_ptr<CachedClip>& b)
+		{
+			return a->myPriority > b->myPriority;
+		});
+	myJobs.clear();
+	for (const std::shared_ptr<CachedClip>& clip : cued)
+		queueHead(clip);
+
+	enforceBudget();
+	dropUnused();
+}
+
+void
+ClipCache::setBudget(int64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	if (bytes == myBudget)
+		return;
+
+	const bool grew = bytes > myBudget;
+	myBudget = bytes;
+	enforceBudget();
+
+	// Frames that were skipped for lack of room may fit now
+	if (grew)
+	{
+		for (auto& it : myClips)
+		{
+			if (it.second->myCued)
+				queueHead(it.second);
+		}
+	}
+}
+
+void
+ClipCache::setHeadFrames(int32_t frames)
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	if (frames == myHeadFrames)
+		return;
+
+	myHeadFrames = frames;
+	for (auto& it : myClips)
+	{
+		resizeHead(*it.second);
+		if (it.second->myCued)
+			queueHead(it.second);
+	}
+}
+
+bool
+ClipCache::evictsBefore(const CachedClip& a, const CachedClip& b) const
+{
+	if (a.myCued != b.myCued)
+		return !a.myCued;
+	if (a.myPriority != b.myPriority)
+		return a.myPriority < b.myPriority;
+	return a.myLastUsed < b.myLastUsed;
+}
+
+CachedClip*
+ClipCache::evictionVictim() const
+{
+	CachedClip* victim = nullptr;
+	for (const auto& it : myClips)
+	{
+		CachedClip* clip = it.second.get();
+		if (clip->myResident > 0 && (!victim || evictsBefore(*clip, *victim)))
+			victim = clip;
+	}
+	return victim;
+}
+
+void
+ClipCache::enforceBudget()
+{
+	while (myResidentBytes > myBudget)
+	{
+		CachedClip* victim = evictionVictim();
+		if (!victim)
+			break;
+
+		// The frames furthest from the start go first
+		for (size_t f = victim->myHead.size(); f-- > 0; )
+		{
+			if (victim->myHead[f])
+			{
+				victim->myHead[f].reset();
+				victim->myResident--;
+				myResidentBytes -= victim->myContainer.frameBytes();
+				myEvictedFrames++;
+				break;
+			}
+		}
+	}
+}
+
+void
+ClipCache::dropUnused()
+{
+	// Clips nobody plays, cues or holds frames of only cost a mapping
+	for (auto it = myClips.begin(); it != myClips.end(); )
+	{
+		const CachedClip& clip = *it->second;
+		if (it->second.use_count() == 1 && !clip.myCued && clip.myResident == 0)
+			it = myClips.erase(it);
+		else
+			++it;
+	}
+}
+
+void
+ClipCache::workerLoop()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(myMutex);
+			myJobReady.wait(lock, [this]() { return myStopping || !myJobs.empty(); });
+			if (myStopping)
+				return;
+			job = std::move(myJobs.front());
+			myJobs.pop_front();
+
+			CachedClip& clip = *job.clip;
+			if (!clip.myCued || job.frame >= static_cast<int32_t>(clip.myHead.size()) || clip.myHead[job.frame])
+				continue;
+
+			// Only take room from clips that would be evicted before this one
+			const int64_t bytes = static_cast<int64_t>(clip.myContainer.frameBytes());
+			if (myResidentBytes + bytes > myBudget)
+			{
+				CachedClip* victim = evictionVictim();
+				if (!victim || !evictsBefore(*victim, clip))
+					continue;
+			}
+		}
+
+		std::shared_ptr<std::vector<uint8_t>> frame =
+			std::make_shared<std::vector<uint8_t>>(job.clip->myContainer.frameBytes());
+		bool ok = job.clip->myContainer.decode(job.frame, frame->data());
+
+		std::lock_guard<std::mutex> lock(myMutex);
+		CachedClip& clip = *job.clip;
+		if (ok && job.frame < static_cast<int32_t>(clip.myHead.size()) && !clip.myHead[job.frame])
+		{
+			clip.myHead[job.frame] = frame;
+			clip.myResident++;
+			myResidentBytes += frame->size();
+			enforceBudget();
+		}
+	}
+}
+
+bool
+ClipCache::decode(const CachedClip& clip, int32_t frame, void* dst)
+{
+	std::shared_ptr<const std::vector<uint8_t>> resident;
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		if (frame >= 0 && frame < static_cast<int32_t>(clip.myHead.size()))
+		{
+			resident = clip.myHead[frame];
+			if (resident)
+				myHeadHits++;
+			else
+				myHeadMisses++;
+		}
+	}
+
+	if (resident)
+	{
+		memcpy(dst, resident->data(), resident->size());
+		return true;
+	}
+	return clip.myContainer.decode(frame, dst);
+}
+
+void
+ClipCache::touch(CachedClip& clip)
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	clip.myLastUsed = ++myClock;
+}
+
+ClipCacheStats
+ClipCache::stats()
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	ClipCacheStats s;
+	s.clips = static_cast<int32_t>(myClips.size());
+	s.residentBytes = myResidentBytes;
+	s.budgetBytes = myBudget;
+	s.headHits = myHeadHits;
+	s.headMisses = myHeadMisses;
+	s.evictedFrames = myEvictedFrames;
+	return s;
+}
+
+std::vector<ClipResidency>
+ClipCache::residency()
+{
+	std::lock_guard<std::mutex> lock(myMutex);
+	std::vector<ClipResidency> result;
+	for (const auto& it : myClips)
+	{
+		ClipResidency r;
+		r.path = it.first;
+		r.residentFrames = it.second->myResident;
+		r.frameCount = it.second->myContainer.frameCount();
+		r.priority = it.second->myPriority;
+		result.push_back(r);
+	}
+	return result;
+}
@@ -0,0 +1,138 @@
+/*
+ * Process wide cache of the clips played by the TOP's Player mode.
+ *
+ * Every clip is mapped once, however many Player TOPs use it. Clips that are
+ * cued also get their first frames decoded into RAM in the background, so
+ * switching to a cued clip shows its first frame on the same cook without
+ * touching the disk. The decoded frames of all clips share one memory budget;
+ * when it is exceeded, frames are evicted from the end of the lowest
+ * priority, least recently used clip first.
+ *
+ * The budget and the number of head frames are shared by every instance, the
+ * values set last apply. The background thread runs while at least one
+ * FramePlayer exists.
+ */
+
+#ifndef __ClipCache__
+#define __ClipCache__
+
+#include "FrameContainer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CachedClip
+{
+public:
+	const FrameContainer&	container() const { return myContainer; }
+
+private:
+	friend class ClipCache;
+
+	FrameContainer			myContainer;
+
+	// Decoded frames from the start of the clip, nullptr where not resident
+	std::vector<std::shared_ptr<const std::vector<uint8_t>>>	myHead;
+	int32_t					myResident = 0;
+	int32_t					myPriority = 0;
+	bool					myCued = false;
+	uint64_t				myLastUsed = 0;
+};
+
+struct ClipCacheStats
+{
+	int32_t		clips = 0;
+	int64_t		residentBytes = 0;
+	int64_t		budgetBytes = 0;
+	int64_t		headHits = 0;
+	int64_t		headMisses = 0;
+	int64_t		evictedFrames = 0;
+};
+
+struct ClipResidency
+{
+	std::string	path;
+	int32_t		residentFrames;
+	int32_t		frameCount;
+	int32_t		priority;
+};
+
+class ClipCache
+{
+public:
+	static ClipCache&	instance();
+
+	// Every FramePlayer attaches while it exists
+	void		attach();
+	void		detach();
+
+	// Maps the clip, or returns the mapping another instance already has.
+	// Returns nullptr if it can't be played, with 'error' set.
+	std::shared_ptr<CachedClip>	acquire(const std::string& path, const char*& error);
+
+	// Marks the clips that should have their head frames resident, replacing
+	// the previous cue list of 'owner'. Higher priorities are evicted last.
+	void		setCues(const void* owner, const std::vector<std::string>& paths,
+						const std::vector<int32_t>& priorities);
+
+	void		setBudget(int64_t bytes);
+	void		setHeadFrames(int32_t frames);
+
+	// Copies the frame from RAM when it is resident, decodes it from the
+	// mapping otherwise. Thread safe.
+	bool		decode(const CachedClip& clip, int32_t frame, void* dst);
+
+	// Marks the clip as just played for the LRU order
+	void		touch(CachedClip& clip);
+
+	ClipCacheStats				stats();
+	std::vector<ClipResidency>	residency();
+
+private:
+	ClipCache();
+	~ClipCache();
+
+	struct Job
+	{
+		std::shared_ptr<CachedClip>	clip;
+		int32_t						frame;
+	};
+
+	void		workerLoop();
+	std::shared_ptr<CachedClip>	openLocked(const std::string& path, const char*& error);
+	void		resizeHead(CachedClip& clip);
+	void		queueHead(const std::shared_ptr<CachedClip>& clip);
+	// Clip whose frames are evicted first, nullptr if none has any resident
+	CachedClip*	evictionVictim() const;
+	bool		evictsBefore(const CachedClip& a, const CachedClip& b) const;
+	void		enforceBudget();
+	void		dropUnused();
+
+	std::mutex				myMutex;
+	std::condition_variable	myJobReady;
+	std::deque<Job>			myJobs;
+	std::thread				myWorker;
+	int32_t					myAttached;
+	bool					myStopping;
+
+	std::map<std::string, std::shared_ptr<CachedClip>>	myClips;
+	// Cue list of every owner, path and priority
+	std::map<const void*, std::vector<std::pair<std::string, int32_t>>>	myCues;
+
+	int64_t					myBudget;
+	int64_t					myResidentBytes;
+	int32_t					myHeadFrames;
+	uint64_t				myClock;
+
+	int64_t					myHeadHits;
+	int64_t					myHeadMisses;
+	int64_t					myEvictedFrames;
+};
+
+#endif
@@ -20,7 +20,8 @@
 #include <string.h>
 #endif
 #include <cstdio>
-#include "cuda_runtime.h"
+
+#include "Parallel.h"
 
 static const char *vertexShader = "#version 330\n\
 uniform mat4 uModelView; \
@@ -52,7 +53,11 @@ FillTOPPluginInfo(TOP_PluginInfo *info)
 	info->apiVersion = TOPCPlusPlusAPIVersion;
 
 	// Change this to change the executeMode behavior of this plugin.
+#ifdef CUDATOP_CPU_BACKEND
+	info->executeMode = TOP_ExecuteMode::CPUMemWriteOnly;
+#else
 	info->executeMode = TOP_ExecuteMode::CUDA;
+#endif
 
 	// The opType is the unique name for this TOP. It must start with a 
 	// capital A-Z character, and all the following characters must lower case
@@ -83,6 +88,7 @@ CreateTOPInstance(const OP_NodeInfo* info, TOP_Context *context)
 
 	// Note we can't do any OpenGL work during instantiation
 
+	ThreadPool::acquire();
 	return new CudaTOP(info, context);
 }
 
@@ -98,6 +104,7 @@ DestroyTOPInstance(TOP_CPlusPlusBase* instance, TOP_Context *context)
 	// to set up our OpenGL context
 
 	delete (CudaTOP*)instance;
+	ThreadPool::release();
 
 }
 
@@ -107,18 +114,18 @@ DestroyTOPInstance(TOP_CPlusPlusBase* instance, TOP_Context *context)
 CudaTOP::CudaTOP(const OP_NodeInfo* info, TOP_Context *context) :
 	myNodeInfo(info), myExecuteCount(0),
 	myError(nullptr),
-	myInputSurface(0),
-	myOutputSurface(0)
+	myMode(TOPMode::Filter),
+	myFilterLevel(0),
+	myFilterSigma(0.0f),
+	myCueDATId(0),
+	myCueDATCooks(-1)
 {
 
 }
 
 CudaTOP::~CudaTOP()
 {
-	if (myInputSurface)
-		cudaDestroySurfaceObject(myInputSurface);
-	if (myOutputSurface)
-		cudaDestroySurfaceObject(myOutputSurface);
+	// myCache destroys any surface objects it still holds
 }
 
 void
@@ -128,6 +135,30 @@ CudaTOP::getGeneralInfo(TOP_GeneralInfo* ginfo, const OP_Inputs *inputs, void* r
 	// if none of its inputs/parameters are changing. Set it to false if it
 	// only needs to cook when inputs/parameters change.
 	ginfo->cookEveryFrame = true;
+
+	// The CPU kernels all work on RGBA32F pixels
+	ginfo->memPixelType = OP_CPUMemPixelType::RGBA32Float;
+
+	// Player mode hands over the clip's frames as they are stored. In any
+	// other mode this cook may reallocate cpuPixelData, so no decode can
+	// still be writing to it.
+	const bool player = static_cast<TOPMode>(inputs->getParInt("Mode")) == TOPMode::Player;
+	if (!player)
+		myPlayer.dropBuffers();
+	if (player && myPlayer.open(getPlayerClip(inputs)))
+	{
+		switch (myPlayer.container().pixelFormat())
+		{
+			case FramePixelFormat::BGRA8:
+				ginfo->memPixelType = OP_CPUMemPixelType::BGRA8Fixed;
+				break;
+			case FramePixelFormat::RGBA8:
+				ginfo->memPixelType = OP_CPUMemPixelType::RGBA8Fixed;
+				break;
+			default:
+				break;
+		}
+	}
 }
 
 bool
@@ -137,36 +168,52 @@ CudaTOP::getOutputFormat(TOP_OutputFormat* format, const OP_Inputs *inputs, void
 	// the pixel format/resolution etc that we want to output to.
 	// If we did that, we'd want to return true to tell the TOP to use the settings we've
 	// specified.
-	// In this example we'll return false and use the TOP's settings
-	return false;
-}
-
-extern cudaError_t doCUDAOperation(int width, int height, cudaSurfaceObject_t input, cudaSurfaceObject_t output);
-
-static void
-setupCudaSurface(cudaSurfaceObject_t* surface, cudaArray_t array)
-{
-	if (*surface)
+	// In this example we'll return false and use the TOP's settings, except
+	// in Player mode where the output follows the clip and in Fluid mode,
+	// which needs a float format.
+	if (static_cast<TOPMode>(inputs->getParInt("Mode")) == TOPMode::Player &&
+		myPlayer.open(getPlayerClip(inputs)))
 	{
-		cudaResourceDesc desc;
-		cudaGetSurfaceObjectResourceDesc(&desc, *surface);
-		if (desc.resType != cudaResourceTypeArray ||
-			desc.res.array.array != array)
-		{
-			cudaDestroySurfaceObject(*surface);
-			*surface = 0;
-		}
+		const FrameContainer& clip = myPlayer.container();
+		format->width = clip.width();
+		format->height = clip.height();
+		format->floatPrecision = clip.pixelFormat() == FramePixelFormat::RGBA32F;
+		format->bitsPerChannel = format->floatPrecision ? 32 : 8;
+		return true;
 	}
 
-	if (!*surface)
+	// Fluid mode outputs signed velocities and dye above 1
+	if (static_cast<TOPMode>(inputs->getParInt("Mode")) == TOPMode::Fluid)
 	{
-		cudaResourceDesc desc;
-		desc.resType = cudaResourceTypeArray;
-		desc.res.array.array = array;
-		cudaCreateSurfaceObject(surface, &desc);
+		format->floatPrecision = true;
+		format->bitsPerChannel = 32;
+		return true;
 	}
+	return false;
 }
 
+#ifdef CUDATOP_CPU_BACKEND
+extern void doCPUOperation(const TilePlan& plan, const std::vector<int32_t>& tiles,
+							const float* input, const ImageView& output);
+#else
+extern cudaError_t doCUDAOperation(int width, int height, dim3 gridSize, dim3 blockSize,
+									cudaSurfaceObject_t input, cudaSurfaceObject_t output);
+#endif
+
+// Edge length of the square tiles the CPU kernels are split into
+static const int CPUTileSize = 64;
+
+// Pixels around an output pixel that the CPU filter kernel reads
+static const int CPUFilterHalo = 1;
+
+// Ids for the scratch images held in the ResourceCache
+enum ScratchId
+{
+	ScratchOutput = 0,
+	ScratchFilter,
+	ScratchFilterLow,
+};
+
 void
 CudaTOP::execute(TOP_OutputFormatSpecs* outputFormat ,
 							const OP_Inputs* inputs,
@@ -176,19 +223,594 @@ CudaTOP::execute(TOP_OutputFormatSpecs* outputFormat ,
 	myError = nullptr;
 	myExecuteCount++;
 
+	TOPMode previousMode = myMode;
+	myMode = static_cast<TOPMode>(inputs->getParInt("Mode"));
+
+	// Another mode's output replaced the image that was uploaded, so the
+	// modes that only write what changed start from a full image again
+	if (myMode != previousMode)
+	{
+		myDirtyTiles.invalidate();
+		myFractal.invalidate();
+		myNoise.invalidate();
+		myText.invalidate();
+		myAttractor.invalidate();
+	}
+
+	// The other modes write to cpuPixelData[0], which a decode ahead may
+	// still be filling
+	if (myMode != TOPMode::Player)
+		myPlayer.dropBuffers();
+
+#ifdef CUDATOP_CPU_BACKEND
+	const bool filter = myMode == TOPMode::Filter;
+#else
+	// The CUDA kernel always runs at the output resolution
+	const bool filter = false;
+#endif
+	inputs->enablePar("Processscale", filter);
+	inputs->enablePar("Edgesigma", filter && inputs->getParInt("Processscale") > 0);
+
+	inputs->enablePar("Fractaltype", myMode == TOPMode::Fractal);
+	inputs->enablePar("Center", myMode == TOPMode::Fractal);
+	inputs->enablePar("Zoom", myMode == TOPMode::Fractal);
+	inputs->enablePar("Iterations", myMode == TOPMode::Fractal);
+	inputs->enablePar("Juliaconst", myMode == TOPMode::Fractal);
+
+	const bool noise = myMode == TOPMode::Noise;
+	const int noiseDims = inputs->getParInt("Dimensions") + 2;
+	inputs->enablePar("Noisetype", noise);
+	inputs->enablePar("Dimensions", noise);
+	inputs->enablePar("Fractal", noise);
+	inputs->enablePar("Octaves", noise);
+	inputs->enablePar("Frequency", noise);
+	inputs->enablePar("Lacunarity", noise);
+	inputs->enablePar("Gain", noise);
+	inputs->enablePar("Translate", noise);
+	inputs->enablePar("Slice", noise && noiseDims == 4);
+	inputs->enablePar("Time", noise && noiseDims > 2);
+	inputs->enablePar("Animoctaves", noise && noiseDims > 2);
+	inputs->enablePar("Seed", noise);
+
+	const bool feedback = myMode == TOPMode::Feedback;
+	inputs->enablePar("Feedbackop", feedback);
+	inputs->enablePar("Decay", feedback);
+	inputs->enablePar("Historylength", feedback);
+
+	const bool fluid = myMode == TOPMode::Fluid;
+	inputs->enablePar("Timestep", fluid);
+	inputs->enablePar("Vorticity", fluid);
+	inputs->enablePar("Dissipation", fluid);
+	inputs->enablePar("Pressuresolver", fluid);
+	inputs->enablePar("Pressureiters", fluid);
+	inputs->enablePar("Tolerance", fluid);
+	inputs->enablePar("Source", fluid);
+	inputs->enablePar("Sourceradius", fluid);
+	inputs->enablePar("Sourcevelocity", fluid);
+	inputs->enablePar("Sourcedye", fluid);
+	inputs->enablePar("Inputforce", fluid);
+
+	const bool text = myMode == TOPMode::Text;
+	inputs->enablePar("Textdat", text);
+	inputs->enablePar("Font", text);
+	inputs->enablePar("Fontsize", text);
+	inputs->enablePar("Glyphcache", text);
+
+	const bool player = myMode == TOPMode::Player;
+	inputs->enablePar("Clipfile", player);
+	inputs->enablePar("Playmode", player);
+	inputs->enablePar("Frameindex", player && inputs->getParInt("Playmode") == int(PlayerMode::Index));
+	inputs->enablePar("Speed", player && inputs->getParInt("Playmode") == int(PlayerMode::Sequential));
+	inputs->enablePar("Readahead", player);
+	inputs->enablePar("Cuedat", player);
+	inputs->enablePar("Cueindex", player);
+	inputs->enablePar("Cachebudget", player);
+	inputs->enablePar("Headframes", player);
+
+	const bool attractor = myMode == TOPMode::Attractor;
+	inputs->enablePar("Attractortype", attractor);
+	inputs->enablePar("Coefficients", attractor);
+	inputs->enablePar("Attractorzoom", attractor);
+	inputs->enablePar("Samples", attractor);
+	inputs->enablePar("Samplelimit", attractor);
+	inputs->enablePar("Timebudget", attractor);
+	inputs->enablePar("Exposure", attractor);
+
+	switch (myMode)
+	{
+		case TOPMode::Fractal:
+			executeFractal(outputFormat, inputs);
+			break;
+
+		case TOPMode::Noise:
+			executeNoise(outputFormat, inputs);
+			break;
+
+		case TOPMode::Feedback:
+			executeFeedback(outputFormat, inputs);
+			break;
+
+		case TOPMode::Fluid:
+			executeFluid(outputFormat, inputs);
+			break;
+
+		case TOPMode::Text:
+			executeText(outputFormat, inputs);
+			break;
+
+		case TOPMode::Player:
+			executePlayer(outputFormat, inputs);
+			break;
+
+		case TOPMode::Attractor:
+			executeAttractor(outputFormat, inputs);
+			break;
+
+		case TOPMode::Filter:
+		default:
+			executeFilter(outputFormat, inputs);
+			break;
+	}
+}
+
+ImageView
+CudaTOP::beginCPUOutput(TOP_OutputFormatSpecs* outputFormat)
+{
+#ifdef CUDATOP_CPU_BACKEND
+	ImageView view;
+	view.pixels = static_cast<float*>(outputFormat->cpuPixelData[0]);
+	view.width = outputFormat->width;
+	view.height = outputFormat->height;
+	return view;
+#else
+	return myCache.getScratch(ScratchOutput, outputFormat->width, outputFormat->height).view();
+#endif
+}
+
+void
+CudaTOP::endCPUOutput(TOP_OutputFormatSpecs* outputFormat, const ImageView& image, bool changed)
+{
+#ifdef CUDATOP_CPU_BACKEND
+	// The image already is cpuPixelData[0]
+	(void)image;
+
+	// Nothing new was written, keep the previously uploaded texture
+	outputFormat->newCPUPixelDataLocation = changed ? 0 : -1;
+#else
+	// The output array isn't guaranteed to keep its contents between cooks,
+	// so the cached image is uploaded even when it didn't change.
+	(void)changed;
+	size_t width = image.width;
+	size_t height = image.height;
+
+	if (outputFormat->pixelFormat == GL_RGBA32F)
+	{
+		cudaMemcpy2DToArray(outputFormat->cudaOutput[0], 0, 0, image.pixels,
+							width * 4 * sizeof(float), width * 4 * sizeof(float), height,
+							cudaMemcpyHostToDevice);
+	}
+	else if (outputFormat->redBits == 8 &&
+			outputFormat->greenBits == 8 &&
+			outputFormat->blueBits == 8 &&
+			outputFormat->alphaBits == 8)
+	{
+		uint8_t* staging = myCache.getStaging(width * height * 4);
+		parallelFor(static_cast<int>(height), [&](int begin, int end)
+		{
+			for (int y = begin; y < end; y++)
+			{
+				const float* src = image.row(y);
+				uint8_t* dst = staging + static_cast<size_t>(y) * width * 4;
+				for (size_t i = 0; i < width * 4; i++)
+				{
+					float v = src[i] < 0.0f ? 0.0f : (src[i] > 1.0f ? 1.0f : src[i]);
+					dst[i] = static_cast<uint8_t>(v * 255.0f + 0.5f);
+				}
+			}
+		}, 16);
+
+		cudaMemcpy2DToArray(outputFormat->cudaOutput[0], 0, 0, staging,
+							width * 4, width * 4, height, cudaMemcpyHostToDevice);
+	}
+	else
+	{
+		myError = "CPU modes can only output 8-bit fixed or 32-bit float RGBA textures.";
+	}
+#endif
+}
+
+void
+CudaTOP::executeFractal(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
 	double color1[3];
 	double color2[3];
+	inputs->getParDouble3("Color1", color1[0], color1[1], color1[2]);
+	inputs->getParDouble3("Color2", color2[0], color2[1], color2[2]);
+
+	float c1[3] = { float(color1[0]), float(color1[1]), float(color1[2]) };
+	float c2[3] = { float(color2[0]), float(color2[1]), float(color2[2]) };
+
+	FractalView view;
+	view.type = static_cast<FractalType>(inputs->getParInt("Fractaltype"));
+	inputs->getParDouble2("Center", view.centerX, view.centerY);
+	view.zoom = inputs->getParDouble("Zoom");
+	view.maxIterations = inputs->getParInt("Iterations");
+	inputs->getParDouble2("Juliaconst", view.juliaX, view.juliaY);
+
+	if (view.zoom <= 0.0)
+	{
+		myError = "Zoom must be greater than zero.";
+		return;
+	}
+
+	const TilePlan& plan = myCache.getTilePlan(outputFormat->width, outputFormat->height, CPUTileSize);
+
+	ImageView image = beginCPUOutput(outputFormat);
+	bool changed = myFractal.cook(view, c1, c2, plan, image);
+	endCPUOutput(outputFormat, image, changed);
+}
+
+void
+CudaTOP::executeNoise(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
+	NoiseSettings settings;
+	settings.type = static_cast<NoiseType>(inputs->getParInt("Noisetype"));
+	settings.dimensions = inputs->getParInt("Dimensions") + 2;
+	settings.fractal = static_cast<NoiseFractal>(inputs->getParInt("Fractal"));
+	settings.octaves = inputs->getParInt("Octaves");
+	settings.frequency = float(inputs->getParDouble("Frequency"));
+	settings.lacunarity = float(inputs->getParDouble("Lacunarity"));
+	settings.gain = float(inputs->getParDouble("Gain"));
+
+	double tx, ty;
+	inputs->getParDouble2("Translate", tx, ty);
+	settings.offsetX = float(tx);
+	settings.offsetY = float(ty);
+
+	settings.slice = float(inputs->getParDouble("Slice"));
+	settings.time = float(inputs->getParDouble("Time"));
+	settings.animOctaves = inputs->getParInt("Animoctaves");
+	settings.seed = static_cast<uint32_t>(inputs->getParInt("Seed"));
+
+	const TilePlan& plan = myCache.getTilePlan(outputFormat->width, outputFormat->height, CPUTileSize);
+
+	ImageView image = beginCPUOutput(outputFormat);
+	bool changed = myNoise.cook(settings, plan, image);
+	endCPUOutput(outputFormat, image, changed);
+}
+
+bool
+CudaTOP::getCPUInput(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs, const float*& pixels)
+{
+	pixels = nullptr;
+	if (inputs->getNumInputs() == 0)
+		return true;
+
+	const OP_TOPInput* topInput = inputs->getInputTOP(0);
+
+	if (topInput->width != outputFormat->width ||
+		topInput->height != outputFormat->height)
+	{
+		myError = "Input and outupt resolution must be the same.";
+		return false;
+	}
+
+	OP_TOPInputDownloadOptions options;
+	options.cpuMemPixelType = OP_CPUMemPixelType::RGBA32Float;
+	pixels = static_cast<const float*>(inputs->getTOPDataInCPUMemory(topInput, &options));
+
+	// Delayed downloads have nothing for us on the first cook
+	return pixels != nullptr;
+}
+
+void
+CudaTOP::executeFeedback(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
+	if (inputs->getNumInputs() == 0)
+	{
+		myError = "Feedback mode needs an input TOP.";
+		return;
+	}
+
+	const float* inputPixels = nullptr;
+	if (!getCPUInput(outputFormat, inputs, inputPixels))
+	{
+		// Keep showing whatever was uploaded last
+		if (!myError)
+			endCPUOutput(outputFormat, beginCPUOutput(outputFormat), false);
+		return;
+	}
+
+	FeedbackSettings settings;
+	settings.op = static_cast<FeedbackOp>(inputs->getParInt("Feedbackop"));
+	settings.decay = float(inputs->getParDouble("Decay"));
+	settings.length = inputs->getParInt("Historylength");
+
+	ImageView image = beginCPUOutput(outputFormat);
+	myFeedback.cook(settings, inputPixels, image);
+	endCPUOutput(outputFormat, image, true);
+}
+
+void
+CudaTOP::executeFluid(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
+	// The input is optional, the fluid keeps moving while a delayed download
+	// has nothing for us yet
+	const float* inputPixels = nullptr;
+	if (!getCPUInput(outputFormat, inputs, inputPixels) && myError)
+		return;
+
+	FluidSettings settings;
+	settings.timestep = float(inputs->getParDouble("Timestep"));
+	settings.vorticity = float(inputs->getParDouble("Vorticity"));
+	settings.dissipation = float(inputs->getParDouble("Dissipation"));
+	settings.solver = static_cast<FluidPressureSolver>(inputs->getParInt("Pressuresolver"));
+	settings.maxIterations = inputs->getParInt("Pressureiters");
+	settings.tolerance = float(inputs->getParDouble("Tolerance"));
+
+	double x, y;
+	inputs->getParDouble2("Source", x, y);
+	settings.sourceX = float(x);
+	settings.sourceY = float(y);
+	settings.sourceRadius = float(inputs->getParDouble("Sourceradius"));
+	inputs->getParDouble2("Sourcevelocity", x, y);
+	settings.sourceVelX = float(x);
+	settings.sourceVelY = float(y);
+	settings.sourceDye = float(inputs->getParDouble("Sourcedye"));
+	settings.inputForce = float(inputs->getParDouble("Inputforce"));
+
+	const TilePlan& plan = myCache.getTilePlan(outputFormat->width, outputFormat->height, CPUTileSize);
+
+	ImageView image = beginCPUOutput(outputFormat);
+	myFluid.step(settings, inputPixels, plan, image);
+	endCPUOutput(outputFormat, image, true);
+}
+
+void
+CudaTOP::executeText(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
+	TextAtlasSettings settings;
+	settings.fontPath = inputs->getParString("Font");
+	settings.pixelSize = float(inputs->getParDouble("Fontsize"));
+	settings.glyphCacheSize = inputs->getParInt("Glyphcache");
+
+	double color[3];
+	inputs->getParDouble3("Color1", color[0], color[1], color[2]);
+	for (int i = 0; i < 3; i++)
+		settings.color[i] = float(color[i]);
+
+	// One line per row, taken from the first column
+	const OP_DATInput* dat = inputs->getParDAT("Textdat");
+	std::vector<const char*> rows;
+	if (dat && dat->numCols > 0)
+	{
+		rows.resize(dat->numRows);
+		for (int32_t r = 0; r < dat->numRows; r++)
+			rows[r] = dat->getCell(r, 0);
+	}
+
+	ImageView image = beginCPUOutput(outputFormat);
+	bool changed = myText.cook(settings, rows, image);
+	if (myText.error())
+	{
+		myError = myText.error();
+		return;
+	}
+	endCPUOutput(outputFormat, image, changed);
+}
 
-	// Color isn't actually used in the example right now, but we have this
-	// here just to illustrate querying parameters.
+void
+CudaTOP::executeAttractor(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
+	double color1[3];
+	double color2[3];
 	inputs->getParDouble3("Color1", color1[0], color1[1], color1[2]);
 	inputs->getParDouble3("Color2", color2[0], color2[1], color2[2]);
 
+	float c1[3] = { float(color1[0]), float(color1[1]), float(color1[2]) };
+	float c2[3] = { float(color2[0]), float(color2[1]), float(color2[2]) };
+
+	double coefficients[4];
+	inputs->getParDouble4("Coefficients", coefficients[0], coefficients[1], coefficients[2], coefficients[3]);
+
+	AttractorSettings settings;
+	settings.type = static_cast<AttractorType>(inputs->getParInt("Attractortype"));
+	settings.a = float(coefficients[0]);
+	settings.b = float(coefficients[1]);
+	settings.c = float(coefficients[2]);
+	settings.d = float(coefficients[3]);
+	settings.zoom = float(inputs->getParDouble("Attractorzoom"));
+
+	// Both in millions of points
+	int64_t samples = static_cast<int64_t>(inputs->getParDouble("Samples") * 1.0e6);
+	int64_t sampleLimit = static_cast<int64_t>(inputs->getParDouble("Samplelimit") * 1.0e6);
+	// In milliseconds, the samples that don't fit in it are left out
+	double budget = inputs->getParDouble("Timebudget") / 1000.0;
+
+	ImageView image = beginCPUOutput(outputFormat);
+	bool changed = myAttractor.cook(settings, samples, sampleLimit, budget, float(inputs->getParDouble("Exposure")),
+									c1, c2, image);
+	endCPUOutput(outputFormat, image, changed);
+}
+
+std::string
+CudaTOP::getPlayerClip(const OP_Inputs* inputs)
+{
+	const OP_DATInput* cues = inputs->getParDAT("Cuedat");
+	if (cues && cues->numRows > 0 && cues->numCols > 0)
+	{
+		int32_t row = std::min(std::max(inputs->getParInt("Cueindex"), 0), cues->numRows - 1);
+		return cues->getCell(row, 0);
+	}
+	return inputs->getParString("Clipfile");
+}
+
+void
+CudaTOP::executePlayer(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
+	// The cache settings are shared by every Player TOP in the process
+	ClipCache& cache = ClipCache::instance();
+	cache.setBudget(static_cast<int64_t>(inputs->getParDouble("Cachebudget") * 1024.0 * 1024.0));
+	cache.setHeadFrames(inputs->getParInt("Headframes"));
+
+	// Every clip in the Cue DAT is kept warm: one per row, the file in the
+	// first column and an optional priority in the second
+	const OP_DATInput* cues = inputs->getParDAT("Cuedat");
+	const uint32_t cueId = cues ? cues->opId : 0;
+	const int64_t cueCooks = cues ? cues->totalCooks : -1;
+	if (cueId != myCueDATId || cueCooks != myCueDATCooks)
+	{
+		std::vector<std::string> paths;
+		std::vector<int32_t> priorities;
+		for (int32_t r = 0; cues && cues->numCols > 0 && r < cues->numRows; r++)
+		{
+			const char* path = cues->getCell(r, 0);
+			if (!path || !*path)
+				continue;
+			paths.push_back(path);
+			priorities.push_back(cues->numCols > 1 ? atoi(cues->getCell(r, 1)) : 0);
+		}
+		myPlayer.cue(paths, priorities);
+		myCueDATId = cueId;
+		myCueDATCooks = cueCooks;
+	}
+
+	// A cue switch lands here on the same cook, starting from a head frame
+	// that's already in RAM
+	if (!myPlayer.open(getPlayerClip(inputs)))
+	{
+		myError = myPlayer.error() ? myPlayer.error() : "Player mode needs a clip file.";
+		myPlayer.dropBuffers();
+		return;
+	}
+
+	const FrameContainer& clip = myPlayer.container();
+	if (outputFormat->width != clip.width() || outputFormat->height != clip.height())
+	{
+		// The output format from getOutputFormat() takes effect next cook,
+		// the buffers handed out so far may not survive it
+		myPlayer.dropBuffers();
+		return;
+	}
+
+	PlayerSettings settings;
+	settings.mode = static_cast<PlayerMode>(inputs->getParInt("Playmode"));
+	settings.index = inputs->getParDouble("Frameindex");
+	settings.speed = inputs->getParDouble("Speed");
+	settings.readAhead = inputs->getParInt("Readahead");
+
+	const int32_t frame = myPlayer.advance(settings);
+
+#ifdef CUDATOP_CPU_BACKEND
+	// Frames are decoded straight into cpuPixelData, the buffers that aren't
+	// uploaded stay valid and get the next frames decoded into them
+	void* buffers[FramePlayer::NumBuffers];
+	for (int i = 0; i < FramePlayer::NumBuffers; i++)
+		buffers[i] = outputFormat->cpuPixelData[i];
+
+	int32_t buffer = -1;
+	if (!myPlayer.deliver(frame, buffers, true, settings.readAhead, buffer))
+	{
+		myError = "Unable to decode the frame.";
+		myPlayer.dropBuffers();
+		return;
+	}
+	outputFormat->newCPUPixelDataLocation = buffer;
+#else
+	const bool rgba8 = clip.pixelFormat() == FramePixelFormat::RGBA8 && outputFormat->pixelFormat == GL_RGBA8;
+	const bool rgba32f = clip.pixelFormat() == FramePixelFormat::RGBA32F && outputFormat->pixelFormat == GL_RGBA32F;
+	if (!rgba8 && !rgba32f)
+	{
+		myError = "The CUDA build can only play 8-bit RGBA or 32-bit float RGBA clips.";
+		myPlayer.dropBuffers();
+		return;
+	}
+
+	void* buffers[FramePlayer::NumBuffers];
+	for (int i = 0; i < FramePlayer::NumBuffers; i++)
+	{
+		myPlayerBuffers[i].resize(clip.frameBytes());
+		buffers[i] = myPlayerBuffers[i].data();
+	}
+
+	// The output array isn't guaranteed to keep its contents, so the frame
+	// is uploaded every cook
+	int32_t buffer = -1;
+	if (!myPlayer.deliver(frame, buffers, false, settings.readAhead, buffer))
+	{
+		myError = "Unable to decode the frame.";
+		myPlayer.dropBuffers();
+		return;
+	}
+
+	size_t rowBytes = clip.frameBytes() / clip.height();
+	cudaMemcpy2DToArray(outputFormat->cudaOutput[0], 0, 0, buffers[buffer],
+						rowBytes, rowBytes, clip.height(), cudaMemcpyHostToDevice);
+#endif
+}
+
+void
+CudaTOP::executeFilter(TOP_OutputFormatSpecs* outputFormat, const OP_Inputs* inputs)
+{
 	int width = outputFormat->width;
 	int height = outputFormat->height;
 
-	float ratio = static_cast<float>(height) / static_cast<float>(width);
+#ifdef CUDATOP_CPU_BACKEND
+	// Without new input data keep showing whatever was uploaded last
+	const float* inputPixels = nullptr;
+	if (!getCPUInput(outputFormat, inputs, inputPixels))
+		return;
+
+	// At a reduced processing scale the kernel runs on a level of the input's
+	// pyramid and the result is brought back up guided by the input
+	const int32_t level = inputPixels ? inputs->getParInt("Processscale") : 0;
+	const float sigma = float(inputs->getParDouble("Edgesigma"));
+	if (level != myFilterLevel || (level > 0 && sigma != myFilterSigma))
+		myDirtyTiles.invalidate();
+	myFilterLevel = level;
+	myFilterSigma = sigma;
+
+	// The filtered image is kept between cooks, only the tiles whose input
+	// changed (plus the kernel's halo) are filtered again. When scaled, a
+	// changed pixel reaches one more low pixel through the upsampler.
+	const TilePlan& plan = myCache.getTilePlan(width, height, CPUTileSize);
+	ImageView filtered = myCache.getScratch(ScratchFilter, width, height).view();
+
+	const int32_t halo = level > 0 ? (CPUFilterHalo + 2) << level : CPUFilterHalo;
+	const std::vector<int32_t>& tiles = myDirtyTiles.update(plan, inputPixels, halo);
+	if (tiles.empty())
+	{
+		// Keep the previously uploaded texture
+		outputFormat->newCPUPixelDataLocation = -1;
+		return;
+	}
+
+	if (level > 0)
+	{
+		myPyramid.resize(plan, level);
+		myPyramid.update(plan, tiles, inputPixels);
+
+		const TilePlan& lowPlan = myPyramid.plan(level);
+		ImageView lowInput = myPyramid.level(level);
+		ImageView lowFiltered = myCache.getScratch(ScratchFilterLow, lowPlan.width, lowPlan.height).view();
+
+		doCPUOperation(lowPlan, tiles, lowInput.pixels, lowFiltered);
+		jointBilateralUpsample(plan, tiles, inputPixels, lowInput, lowFiltered, level, sigma, filtered);
+	}
+	else
+	{
+		doCPUOperation(plan, tiles, inputPixels, filtered);
+	}
+
+	float* output = static_cast<float*>(outputFormat->cpuPixelData[0]);
+	parallelFor(height, [&](int begin, int end)
+	{
+		const size_t rowFloats = static_cast<size_t>(width) * 4;
+		memcpy(output + begin * rowFloats, filtered.row(begin), (end - begin) * rowFloats * sizeof(float));
+	}, 64);
 
+	outputFormat->newCPUPixelDataLocation = 0;
+#else
 	if (outputFormat->redBits != 8 ||
 		outputFormat->greenBits != 8 ||
 		outputFormat->blueBits != 8 ||
@@ -198,7 +820,7 @@ CudaTOP::execute(TOP_OutputFormatSpecs* outputFormat ,
 		return;
 	}
 
-	cudaArray *inputMem = nullptr;
+	cudaSurfaceObject_t inputSurface = 0;
 	if (inputs->getNumInputs() > 0)
 	{
 		const OP_TOPInput* topInput = inputs->getInputTOP(0);
@@ -220,23 +842,43 @@ CudaTOP::execute(TOP_OutputFormatSpecs* outputFormat ,
 			return;
 		}
 
-		setupCudaSurface(&myInputSurface, topInput->cudaInput);
-
-		inputMem = topInput->cudaInput;
+		inputSurface = myCache.getSurface(ResourceCache::InputSlot, topInput->cudaInput,
+										topInput->width, topInput->height, topInput->pixelFormat);
 	}
 
-	setupCudaSurface(&myOutputSurface, outputFormat->cudaOutput[0]);
-		
-	doCUDAOperation(outputFormat->width, outputFormat->height, myInputSurface, myOutputSurface);
+	cudaSurfaceObject_t outputSurface = myCache.getSurface(ResourceCache::OutputSlot,
+										outputFormat->cudaOutput[0], width, height, outputFormat->pixelFormat);
+	if (!outputSurface)
+	{
+		myError = "Unable to create a CUDA surface for the output texture.";
+		return;
+	}
 
+	const LaunchConfig& launch = myCache.getLaunchConfig(width, height);
+	doCUDAOperation(width, height, launch.gridSize, launch.blockSize, inputSurface, outputSurface);
+#endif
 }
 
 int32_t
 CudaTOP::getNumInfoCHOPChans(void* reserved)
 {
 	// We return the number of channel we want to output to any Info CHOP
-	// connected to the TOP. In this example we are just going to send one channel.
-	return 1;
+	// connected to the TOP. The last ones depend on the mode.
+	switch (myMode)
+	{
+		case TOPMode::Filter:
+		case TOPMode::Fractal:
+		case TOPMode::Fluid:
+		case TOPMode::Text:
+		case TOPMode::Player:
+		case TOPMode::Attractor:
+			return 5;
+		case TOPMode::Noise:
+		case TOPMode::Feedback:
+			return 4;
+		default:
+			return 3;
+	}
 }
 
 void
@@ -252,56 +894,243 @@ CudaTOP::getInfoCHOPChan(int32_t index,
 		chan->name->setString("executeCount");
 		chan->value = (float)myExecuteCount;
 	}
-}
 
-bool		
-CudaTOP::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved)
-{
-	infoSize->rows = 1;
-	infoSize->cols = 2;
-	// Setting this to false means we'll be assigning values to the table
-	// one row at a time. True means we'll do it one column at a time.
-	infoSize->byColumn = false;
-	return true;
-}
+	if (index == 1)
+	{
+		chan->name->setString("cacheHits");
+		chan->value = (float)myCache.hits();
+	}
 
-void
-CudaTOP::getInfoDATEntries(int32_t index,
-										int32_t nEntries,
-										OP_InfoDATEntries* entries,
-										void* reserved)
-{
-	char tempBuffer[4096];
+	if (index == 2)
+	{
+		chan->name->setString("cacheMisses");
+		chan->value = (float)myCache.misses();
+	}
 
-	if (index == 0)
+	if (myMode == TOPMode::Filter)
 	{
-		// Set the value for the first column
-#ifdef _WIN32
-		strcpy_s(tempBuffer, "executeCount");
-#else // macOS
-		strlcpy(tempBuffer, "executeCount", sizeof(tempBuffer));
-#endif
-		entries->values[0]->setString(tempBuffer);
+		if (index == 3)
+		{
+			chan->name->setString("dirtyTileRatio");
+			chan->value = myDirtyTiles.dirtyRatio();
+		}
 
-		// Set the value for the second column
-#ifdef _WIN32
-		sprintf_s(tempBuffer, "%d", myExecuteCount);
-#else // macOS
-		snprintf(tempBuffer, sizeof(tempBuffer), "%d", myExecuteCount);
-#endif
-		entries->values[1]->setString(tempBuffer);
+		if (index == 4)
+		{
+			chan->name->setString("processScale");
+			chan->value = 1.0f / (1 << myFilterLevel);
+		}
 	}
-}
-
-void
-CudaTOP::getErrorString(OP_String *error, void* reserved)
-{
-	error->setString(myError);
-}
+
+	if (myMode == TOPMode::Fractal)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("refineStep");
+			chan->value = (float)myFractal.lastStep();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("pixelsIterated");
+			chan->value = (float)myFractal.lastPixelCount();
+		}
+	}
+
+	if (myMode == TOPMode::Noise)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("octavesComputed");
+			chan->value = (float)myNoise.lastOctavesComputed();
+		}
+	}
+
+	if (myMode == TOPMode::Feedback)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("historyFrames");
+			chan->value = (float)myFeedback.filledFrames();
+		}
+	}
+
+	if (myMode == TOPMode::Fluid)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("solverIterations");
+			chan->value = (float)myFluid.lastIterations();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("residual");
+			chan->value = myFluid.lastResidual();
+		}
+	}
+
+	if (myMode == TOPMode::Text)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("rowsUpdated");
+			chan->value = (float)myText.lastRowsUpdated();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("glyphsRasterized");
+			chan->value = (float)myText.lastGlyphMisses();
+		}
+	}
+
+	if (myMode == TOPMode::Player)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("frame");
+			chan->value = (float)myPlayer.shownFrame();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("decodeAheadMisses");
+			chan->value = (float)myPlayer.decodeAheadMisses();
+		}
+	}
+
+	if (myMode == TOPMode::Attractor)
+	{
+		if (index == 3)
+		{
+			chan->name->setString("samples");
+			chan->value = (float)myAttractor.totalSamples();
+		}
+
+		if (index == 4)
+		{
+			chan->name->setString("samplesPerSecond");
+			chan->value = (float)myAttractor.samplesPerSecond();
+		}
+	}
+}
+
+bool		
+CudaTOP::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved)
+{
+	infoSize->rows = 3;
+	infoSize->cols = 2;
+
+	// Player mode adds the clip cache stats and a row per cached clip
+	if (myMode == TOPMode::Player)
+	{
+		myClipStats = ClipCache::instance().stats();
+		myClipResidency = ClipCache::instance().residency();
+		infoSize->rows += 6 + static_cast<int32_t>(myClipResidency.size());
+	}
+
+	// Setting this to false means we'll be assigning values to the table
+	// one row at a time. True means we'll do it one column at a time.
+	infoSize->byColumn = false;
+	return true;
+}
+
+void
+CudaTOP::getInfoDATEntries(int32_t index,
+										int32_t nEntries,
+										OP_InfoDATEntries* entries,
+										void* reserved)
+{
+	char tempBuffer[4096];
+
+	if (index == 0)
+	{
+		// Set the value for the first column
+#ifdef _WIN32
+		strcpy_s(tempBuffer, "executeCount");
+#else // macOS
+		strlcpy(tempBuffer, "executeCount", sizeof(tempBuffer));
+#endif
+		entries->values[0]->setString(tempBuffer);
+
+		// Set the value for the second column
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%d", myExecuteCount);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%d", myExecuteCount);
+#endif
+		entries->values[1]->setString(tempBuffer);
+	}
+
+	if (index == 1 || index == 2)
+	{
+		entries->values[0]->setString(index == 1 ? "cacheHits" : "cacheMisses");
+
+		long long count = index == 1 ? myCache.hits() : myCache.misses();
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%lld", count);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%lld", count);
+#endif
+		entries->values[1]->setString(tempBuffer);
+	}
+
+	if (myMode == TOPMode::Player && index >= 3 && index < 9)
+	{
+		const char* names[] = { "clipCacheClips", "clipCacheResidentBytes", "clipCacheBudgetBytes",
+								"clipCacheHeadHits", "clipCacheHeadMisses", "clipCacheEvictedFrames" };
+		long long values[] = { myClipStats.clips, myClipStats.residentBytes, myClipStats.budgetBytes,
+								myClipStats.headHits, myClipStats.headMisses, myClipStats.evictedFrames };
+
+		entries->values[0]->setString(names[index - 3]);
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%lld", values[index - 3]);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%lld", values[index - 3]);
+#endif
+		entries->values[1]->setString(tempBuffer);
+	}
+
+	if (myMode == TOPMode::Player && index >= 9 && index - 9 < static_cast<int32_t>(myClipResidency.size()))
+	{
+		// Resident head frames out of the clip's frames
+		const ClipResidency& clip = myClipResidency[index - 9];
+		entries->values[0]->setString(clip.path.c_str());
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "%d/%d priority %d", clip.residentFrames, clip.frameCount, clip.priority);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "%d/%d priority %d", clip.residentFrames, clip.frameCount, clip.priority);
+#endif
+		entries->values[1]->setString(tempBuffer);
+	}
+}
+
+void
+CudaTOP::getErrorString(OP_String *error, void* reserved)
+{
+	error->setString(myError);
+}
 
 void
 CudaTOP::setupParameters(OP_ParameterManager* manager, void* reserved)
 {
+	// mode
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Mode";
+		sp.label = "Mode";
+
+		sp.defaultValue = "Filter";
+
+		const char *names[] = { "Filter", "Fractal", "Noise", "Feedback", "Fluid", "Text", "Player", "Attractor" };
+		const char *labels[] = { "Filter", "Fractal", "Noise", "Feedback", "Fluid", "Text", "Player", "Attractor" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 8, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
 	// color 1
 	{
 		OP_NumericParameter	np;
@@ -352,6 +1181,910 @@ CudaTOP::setupParameters(OP_ParameterManager* manager, void* reserved)
 		assert(res == OP_ParAppendResult::Success);
 	}
 
+	// processing scale
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Processscale";
+		sp.label = "Processing Scale";
+		sp.page = "Filter";
+
+		sp.defaultValue = "Full";
+
+		const char *names[] = { "Full", "Half", "Quarter", "Eighth" };
+		const char *labels[] = { "Full", "1/2", "1/4", "1/8" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 4, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// upsampling edge sigma
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Edgesigma";
+		np.label = "Edge Sigma";
+		np.page = "Filter";
+		np.defaultValues[0] = 0.1;
+		np.minValues[0] = 0.001;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.01;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fractal type
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Fractaltype";
+		sp.label = "Fractal Type";
+		sp.page = "Fractal";
+
+		sp.defaultValue = "Mandelbrot";
+
+		const char *names[] = { "Mandelbrot", "Julia" };
+		const char *labels[] = { "Mandelbrot", "Julia" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fractal center
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Center";
+		np.label = "Center";
+		np.page = "Fractal";
+
+		np.defaultValues[0] = -0.5;
+		np.defaultValues[1] = 0.0;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minSliders[i] = -2.0;
+			np.maxSliders[i] = 2.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fractal zoom
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Zoom";
+		np.label = "Zoom";
+		np.page = "Fractal";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0001;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 1000.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fractal iterations
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Iterations";
+		np.label = "Max Iterations";
+		np.page = "Fractal";
+		np.defaultValues[0] = 256;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 16;
+		np.maxSliders[0] = 4096;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// julia constant
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Juliaconst";
+		np.label = "Julia Constant";
+		np.page = "Fractal";
+
+		np.defaultValues[0] = -0.8;
+		np.defaultValues[1] = 0.156;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minSliders[i] = -1.0;
+			np.maxSliders[i] = 1.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// noise type
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Noisetype";
+		sp.label = "Noise Type";
+		sp.page = "Noise";
+
+		sp.defaultValue = "Simplex";
+
+		const char *names[] = { "Simplex", "Value" };
+		const char *labels[] = { "Simplex", "Value" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// noise dimensions
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Dimensions";
+		sp.label = "Dimensions";
+		sp.page = "Noise";
+
+		sp.defaultValue = "2d";
+
+		const char *names[] = { "2d", "3d", "4d" };
+		const char *labels[] = { "2D", "3D (Time)", "4D (Slice, Time)" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// octave combination
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Fractal";
+		sp.label = "Fractal";
+		sp.page = "Noise";
+
+		sp.defaultValue = "Fbm";
+
+		const char *names[] = { "Fbm", "Ridged", "Turbulence" };
+		const char *labels[] = { "fBm", "Ridged", "Turbulence" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// octaves
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Octaves";
+		np.label = "Octaves";
+		np.page = "Noise";
+		np.defaultValues[0] = 4;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.maxValues[0] = 12;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 12;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// base frequency, in periods per image height
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Frequency";
+		np.label = "Frequency";
+		np.page = "Noise";
+		np.defaultValues[0] = 4.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 32.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frequency multiplier between octaves
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Lacunarity";
+		np.label = "Lacunarity";
+		np.page = "Noise";
+		np.defaultValues[0] = 2.0;
+		np.minSliders[0] = 1.0;
+		np.maxSliders[0] = 4.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// amplitude multiplier between octaves
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Gain";
+		np.label = "Gain";
+		np.page = "Noise";
+		np.defaultValues[0] = 0.5;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// noise translate
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Translate";
+		np.label = "Translate";
+		np.page = "Noise";
+
+		for (int i=0; i<2; i++)
+		{
+			np.minSliders[i] = -10.0;
+			np.maxSliders[i] = 10.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// z position of the 4D slice
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Slice";
+		np.label = "Slice";
+		np.page = "Noise";
+		np.defaultValues[0] = 0.0;
+		np.minSliders[0] = -10.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// animation coordinate, e.g. absTime.seconds
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Time";
+		np.label = "Time";
+		np.page = "Noise";
+		np.defaultValues[0] = 0.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// number of low octaves that follow Time, the rest are cached
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Animoctaves";
+		np.label = "Animated Octaves";
+		np.page = "Noise";
+		np.defaultValues[0] = 4;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 12;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// seed
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Seed";
+		np.label = "Seed";
+		np.page = "Noise";
+		np.defaultValues[0] = 0;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 100;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// feedback operation
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Feedbackop";
+		sp.label = "Operation";
+		sp.page = "Feedback";
+
+		sp.defaultValue = "Decay";
+
+		const char *names[] = { "Decay", "Maxhold", "Additive" };
+		const char *labels[] = { "Exponential Decay", "Max Hold", "Additive" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// feedback decay per frame
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Decay";
+		np.label = "Decay";
+		np.page = "Feedback";
+		np.defaultValues[0] = 0.9;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frames kept for Max Hold and Additive
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Historylength";
+		np.label = "History Length";
+		np.page = "Feedback";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 1;
+		np.maxValues[0] = 64;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 64;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fluid time step in seconds
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Timestep";
+		np.label = "Time Step";
+		np.page = "Fluid";
+		np.defaultValues[0] = 1.0 / 60.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.1;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// vorticity confinement strength
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Vorticity";
+		np.label = "Vorticity";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.3;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 2.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fraction of dye lost per second
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Dissipation";
+		np.label = "Dye Dissipation";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.1;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 2.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// pressure solver
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Pressuresolver";
+		sp.label = "Pressure Solver";
+		sp.page = "Fluid";
+
+		sp.defaultValue = "Multigrid";
+
+		const char *names[] = { "Multigrid", "Redblack" };
+		const char *labels[] = { "Multigrid", "Red-Black Gauss-Seidel" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// V-cycles or red-black sweeps per step
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Pressureiters";
+		np.label = "Max Iterations";
+		np.page = "Fluid";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 100;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// residual relative to the divergence
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Tolerance";
+		np.label = "Tolerance";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.001;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.1;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// source position in uv
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Source";
+		np.label = "Source";
+		np.page = "Fluid";
+
+		np.defaultValues[0] = 0.5;
+		np.defaultValues[1] = 0.1;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minSliders[i] = 0.0;
+			np.maxSliders[i] = 1.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// source radius relative to the height
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sourceradius";
+		np.label = "Source Radius";
+		np.page = "Fluid";
+		np.defaultValues[0] = 0.04;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.25;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// source velocity in cells per second
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sourcevelocity";
+		np.label = "Source Velocity";
+		np.page = "Fluid";
+
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 200.0;
+
+		for (int i=0; i<2; i++)
+		{
+			np.minSliders[i] = -500.0;
+			np.maxSliders[i] = 500.0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// dye at the source center
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sourcedye";
+		np.label = "Source Dye";
+		np.page = "Fluid";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// acceleration per unit of the input's red and green
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Inputforce";
+		np.label = "Input Force";
+		np.page = "Fluid";
+		np.defaultValues[0] = 1000.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 5000.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// DAT with one line of text per row
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Textdat";
+		sp.label = "Text DAT";
+		sp.page = "Text";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// TrueType font file
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Font";
+		sp.label = "Font File";
+		sp.page = "Text";
+
+#ifdef _WIN32
+		sp.defaultValue = "C:/Windows/Fonts/arial.ttf";
+#else // macOS
+		sp.defaultValue = "/System/Library/Fonts/Supplemental/Arial.ttf";
+#endif
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// line height in pixels
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fontsize";
+		np.label = "Font Size";
+		np.page = "Text";
+		np.defaultValues[0] = 32.0;
+		np.minValues[0] = 1.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 8.0;
+		np.maxSliders[0] = 200.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// glyphs kept rasterized
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Glyphcache";
+		np.label = "Glyph Cache Size";
+		np.page = "Text";
+		np.defaultValues[0] = 256;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 4096;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frame container, see FrameContainer.h
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Clipfile";
+		sp.label = "Clip File";
+		sp.page = "Player";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// DAT of clips to keep warm, file path and optional priority per row
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Cuedat";
+		sp.label = "Cue DAT";
+		sp.page = "Player";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Cue DAT row that plays
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cueindex";
+		np.label = "Cue Index";
+		np.page = "Player";
+		np.defaultValues[0] = 0;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 32;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// how the frame is chosen
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Playmode";
+		sp.label = "Play Mode";
+		sp.page = "Player";
+
+		sp.defaultValue = "Sequential";
+
+		const char *names[] = { "Index", "Sequential" };
+		const char *labels[] = { "Specify Index", "Sequential" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frame shown in Index mode
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Frameindex";
+		np.label = "Index";
+		np.page = "Player";
+		np.defaultValues[0] = 0.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1000.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frames advanced per cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Speed";
+		np.label = "Speed";
+		np.page = "Player";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = -4.0;
+		np.maxSliders[0] = 4.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frames kept resident ahead of the play position
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Readahead";
+		np.label = "Read Ahead";
+		np.page = "Player";
+		np.defaultValues[0] = 8;
+		np.minValues[0] = 0;
+		np.maxValues[0] = 120;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 60;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// RAM for decoded head frames, shared by all Player TOPs
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cachebudget";
+		np.label = "Clip Cache (MB)";
+		np.page = "Player";
+		np.defaultValues[0] = 1024.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 16384.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// frames decoded ahead of time for every cued clip
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Headframes";
+		np.label = "Head Frames";
+		np.page = "Player";
+		np.defaultValues[0] = 30;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 240;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// attractor type
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Attractortype";
+		sp.label = "Attractor Type";
+		sp.page = "Attractor";
+
+		sp.defaultValue = "Clifford";
+
+		const char *names[] = { "Clifford", "Dejong", "Lorenz" };
+		const char *labels[] = { "Clifford", "De Jong", "Lorenz" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// map coefficients a b c d, sigma rho beta and time step for Lorenz
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Coefficients";
+		np.label = "Coefficients";
+		np.page = "Attractor";
+
+		np.defaultValues[0] = -1.4;
+		np.defaultValues[1] = 1.6;
+		np.defaultValues[2] = 1.0;
+		np.defaultValues[3] = 0.7;
+
+		for (int i=0; i<4; i++)
+		{
+			np.minSliders[i] = -3.0;
+			np.maxSliders[i] = 3.0;
+		}
+
+		OP_ParAppendResult res = manager->appendFloat(np, 4);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// attractor zoom
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Attractorzoom";
+		np.label = "Zoom";
+		np.page = "Attractor";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.01;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// millions of points added per cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Samples";
+		np.label = "Samples per Cook (M)";
+		np.page = "Attractor";
+		np.defaultValues[0] = 20.0;
+		np.minValues[0] = 0.0;
+		np.maxValues[0] = 1000.0;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 200.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// millions of points after which accumulation stops
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Samplelimit";
+		np.label = "Sample Limit (M)";
+		np.page = "Attractor";
+		np.defaultValues[0] = 10000.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 100000.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// milliseconds a cook may spend adding samples, 0 for no limit
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Timebudget";
+		np.label = "Time Budget (ms)";
+		np.page = "Attractor";
+		np.defaultValues[0] = 0.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 33.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// tone mapping exposure
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Exposure";
+		np.label = "Exposure";
+		np.page = "Attractor";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 4.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
 	// pulse
 	{
 		OP_NumericParameter	np;
@@ -369,6 +2102,12 @@ CudaTOP::pulsePressed(const char* name, void* reserved)
 {
 	if (!strcmp(name, "Reset"))
 	{
-		// Do something to reset here
+		myFractal.reset();
+		myNoise.reset();
+		myFeedback.reset();
+		myFluid.reset();
+		myText.reset();
+		myPlayer.reset();
+		myAttractor.reset();
 	}
 }
@@ -13,7 +13,42 @@
 */
 
 #include "TOP_CPlusPlusBase.h"
+#ifndef CUDATOP_CPU_BACKEND
 #include "cuda_runtime.h"
+#endif
+#include "ResourceCache.h"
+#include "FractalGenerator.h"
+#include "NoiseGenerator.h"
+#include "FeedbackHistory.h"
+#include "FluidSolver.h"
+#include "TextAtlas.h"
+#include "FramePlayer.h"
+#include "DirtyTiles.h"
+#include "ImagePyramid.h"
+#include "AttractorDensity.h"
+
+/*
+ By default this TOP runs with TOP_ExecuteMode::CUDA and does its work with the
+ kernels in kernel.cu.
+ Define CUDATOP_CPU_BACKEND to build it as a CPU memory TOP instead. In that
+ build no CUDA calls are made, the input is downloaded with
+ getTOPDataInCPUMemory() and the output is written straight into cpuPixelData
+ as RGBA32F, using the CPU kernels in cpuKernel.cpp.
+*/
+
+// What the TOP does, selected by the Mode menu. Every mode other than Filter
+// is computed on the CPU, in both backends.
+enum class TOPMode
+{
+	Filter = 0,
+	Fractal,
+	Noise,
+	Feedback,
+	Fluid,
+	Text,
+	Player,
+	Attractor,
+};
 
 class CudaTOP : public TOP_CPlusPlusBase
 {
@@ -48,6 +83,31 @@ public:
 	virtual void		pulsePressed(const char *name, void* reserved) override;
 
 private:
+	void				executeFilter(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executeFractal(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executeNoise(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executeFeedback(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executeFluid(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executeText(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executePlayer(TOP_OutputFormatSpecs*, const OP_Inputs*);
+	void				executeAttractor(TOP_OutputFormatSpecs*, const OP_Inputs*);
+
+	// The clip Player mode plays: the Cue DAT row picked by Cue Index, or the
+	// Clip File when there is no Cue DAT
+	std::string			getPlayerClip(const OP_Inputs*);
+
+	// Downloads the first input as RGBA32F. Returns false if there is nothing
+	// to work with this cook, setting myError if that's an error. 'pixels' is
+	// left nullptr when no input is connected.
+	bool				getCPUInput(TOP_OutputFormatSpecs*, const OP_Inputs*, const float*& pixels);
+
+	// CPU modes render into the image returned by beginCPUOutput() and hand
+	// it to endCPUOutput(). In the CPU backend that image is cpuPixelData[0]
+	// itself, in the CUDA backend it is a cached scratch image that gets
+	// uploaded to the output array.
+	ImageView			beginCPUOutput(TOP_OutputFormatSpecs*);
+	void				endCPUOutput(TOP_OutputFormatSpecs*, const ImageView& image, bool changed);
+
 	// We don't need to store this pointer, but we do for the example.
 	// The OP_NodeInfo class store information about the node that's using
 	// this instance of the class (like its name).
@@ -57,9 +117,38 @@ private:
 	// function is called, then passes back to the TOP 
 	int32_t				myExecuteCount;
 
-	cudaSurfaceObject_t	myInputSurface;
-	cudaSurfaceObject_t	myOutputSurface;
-
 	const char*			myError;
 
+	// Surfaces, launch configs, tile plans and scratch images that are
+	// reused between cooks until the textures they were built for change.
+	ResourceCache		myCache;
+
+	TOPMode				myMode;
+
+	// Input tiles that changed since the last Filter cook on the CPU
+	DirtyTileTracker	myDirtyTiles;
+	// Downsampled input for Filter's processing scale, and the scale (as a
+	// pyramid level) and edge sigma the cached filtered image was made with
+	ImagePyramid		myPyramid;
+	int32_t				myFilterLevel;
+	float				myFilterSigma;
+
+	FractalGenerator	myFractal;
+	NoiseGenerator		myNoise;
+	FeedbackHistory		myFeedback;
+	FluidSolver			myFluid;
+	TextAtlas			myText;
+	FramePlayer			myPlayer;
+	AttractorDensity	myAttractor;
+	// Cue DAT the clip cache was last given the cue list of
+	uint32_t			myCueDATId;
+	int64_t				myCueDATCooks;
+	// Snapshot taken by getInfoDATSize() for getInfoDATEntries()
+	ClipCacheStats		myClipStats;
+	std::vector<ClipResidency>	myClipResidency;
+#ifndef CUDATOP_CPU_BACKEND
+	// Host copies of the frames Player mode decodes, uploaded from here
+	std::vector<uint8_t>	myPlayerBuffers[FramePlayer::NumBuffers];
+#endif
+
 };
@@ -0,0 +1,125 @@
+/*
+ * See DirtyTiles.h
+ */
+
+#include "DirtyTiles.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <string.h>
+
+static const uint64_t HashMultiplier = 0x9E3779B97F4A7C15ull;
+
+static inline uint64_t
+mix(uint64_t h, uint64_t word)
+{
+	h = (h ^ word) * HashMultiplier;
+	return h ^ (h >> 29);
+}
+
+// Hash of the pixels of one tile. Four independent lanes keep the
+// multiplies from serializing, rows are RGBA32F so always a multiple of 16
+// bytes wide.
+static uint64_t
+hashTile(const TileRect& tile, int32_t width, const float* input)
+{
+	uint64_t lanes[4] = { 1, 2, 3, 4 };
+	const size_t rowBytes = static_cast<size_t>(tile.x1 - tile.x0) * 4 * sizeof(float);
+
+	for (int32_t y = tile.y0; y < tile.y1; y++)
+	{
+		const uint8_t* row = reinterpret_cast<const uint8_t*>(input + (static_cast<size_t>(y) * width + tile.x0) * 4);
+		for (size_t i = 0; i < rowBytes; i += 32)
+		{
+			uint64_t words[4] = {};
+			memcpy(words, row + i, std::min<size_t>(32, rowBytes - i));
+			for (int l = 0; l < 4; l++)
+				lanes[l] = mix(lanes[l], words[l]);
+		}
+	}
+
+	uint64_t h = lanes[0];
+	for (int l = 1; l < 4; l++)
+		h = mix(h, lanes[l]);
+	return h;
+}
+
+DirtyTileTracker::DirtyTileTracker() :
+	myWidth(0),
+	myHeight(0),
+	myTileSize(0),
+	myValid(false),
+	myDirtyRatio(1.0f)
+{
+}
+
+void
+DirtyTileTracker::invalidate()
+{
+	myValid = false;
+}
+
+const std::vector<int32_t>&
+DirtyTileTracker::update(const TilePlan& plan, const float* input, int32_t halo)
+{
+	const int32_t numTiles = static_cast<int32_t>(plan.tiles.size());
+
+	if (plan.width != myWidth || plan.height != myHeight || plan.tileSize != myTileSize)
+	{
+		myWidth = plan.width;
+		myHeight = plan.height;
+		myTileSize = plan.tileSize;
+		myHashes.assign(numTiles, 0);
+		myChanged.assign(numTiles, 1);
+		myValid = false;
+	}
+
+	myDirty.clear();
+
+	if (!input)
+	{
+		myValid = false;
+		for (int32_t t = 0; t < numTiles; t++)
+			myDirty.push_back(t);
+		myDirtyRatio = 1.0f;
+		return myDirty;
+	}
+
+	const bool valid = myValid;
+	parallelFor(plan.numPartitions(), [&](int begin, int end)
+	{
+		for (int t = plan.partitionStart[begin]; t < plan.partitionStart[end]; t++)
+		{
+			uint64_t h = hashTile(plan.tiles[t], plan.width, input);
+			myChanged[t] = !valid || h != myHashes[t];
+			myHashes[t] = h;
+		}
+	});
+	myValid = true;
+
+	// An output tile is dirty if any input tile its halo reaches changed
+	for (int32_t ty = 0; ty < plan.tilesY; ty++)
+	{
+		for (int32_t tx = 0; tx < plan.tilesX; tx++)
+		{
+			const int32_t t = ty * plan.tilesX + tx;
+			const TileRect& r = plan.tiles[t];
+			const int32_t ty0 = std::max(0, (r.y0 - halo) / myTileSize);
+			const int32_t ty1 = std::min(plan.tilesY - 1, (r.y1 - 1 + halo) / myTileSize);
+			const int32_t tx0 = std::max(0, (r.x0 - halo) / myTileSize);
+			const int32_t tx1 = std::min(plan.tilesX - 1, (r.x1 - 1 + halo) / myTileSize);
+
+			bool dirty = false;
+			for (int32_t ny = ty0; ny <= ty1 && !dirty; ny++)
+			{
+				for (int32_t nx = tx0; nx <= tx1 && !dirty; nx++)
+					dirty = myChanged[ny * plan.tilesX + nx] != 0;
+			}
+			if (dirty)
+				myDirty.push_back(t);
+		}
+	}
+
+	myDirtyRatio = numTiles > 0 ? float(myDirty.size()) / numTiles : 0.0f;
+	return myDirty;
+}
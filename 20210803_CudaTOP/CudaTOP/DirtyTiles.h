@@ -0,0 +1,49 @@
+/*
+ * Tracks which tiles of an input image changed between cooks.
+ *
+ * Every cook each tile of the input is hashed (64-bit, one pass over the
+ * pixels) and compared with the hash from the previous cook. A tile of the
+ * output needs recomputing when any input tile within the kernel's halo of
+ * it changed; every other output tile can be reused from the previous cook.
+ */
+
+#ifndef __DirtyTiles__
+#define __DirtyTiles__
+
+#include "ResourceCache.h"
+
+#include <vector>
+
+class DirtyTileTracker
+{
+public:
+	DirtyTileTracker();
+
+	// Hashes the tiles of 'input', an RGBA32F image of plan.width by
+	// plan.height, and returns the indices of the output tiles to recompute
+	// for a kernel reading up to 'halo' pixels around each output pixel.
+	// Everything is dirty the first time, after a resolution change or
+	// invalidate(), and when 'input' is nullptr.
+	const std::vector<int32_t>&	update(const TilePlan& plan, const float* input, int32_t halo);
+
+	// Forces every tile to be dirty on the next update, e.g. because the
+	// cached output was overwritten.
+	void		invalidate();
+
+	// Fraction of the tiles the last update returned
+	float		dirtyRatio() const { return myDirtyRatio; }
+
+private:
+	int32_t					myWidth;
+	int32_t					myHeight;
+	int32_t					myTileSize;
+	bool					myValid;
+
+	std::vector<uint64_t>	myHashes;
+	std::vector<uint8_t>	myChanged;
+	std::vector<int32_t>	myDirty;
+
+	float					myDirtyRatio;
+};
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * See FeedbackHistory.h
+ */
+
+#include "FeedbackHistory.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Upper bound on the ring length, a 1080p RGBA32F frame is about 33 MB
+static const int32_t MaxLength = 64;
+
+// Pushes 'in' into 'slot', which holds the oldest frame if 'full', and
+// updates the running sum and decayed accumulation of n floats.
+static void
+updateScalar(const float* in, float* slot, bool full, float* sum, float* decayed, float decay, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		float oldest = full ? slot[i] : 0.0f;
+		sum[i] += in[i] - oldest;
+		slot[i] = in[i];
+		decayed[i] = in[i] + decay * decayed[i];
+	}
+}
+
+// out = max over frames[k] * weights[k]
+static void
+maxScalar(const float* const* frames, const float* weights, int32_t count, float* out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		float m = frames[0][i] * weights[0];
+		for (int32_t k = 1; k < count; k++)
+			m = std::max(m, frames[k][i] * weights[k]);
+		out[i] = m;
+	}
+}
+
+#if SIMD_X86
+SIMD_TARGET_AVX2 static void
+updateAVX2(const float* in, float* slot, bool full, float* sum, float* decayed, float decay, size_t n)
+{
+	const __m256 d = _mm256_set1_ps(decay);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(in + i);
+		__m256 oldest = full ? _mm256_loadu_ps(slot + i) : _mm256_setzero_ps();
+		_mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_sub_ps(x, oldest)));
+		_mm256_storeu_ps(slot + i, x);
+		_mm256_storeu_ps(decayed + i, _mm256_fmadd_ps(d, _mm256_loadu_ps(decayed + i), x));
+	}
+	updateScalar(in + i, slot + i, full, sum + i, decayed + i, decay, n - i);
+}
+
+SIMD_TARGET_AVX2 static void
+maxAVX2(const float* const* frames, const float* weights, int32_t count, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 m = _mm256_mul_ps(_mm256_loadu_ps(frames[0] + i), _mm256_set1_ps(weights[0]));
+		for (int32_t k = 1; k < count; k++)
+			m = _mm256_max_ps(m, _mm256_mul_ps(_mm256_loadu_ps(frames[k] + i), _mm256_set1_ps(weights[k])));
+		_mm256_storeu_ps(out + i, m);
+	}
+	if (i < n)
+	{
+		const float* tail[MaxLength];
+		for (int32_t k = 0; k < count; k++)
+			tail[k] = frames[k] + i;
+		maxScalar(tail, weights, count, out + i, n - i);
+	}
+}
+#endif
+
+FeedbackHistory::FeedbackHistory() :
+	myWidth(0),
+	myHeight(0),
+	myNext(0),
+	myFilled(0)
+{
+}
+
+void
+FeedbackHistory::reset()
+{
+	myNext = 0;
+	myFilled = 0;
+	std::fill(myDecayed.begin(), myDecayed.end(), 0.0f);
+	std::fill(mySum.begin(), mySum.end(), 0.0f);
+}
+
+void
+FeedbackHistory::resize(int32_t width, int32_t height)
+{
+	if (width == myWidth && height == myHeight)
+		return;
+
+	myWidth = width;
+	myHeight = height;
+	for (std::vector<float>& frame : myFrames)
+		frame.assign(frameSize(), 0.0f);
+	myDecayed.assign(frameSize(), 0.0f);
+	mySum.assign(frameSize(), 0.0f);
+	myNext = 0;
+	myFilled = 0;
+}
+
+void
+FeedbackHistory::setLength(int32_t length)
+{
+	const int32_t oldLength = static_cast<int32_t>(myFrames.size());
+	if (length == oldLength)
+		return;
+
+	// Keep the newest frames, reordered oldest first from slot 0
+	const int32_t oldFilled = myFilled;
+	const int32_t keep = std::min(myFilled, length);
+	std::vector<std::vector<float>> frames(length);
+	for (int32_t age = 0; age < keep; age++)
+	{
+		int32_t slot = (myNext - 1 - age + oldLength) % oldLength;
+		frames[keep - 1 - age] = std::move(myFrames[slot]);
+	}
+	for (std::vector<float>& frame : frames)
+		frame.resize(frameSize());
+
+	myFrames.swap(frames);
+	myFilled = keep;
+	myNext = keep % length;
+
+	if (keep < oldFilled)
+		recomputeSum();
+}
+
+void
+FeedbackHistory::recomputeSum()
+{
+	const int32_t length = static_cast<int32_t>(myFrames.size());
+
+	parallelFor(myHeight, [&](int begin, int end)
+	{
+		size_t first = static_cast<size_t>(begin) * myWidth * 4;
+		size_t last = static_cast<size_t>(end) * myWidth * 4;
+		std::fill(mySum.begin() + first, mySum.begin() + last, 0.0f);
+		for (int32_t age = 0; age < myFilled; age++)
+		{
+			const float* frame = myFrames[(myNext - 1 - age + length) % length].data();
+			for (size_t i = first; i < last; i++)
+				mySum[i] += frame[i];
+		}
+	}, 16);
+}
+
+void
+FeedbackHistory::cook(const FeedbackSettings& settings, const float* input, const ImageView& output)
+{
+	resize(output.width, output.height);
+	setLength(std::max(1, std::min(settings.length, MaxLength)));
+
+	const int32_t length = static_cast<int32_t>(myFrames.size());
+	const bool full = myFilled == length;
+	float* slot = myFrames[myNext].data();
+
+	myNext = (myNext + 1) % length;
+	myFilled = std::min(myFilled + 1, length);
+
+	// Newest first, with the decay applied per frame of age
+	const float* frames[MaxLength];
+	float weights[MaxLength];
+	for (int32_t age = 0; age < myFilled; age++)
+	{
+		frames[age] = myFrames[(myNext - 1 - age + length) % length].data();
+		weights[age] = std::pow(settings.decay, static_cast<float>(age));
+	}
+
+	const bool useAVX2 = simdHasAVX2();
+	const size_t rowFloats = static_cast<size_t>(myWidth) * 4;
+
+	parallelFor(myHeight, [&](int begin, int end)
+	{
+		const size_t first = begin * rowFloats;
+		const size_t n = (end - begin) * rowFloats;
+		float* out = output.row(begin);
+
+#if SIMD_X86
+		if (useAVX2)
+			updateAVX2(input + first, slot + first, full, &mySum[first], &myDecayed[first], settings.decay, n);
+		else
+#endif
+			updateScalar(input + first, slot + first, full, &mySum[first], &myDecayed[first], settings.decay, n);
+
+		switch (settings.op)
+		{
+			case FeedbackOp::MaxHold:
+			{
+				const float* spans[MaxLength];
+				for (int32_t k = 0; k < myFilled; k++)
+					spans[k] = frames[k] + first;
+#if SIMD_X86
+				if (useAVX2)
+					maxAVX2(spans, weights, myFilled, out, n);
+				else
+#endif
+					maxScalar(spans, weights, myFilled, out, n);
+				break;
+			}
+
+			case FeedbackOp::Additive:
+				std::copy(&mySum[first], &mySum[first] + n, out);
+				break;
+
+			case FeedbackOp::Decay:
+			default:
+				std::copy(&myDecayed[first], &myDecayed[first] + n, out);
+				break;
+		}
+	}, 16);
+
+	// The running sum picks up rounding error from the subtractions, rebuild
+	// it from the frames each time the ring wraps around.
+	if (full && myNext == 0)
+		recomputeSum();
+}
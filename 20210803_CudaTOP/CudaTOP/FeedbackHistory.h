@@ -0,0 +1,70 @@
+/*
+ * History of input frames for the TOP's Feedback mode.
+ *
+ * Every cook pushes the input into a ring of the last 'length' frames and
+ * updates, in the same pass, an exponentially decayed accumulation and a
+ * running sum of the ring. The output is one of
+ *   Decay:    input + decay * previous accumulation
+ *   Max Hold: max over the ring of frame * decay^age
+ *   Additive: sum of the ring
+ * All three are kept up to date whatever the operation, so switching between
+ * them, or changing the decay or length, doesn't lose the history. Only a
+ * change of resolution or reset() clears it.
+ */
+
+#ifndef __FeedbackHistory__
+#define __FeedbackHistory__
+
+#include "ResourceCache.h"
+
+#include <vector>
+
+enum class FeedbackOp
+{
+	Decay = 0,
+	MaxHold,
+	Additive
+};
+
+struct FeedbackSettings
+{
+	FeedbackOp	op = FeedbackOp::Decay;
+	float		decay = 0.9f;
+	int32_t		length = 8;
+};
+
+class FeedbackHistory
+{
+public:
+	FeedbackHistory();
+
+	// Adds 'input' (RGBA32F, same size as 'output') to the history and writes
+	// the result of settings.op into 'output'.
+	void		cook(const FeedbackSettings& settings, const float* input, const ImageView& output);
+
+	void		reset();
+
+	// Number of frames currently in the ring
+	int32_t		filledFrames() const { return myFilled; }
+
+private:
+	void		resize(int32_t width, int32_t height);
+	void		setLength(int32_t length);
+	void		recomputeSum();
+
+	size_t		frameSize() const { return static_cast<size_t>(myWidth) * myHeight * 4; }
+
+	int32_t				myWidth;
+	int32_t				myHeight;
+
+	// Ring of input frames. myNext is the slot the next frame goes to, which
+	// is also the oldest frame once the ring is full.
+	std::vector<std::vector<float>>	myFrames;
+	int32_t				myNext;
+	int32_t				myFilled;
+
+	std::vector<float>	myDecayed;
+	std::vector<float>	mySum;
+};
+
+#endif
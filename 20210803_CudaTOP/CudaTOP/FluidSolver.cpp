@@ -0,0 +1,443 @@
+/*
+ * See FluidSolver.h
+ */
+
+#include "FluidSolver.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Levels stop being added once a side would drop below this
+static const int32_t CoarsestSize = 4;
+static const int32_t SmoothSweeps = 2;
+static const int32_t CoarseSweeps = 32;
+// The red-black solver only measures its residual every few sweeps
+static const int32_t RedBlackCheckInterval = 8;
+
+FluidSolver::FluidSolver() :
+	myWidth(0),
+	myHeight(0),
+	myLastIterations(0),
+	myLastResidual(0.0f)
+{
+}
+
+void
+FluidSolver::reset()
+{
+	std::fill(myU.begin(), myU.end(), 0.0f);
+	std::fill(myV.begin(), myV.end(), 0.0f);
+	std::fill(myDye.begin(), myDye.end(), 0.0f);
+	for (Grid& grid : myLevels)
+		std::fill(grid.p.begin(), grid.p.end(), 0.0f);
+}
+
+void
+FluidSolver::resize(int32_t width, int32_t height)
+{
+	if (width == myWidth && height == myHeight)
+		return;
+
+	myWidth = width;
+	myHeight = height;
+	const size_t size = static_cast<size_t>(width) * height;
+	myU.assign(size, 0.0f);
+	myV.assign(size, 0.0f);
+	myDye.assign(size, 0.0f);
+	myTemp.assign(size, 0.0f);
+	myCurl.assign(size, 0.0f);
+
+	myLevels.clear();
+	int32_t w = width;
+	int32_t h = height;
+	while (true)
+	{
+		Grid grid;
+		grid.width = w;
+		grid.height = h;
+		grid.p.assign(static_cast<size_t>(w) * h, 0.0f);
+		grid.rhs.assign(static_cast<size_t>(w) * h, 0.0f);
+		grid.residual.assign(static_cast<size_t>(w) * h, 0.0f);
+		myLevels.push_back(std::move(grid));
+
+		if (w / 2 < CoarsestSize || h / 2 < CoarsestSize)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+// Runs fn(x, y, index) for every cell, tile by tile
+template<typename F> static void
+forEachCell(const TilePlan& plan, F&& fn)
+{
+	parallelFor(plan.numPartitions(), [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			for (int t = plan.partitionStart[p]; t < plan.partitionStart[p + 1]; t++)
+			{
+				const TileRect& tile = plan.tiles[t];
+				for (int32_t y = tile.y0; y < tile.y1; y++)
+				{
+					size_t i = static_cast<size_t>(y) * plan.width + tile.x0;
+					for (int32_t x = tile.x0; x < tile.x1; x++, i++)
+						fn(x, y, i);
+				}
+			}
+		}
+	});
+}
+
+void
+FluidSolver::enforceWalls()
+{
+	// No flow through the walls
+	for (int32_t y = 0; y < myHeight; y++)
+	{
+		myU[static_cast<size_t>(y) * myWidth] = 0.0f;
+		myU[static_cast<size_t>(y) * myWidth + myWidth - 1] = 0.0f;
+	}
+	for (int32_t x = 0; x < myWidth; x++)
+	{
+		myV[x] = 0.0f;
+		myV[static_cast<size_t>(myHeight - 1) * myWidth + x] = 0.0f;
+	}
+}
+
+void
+FluidSolver::addForces(const FluidSettings& s, const float* input, const TilePlan& plan)
+{
+	const float cx = s.sourceX * myWidth;
+	const float cy = s.sourceY * myHeight;
+	const float radius = std::max(s.sourceRadius * myHeight, 0.5f);
+	const float invR2 = 1.0f / (radius * radius);
+	const float dt = s.timestep;
+	const float keep = std::exp(-s.dissipation * dt);
+
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		myDye[i] *= keep;
+
+		float dx = x + 0.5f - cx;
+		float dy = y + 0.5f - cy;
+		float d2 = (dx * dx + dy * dy) * invR2;
+		if (d2 < 9.0f)
+		{
+			float falloff = std::exp(-d2);
+			myU[i] += (s.sourceVelX - myU[i]) * falloff;
+			myV[i] += (s.sourceVelY - myV[i]) * falloff;
+			myDye[i] = std::max(myDye[i], s.sourceDye * falloff);
+		}
+
+		if (input)
+		{
+			const float* px = input + i * 4;
+			myU[i] += dt * s.inputForce * px[0];
+			myV[i] += dt * s.inputForce * px[1];
+			myDye[i] += dt * px[2];
+		}
+	});
+}
+
+void
+FluidSolver::confineVorticity(const FluidSettings& s, const TilePlan& plan)
+{
+	if (s.vorticity == 0.0f)
+		return;
+
+	const int32_t w = myWidth;
+	const int32_t h = myHeight;
+
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		int32_t xl = std::max(x - 1, 0), xr = std::min(x + 1, w - 1);
+		int32_t yd = std::max(y - 1, 0), yu = std::min(y + 1, h - 1);
+		float dvdx = (myV[static_cast<size_t>(y) * w + xr] - myV[static_cast<size_t>(y) * w + xl]) * 0.5f;
+		float dudy = (myU[static_cast<size_t>(yu) * w + x] - myU[static_cast<size_t>(yd) * w + x]) * 0.5f;
+		myCurl[i] = dvdx - dudy;
+	});
+
+	const float scale = s.vorticity * s.timestep;
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		if (x == 0 || y == 0 || x == w - 1 || y == h - 1)
+			return;
+
+		// Push along N x curl, N pointing towards higher |curl|
+		float nx = (std::fabs(myCurl[i + 1]) - std::fabs(myCurl[i - 1])) * 0.5f;
+		float ny = (std::fabs(myCurl[i + w]) - std::fabs(myCurl[i - w])) * 0.5f;
+		float len = std::sqrt(nx * nx + ny * ny) + 1e-5f;
+		nx /= len;
+		ny /= len;
+		myU[i] += scale * ny * myCurl[i];
+		myV[i] -= scale * nx * myCurl[i];
+	});
+}
+
+static inline float
+sampleBilinear(const std::vector<float>& field, int32_t w, int32_t h, float fx, float fy)
+{
+	fx = std::min(std::max(fx, 0.0f), static_cast<float>(w - 1));
+	fy = std::min(std::max(fy, 0.0f), static_cast<float>(h - 1));
+	int32_t x0 = std::min(static_cast<int32_t>(fx), w - 2 < 0 ? 0 : w - 2);
+	int32_t y0 = std::min(static_cast<int32_t>(fy), h - 2 < 0 ? 0 : h - 2);
+	int32_t x1 = std::min(x0 + 1, w - 1);
+	int32_t y1 = std::min(y0 + 1, h - 1);
+	float tx = fx - x0;
+	float ty = fy - y0;
+	const float* r0 = &field[static_cast<size_t>(y0) * w];
+	const float* r1 = &field[static_cast<size_t>(y1) * w];
+	float a = r0[x0] + (r0[x1] - r0[x0]) * tx;
+	float b = r1[x0] + (r1[x1] - r1[x0]) * tx;
+	return a + (b - a) * ty;
+}
+
+void
+FluidSolver::advect(const std::vector<float>& field, std::vector<float>& result, float dt, const TilePlan& plan)
+{
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		float fx = x - dt * myU[i];
+		float fy = y - dt * myV[i];
+		result[i] = sampleBilinear(field, myWidth, myHeight, fx, fy);
+	});
+}
+
+// Neighbour sum and count of a cell with Neumann walls
+static inline void
+neighbours(const std::vector<float>& p, int32_t w, int32_t h, int32_t x, int32_t y, float& sum, float& count)
+{
+	size_t i = static_cast<size_t>(y) * w + x;
+	sum = 0.0f;
+	count = 0.0f;
+	if (x > 0)		{ sum += p[i - 1]; count += 1.0f; }
+	if (x < w - 1)	{ sum += p[i + 1]; count += 1.0f; }
+	if (y > 0)		{ sum += p[i - w]; count += 1.0f; }
+	if (y < h - 1)	{ sum += p[i + w]; count += 1.0f; }
+}
+
+void
+FluidSolver::smooth(Grid& grid, int32_t sweeps)
+{
+	const int32_t w = grid.width;
+	const int32_t h = grid.height;
+
+	for (int32_t s = 0; s < sweeps; s++)
+	{
+		for (int32_t color = 0; color < 2; color++)
+		{
+			// Cells of one colour only depend on the other colour, so rows
+			// can be updated in parallel
+			parallelFor(h, [&](int begin, int end)
+			{
+				for (int32_t y = begin; y < end; y++)
+				{
+					for (int32_t x = (y + color) & 1; x < w; x += 2)
+					{
+						float sum, count;
+						neighbours(grid.p, w, h, x, y, sum, count);
+						size_t i = static_cast<size_t>(y) * w + x;
+						if (count > 0.0f)
+							grid.p[i] = (sum - grid.rhs[i]) / count;
+					}
+				}
+			}, 32);
+		}
+	}
+}
+
+float
+FluidSolver::computeResidual(Grid& grid)
+{
+	const int32_t w = grid.width;
+	const int32_t h = grid.height;
+	std::vector<double> sums(std::max(1, h), 0.0);
+
+	parallelFor(h, [&](int begin, int end)
+	{
+		for (int32_t y = begin; y < end; y++)
+		{
+			double rowSum = 0.0;
+			for (int32_t x = 0; x < w; x++)
+			{
+				float sum, count;
+				neighbours(grid.p, w, h, x, y, sum, count);
+				size_t i = static_cast<size_t>(y) * w + x;
+				float r = grid.rhs[i] - (sum - count * grid.p[i]);
+				grid.residual[i] = r;
+				rowSum += double(r) * r;
+			}
+			sums[y] = rowSum;
+		}
+	}, 32);
+
+	double total = 0.0;
+	for (double s : sums)
+		total += s;
+	return static_cast<float>(std::sqrt(total / (double(w) * h)));
+}
+
+void
+FluidSolver::restrictResidual(const Grid& fine, Grid& coarse)
+{
+	// Equations aren't scaled by the cell size, so the coarse right hand
+	// side is the sum, not the average, of the fine residuals.
+	parallelFor(coarse.height, [&](int begin, int end)
+	{
+		for (int32_t y = begin; y < end; y++)
+		{
+			for (int32_t x = 0; x < coarse.width; x++)
+			{
+				float sum = 0.0f;
+				for (int32_t dy = 0; dy < 2; dy++)
+				{
+					int32_t fy = y * 2 + dy;
+					if (fy >= fine.height)
+						continue;
+					for (int32_t dx = 0; dx < 2; dx++)
+					{
+						int32_t fx = x * 2 + dx;
+						if (fx < fine.width)
+							sum += fine.residual[static_cast<size_t>(fy) * fine.width + fx];
+					}
+				}
+				size_t i = static_cast<size_t>(y) * coarse.width + x;
+				coarse.rhs[i] = sum;
+				coarse.p[i] = 0.0f;
+			}
+		}
+	}, 32);
+}
+
+void
+FluidSolver::prolongAdd(const Grid& coarse, Grid& fine)
+{
+	parallelFor(fine.height, [&](int begin, int end)
+	{
+		for (int32_t y = begin; y < end; y++)
+		{
+			float cy = (y + 0.5f) * 0.5f - 0.5f;
+			for (int32_t x = 0; x < fine.width; x++)
+			{
+				float cx = (x + 0.5f) * 0.5f - 0.5f;
+				fine.p[static_cast<size_t>(y) * fine.width + x] +=
+					sampleBilinear(coarse.p, coarse.width, coarse.height, cx, cy);
+			}
+		}
+	}, 32);
+}
+
+void
+FluidSolver::vcycle(size_t level)
+{
+	Grid& grid = myLevels[level];
+	if (level + 1 == myLevels.size())
+	{
+		smooth(grid, CoarseSweeps);
+		return;
+	}
+
+	smooth(grid, SmoothSweeps);
+	computeResidual(grid);
+	restrictResidual(grid, myLevels[level + 1]);
+	vcycle(level + 1);
+	prolongAdd(myLevels[level + 1], grid);
+	smooth(grid, SmoothSweeps);
+}
+
+void
+FluidSolver::project(const FluidSettings& s, const TilePlan& plan)
+{
+	const int32_t w = myWidth;
+	const int32_t h = myHeight;
+	Grid& grid = myLevels[0];
+
+	// Central difference divergence, walls have zero normal velocity
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		float ur = x < w - 1 ? myU[i + 1] : 0.0f;
+		float ul = x > 0 ? myU[i - 1] : 0.0f;
+		float vu = y < h - 1 ? myV[i + w] : 0.0f;
+		float vd = y > 0 ? myV[i - w] : 0.0f;
+		grid.rhs[i] = 0.5f * (ur - ul + vu - vd);
+	});
+
+	// The pure Neumann problem needs a right hand side that sums to zero
+	double mean = 0.0;
+	double rhsSquares = 0.0;
+	for (float r : grid.rhs)
+	{
+		mean += r;
+		rhsSquares += double(r) * r;
+	}
+	mean /= double(w) * h;
+	for (float& r : grid.rhs)
+		r -= static_cast<float>(mean);
+
+	const float target = s.tolerance * static_cast<float>(std::sqrt(rhsSquares / (double(w) * h)));
+	int32_t iterations = 0;
+	float residual = computeResidual(grid);
+
+	while (iterations < s.maxIterations && residual > target)
+	{
+		if (s.solver == FluidPressureSolver::Multigrid)
+		{
+			vcycle(0);
+			iterations++;
+		}
+		else
+		{
+			int32_t sweeps = std::min(RedBlackCheckInterval, s.maxIterations - iterations);
+			smooth(grid, sweeps);
+			iterations += sweeps;
+		}
+		residual = computeResidual(grid);
+	}
+
+	myLastIterations = iterations;
+	myLastResidual = residual;
+
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		float pr = x < w - 1 ? grid.p[i + 1] : grid.p[i];
+		float pl = x > 0 ? grid.p[i - 1] : grid.p[i];
+		float pu = y < h - 1 ? grid.p[i + w] : grid.p[i];
+		float pd = y > 0 ? grid.p[i - w] : grid.p[i];
+		myU[i] -= 0.5f * (pr - pl);
+		myV[i] -= 0.5f * (pu - pd);
+	});
+
+	enforceWalls();
+}
+
+void
+FluidSolver::step(const FluidSettings& settings, const float* input, const TilePlan& plan,
+					const ImageView& output)
+{
+	resize(plan.width, plan.height);
+
+	addForces(settings, input, plan);
+	confineVorticity(settings, plan);
+	enforceWalls();
+
+	advect(myU, myTemp, settings.timestep, plan);
+	advect(myV, myCurl, settings.timestep, plan);
+	myU.swap(myTemp);
+	myV.swap(myCurl);
+
+	project(settings, plan);
+
+	advect(myDye, myTemp, settings.timestep, plan);
+	myDye.swap(myTemp);
+
+	forEachCell(plan, [&](int32_t x, int32_t y, size_t i)
+	{
+		float* dst = output.row(y) + x * 4;
+		dst[0] = myU[i];
+		dst[1] = myV[i];
+		dst[2] = myDye[i];
+		dst[3] = 1.0f;
+	});
+}
@@ -0,0 +1,110 @@
+/*
+ * 2D incompressible fluid for the TOP's Fluid mode, after Stam's stable
+ * fluids, on a collocated grid of one cell per output pixel with solid walls.
+ *
+ * Each step adds the source and input forces, applies vorticity confinement,
+ * advects the velocity semi-Lagrangian, projects it to be divergence free and
+ * then advects the dye with it. The pressure Poisson equation is solved with
+ * either multigrid V-cycles (red-black Gauss-Seidel smoothing, bilinear
+ * prolongation) or plain red-black Gauss-Seidel, warm started from the
+ * previous step's pressure.
+ *
+ * The output holds the velocity in cells per second in red and green, the
+ * dye in blue and 1 in alpha.
+ */
+
+#ifndef __FluidSolver__
+#define __FluidSolver__
+
+#include "ResourceCache.h"
+
+#include <vector>
+
+enum class FluidPressureSolver
+{
+	Multigrid = 0,
+	RedBlack
+};
+
+struct FluidSettings
+{
+	float				timestep = 1.0f / 60.0f;
+	float				vorticity = 0.3f;
+	// Fraction of the dye lost per second
+	float				dissipation = 0.1f;
+
+	FluidPressureSolver	solver = FluidPressureSolver::Multigrid;
+	// V-cycles for Multigrid, red-black sweeps for RedBlack
+	int32_t				maxIterations = 8;
+	// Stop once the RMS residual drops below this fraction of the RMS divergence
+	float				tolerance = 1e-3f;
+
+	// Circular source in uv space, radius relative to the image height
+	float				sourceX = 0.5f;
+	float				sourceY = 0.1f;
+	float				sourceRadius = 0.04f;
+	float				sourceVelX = 0.0f;
+	float				sourceVelY = 200.0f;
+	float				sourceDye = 1.0f;
+
+	// Scale of the input's red/green added as acceleration, blue adds dye
+	float				inputForce = 1000.0f;
+};
+
+class FluidSolver
+{
+public:
+	FluidSolver();
+
+	// Advances the fluid by one step and writes it to 'output'. 'input' is an
+	// optional RGBA32F image of the same size.
+	void		step(const FluidSettings& settings, const float* input, const TilePlan& plan,
+					const ImageView& output);
+
+	void		reset();
+
+	// Pressure iterations used and RMS residual reached by the last step
+	int32_t		lastIterations() const { return myLastIterations; }
+	float		lastResidual() const { return myLastResidual; }
+
+private:
+	struct Grid
+	{
+		int32_t				width = 0;
+		int32_t				height = 0;
+		std::vector<float>	p;
+		std::vector<float>	rhs;
+		std::vector<float>	residual;
+	};
+
+	void		resize(int32_t width, int32_t height);
+	void		addForces(const FluidSettings& settings, const float* input, const TilePlan& plan);
+	void		confineVorticity(const FluidSettings& settings, const TilePlan& plan);
+	void		advect(const std::vector<float>& field, std::vector<float>& result, float dt, const TilePlan& plan);
+	void		project(const FluidSettings& settings, const TilePlan& plan);
+	void		enforceWalls();
+
+	// Poisson solver on myLevels
+	static void		smooth(Grid& grid, int32_t sweeps);
+	static float	computeResidual(Grid& grid);
+	static void		restrictResidual(const Grid& fine, Grid& coarse);
+	static void		prolongAdd(const Grid& coarse, Grid& fine);
+	void			vcycle(size_t level);
+
+	int32_t				myWidth;
+	int32_t				myHeight;
+
+	std::vector<float>	myU;
+	std::vector<float>	myV;
+	std::vector<float>	myDye;
+	std::vector<float>	myTemp;
+	std::vector<float>	myCurl;
+
+	// Level 0 is the simulation grid, each following level half the size
+	std::vector<Grid>	myLevels;
+
+	int32_t				myLastIterations;
+	float				myLastResidual;
+};
+
+#endif
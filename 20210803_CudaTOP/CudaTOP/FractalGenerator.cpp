@@ -0,0 +1,294 @@
+/*
+ * See FractalGenerator.h
+ */
+
+#include "FractalGenerator.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Step of the first pass after the view changes. Must divide the tile size
+// so that the blocks filled by a pass never straddle two tiles.
+static const int32_t CoarsestStep = 8;
+
+// A large bailout radius makes the smooth iteration count accurate
+static const double BailoutSquared = 256.0 * 256.0;
+
+bool
+FractalView::operator==(const FractalView& other) const
+{
+	return type == other.type &&
+		centerX == other.centerX &&
+		centerY == other.centerY &&
+		zoom == other.zoom &&
+		juliaX == other.juliaX &&
+		juliaY == other.juliaY &&
+		maxIterations == other.maxIterations;
+}
+
+FractalGenerator::FractalGenerator() :
+	myWidth(0),
+	myHeight(0),
+	myLastStep(0),
+	myLastPixelCount(0),
+	myOutputValid(false)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		myColor1[i] = -1.0f;
+		myColor2[i] = -1.0f;
+	}
+}
+
+void
+FractalGenerator::reset()
+{
+	myLastStep = 0;
+}
+
+static inline float
+smoothIterations(int32_t n, double magnitudeSquared, int32_t maxIterations)
+{
+	if (n >= maxIterations)
+		return -1.0f;
+	// n + 1 - log2(log|z|)
+	double logZ = 0.5 * std::log(magnitudeSquared);
+	return static_cast<float>(n + 1 - std::log2(logZ));
+}
+
+// Iterates 'count' points (count <= 4). For Mandelbrot z starts at 0 and c is
+// the pixel, for Julia z starts at the pixel and c is constant.
+static void
+iterateScalar(int count, const double* zx0, const double* zy0,
+				const double* cx, const double* cy, int32_t maxIterations, float* out)
+{
+	for (int i = 0; i < count; i++)
+	{
+		double zx = zx0[i];
+		double zy = zy0[i];
+		double mag = zx * zx + zy * zy;
+		int32_t n = 0;
+		while (n < maxIterations && mag < BailoutSquared)
+		{
+			double t = zx * zx - zy * zy + cx[i];
+			zy = 2.0 * zx * zy + cy[i];
+			zx = t;
+			mag = zx * zx + zy * zy;
+			n++;
+		}
+		out[i] = smoothIterations(n, mag, maxIterations);
+	}
+}
+
+#if SIMD_X86
+// Same as iterateScalar for exactly 4 points, one per AVX2 lane. Lanes that
+// escape are frozen with a blend so their |z| stays finite for smoothing.
+SIMD_TARGET_AVX2 static void
+iterateAVX2(const double* zx0, const double* zy0,
+			const double* cx0, const double* cy0, int32_t maxIterations, float* out)
+{
+	__m256d zx = _mm256_loadu_pd(zx0);
+	__m256d zy = _mm256_loadu_pd(zy0);
+	const __m256d cx = _mm256_loadu_pd(cx0);
+	const __m256d cy = _mm256_loadu_pd(cy0);
+	const __m256d bailout = _mm256_set1_pd(BailoutSquared);
+	const __m256d one = _mm256_set1_pd(1.0);
+	__m256d iterations = _mm256_setzero_pd();
+	__m256d mag = _mm256_fmadd_pd(zx, zx, _mm256_mul_pd(zy, zy));
+
+	for (int32_t n = 0; n < maxIterations; n++)
+	{
+		__m256d active = _mm256_cmp_pd(mag, bailout, _CMP_LT_OQ);
+		if (_mm256_movemask_pd(active) == 0)
+			break;
+
+		__m256d zx2 = _mm256_mul_pd(zx, zx);
+		__m256d zy2 = _mm256_mul_pd(zy, zy);
+		__m256d nx = _mm256_add_pd(_mm256_sub_pd(zx2, zy2), cx);
+		__m256d ny = _mm256_fmadd_pd(_mm256_add_pd(zx, zx), zy, cy);
+
+		zx = _mm256_blendv_pd(zx, nx, active);
+		zy = _mm256_blendv_pd(zy, ny, active);
+		mag = _mm256_fmadd_pd(zx, zx, _mm256_mul_pd(zy, zy));
+		iterations = _mm256_add_pd(iterations, _mm256_and_pd(active, one));
+	}
+
+	alignas(32) double n[4];
+	alignas(32) double m[4];
+	_mm256_store_pd(n, iterations);
+	_mm256_store_pd(m, mag);
+	for (int i = 0; i < 4; i++)
+		out[i] = smoothIterations(static_cast<int32_t>(n[i]), m[i], maxIterations);
+}
+#endif
+
+void
+FractalGenerator::iteratePass(const TilePlan& plan, int32_t step, int32_t previousStep)
+{
+	const FractalView view = myView;
+	const int32_t width = myWidth;
+	const int32_t height = myHeight;
+	const double scale = 3.0 / (view.zoom * std::min(width, height));
+	const bool julia = view.type == FractalType::Julia;
+	const bool useAVX2 = simdHasAVX2();
+
+	std::vector<int64_t> counts(plan.numPartitions(), 0);
+
+	parallelFor(plan.numPartitions(), [&](int begin, int end)
+	{
+		double zx[4], zy[4], cx[4], cy[4];
+		int32_t px[4], py[4];
+		float result[4];
+
+		for (int p = begin; p < end; p++)
+		{
+			int64_t count = 0;
+			int lanes = 0;
+
+			auto flush = [&]()
+			{
+#if SIMD_X86
+				if (lanes == 4 && useAVX2)
+					iterateAVX2(zx, zy, cx, cy, view.maxIterations, result);
+				else
+#endif
+					iterateScalar(lanes, zx, zy, cx, cy, view.maxIterations, result);
+
+				// Fill the step x step block each point stands for
+				for (int i = 0; i < lanes; i++)
+				{
+					int32_t x1 = std::min(width, px[i] + step);
+					int32_t y1 = std::min(height, py[i] + step);
+					for (int32_t y = py[i]; y < y1; y++)
+					{
+						float* row = &myIterations[static_cast<size_t>(y) * width];
+						std::fill(row + px[i], row + x1, result[i]);
+					}
+				}
+				count += lanes;
+				lanes = 0;
+			};
+
+			for (int t = plan.partitionStart[p]; t < plan.partitionStart[p + 1]; t++)
+			{
+				const TileRect& tile = plan.tiles[t];
+				for (int32_t y = tile.y0; y < tile.y1; y += step)
+				{
+					double fy = view.centerY + (y - height * 0.5) * scale;
+					for (int32_t x = tile.x0; x < tile.x1; x += step)
+					{
+						// Already iterated by the previous, coarser pass
+						if (previousStep && x % previousStep == 0 && y % previousStep == 0)
+							continue;
+
+						double fx = view.centerX + (x - width * 0.5) * scale;
+						if (julia)
+						{
+							zx[lanes] = fx;
+							zy[lanes] = fy;
+							cx[lanes] = view.juliaX;
+							cy[lanes] = view.juliaY;
+						}
+						else
+						{
+							zx[lanes] = 0.0;
+							zy[lanes] = 0.0;
+							cx[lanes] = fx;
+							cy[lanes] = fy;
+						}
+						px[lanes] = x;
+						py[lanes] = y;
+						if (++lanes == 4)
+							flush();
+					}
+				}
+			}
+			if (lanes)
+				flush();
+
+			counts[p] = count;
+		}
+	});
+
+	myLastPixelCount = 0;
+	for (int64_t c : counts)
+		myLastPixelCount += c;
+}
+
+void
+FractalGenerator::colorize(const ImageView& output) const
+{
+	const float period = 64.0f;
+	const float twoPi = 6.28318530718f;
+
+	parallelFor(output.height, [&](int begin, int end)
+	{
+		for (int32_t y = begin; y < end; y++)
+		{
+			const float* src = &myIterations[static_cast<size_t>(y) * myWidth];
+			float* dst = output.row(y);
+			for (int32_t x = 0; x < myWidth; x++)
+			{
+				float mu = src[x];
+				if (mu < 0.0f)
+				{
+					dst[x * 4 + 0] = 0.0f;
+					dst[x * 4 + 1] = 0.0f;
+					dst[x * 4 + 2] = 0.0f;
+				}
+				else
+				{
+					float t = 0.5f - 0.5f * std::cos(twoPi * mu / period);
+					for (int c = 0; c < 3; c++)
+						dst[x * 4 + c] = myColor1[c] + (myColor2[c] - myColor1[c]) * t;
+				}
+				dst[x * 4 + 3] = 1.0f;
+			}
+		}
+	}, 16);
+}
+
+bool
+FractalGenerator::cook(const FractalView& view, const float color1[3], const float color2[3],
+						const TilePlan& plan, const ImageView& output)
+{
+	if (view != myView || plan.width != myWidth || plan.height != myHeight)
+	{
+		myView = view;
+		myWidth = plan.width;
+		myHeight = plan.height;
+		myIterations.assign(static_cast<size_t>(myWidth) * myHeight, 0.0f);
+		myLastStep = 0;
+	}
+
+	bool colorsChanged = false;
+	for (int c = 0; c < 3; c++)
+	{
+		if (color1[c] != myColor1[c] || color2[c] != myColor2[c])
+			colorsChanged = true;
+		myColor1[c] = color1[c];
+		myColor2[c] = color2[c];
+	}
+
+	bool iterated = false;
+	if (myLastStep != 1)
+	{
+		int32_t step = myLastStep ? myLastStep / 2 : CoarsestStep;
+		iteratePass(plan, step, myLastStep);
+		myLastStep = step;
+		iterated = true;
+	}
+	else
+	{
+		myLastPixelCount = 0;
+	}
+
+	if (!iterated && !colorsChanged && myOutputValid)
+		return false;
+
+	colorize(output);
+	myOutputValid = true;
+	return true;
+}
@@ -0,0 +1,84 @@
+/*
+ * Escape-time Mandelbrot/Julia renderer for the TOP's Fractal mode.
+ *
+ * The image refines progressively: the first cook after the view changes
+ * only iterates every 8th pixel in each direction and fills 8x8 blocks, each
+ * following cook halves the step until every pixel has been iterated. The
+ * smooth iteration counts are kept between cooks, so a static view costs
+ * nothing once it is complete, and a colour change only re-runs the cheap
+ * colouring pass.
+ */
+
+#ifndef __FractalGenerator__
+#define __FractalGenerator__
+
+#include "ResourceCache.h"
+
+#include <vector>
+
+enum class FractalType
+{
+	Mandelbrot = 0,
+	Julia
+};
+
+struct FractalView
+{
+	FractalType	type = FractalType::Mandelbrot;
+	double		centerX = -0.5;
+	double		centerY = 0.0;
+	double		zoom = 1.0;
+	double		juliaX = -0.8;
+	double		juliaY = 0.156;
+	int32_t		maxIterations = 256;
+
+	bool		operator==(const FractalView& other) const;
+	bool		operator!=(const FractalView& other) const { return !(*this == other); }
+};
+
+class FractalGenerator
+{
+public:
+	FractalGenerator();
+
+	// Runs the next refinement pass, if any is left, and colours the result
+	// into 'output'. Returns false without touching 'output' when neither the
+	// view, the colours nor the iteration buffer changed since the last call.
+	// 'plan' must use a tile size that is a multiple of 8.
+	bool		cook(const FractalView& view, const float color1[3], const float color2[3],
+					const TilePlan& plan, const ImageView& output);
+
+	// Forces the next cook to start over from the coarsest pass.
+	void		reset();
+	// Makes the next cook colour the whole output again, for when something
+	// else drew over it.
+	void		invalidate() { myOutputValid = false; }
+
+	// Pixel step of the last pass that ran, 1 once the image is complete.
+	int32_t		lastStep() const { return myLastStep; }
+	bool		isComplete() const { return myLastStep == 1; }
+
+	// Number of pixels iterated by the last pass
+	int64_t		lastPixelCount() const { return myLastPixelCount; }
+
+private:
+	void		iteratePass(const TilePlan& plan, int32_t step, int32_t previousStep);
+	void		colorize(const ImageView& output) const;
+
+	FractalView			myView;
+	float				myColor1[3];
+	float				myColor2[3];
+
+	int32_t				myWidth;
+	int32_t				myHeight;
+
+	// Smooth iteration count per pixel, -1 for points inside the set
+	std::vector<float>	myIterations;
+
+	int32_t				myLastStep;
+	int64_t				myLastPixelCount;
+	// Whether 'output' still holds the last colouring
+	bool				myOutputValid;
+};
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * See FrameContainer.h
+ */
+
+#include "FrameContainer.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else // macOS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const size_t HeaderSize = 32;
+static const size_t IndexEntrySize = 16;
+static const size_t PageSize = 4096;
+
+static uint32_t
+readU32(const uint8_t* p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+// Decodes one LZ4 block. Returns false unless it decodes to exactly
+// 'dstSize' bytes without reading or writing out of bounds.
+static bool
+decodeLZ4(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+	const uint8_t* srcEnd = src + srcSize;
+	uint8_t* const dstBegin = dst;
+	uint8_t* const dstEnd = dst + dstSize;
+
+	while (src < srcEnd)
+	{
+		const uint32_t token = *src++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			uint8_t b;
+			do
+			{
+				if (src >= srcEnd)
+					return false;
+				b = *src++;
+				literals += b;
+			} while (b == 255);
+		}
+		if (literals > static_cast<size_t>(srcEnd - src) || literals > static_cast<size_t>(dstEnd - dst))
+			return false;
+		memcpy(dst, src, literals);
+		src += literals;
+		dst += literals;
+
+		// The last sequence only has literals
+		if (src == srcEnd)
+			break;
+
+		if (srcEnd - src < 2)
+			return false;
+		const size_t offset = src[0] | (src[1] << 8);
+		src += 2;
+		if (offset == 0 || offset > static_cast<size_t>(dst - dstBegin))
+			return false;
+
+		size_t length = token & 15;
+		if (length == 15)
+		{
+			uint8_t b;
+			do
+			{
+				if (src >= srcEnd)
+					return false;
+				b = *src++;
+				length += b;
+			} while (b == 255);
+		}
+		length += 4;
+		if (length > static_cast<size_t>(dstEnd - dst))
+			return false;
+
+		// Matches may overlap the bytes they produce
+		const uint8_t* match = dst - offset;
+		if (offset >= length)
+		{
+			memcpy(dst, match, length);
+			dst += length;
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+				*dst++ = *match++;
+		}
+	}
+	return dst == dstEnd;
+}
+
+FrameContainer::FrameContainer() :
+	myError(nullptr),
+	myData(nullptr),
+	mySize(0),
+#ifdef _WIN32
+	myFile(nullptr),
+	myMapping(nullptr),
+#endif
+	myWidth(0),
+	myHeight(0),
+	myFrameCount(0),
+	myFrameRate(0.0f),
+	myPixelFormat(FramePixelFormat::BGRA8),
+	myCodec(FrameCodec::Raw)
+{
+}
+
+FrameContainer::~FrameContainer()
+{
+	close();
+}
+
+void
+FrameContainer::close()
+{
+#ifdef _WIN32
+	if (myData)
+		UnmapViewOfFile(myData);
+	if (myMapping)
+		CloseHandle(myMapping);
+	if (myFile)
+		CloseHandle(myFile);
+	myMapping = nullptr;
+	myFile = nullptr;
+#else // macOS
+	if (myData)
+		munmap(const_cast<uint8_t*>(myData), mySize);
+#endif
+	myData = nullptr;
+	mySize = 0;
+	myFrameCount = 0;
+	myPath.clear();
+}
+
+bool
+FrameContainer::open(const char* path)
+{
+	close();
+	myError = nullptr;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+								FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER size;
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+	{
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		myError = "Unable to open the clip file.";
+		return false;
+	}
+	myFile = file;
+	mySize = static_cast<size_t>(size.QuadPart);
+
+	if (mySize >= HeaderSize)
+	{
+		myMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (myMapping)
+			myData = static_cast<const uint8_t*>(MapViewOfFile(myMapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else // macOS
+	int fd = ::open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		if (fd >= 0)
+			::close(fd);
+		myError = "Unable to open the clip file.";
+		return false;
+	}
+	mySize = static_cast<size_t>(st.st_size);
+
+	if (mySize >= HeaderSize)
+	{
+		void* data = mmap(nullptr, mySize, PROT_READ, MAP_SHARED, fd, 0);
+		if (data != MAP_FAILED)
+		{
+			myData = static_cast<const uint8_t*>(data);
+			// Frames are mostly read in order, let the kernel read ahead
+			madvise(data, mySize, MADV_SEQUENTIAL);
+		}
+	}
+	// The mapping keeps the file referenced
+	::close(fd);
+#endif
+
+	if (!myData)
+	{
+		close();
+		myError = "Unable to map the clip file.";
+		return false;
+	}
+
+	const uint32_t version = readU32(myData + 4);
+	myWidth = static_cast<int32_t>(readU32(myData + 8));
+	myHeight = static_cast<int32_t>(readU32(myData + 12));
+	myPixelFormat = static_cast<FramePixelFormat>(readU32(myData + 16));
+	myCodec = static_cast<FrameCodec>(readU32(myData + 20));
+	const uint32_t frameCount = readU32(myData + 24);
+	memcpy(&myFrameRate, myData + 28, sizeof(float));
+
+	if (memcmp(myData, "TDFC", 4) != 0 || version != 1)
+		myError = "The file is not a frame container.";
+	else if (myWidth <= 0 || myHeight <= 0 || frameCount == 0 ||
+		myPixelFormat > FramePixelFormat::RGBA32F || myCodec > FrameCodec::LZ4)
+		myError = "The frame container header is invalid.";
+	else if (frameCount > (mySize - HeaderSize) / IndexEntrySize)
+		myError = "The frame container index is truncated.";
+
+	if (!myError)
+	{
+		myFrameCount = static_cast<int32_t>(frameCount);
+		for (int32_t i = 0; i < myFrameCount && !myError; i++)
+		{
+			IndexEntry e = entry(i);
+			if (e.offset > mySize || e.size > mySize - e.offset)
+				myError = "A frame lies outside of the frame container.";
+			else if (myCodec == FrameCodec::Raw && e.size != frameBytes())
+				myError = "A raw frame has the wrong size.";
+		}
+	}
+
+	if (myError)
+	{
+		const char* error = myError;
+		close();
+		myError = error;
+		return false;
+	}
+
+	myPath = path;
+	return true;
+}
+
+FrameContainer::IndexEntry
+FrameContainer::entry(int32_t frame) const
+{
+	const uint8_t* p = myData + HeaderSize + IndexEntrySize * frame;
+	IndexEntry e;
+	e.offset = uint64_t(readU32(p)) | (uint64_t(readU32(p + 4)) << 32);
+	e.size = readU32(p + 8);
+	e.reserved = readU32(p + 12);
+	return e;
+}
+
+size_t
+FrameContainer::frameBytes() const
+{
+	size_t pixel = myPixelFormat == FramePixelFormat::RGBA32F ? 4 * sizeof(float) : 4;
+	return static_cast<size_t>(myWidth) * myHeight * pixel;
+}
+
+void
+FrameContainer::prefetch(int32_t first, int32_t count) const
+{
+	first = std::max(first, 0);
+	const int32_t last = std::min(first + count, myFrameCount);
+	if (!myData || first >= last)
+		return;
+
+	// Frames are stored in order, so this is one contiguous range
+	const IndexEntry begin = entry(first);
+	const IndexEntry end = entry(last - 1);
+	uint64_t from = std::min(begin.offset, end.offset) & ~uint64_t(PageSize - 1);
+	uint64_t to = std::max(begin.offset + begin.size, end.offset + end.size);
+	if (to <= from)
+		return;
+
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<uint8_t*>(myData + from);
+	range.NumberOfBytes = static_cast<SIZE_T>(to - from);
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else // macOS
+	madvise(const_cast<uint8_t*>(myData + from), static_cast<size_t>(to - from), MADV_WILLNEED);
+#endif
+}
+
+void
+FrameContainer::touch(int32_t frame) const
+{
+	if (!myData || frame < 0 || frame >= myFrameCount)
+		return;
+
+	const IndexEntry e = entry(frame);
+	const volatile uint8_t* p = myData + e.offset;
+	uint8_t sink = 0;
+	for (size_t i = 0; i < e.size; i += PageSize)
+		sink ^= p[i];
+	if (e.size > 0)
+		sink ^= p[e.size - 1];
+	(void)sink;
+}
+
+bool
+FrameContainer::decode(int32_t frame, void* dst) const
+{
+	if (!myData || frame < 0 || frame >= myFrameCount)
+		return false;
+
+	const IndexEntry e = entry(frame);
+	const uint8_t* src = myData + e.offset;
+
+	if (myCodec == FrameCodec::Raw)
+	{
+		memcpy(dst, src, e.size);
+		return true;
+	}
+	return decodeLZ4(src, e.size, static_cast<uint8_t*>(dst), frameBytes());
+}
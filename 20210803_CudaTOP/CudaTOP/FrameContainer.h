@@ -0,0 +1,113 @@
+/*
+ * Read-only, memory-mapped frame container for the TOP's Player mode.
+ *
+ * The file is a little-endian header, an index with one entry per frame and
+ * the frame data:
+ *
+ *	offset	size
+ *	0		4		magic "TDFC"
+ *	4		4		version, 1
+ *	8		4		width
+ *	12		4		height
+ *	16		4		pixel format, see FramePixelFormat
+ *	20		4		codec, see FrameCodec
+ *	24		4		frame count
+ *	28		4		frame rate, float
+ *	32		16 * n	index: per frame a 64-bit byte offset from the start of the
+ *					file, a 32-bit stored size and 4 reserved bytes
+ *
+ * A frame is width * height pixels, bottom row first. Raw frames are stored
+ * as is, LZ4 frames as one LZ4 block each (what LZ4_compress_default()
+ * writes, without the LZ4 frame header).
+ *
+ * Nothing is read up front except the header and index. Frames are read
+ * straight out of the mapping, prefetch() asks the OS to page them in ahead.
+ */
+
+#ifndef __FrameContainer__
+#define __FrameContainer__
+
+#include <stdint.h>
+#include <string>
+
+enum class FramePixelFormat : uint32_t
+{
+	BGRA8 = 0,
+	RGBA8,
+	RGBA32F,
+};
+
+enum class FrameCodec : uint32_t
+{
+	Raw = 0,
+	LZ4,
+};
+
+class FrameContainer
+{
+public:
+	FrameContainer();
+	~FrameContainer();
+
+	FrameContainer(const FrameContainer&) = delete;
+	FrameContainer&	operator=(const FrameContainer&) = delete;
+
+	// Maps the file and validates the header and index. On failure the
+	// container is left closed and error() says why.
+	bool			open(const char* path);
+	void			close();
+
+	bool			isOpen() const { return myData != nullptr; }
+	const std::string&	path() const { return myPath; }
+	const char*		error() const { return myError; }
+
+	int32_t			width() const { return myWidth; }
+	int32_t			height() const { return myHeight; }
+	int32_t			frameCount() const { return myFrameCount; }
+	float			frameRate() const { return myFrameRate; }
+	FramePixelFormat	pixelFormat() const { return myPixelFormat; }
+	FrameCodec		codec() const { return myCodec; }
+
+	// Size of one decoded frame
+	size_t			frameBytes() const;
+
+	// Hints the OS to start reading frames [first, first + count) in.
+	void			prefetch(int32_t first, int32_t count) const;
+
+	// Touches every page of the frame so it's resident before a cook needs
+	// it. Blocks while the pages are read from disk.
+	void			touch(int32_t frame) const;
+
+	// Decodes the frame into 'dst', which must hold frameBytes(). Thread
+	// safe. Returns false if the stored frame is corrupt.
+	bool			decode(int32_t frame, void* dst) const;
+
+private:
+	struct IndexEntry
+	{
+		uint64_t	offset;
+		uint32_t	size;
+		uint32_t	reserved;
+	};
+
+	IndexEntry		entry(int32_t frame) const;
+
+	std::string		myPath;
+	const char*		myError;
+
+	const uint8_t*	myData;
+	size_t			mySize;
+#ifdef _WIN32
+	void*			myFile;
+	void*			myMapping;
+#endif
+
+	int32_t			myWidth;
+	int32_t			myHeight;
+	int32_t			myFrameCount;
+	float			myFrameRate;
+	FramePixelFormat	myPixelFormat;
+	FrameCodec		myCodec;
+};
+
+#endif
@@ -0,0 +1,376 @@
+/*
+ * See FramePlayer.h
+ */
+
+#include "FramePlayer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Enough to decode both frames ahead at once
+static const int32_t NumWorkers = 2;
+
+FramePlayer::FramePlayer() :
+	myError(nullptr),
+	myPosition(0.0),
+	myLastFrame(-1),
+	myDirection(1),
+	myStep(1),
+	myShownFrame(-1),
+	myExpectedFrame(-1),
+	myPendingDecodes(0),
+	myStopping(false),
+	myDecodeAheadHits(0),
+	myDecodeAheadMisses(0)
+{
+	ClipCache::instance().attach();
+}
+
+FramePlayer::~FramePlayer()
+{
+	close();
+	ClipCache::instance().setCues(this, {}, {});
+	ClipCache::instance().detach();
+}
+
+const FrameContainer&
+FramePlayer::container() const
+{
+	static const FrameContainer closed;
+	return myClip ? myClip->container() : closed;
+}
+
+bool
+FramePlayer::open(const std::string& path)
+{
+	if (myClip && path == myPath)
+		return true;
+
+	// Nothing of the previous clip may be written after this
+	waitForDecodes();
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		myJobs.clear();
+		for (Buffer& buffer : myBuffers)
+			buffer.frame = -1;
+	}
+
+	myPath = path;
+	myError = nullptr;
+	myClip = path.empty() ? nullptr : ClipCache::instance().acquire(path, myError);
+	reset();
+	if (!myClip)
+		return false;
+
+	if (myWorkers.empty())
+		startWorkers();
+	return true;
+}
+
+void
+FramePlayer::close()
+{
+	stopWorkers();
+	myClip.reset();
+	myPath.clear();
+	for (Buffer& buffer : myBuffers)
+		buffer = Buffer();
+	myShownFrame = -1;
+}
+
+void
+FramePlayer::cue(const std::vector<std::string>& paths, const std::vector<int32_t>& priorities)
+{
+	ClipCache::instance().setCues(this, paths, priorities);
+}
+
+void
+FramePlayer::reset()
+{
+	myPosition = 0.0;
+	myLastFrame = -1;
+	myDirection = 1;
+	myStep = 1;
+	myShownFrame = -1;
+	myExpectedFrame = -1;
+}
+
+void
+FramePlayer::startWorkers()
+{
+	myStopping = false;
+	for (int32_t i = 0; i < NumWorkers; i++)
+		myWorkers.emplace_back(&FramePlayer::workerLoop, this);
+}
+
+void
+FramePlayer::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		myStopping = true;
+	}
+	myJobReady.notify_all();
+	for (std::thread& worker : myWorkers)
+		worker.join();
+	myWorkers.clear();
+
+	// Decodes that never ran leave their buffers empty
+	for (const Job& job : myJobs)
+	{
+		if (job.dst)
+			myBuffers[job.buffer].frame = -1;
+	}
+	myJobs.clear();
+	myPendingDecodes = 0;
+}
+
+void
+FramePlayer::workerLoop()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(myMutex);
+			myJobReady.wait(lock, [this]() { return myStopping || !myJobs.empty(); });
+			if (myStopping)
+				return;
+			job = myJobs.front();
+			myJobs.pop_front();
+		}
+
+		if (!job.dst)
+		{
+			job.clip->container().touch(job.frame);
+			continue;
+		}
+
+		bool ok = ClipCache::instance().decode(*job.clip, job.frame, job.dst);
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+			myBuffers[job.buffer].frame = ok ? job.frame : -1;
+			myPendingDecodes--;
+		}
+		myDecodeDone.notify_all();
+	}
+}
+
+void
+FramePlayer::waitForDecodes()
+{
+	std::unique_lock<std::mutex> lock(myMutex);
+	myDecodeDone.wait(lock, [this]() { return myPendingDecodes == 0; });
+}
+
+void
+FramePlayer::dropBuffers()
+{
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		// Read-ahead only touches the clip's pages, it can carry on
+		for (auto it = myJobs.begin(); it != myJobs.end(); )
+		{
+			if (it->dst)
+			{
+				myPendingDecodes--;
+				it = myJobs.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+	waitForDecodes();
+
+	for (Buffer& buffer : myBuffers)
+		buffer = Buffer();
+	// The texture shown now is someone else's, the frame is uploaded again
+	myShownFrame = -1;
+}
+
+int32_t
+FramePlayer::wrap(int64_t frame) const
+{
+	const int64_t n = container().frameCount();
+	return static_cast<int32_t>(((frame % n) + n) % n);
+}
+
+int32_t
+FramePlayer::advance(const PlayerSettings& settings)
+{
+	const int32_t n = container().frameCount();
+	if (n == 0)
+		return -1;
+
+	int32_t frame;
+	if (settings.mode == PlayerMode::Index)
+	{
+		frame = wrap(static_cast<int64_t>(std::floor(settings.index + 0.5)));
+	}
+	else
+	{
+		frame = wrap(static_cast<int64_t>(std::floor(myPosition)));
+		myPosition = std::fmod(myPosition + settings.speed, static_cast<double>(n));
+		if (myPosition < 0.0)
+			myPosition += n;
+	}
+
+	// Direction and stride the next frames are predicted with
+	if (settings.mode == PlayerMode::Sequential && settings.speed != 0.0)
+	{
+		myDirection = settings.speed > 0.0 ? 1 : -1;
+		myStep = std::max(1, static_cast<int32_t>(std::fabs(settings.speed) + 0.5));
+	}
+	else if (myLastFrame >= 0 && frame != myLastFrame)
+	{
+		int32_t delta = frame - myLastFrame;
+		if (delta > n / 2)
+			delta -= n;
+		else if (delta < -n / 2)
+			delta += n;
+		myDirection = delta > 0 ? 1 : -1;
+		myStep = std::max(1, std::abs(delta));
+	}
+	myLastFrame = frame;
+	return frame;
+}
+
+void
+FramePlayer::queueReadAhead(int32_t frame, int32_t readAhead)
+{
+	if (readAhead <= 0)
+		return;
+
+	const int64_t stride = static_cast<int64_t>(myDirection) * myStep;
+
+	// The pages of the whole window, in one hint
+	int64_t far = frame + stride * readAhead;
+	int64_t first = std::min<int64_t>(frame, far);
+	int64_t last = std::max<int64_t>(frame, far);
+	first = std::max<int64_t>(first, 0);
+	last = std::min<int64_t>(last, container().frameCount() - 1);
+	container().prefetch(static_cast<int32_t>(first), static_cast<int32_t>(last - first + 1));
+
+	// In steady playback the rest of the window was queued by earlier cooks,
+	// only the new far end needs touching. After a jump, start over.
+	const bool jumped = frame != myExpectedFrame;
+	myExpectedFrame = wrap(frame + stride);
+
+	std::lock_guard<std::mutex> lock(myMutex);
+	if (jumped)
+	{
+		myJobs.erase(std::remove_if(myJobs.begin(), myJobs.end(),
+						[](const Job& job) { return job.dst == nullptr; }), myJobs.end());
+		for (int32_t k = 1; k <= readAhead; k++)
+			myJobs.push_back({ myClip, wrap(frame + stride * k), nullptr, -1 });
+	}
+	else
+	{
+		myJobs.push_back({ myClip, wrap(far), nullptr, -1 });
+	}
+	myJobReady.notify_all();
+}
+
+bool
+FramePlayer::deliver(int32_t frame, void* const buffers[NumBuffers], bool uploadConsumes,
+					int32_t readAhead, int32_t& buffer)
+{
+	buffer = -1;
+	if (!myClip || frame < 0)
+		return false;
+
+	// No worker writes to a buffer past this point
+	waitForDecodes();
+
+	for (int32_t i = 0; i < NumBuffers; i++)
+	{
+		if (myBuffers[i].pointer != buffers[i])
+		{
+			myBuffers[i].pointer = buffers[i];
+			myBuffers[i].frame = -1;
+		}
+	}
+
+	int32_t shown = -1;
+	for (int32_t i = 0; i < NumBuffers; i++)
+	{
+		if (myBuffers[i].frame == frame)
+			shown = i;
+	}
+
+	if (frame == myShownFrame && (uploadConsumes || shown >= 0))
+	{
+		buffer = uploadConsumes ? -1 : shown;
+		return true;
+	}
+
+	// Frames worth decoding ahead, nearest first
+	const int64_t stride = static_cast<int64_t>(myDirection) * myStep;
+	int32_t ahead[2] = { wrap(frame + stride), wrap(frame + 2 * stride) };
+	if (ahead[1] == ahead[0] || ahead[1] == frame)
+		ahead[1] = -1;
+	if (ahead[0] == frame)
+		ahead[0] = -1;
+
+	if (shown >= 0)
+	{
+		myDecodeAheadHits++;
+	}
+	else
+	{
+		myDecodeAheadMisses++;
+
+		// Decode into a buffer that holds nothing we'll want next
+		for (int32_t i = 0; i < NumBuffers && shown < 0; i++)
+		{
+			if (myBuffers[i].frame < 0 || (myBuffers[i].frame != ahead[0] && myBuffers[i].frame != ahead[1]))
+				shown = i;
+		}
+		if (!ClipCache::instance().decode(*myClip, frame, myBuffers[shown].pointer))
+		{
+			myBuffers[shown].frame = -1;
+			return false;
+		}
+		myBuffers[shown].frame = frame;
+	}
+
+	myShownFrame = frame;
+	ClipCache::instance().touch(*myClip);
+	if (uploadConsumes)
+		myBuffers[shown].frame = -1;
+
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		bool reserved[NumBuffers] = {};
+		reserved[shown] = true;
+		for (int32_t a = 0; a < 2; a++)
+		{
+			for (int32_t i = 0; i < NumBuffers && ahead[a] >= 0; i++)
+			{
+				if (!reserved[i] && myBuffers[i].frame == ahead[a])
+				{
+					reserved[i] = true;
+					ahead[a] = -1;
+				}
+			}
+		}
+		for (int32_t a = 0; a < 2; a++)
+		{
+			for (int32_t i = 0; i < NumBuffers && ahead[a] >= 0; i++)
+			{
+				if (reserved[i])
+					continue;
+				reserved[i] = true;
+				myBuffers[i].frame = -1;
+				myPendingDecodes++;
+				myJobs.push_front({ myClip, ahead[a], myBuffers[i].pointer, i });
+				ahead[a] = -1;
+			}
+		}
+	}
+	myJobReady.notify_all();
+
+	queueReadAhead(frame, readAhead);
+	buffer = shown;
+	return true;
+}
@@ -0,0 +1,144 @@
+/*
+ * Frame container playback for the TOP's Player mode.
+ *
+ * Frames are decoded into three output buffers: cpuPixelData in the CPU
+ * backend, three host images in the CUDA backend. The buffer shown this cook
+ * is handed to the TOP, the other two are filled in the background with the
+ * next frames in the current play direction, so a steady cook just uploads a
+ * buffer that is already complete and the frame is only ever written once.
+ *
+ * Further ahead, the next 'readAhead' frames in the play direction are
+ * prefetched and touched by the worker threads so their pages are resident
+ * before they are decoded. A jump (scrub, cue, direction change) drops any
+ * read-ahead that hasn't started yet.
+ *
+ * Clips are mapped through the process wide ClipCache, which also serves
+ * the first frames of cued clips from RAM.
+ */
+
+#ifndef __FramePlayer__
+#define __FramePlayer__
+
+#include "ClipCache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class PlayerMode
+{
+	Index = 0,
+	Sequential
+};
+
+struct PlayerSettings
+{
+	PlayerMode	mode = PlayerMode::Sequential;
+	// Frame shown in Index mode, wraps around the clip
+	double		index = 0.0;
+	// Frames advanced per cook in Sequential mode, negative plays backwards
+	double		speed = 1.0;
+	// Frames kept resident ahead of the play position
+	int32_t		readAhead = 8;
+};
+
+class FramePlayer
+{
+public:
+	static const int32_t NumBuffers = 3;
+
+	FramePlayer();
+	~FramePlayer();
+
+	// Switches to the clip unless it is already playing, starting from its
+	// first frame. Returns false if it can't be played, see error().
+	bool		open(const std::string& path);
+	void		close();
+
+	const FrameContainer&	container() const;
+	const char*	error() const { return myError; }
+
+	// Clips this instance wants kept warm in the ClipCache
+	void		cue(const std::vector<std::string>& paths, const std::vector<int32_t>& priorities);
+
+	// Frame to show this cook, advancing the play position in Sequential mode
+	int32_t		advance(const PlayerSettings& settings);
+
+	// Makes sure 'frame' is in one of 'buffers' and sets 'buffer' to its
+	// index, then queues the decodes and read-ahead for the frames after it.
+	// When 'uploadConsumes' is set the buffer is treated as gone after this
+	// call, as cpuPixelData is once it's uploaded, and 'buffer' is -1 if the
+	// frame is the one delivered last time. Returns false on a decode error.
+	bool		deliver(int32_t frame, void* const buffers[NumBuffers], bool uploadConsumes,
+						int32_t readAhead, int32_t& buffer);
+
+	// Drops the decodes that haven't started, waits for the rest and forgets
+	// the buffers. Called whenever a cook doesn't end in deliver(), as the
+	// TOP may write to or reallocate cpuPixelData before the next one.
+	void		dropBuffers();
+
+	// Frame delivered last, -1 if none
+	int32_t		shownFrame() const { return myShownFrame; }
+
+	// Starts over from the first frame
+	void		reset();
+
+	int64_t		decodeAheadHits() const { return myDecodeAheadHits; }
+	int64_t		decodeAheadMisses() const { return myDecodeAheadMisses; }
+
+private:
+	struct Job
+	{
+		std::shared_ptr<CachedClip>	clip;
+		int32_t		frame;
+		// Decode target, nullptr to only touch the frame's pages
+		void*		dst;
+		int32_t		buffer;
+	};
+
+	struct Buffer
+	{
+		void*		pointer = nullptr;
+		// Frame decoded into it, -1 if none
+		int32_t		frame = -1;
+	};
+
+	int32_t		wrap(int64_t frame) const;
+	void		startWorkers();
+	void		stopWorkers();
+	void		workerLoop();
+	void		waitForDecodes();
+	void		queueReadAhead(int32_t frame, int32_t readAhead);
+
+	std::shared_ptr<CachedClip>	myClip;
+	std::string			myPath;
+	const char*			myError;
+
+	double				myPosition;
+	int32_t				myLastFrame;
+	int32_t				myDirection;
+	int32_t				myStep;
+	int32_t				myShownFrame;
+
+	// Frame the last cook expected to come next, anything else is a jump
+	int32_t				myExpectedFrame;
+
+	// Everything below is shared with the workers and guarded by myMutex
+	std::mutex			myMutex;
+	std::condition_variable	myJobReady;
+	std::condition_variable	myDecodeDone;
+	std::deque<Job>		myJobs;
+	int32_t				myPendingDecodes;
+	bool				myStopping;
+	Buffer				myBuffers[NumBuffers];
+
+	std::vector<std::thread>	myWorkers;
+
+	int64_t				myDecodeAheadHits;
+	int64_t				myDecodeAheadMisses;
+};
+
+#endif
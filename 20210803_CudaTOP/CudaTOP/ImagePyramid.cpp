@@ -0,0 +1,208 @@
+/*
+ * See ImagePyramid.h
+ */
+
+#include "ImagePyramid.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+// The range weight is looked up from (difference / sigma)^2, in this many
+// bins per unit, up to RangeTableMax where it is negligible
+static const int32_t RangeTableBinsPerUnit = 16;
+static const int32_t RangeTableMax = 16;
+static const int32_t RangeTableSize = RangeTableBinsPerUnit * RangeTableMax;
+
+static inline float
+luminance(const float* rgba)
+{
+	return 0.2126f * rgba[0] + 0.7152f * rgba[1] + 0.0722f * rgba[2];
+}
+
+static inline TileRect
+scaleTile(const TileRect& tile, int32_t level)
+{
+	const int32_t round = (1 << level) - 1;
+	TileRect r;
+	r.x0 = tile.x0 >> level;
+	r.y0 = tile.y0 >> level;
+	r.x1 = (tile.x1 + round) >> level;
+	r.y1 = (tile.y1 + round) >> level;
+	return r;
+}
+
+ImagePyramid::ImagePyramid() :
+	myWidth(0),
+	myHeight(0),
+	myTileSize(0)
+{
+}
+
+void
+ImagePyramid::resize(const TilePlan& base, int32_t levels)
+{
+	if (base.width == myWidth && base.height == myHeight && base.tileSize == myTileSize &&
+		levels == static_cast<int32_t>(myLevels.size()))
+	{
+		return;
+	}
+
+	myWidth = base.width;
+	myHeight = base.height;
+	myTileSize = base.tileSize;
+	myLevels.resize(levels);
+
+	for (int32_t l = 1; l <= levels; l++)
+	{
+		TilePlan& plan = myLevels[l - 1].plan;
+		plan.width = (base.width + (1 << l) - 1) >> l;
+		plan.height = (base.height + (1 << l) - 1) >> l;
+		plan.tileSize = base.tileSize >> l;
+		plan.tilesX = base.tilesX;
+		plan.tilesY = base.tilesY;
+		plan.partitionStart = base.partitionStart;
+
+		plan.tiles.resize(base.tiles.size());
+		for (size_t t = 0; t < base.tiles.size(); t++)
+			plan.tiles[t] = scaleTile(base.tiles[t], l);
+
+		myLevels[l - 1].pixels.assign(static_cast<size_t>(plan.width) * plan.height * 4, 0.0f);
+	}
+}
+
+ImageView
+ImagePyramid::level(int32_t l)
+{
+	Level& level = myLevels[l - 1];
+	ImageView v;
+	v.pixels = level.pixels.data();
+	v.width = level.plan.width;
+	v.height = level.plan.height;
+	return v;
+}
+
+void
+ImagePyramid::update(const TilePlan& base, const std::vector<int32_t>& tiles, const float* input)
+{
+	ImageView source;
+	source.pixels = const_cast<float*>(input);
+	source.width = base.width;
+	source.height = base.height;
+
+	// A tile covers the same region on every level, so each one is taken all
+	// the way down the pyramid by one thread
+	parallelFor(static_cast<int>(tiles.size()), [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			ImageView src = source;
+			for (int32_t l = 1; l <= levels(); l++)
+			{
+				ImageView dst = level(l);
+				const TileRect& r = plan(l).tiles[tiles[i]];
+
+				for (int32_t y = r.y0; y < r.y1; y++)
+				{
+					const float* row0 = src.row(2 * y);
+					const float* row1 = src.row(std::min(2 * y + 1, src.height - 1));
+					float* out = dst.row(y);
+
+					for (int32_t x = r.x0; x < r.x1; x++)
+					{
+						const int32_t x0 = 2 * x * 4;
+						const int32_t x1 = std::min(2 * x + 1, src.width - 1) * 4;
+						for (int c = 0; c < 4; c++)
+							out[x * 4 + c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+					}
+				}
+				src = dst;
+			}
+		}
+	});
+}
+
+void
+jointBilateralUpsample(const TilePlan& plan, const std::vector<int32_t>& tiles,
+						const float* guide, const ImageView& guideLow, const ImageView& low,
+						int32_t level, float sigma, const ImageView& output)
+{
+	float rangeWeights[RangeTableSize];
+	for (int32_t i = 0; i < RangeTableSize; i++)
+		rangeWeights[i] = std::exp(-0.5f * (i + 0.5f) / RangeTableBinsPerUnit);
+
+	const float invSigma2 = RangeTableBinsPerUnit / std::max(sigma * sigma, 1e-8f);
+	const float invScale = 1.0f / (1 << level);
+
+	parallelFor(static_cast<int>(tiles.size()), [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const TileRect& tile = plan.tiles[tiles[i]];
+
+			for (int32_t y = tile.y0; y < tile.y1; y++)
+			{
+				// Position of the output pixel's center on the low grid
+				const float v = (y + 0.5f) * invScale - 0.5f;
+				const int32_t ly = static_cast<int32_t>(std::floor(v));
+				const float fy = v - ly;
+				const int32_t rows[2] = { std::max(ly, 0), std::min(ly + 1, low.height - 1) };
+				const float wy[2] = { 1.0f - fy, fy };
+
+				const float* guideRow = guide + static_cast<size_t>(y) * plan.width * 4;
+				float* out = output.row(y);
+
+				for (int32_t x = tile.x0; x < tile.x1; x++)
+				{
+					const float u = (x + 0.5f) * invScale - 0.5f;
+					const int32_t lx = static_cast<int32_t>(std::floor(u));
+					const float fx = u - lx;
+					const int32_t cols[2] = { std::max(lx, 0), std::min(lx + 1, low.width - 1) };
+					const float wx[2] = { 1.0f - fx, fx };
+
+					const float g = luminance(guideRow + x * 4);
+
+					float sum[4] = {};
+					float bilinear[4] = {};
+					float total = 0.0f;
+
+					for (int sy = 0; sy < 2; sy++)
+					{
+						const float* lowRow = low.row(rows[sy]);
+						const float* guideLowRow = guideLow.row(rows[sy]);
+
+						for (int sx = 0; sx < 2; sx++)
+						{
+							const float* p = lowRow + cols[sx] * 4;
+							const float d = luminance(guideLowRow + cols[sx] * 4) - g;
+							const int32_t bin = static_cast<int32_t>(std::min(d * d * invSigma2, float(RangeTableSize - 1)));
+							const float spatial = wx[sx] * wy[sy];
+							const float w = spatial * rangeWeights[bin];
+
+							for (int c = 0; c < 4; c++)
+							{
+								sum[c] += w * p[c];
+								bilinear[c] += spatial * p[c];
+							}
+							total += w;
+						}
+					}
+
+					// Nothing close enough in luminance, plain bilinear is the
+					// best we have
+					if (total > 1e-6f)
+					{
+						const float inv = 1.0f / total;
+						for (int c = 0; c < 4; c++)
+							out[x * 4 + c] = sum[c] * inv;
+					}
+					else
+					{
+						for (int c = 0; c < 4; c++)
+							out[x * 4 + c] = bilinear[c];
+					}
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,65 @@
+/*
+ * Downsampled copies of an input image, for running the Filter kernel at a
+ * fraction of the output resolution.
+ *
+ * Level l is the base image box-filtered down by 2^l on each side (rounding
+ * up). Every level has a TilePlan with the same tiles as the base plan,
+ * scaled down, so a tile index means the same region on every level and the
+ * dirty tiles of the base image can be brought down the pyramid without
+ * touching the rest. The levels are kept between cooks.
+ *
+ * jointBilateralUpsample() brings a result computed on a level back up to
+ * the base resolution, using the full resolution input as the guide so that
+ * edges in the input stay sharp in the output.
+ */
+
+#ifndef __ImagePyramid__
+#define __ImagePyramid__
+
+#include "ResourceCache.h"
+
+#include <vector>
+
+class ImagePyramid
+{
+public:
+	ImagePyramid();
+
+	// Sizes the pyramid for 'base' with 'levels' levels below it. Levels are
+	// only reallocated when the base size, tile size or level count change.
+	void			resize(const TilePlan& base, int32_t levels);
+
+	// Downsamples the given tiles of 'input', an RGBA32F image the size of
+	// the base plan, into every level.
+	void			update(const TilePlan& base, const std::vector<int32_t>& tiles, const float* input);
+
+	int32_t			levels() const { return static_cast<int32_t>(myLevels.size()); }
+
+	// Level 1 is half the base size, 'l' runs from 1 to levels()
+	ImageView		level(int32_t l);
+	const TilePlan&	plan(int32_t l) const { return myLevels[l - 1].plan; }
+
+private:
+	struct Level
+	{
+		TilePlan			plan;
+		std::vector<float>	pixels;
+	};
+
+	int32_t				myWidth;
+	int32_t				myHeight;
+	int32_t				myTileSize;
+	std::vector<Level>	myLevels;
+};
+
+// Upsamples 'low', computed from pyramid level 'level' of the image 'guide',
+// into the given tiles of 'output' (the base size). Each output pixel is the
+// bilinear blend of its four nearest 'low' pixels, with every weight scaled
+// down by how far the luminance of 'guideLow' at that pixel is from the
+// luminance of 'guide' at the output pixel. 'sigma' is the luminance
+// difference at which a weight has dropped to about 60%.
+void	jointBilateralUpsample(const TilePlan& plan, const std::vector<int32_t>& tiles,
+								const float* guide, const ImageView& guideLow, const ImageView& low,
+								int32_t level, float sigma, const ImageView& output);
+
+#endif
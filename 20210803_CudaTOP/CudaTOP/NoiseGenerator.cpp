@@ -0,0 +1,251 @@
+/*
+ * See NoiseGenerator.h
+ */
+
+#include "NoiseGenerator.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+// One pixel at a time, used when AVX2 isn't available and for testing.
+namespace NoiseScalar
+{
+	typedef float		VF;
+	typedef uint32_t	VI;
+	typedef bool		Mask;
+
+	static inline VF	vf(float v) { return v; }
+	static inline VI	vi(uint32_t v) { return v; }
+	static inline VF	vfloor(VF v) { return std::floor(v); }
+	static inline VI	vtoi(VF v) { return static_cast<VI>(static_cast<int32_t>(v)); }
+	static inline VF	vtof(VI v) { return static_cast<float>(static_cast<int32_t>(v)); }
+	static inline VF	vabs(VF v) { return std::fabs(v); }
+	static inline Mask	vlt(VF a, VF b) { return a < b; }
+	static inline VF	vselect(Mask m, VF a, VF b) { return m ? a : b; }
+	static inline Mask	bitTest(VI h, int bit) { return ((h >> bit) & 1) != 0; }
+	static inline VI	maskToInt(Mask m) { return m ? 1 : 0; }
+	static inline Mask	vige(VI a, int32_t b) { return static_cast<int32_t>(a) >= b; }
+	static inline VF	loadf(const float* p) { return *p; }
+	static inline void	storef(float* p, VF v) { *p = v; }
+
+	#define NOISE_TARGET
+	#define NOISE_LANES 1
+	#include "NoiseKernels.inl"
+	#undef NOISE_TARGET
+	#undef NOISE_LANES
+}
+
+#if SIMD_X86
+// Eight pixels of a row per call
+namespace NoiseAVX2
+{
+	struct VF { __m256 v; };
+	struct VI { __m256i v; };
+	typedef VF Mask;
+
+	SIMD_TARGET_AVX2 static inline VF operator+(VF a, VF b) { return { _mm256_add_ps(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VF operator-(VF a, VF b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VF operator*(VF a, VF b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VF operator&(VF a, VF b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+	SIMD_TARGET_AVX2 static inline VI operator+(VI a, VI b) { return { _mm256_add_epi32(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VI operator-(VI a, VI b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VI operator*(VI a, VI b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VI operator^(VI a, VI b) { return { _mm256_xor_si256(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VI operator&(VI a, VI b) { return { _mm256_and_si256(a.v, b.v) }; }
+	SIMD_TARGET_AVX2 static inline VI operator>>(VI a, int n) { return { _mm256_srli_epi32(a.v, n) }; }
+
+	SIMD_TARGET_AVX2 static inline VF	vf(float v) { return { _mm256_set1_ps(v) }; }
+	SIMD_TARGET_AVX2 static inline VI	vi(uint32_t v) { return { _mm256_set1_epi32(static_cast<int>(v)) }; }
+	SIMD_TARGET_AVX2 static inline VF	vfloor(VF v) { return { _mm256_floor_ps(v.v) }; }
+	SIMD_TARGET_AVX2 static inline VI	vtoi(VF v) { return { _mm256_cvttps_epi32(v.v) }; }
+	SIMD_TARGET_AVX2 static inline VF	vtof(VI v) { return { _mm256_cvtepi32_ps(v.v) }; }
+	SIMD_TARGET_AVX2 static inline VF	vabs(VF v) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v.v) }; }
+	SIMD_TARGET_AVX2 static inline Mask	vlt(VF a, VF b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	SIMD_TARGET_AVX2 static inline VF	vselect(Mask m, VF a, VF b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+	SIMD_TARGET_AVX2 static inline VF	loadf(const float* p) { return { _mm256_loadu_ps(p) }; }
+	SIMD_TARGET_AVX2 static inline void	storef(float* p, VF v) { _mm256_storeu_ps(p, v.v); }
+
+	SIMD_TARGET_AVX2 static inline Mask
+	bitTest(VI h, int bit)
+	{
+		__m256i b = _mm256_set1_epi32(1 << bit);
+		return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(h.v, b), b)) };
+	}
+
+	SIMD_TARGET_AVX2 static inline VI
+	maskToInt(Mask m)
+	{
+		return { _mm256_srli_epi32(_mm256_castps_si256(m.v), 31) };
+	}
+
+	SIMD_TARGET_AVX2 static inline Mask
+	vige(VI a, int32_t b)
+	{
+		return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(a.v, _mm256_set1_epi32(b - 1))) };
+	}
+
+	#define NOISE_TARGET SIMD_TARGET_AVX2
+	#define NOISE_LANES 8
+	#include "NoiseKernels.inl"
+	#undef NOISE_TARGET
+	#undef NOISE_LANES
+}
+#endif
+
+NoiseGenerator::NoiseGenerator() :
+	myValid(false),
+	myOutputValid(false),
+	myWidth(0),
+	myHeight(0),
+	myLastOctavesComputed(0)
+{
+}
+
+// The octaves from 'animOctaves' up don't depend on Time, and with 2
+// dimensions none of them do.
+static int32_t
+animatedOctaves(const NoiseSettings& s)
+{
+	if (s.dimensions == 2)
+		return 0;
+	return std::max(0, std::min(s.animOctaves, s.octaves));
+}
+
+bool
+NoiseGenerator::sameStaticOctaves(const NoiseSettings& s, int32_t width, int32_t height) const
+{
+	const NoiseSettings& o = mySettings;
+	return myValid &&
+		width == myWidth &&
+		height == myHeight &&
+		s.type == o.type &&
+		s.dimensions == o.dimensions &&
+		s.fractal == o.fractal &&
+		s.octaves == o.octaves &&
+		s.frequency == o.frequency &&
+		s.lacunarity == o.lacunarity &&
+		s.gain == o.gain &&
+		s.offsetX == o.offsetX &&
+		s.offsetY == o.offsetY &&
+		s.slice == o.slice &&
+		animatedOctaves(s) == animatedOctaves(o) &&
+		s.seed == o.seed;
+}
+
+static void
+accumulate(bool useAVX2, const NoiseOctaveRange& range, int32_t x0, int32_t y, int32_t count, float* accum)
+{
+	if (range.octaveBegin >= range.octaveEnd)
+		return;
+#if SIMD_X86
+	if (useAVX2)
+	{
+		NoiseAVX2::accumulateOctaves(range, x0, y, count, accum);
+		return;
+	}
+#endif
+	for (int32_t i = 0; i < count; i++)
+		NoiseScalar::accumulateOctaves(range, x0 + i, y, 1, accum + i);
+}
+
+bool
+NoiseGenerator::cook(const NoiseSettings& settings, const TilePlan& plan, const ImageView& output)
+{
+	const int32_t width = plan.width;
+	const int32_t height = plan.height;
+	const int32_t animated = animatedOctaves(settings);
+
+	bool staticValid = sameStaticOctaves(settings, width, height);
+	if (staticValid && myOutputValid && (animated == 0 || settings.time == mySettings.time))
+	{
+		myLastOctavesComputed = 0;
+		return false;
+	}
+
+	if (!staticValid)
+		myStaticSum.resize(static_cast<size_t>(width) * height);
+
+	mySettings = settings;
+	myWidth = width;
+	myHeight = height;
+	myValid = true;
+	myOutputValid = true;
+	myLastOctavesComputed = staticValid ? animated : settings.octaves;
+
+	NoiseOctaveRange animRange;
+	animRange.type = settings.type;
+	animRange.dimensions = settings.dimensions;
+	animRange.fractal = settings.fractal;
+	animRange.frequency = settings.frequency;
+	animRange.lacunarity = settings.lacunarity;
+	animRange.gain = settings.gain;
+	animRange.offsetX = settings.offsetX;
+	animRange.offsetY = settings.offsetY;
+	animRange.slice = settings.slice;
+	animRange.time = settings.time;
+	animRange.seed = settings.seed;
+	animRange.octaveBegin = 0;
+	animRange.octaveEnd = animated;
+	animRange.pixelScale = 1.0f / height;
+
+	NoiseOctaveRange staticRange = animRange;
+	staticRange.time = 0.0f;
+	staticRange.octaveBegin = animated;
+	staticRange.octaveEnd = settings.octaves;
+
+	// Normalize by the total amplitude so the octave count doesn't change
+	// the brightness
+	float totalAmplitude = 0.0f;
+	float amplitude = 1.0f;
+	for (int32_t o = 0; o < settings.octaves; o++)
+	{
+		totalAmplitude += amplitude;
+		amplitude *= settings.gain;
+	}
+	const float norm = totalAmplitude > 0.0f ? 1.0f / totalAmplitude : 0.0f;
+	const bool signedNoise = settings.fractal == NoiseFractal::FBM;
+	const bool useAVX2 = simdHasAVX2();
+
+	parallelFor(plan.numPartitions(), [&](int begin, int end)
+	{
+		std::vector<float> span(plan.tileSize);
+
+		for (int p = begin; p < end; p++)
+		{
+			for (int t = plan.partitionStart[p]; t < plan.partitionStart[p + 1]; t++)
+			{
+				const TileRect& tile = plan.tiles[t];
+				const int32_t count = tile.x1 - tile.x0;
+
+				for (int32_t y = tile.y0; y < tile.y1; y++)
+				{
+					float* cached = &myStaticSum[static_cast<size_t>(y) * width + tile.x0];
+					if (!staticValid)
+					{
+						std::fill(cached, cached + count, 0.0f);
+						accumulate(useAVX2, staticRange, tile.x0, y, count, cached);
+					}
+					std::copy(cached, cached + count, span.begin());
+					accumulate(useAVX2, animRange, tile.x0, y, count, span.data());
+
+					float* dst = output.row(y) + tile.x0 * 4;
+					for (int32_t i = 0; i < count; i++)
+					{
+						float v = span[i] * norm;
+						if (signedNoise)
+							v = 0.5f + 0.5f * v;
+						dst[i * 4 + 0] = v;
+						dst[i * 4 + 1] = v;
+						dst[i * 4 + 2] = v;
+						dst[i * 4 + 3] = 1.0f;
+					}
+				}
+			}
+		}
+	});
+
+	return true;
+}
@@ -0,0 +1,106 @@
+/*
+ * Procedural noise texture generator for the TOP's Noise mode.
+ *
+ * Simplex (2D/3D/4D) or value noise summed over octaves as fBm, ridged or
+ * turbulence. With 3 dimensions the third coordinate is Time, with 4 the
+ * image is a slice at z = Slice through noise animated along w = Time.
+ *
+ * Only the lowest 'animOctaves' octaves follow Time. The octaves above them
+ * don't change while Time animates, so their sum is kept between cooks and
+ * only the animated octaves are recomputed.
+ */
+
+#ifndef __NoiseGenerator__
+#define __NoiseGenerator__
+
+#include "ResourceCache.h"
+
+#include <vector>
+
+enum class NoiseType
+{
+	Simplex = 0,
+	Value
+};
+
+enum class NoiseFractal
+{
+	FBM = 0,
+	Ridged,
+	Turbulence
+};
+
+struct NoiseSettings
+{
+	NoiseType		type = NoiseType::Simplex;
+	int32_t			dimensions = 2;
+	NoiseFractal	fractal = NoiseFractal::FBM;
+	int32_t			octaves = 4;
+	float			frequency = 4.0f;
+	float			lacunarity = 2.0f;
+	float			gain = 0.5f;
+	float			offsetX = 0.0f;
+	float			offsetY = 0.0f;
+	float			slice = 0.0f;
+	float			time = 0.0f;
+	int32_t			animOctaves = 4;
+	uint32_t		seed = 0;
+};
+
+// The parameters a single pass over a range of octaves needs. Shared with
+// the kernels in NoiseKernels.inl.
+struct NoiseOctaveRange
+{
+	NoiseType		type;
+	int32_t			dimensions;
+	NoiseFractal	fractal;
+	float			frequency;
+	float			lacunarity;
+	float			gain;
+	float			offsetX;
+	float			offsetY;
+	float			slice;
+	float			time;
+	uint32_t		seed;
+	int32_t			octaveBegin;
+	int32_t			octaveEnd;
+	// 1 / image height, so the noise scales with the image height
+	float			pixelScale;
+};
+
+class NoiseGenerator
+{
+public:
+	NoiseGenerator();
+
+	// Renders the noise into 'output' as grey RGB with alpha 1.
+	// Returns false without touching 'output' if nothing changed.
+	bool		cook(const NoiseSettings& settings, const TilePlan& plan, const ImageView& output);
+
+	// Drops the cached octaves, the next cook computes them all again
+	void		reset() { myValid = false; }
+
+	// Makes the next cook render into the output again from the cached
+	// octaves, for when something else drew over it
+	void		invalidate() { myOutputValid = false; }
+
+	// Octaves evaluated per pixel by the last cook
+	int32_t		lastOctavesComputed() const { return myLastOctavesComputed; }
+
+private:
+	bool		sameStaticOctaves(const NoiseSettings& settings, int32_t width, int32_t height) const;
+
+	NoiseSettings		mySettings;
+	bool				myValid;
+	// Whether 'output' still holds the last render
+	bool				myOutputValid;
+	int32_t				myWidth;
+	int32_t				myHeight;
+
+	// Sum of the octaves that don't follow Time
+	std::vector<float>	myStaticSum;
+
+	int32_t				myLastOctavesComputed;
+};
+
+#endif
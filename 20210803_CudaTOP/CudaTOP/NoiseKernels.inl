@@ -0,0 +1,334 @@
+/*
+ * Noise kernels, written once against a small lane abstraction and included
+ * by NoiseGenerator.cpp once per instruction set.
+ *
+ * Before including, define:
+ *   NOISE_TARGET   attribute applied to every function (e.g. SIMD_TARGET_AVX2)
+ *   NOISE_LANES    number of pixels per VF
+ * and provide, in the enclosing namespace, the types VF (floats), VI (uint32)
+ * and Mask, plus the helpers used below (vf, vi, vfloor, vtoi, vtof, vlt,
+ * vselect, bitTest, maskToInt, vige, vabs, loadf, storef).
+ */
+
+// lowbias32 style integer hash over up to four lattice coordinates
+NOISE_TARGET static inline VI
+hashLattice(VI x, VI y, VI z, VI w, uint32_t seed)
+{
+	VI h = vi(seed * 0x9E3779B1u);
+	h = h + x * vi(0x8DA6B343u);
+	h = h + y * vi(0xD8163841u);
+	h = h + z * vi(0xCB1AB31Fu);
+	h = h + w * vi(0x165667B1u);
+	h = h ^ (h >> 16);
+	h = h * vi(0x7FEB352Du);
+	h = h ^ (h >> 15);
+	h = h * vi(0x846CA68Bu);
+	h = h ^ (h >> 16);
+	return h;
+}
+
+// Perlin's 12 edge gradients for 3D (also used for 2D with z = 0)
+NOISE_TARGET static inline VF
+grad3(VI h, VF x, VF y, VF z)
+{
+	VF h15 = vtof(h & vi(15));
+	// h == 12 || h == 14
+	VF h13 = vtof(h & vi(13));
+	Mask uIsX = vlt(h15, vf(8.0f));
+	Mask vIsY = vlt(h15, vf(4.0f));
+	Mask vIsX = vlt(vf(11.5f), h13) & vlt(h13, vf(12.5f));
+	VF u = vselect(uIsX, x, y);
+	VF v = vselect(vIsY, y, vselect(vIsX, x, z));
+	return vselect(bitTest(h, 0), vf(0.0f) - u, u) + vselect(bitTest(h, 1), vf(0.0f) - v, v);
+}
+
+// 32 edge gradients for 4D
+NOISE_TARGET static inline VF
+grad4(VI h, VF x, VF y, VF z, VF w)
+{
+	VF h31 = vtof(h & vi(31));
+	VF u = vselect(vlt(h31, vf(24.0f)), x, y);
+	VF v = vselect(vlt(h31, vf(16.0f)), y, z);
+	VF t = vselect(vlt(h31, vf(8.0f)), z, w);
+	return vselect(bitTest(h, 0), vf(0.0f) - u, u) +
+		vselect(bitTest(h, 1), vf(0.0f) - v, v) +
+		vselect(bitTest(h, 2), vf(0.0f) - t, t);
+}
+
+NOISE_TARGET static inline VF
+cornerFalloff(VF t)
+{
+	t = vselect(vlt(t, vf(0.0f)), vf(0.0f), t);
+	t = t * t;
+	return t * t;
+}
+
+NOISE_TARGET static inline VF
+simplex2(VF x, VF y, uint32_t seed)
+{
+	const float F2 = 0.366025403f;
+	const float G2 = 0.211324865f;
+
+	VF s = (x + y) * vf(F2);
+	VF fi = vfloor(x + s);
+	VF fj = vfloor(y + s);
+	VF t = (fi + fj) * vf(G2);
+	VF x0 = x - (fi - t);
+	VF y0 = y - (fj - t);
+
+	Mask xBig = vlt(y0, x0);
+	VF i1 = vselect(xBig, vf(1.0f), vf(0.0f));
+	VF j1 = vf(1.0f) - i1;
+
+	VF x1 = x0 - i1 + vf(G2);
+	VF y1 = y0 - j1 + vf(G2);
+	VF x2 = x0 - vf(1.0f - 2.0f * G2);
+	VF y2 = y0 - vf(1.0f - 2.0f * G2);
+
+	VI i = vtoi(fi);
+	VI j = vtoi(fj);
+	VI zero = vi(0);
+
+	VF n = cornerFalloff(vf(0.5f) - x0 * x0 - y0 * y0) * grad3(hashLattice(i, j, zero, zero, seed), x0, y0, vf(0.0f));
+	n = n + cornerFalloff(vf(0.5f) - x1 * x1 - y1 * y1) *
+		grad3(hashLattice(i + vtoi(i1), j + vtoi(j1), zero, zero, seed), x1, y1, vf(0.0f));
+	n = n + cornerFalloff(vf(0.5f) - x2 * x2 - y2 * y2) *
+		grad3(hashLattice(i + vi(1), j + vi(1), zero, zero, seed), x2, y2, vf(0.0f));
+
+	return n * vf(70.0f);
+}
+
+NOISE_TARGET static inline VF
+simplex3(VF x, VF y, VF z, uint32_t seed)
+{
+	const float F3 = 1.0f / 3.0f;
+	const float G3 = 1.0f / 6.0f;
+
+	VF s = (x + y + z) * vf(F3);
+	VF fi = vfloor(x + s);
+	VF fj = vfloor(y + s);
+	VF fk = vfloor(z + s);
+	VF t = (fi + fj + fk) * vf(G3);
+	VF x0 = x - (fi - t);
+	VF y0 = y - (fj - t);
+	VF z0 = z - (fk - t);
+
+	// Rank the coordinates to find which simplex we're in, branch free
+	Mask xy = vlt(y0, x0);
+	Mask xz = vlt(z0, x0);
+	Mask yz = vlt(z0, y0);
+	VI one = vi(1);
+	VI rx = maskToInt(xy) + maskToInt(xz);
+	VI ry = (one - maskToInt(xy)) + maskToInt(yz);
+	VI rz = (one - maskToInt(xz)) + (one - maskToInt(yz));
+
+	VI i1 = maskToInt(vige(rx, 2)), j1 = maskToInt(vige(ry, 2)), k1 = maskToInt(vige(rz, 2));
+	VI i2 = maskToInt(vige(rx, 1)), j2 = maskToInt(vige(ry, 1)), k2 = maskToInt(vige(rz, 1));
+
+	VF x1 = x0 - vtof(i1) + vf(G3);
+	VF y1 = y0 - vtof(j1) + vf(G3);
+	VF z1 = z0 - vtof(k1) + vf(G3);
+	VF x2 = x0 - vtof(i2) + vf(2.0f * G3);
+	VF y2 = y0 - vtof(j2) + vf(2.0f * G3);
+	VF z2 = z0 - vtof(k2) + vf(2.0f * G3);
+	VF x3 = x0 - vf(1.0f - 3.0f * G3);
+	VF y3 = y0 - vf(1.0f - 3.0f * G3);
+	VF z3 = z0 - vf(1.0f - 3.0f * G3);
+
+	VI i = vtoi(fi);
+	VI j = vtoi(fj);
+	VI k = vtoi(fk);
+	VI zero = vi(0);
+
+	VF n = cornerFalloff(vf(0.6f) - x0 * x0 - y0 * y0 - z0 * z0) *
+		grad3(hashLattice(i, j, k, zero, seed), x0, y0, z0);
+	n = n + cornerFalloff(vf(0.6f) - x1 * x1 - y1 * y1 - z1 * z1) *
+		grad3(hashLattice(i + i1, j + j1, k + k1, zero, seed), x1, y1, z1);
+	n = n + cornerFalloff(vf(0.6f) - x2 * x2 - y2 * y2 - z2 * z2) *
+		grad3(hashLattice(i + i2, j + j2, k + k2, zero, seed), x2, y2, z2);
+	n = n + cornerFalloff(vf(0.6f) - x3 * x3 - y3 * y3 - z3 * z3) *
+		grad3(hashLattice(i + one, j + one, k + one, zero, seed), x3, y3, z3);
+
+	return n * vf(32.0f);
+}
+
+NOISE_TARGET static inline VF
+simplex4(VF x, VF y, VF z, VF w, uint32_t seed)
+{
+	const float F4 = 0.309016994f;
+	const float G4 = 0.138196601f;
+
+	VF s = (x + y + z + w) * vf(F4);
+	VF fi = vfloor(x + s);
+	VF fj = vfloor(y + s);
+	VF fk = vfloor(z + s);
+	VF fl = vfloor(w + s);
+	VF t = (fi + fj + fk + fl) * vf(G4);
+	VF x0 = x - (fi - t);
+	VF y0 = y - (fj - t);
+	VF z0 = z - (fk - t);
+	VF w0 = w - (fl - t);
+
+	Mask xy = vlt(y0, x0), xz = vlt(z0, x0), xw = vlt(w0, x0);
+	Mask yz = vlt(z0, y0), yw = vlt(w0, y0), zw = vlt(w0, z0);
+	VI one = vi(1);
+	VI rx = maskToInt(xy) + maskToInt(xz) + maskToInt(xw);
+	VI ry = (one - maskToInt(xy)) + maskToInt(yz) + maskToInt(yw);
+	VI rz = (one - maskToInt(xz)) + (one - maskToInt(yz)) + maskToInt(zw);
+	VI rw = (one - maskToInt(xw)) + (one - maskToInt(yw)) + (one - maskToInt(zw));
+
+	VI i1 = maskToInt(vige(rx, 3)), j1 = maskToInt(vige(ry, 3)), k1 = maskToInt(vige(rz, 3)), l1 = maskToInt(vige(rw, 3));
+	VI i2 = maskToInt(vige(rx, 2)), j2 = maskToInt(vige(ry, 2)), k2 = maskToInt(vige(rz, 2)), l2 = maskToInt(vige(rw, 2));
+	VI i3 = maskToInt(vige(rx, 1)), j3 = maskToInt(vige(ry, 1)), k3 = maskToInt(vige(rz, 1)), l3 = maskToInt(vige(rw, 1));
+
+	VI i = vtoi(fi);
+	VI j = vtoi(fj);
+	VI k = vtoi(fk);
+	VI l = vtoi(fl);
+
+	VF n = vf(0.0f);
+
+	VF x1 = x0 - vtof(i1) + vf(G4), y1 = y0 - vtof(j1) + vf(G4);
+	VF z1 = z0 - vtof(k1) + vf(G4), w1 = w0 - vtof(l1) + vf(G4);
+	VF x2 = x0 - vtof(i2) + vf(2.0f * G4), y2 = y0 - vtof(j2) + vf(2.0f * G4);
+	VF z2 = z0 - vtof(k2) + vf(2.0f * G4), w2 = w0 - vtof(l2) + vf(2.0f * G4);
+	VF x3 = x0 - vtof(i3) + vf(3.0f * G4), y3 = y0 - vtof(j3) + vf(3.0f * G4);
+	VF z3 = z0 - vtof(k3) + vf(3.0f * G4), w3 = w0 - vtof(l3) + vf(3.0f * G4);
+	VF x4 = x0 - vf(1.0f - 4.0f * G4), y4 = y0 - vf(1.0f - 4.0f * G4);
+	VF z4 = z0 - vf(1.0f - 4.0f * G4), w4 = w0 - vf(1.0f - 4.0f * G4);
+
+	n = n + cornerFalloff(vf(0.6f) - x0 * x0 - y0 * y0 - z0 * z0 - w0 * w0) *
+		grad4(hashLattice(i, j, k, l, seed), x0, y0, z0, w0);
+	n = n + cornerFalloff(vf(0.6f) - x1 * x1 - y1 * y1 - z1 * z1 - w1 * w1) *
+		grad4(hashLattice(i + i1, j + j1, k + k1, l + l1, seed), x1, y1, z1, w1);
+	n = n + cornerFalloff(vf(0.6f) - x2 * x2 - y2 * y2 - z2 * z2 - w2 * w2) *
+		grad4(hashLattice(i + i2, j + j2, k + k2, l + l2, seed), x2, y2, z2, w2);
+	n = n + cornerFalloff(vf(0.6f) - x3 * x3 - y3 * y3 - z3 * z3 - w3 * w3) *
+		grad4(hashLattice(i + i3, j + j3, k + k3, l + l3, seed), x3, y3, z3, w3);
+	n = n + cornerFalloff(vf(0.6f) - x4 * x4 - y4 * y4 - z4 * z4 - w4 * w4) *
+		grad4(hashLattice(i + one, j + one, k + one, l + one, seed), x4, y4, z4, w4);
+
+	return n * vf(27.0f);
+}
+
+// Lattice value in [-1, 1]
+NOISE_TARGET static inline VF
+latticeValue(VI x, VI y, VI z, VI w, uint32_t seed)
+{
+	VI h = hashLattice(x, y, z, w, seed) & vi(0xFFFFFF);
+	return vtof(h) * vf(2.0f / 16777215.0f) - vf(1.0f);
+}
+
+NOISE_TARGET static inline VF
+fade(VF t)
+{
+	// 6t^5 - 15t^4 + 10t^3
+	return t * t * t * (t * (t * vf(6.0f) - vf(15.0f)) + vf(10.0f));
+}
+
+NOISE_TARGET static inline VF
+lerp(VF a, VF b, VF t)
+{
+	return a + (b - a) * t;
+}
+
+// Value noise over 2, 3 or 4 dimensions. Unused dimensions are 0.
+NOISE_TARGET static inline VF
+valueNoise(int32_t dimensions, VF x, VF y, VF z, VF w, uint32_t seed)
+{
+	VF fx = vfloor(x), fy = vfloor(y), fz = vfloor(z), fw = vfloor(w);
+	VF tx = fade(x - fx), ty = fade(y - fy), tz = fade(z - fz), tw = fade(w - fw);
+	VI ix = vtoi(fx), iy = vtoi(fy), iz = vtoi(fz), iw = vtoi(fw);
+	VI one = vi(1);
+
+	VF result = vf(0.0f);
+	VF wLayer[2];
+	int32_t layersW = dimensions >= 4 ? 2 : 1;
+	int32_t layersZ = dimensions >= 3 ? 2 : 1;
+
+	for (int32_t dw = 0; dw < layersW; dw++)
+	{
+		VF zLayer[2];
+		for (int32_t dz = 0; dz < layersZ; dz++)
+		{
+			VI cz = dz ? iz + one : iz;
+			VI cw = dw ? iw + one : iw;
+			VF v00 = latticeValue(ix, iy, cz, cw, seed);
+			VF v10 = latticeValue(ix + one, iy, cz, cw, seed);
+			VF v01 = latticeValue(ix, iy + one, cz, cw, seed);
+			VF v11 = latticeValue(ix + one, iy + one, cz, cw, seed);
+			zLayer[dz] = lerp(lerp(v00, v10, tx), lerp(v01, v11, tx), ty);
+		}
+		wLayer[dw] = layersZ == 2 ? lerp(zLayer[0], zLayer[1], tz) : zLayer[0];
+	}
+	result = layersW == 2 ? lerp(wLayer[0], wLayer[1], tw) : wLayer[0];
+	return result;
+}
+
+// Adds the contribution of octaves [range.octaveBegin, range.octaveEnd) for
+// 'count' pixels of row 'y' starting at column 'x0' into 'accum'.
+NOISE_TARGET static void
+accumulateOctaves(const NoiseOctaveRange& range, int32_t x0, int32_t y, int32_t count, float* accum)
+{
+	float laneOffsets[NOISE_LANES];
+	for (int i = 0; i < NOISE_LANES; i++)
+		laneOffsets[i] = static_cast<float>(i);
+	VF lanes = loadf(laneOffsets);
+
+	for (int32_t x = 0; x < count; x += NOISE_LANES)
+	{
+		VF px = (vf(static_cast<float>(x0 + x) + 0.5f) + lanes) * vf(range.pixelScale);
+		VF py = vf((y + 0.5f) * range.pixelScale);
+
+		VF sum = vf(0.0f);
+		float frequency = range.frequency;
+		float amplitude = 1.0f;
+		for (int32_t o = 0; o < range.octaveEnd; o++)
+		{
+			if (o >= range.octaveBegin)
+			{
+				uint32_t seed = range.seed + static_cast<uint32_t>(o) * 1013u;
+				VF nx = px * vf(frequency) + vf(range.offsetX);
+				VF ny = py * vf(frequency) + vf(range.offsetY);
+				VF nz = vf(range.dimensions == 3 ? range.time : range.slice * frequency);
+				VF nw = vf(range.time);
+
+				VF n;
+				if (range.type == NoiseType::Value)
+					n = valueNoise(range.dimensions, nx, ny, nz, nw, seed);
+				else if (range.dimensions == 2)
+					n = simplex2(nx, ny, seed);
+				else if (range.dimensions == 3)
+					n = simplex3(nx, ny, nz, seed);
+				else
+					n = simplex4(nx, ny, nz, nw, seed);
+
+				if (range.fractal == NoiseFractal::Ridged)
+				{
+					VF r = vf(1.0f) - vabs(n);
+					n = r * r;
+				}
+				else if (range.fractal == NoiseFractal::Turbulence)
+				{
+					n = vabs(n);
+				}
+
+				sum = sum + n * vf(amplitude);
+			}
+			frequency *= range.lacunarity;
+			amplitude *= range.gain;
+		}
+
+		if (count - x >= NOISE_LANES)
+		{
+			storef(accum + x, loadf(accum + x) + sum);
+		}
+		else
+		{
+			float tmp[NOISE_LANES];
+			storef(tmp, sum);
+			for (int32_t i = 0; i < count - x; i++)
+				accum[x + i] += tmp[i];
+		}
+	}
+}
@@ -0,0 +1,195 @@
+/*
+ * See ResourceCache.h
+ */
+
+#include "ResourceCache.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+ResourceCache::ResourceCache() :
+#ifndef CUDATOP_CPU_BACKEND
+	myLaunchWidth(0),
+	myLaunchHeight(0),
+#endif
+	myHits(0),
+	myMisses(0)
+{
+#ifndef CUDATOP_CPU_BACKEND
+	for (int i = 0; i < NumSlots; i++)
+		mySurfaces[i] = 0;
+#endif
+}
+
+ResourceCache::~ResourceCache()
+{
+	clear();
+}
+
+void
+ResourceCache::count(bool hit)
+{
+	if (hit)
+		myHits++;
+	else
+		myMisses++;
+}
+
+#ifndef CUDATOP_CPU_BACKEND
+cudaSurfaceObject_t
+ResourceCache::getSurface(Slot slot, cudaArray_t array,
+							int32_t width, int32_t height, GLint pixelFormat)
+{
+	TextureKey key;
+	key.identity = array;
+	key.width = width;
+	key.height = height;
+	key.pixelFormat = pixelFormat;
+
+	if (mySurfaces[slot] && mySurfaceKeys[slot] == key)
+	{
+		count(true);
+		return mySurfaces[slot];
+	}
+
+	count(false);
+
+	if (mySurfaces[slot])
+	{
+		cudaDestroySurfaceObject(mySurfaces[slot]);
+		mySurfaces[slot] = 0;
+	}
+
+	cudaResourceDesc desc = {};
+	desc.resType = cudaResourceTypeArray;
+	desc.res.array.array = array;
+	if (cudaCreateSurfaceObject(&mySurfaces[slot], &desc) != cudaSuccess)
+	{
+		mySurfaces[slot] = 0;
+		mySurfaceKeys[slot] = TextureKey();
+		return 0;
+	}
+
+	mySurfaceKeys[slot] = key;
+	return mySurfaces[slot];
+}
+
+const LaunchConfig&
+ResourceCache::getLaunchConfig(int32_t width, int32_t height)
+{
+	bool hit = myLaunchWidth == width && myLaunchHeight == height;
+	count(hit);
+
+	if (!hit)
+	{
+		myLaunchWidth = width;
+		myLaunchHeight = height;
+		myLaunchConfig.blockSize = dim3(16, 16, 1);
+		myLaunchConfig.gridSize = dim3((width + 15) / 16, (height + 15) / 16, 1);
+	}
+	return myLaunchConfig;
+}
+#endif
+
+const TilePlan&
+ResourceCache::getTilePlan(int32_t width, int32_t height, int32_t tileSize)
+{
+	for (const TilePlan& plan : myTilePlans)
+	{
+		if (plan.width == width && plan.height == height && plan.tileSize == tileSize)
+		{
+			count(true);
+			return plan;
+		}
+	}
+
+	count(false);
+
+	// Plans for sizes we no longer render at are dropped, only the ones for
+	// different tile sizes at the current resolution are kept around.
+	myTilePlans.erase(std::remove_if(myTilePlans.begin(), myTilePlans.end(),
+		[&](const TilePlan& p) { return p.width != width || p.height != height; }),
+		myTilePlans.end());
+
+	TilePlan plan;
+	plan.width = width;
+	plan.height = height;
+	plan.tileSize = tileSize;
+	plan.tilesX = (width + tileSize - 1) / tileSize;
+	plan.tilesY = (height + tileSize - 1) / tileSize;
+	plan.tiles.reserve(static_cast<size_t>(plan.tilesX) * plan.tilesY);
+
+	for (int32_t ty = 0; ty < plan.tilesY; ty++)
+	{
+		for (int32_t tx = 0; tx < plan.tilesX; tx++)
+		{
+			TileRect r;
+			r.x0 = tx * tileSize;
+			r.y0 = ty * tileSize;
+			r.x1 = std::min(width, r.x0 + tileSize);
+			r.y1 = std::min(height, r.y0 + tileSize);
+			plan.tiles.push_back(r);
+		}
+	}
+
+	int32_t numTiles = static_cast<int32_t>(plan.tiles.size());
+	int32_t partitions = std::max(1, std::min(parallelWorkerCount(), numTiles));
+	plan.partitionStart.resize(partitions + 1);
+	for (int32_t p = 0; p <= partitions; p++)
+		plan.partitionStart[p] = static_cast<int32_t>(static_cast<int64_t>(numTiles) * p / partitions);
+
+	myTilePlans.push_back(std::move(plan));
+	return myTilePlans.back();
+}
+
+ScratchImage&
+ResourceCache::getScratch(int32_t id, int32_t width, int32_t height)
+{
+	for (ScratchEntry& e : myScratch)
+	{
+		if (e.id == id)
+		{
+			bool hit = e.image.width() == width && e.image.height() == height;
+			count(hit);
+			if (!hit)
+				e.image.resize(width, height);
+			return e.image;
+		}
+	}
+
+	count(false);
+	myScratch.push_back(ScratchEntry());
+	myScratch.back().id = id;
+	myScratch.back().image.resize(width, height);
+	return myScratch.back().image;
+}
+
+uint8_t*
+ResourceCache::getStaging(size_t bytes)
+{
+	bool hit = myStaging.size() >= bytes;
+	count(hit);
+	if (!hit)
+		myStaging.resize(bytes);
+	return myStaging.data();
+}
+
+void
+ResourceCache::clear()
+{
+#ifndef CUDATOP_CPU_BACKEND
+	for (int i = 0; i < NumSlots; i++)
+	{
+		if (mySurfaces[i])
+			cudaDestroySurfaceObject(mySurfaces[i]);
+		mySurfaces[i] = 0;
+		mySurfaceKeys[i] = TextureKey();
+	}
+	myLaunchWidth = 0;
+	myLaunchHeight = 0;
+#endif
+	myTilePlans.clear();
+	myScratch.clear();
+	myStaging.clear();
+	myStaging.shrink_to_fit();
+}
@@ -0,0 +1,196 @@
+/*
+ * Per-instance cache of the objects CudaTOP needs every cook.
+ *
+ * Everything in here is keyed on what it was built from (texture identity,
+ * pixel format and size). As long as the key matches, the cached object is
+ * handed back untouched; only a real change destroys and rebuilds it.
+ * Every lookup is counted as a hit or a miss so the Info CHOP/DAT can show
+ * how often we rebuild.
+ */
+
+#ifndef __ResourceCache__
+#define __ResourceCache__
+
+#include "TOP_CPlusPlusBase.h"
+#ifndef CUDATOP_CPU_BACKEND
+#include "cuda_runtime.h"
+#endif
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+// Identity of a texture as the TOP sees it. 'identity' is the cudaArray for
+// the CUDA backend, or the host pointer / opId for the CPU backend.
+struct TextureKey
+{
+	const void*	identity = nullptr;
+	int32_t		width = 0;
+	int32_t		height = 0;
+	GLint		pixelFormat = 0;
+
+	bool
+	operator==(const TextureKey& other) const
+	{
+		return identity == other.identity &&
+			width == other.width &&
+			height == other.height &&
+			pixelFormat == other.pixelFormat;
+	}
+
+	bool
+	operator!=(const TextureKey& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+struct TileRect
+{
+	int32_t		x0, y0;
+	int32_t		x1, y1;
+};
+
+// An image split into square tiles, with the tiles grouped into one
+// contiguous run per worker thread.
+struct TilePlan
+{
+	int32_t					width = 0;
+	int32_t					height = 0;
+	int32_t					tileSize = 0;
+	int32_t					tilesX = 0;
+	int32_t					tilesY = 0;
+
+	std::vector<TileRect>	tiles;
+
+	// Partition p owns tiles [partitionStart[p], partitionStart[p + 1])
+	std::vector<int32_t>	partitionStart;
+
+	int32_t
+	numPartitions() const
+	{
+		return partitionStart.empty() ? 0 : static_cast<int32_t>(partitionStart.size()) - 1;
+	}
+};
+
+// Non-owning RGBA32F view. Row 0 is the bottom row, matching
+// TOP_FirstPixel::BottomLeft.
+struct ImageView
+{
+	float*		pixels = nullptr;
+	int32_t		width = 0;
+	int32_t		height = 0;
+
+	float*
+	row(int32_t y) const
+	{
+		return pixels + static_cast<size_t>(y) * width * 4;
+	}
+};
+
+// Host-side RGBA32F image used as a render target and for intermediates.
+class ScratchImage
+{
+public:
+	void
+	resize(int32_t width, int32_t height)
+	{
+		myWidth = width;
+		myHeight = height;
+		myPixels.resize(static_cast<size_t>(width) * height * 4);
+	}
+
+	ImageView
+	view()
+	{
+		ImageView v;
+		v.pixels = myPixels.data();
+		v.width = myWidth;
+		v.height = myHeight;
+		return v;
+	}
+
+	int32_t		width() const { return myWidth; }
+	int32_t		height() const { return myHeight; }
+
+private:
+	std::vector<float>	myPixels;
+	int32_t				myWidth = 0;
+	int32_t				myHeight = 0;
+};
+
+#ifndef CUDATOP_CPU_BACKEND
+struct LaunchConfig
+{
+	dim3		blockSize;
+	dim3		gridSize;
+};
+#endif
+
+class ResourceCache
+{
+public:
+	enum Slot
+	{
+		InputSlot = 0,
+		OutputSlot,
+		NumSlots
+	};
+
+	ResourceCache();
+	~ResourceCache();
+
+#ifndef CUDATOP_CPU_BACKEND
+	// Surface object bound to 'array'. Recreated only when the array, its
+	// size or its format differ from the last call for this slot.
+	cudaSurfaceObject_t	getSurface(Slot slot, cudaArray_t array,
+									int32_t width, int32_t height, GLint pixelFormat);
+
+	const LaunchConfig&	getLaunchConfig(int32_t width, int32_t height);
+#endif
+
+	// The returned plan stays valid until a plan for a different
+	// resolution is requested.
+	const TilePlan&		getTilePlan(int32_t width, int32_t height, int32_t tileSize);
+
+	// Scratch images are identified by a small caller-chosen id.
+	ScratchImage&		getScratch(int32_t id, int32_t width, int32_t height);
+
+	// Untyped host staging memory, e.g. for format conversion before upload.
+	uint8_t*			getStaging(size_t bytes);
+
+	// Drops every cached object. The next lookups will all be misses.
+	void				clear();
+
+	int64_t				hits() const { return myHits; }
+	int64_t				misses() const { return myMisses; }
+
+private:
+	void				count(bool hit);
+
+#ifndef CUDATOP_CPU_BACKEND
+	TextureKey			mySurfaceKeys[NumSlots];
+	cudaSurfaceObject_t	mySurfaces[NumSlots];
+
+	int32_t				myLaunchWidth;
+	int32_t				myLaunchHeight;
+	LaunchConfig		myLaunchConfig;
+#endif
+
+	std::deque<TilePlan>	myTilePlans;
+
+	struct ScratchEntry
+	{
+		int32_t			id;
+		ScratchImage	image;
+	};
+	// A deque so references handed out stay valid as entries are added
+	std::deque<ScratchEntry>	myScratch;
+
+	std::vector<uint8_t>	myStaging;
+
+	int64_t				myHits;
+	int64_t				myMisses;
+};
+
+#endif
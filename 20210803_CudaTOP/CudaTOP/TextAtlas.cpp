@@ -0,0 +1,333 @@
+/*
+ * See TextAtlas.h
+ */
+
+#include "TextAtlas.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <unordered_set>
+
+// Decodes UTF-8, invalid bytes come out as U+FFFD
+static void
+decodeUTF8(const char* text, std::vector<uint32_t>& codepoints)
+{
+	codepoints.clear();
+	const unsigned char* s = reinterpret_cast<const unsigned char*>(text);
+	while (*s)
+	{
+		uint32_t c = *s++;
+		int extra = 0;
+		if (c >= 0xF0 && c < 0xF8)
+		{
+			c &= 0x07;
+			extra = 3;
+		}
+		else if (c >= 0xE0)
+		{
+			c &= 0x0F;
+			extra = 2;
+		}
+		else if (c >= 0xC0)
+		{
+			c &= 0x1F;
+			extra = 1;
+		}
+		else if (c >= 0x80)
+		{
+			c = 0xFFFD;
+		}
+
+		for (; extra > 0; extra--)
+		{
+			if ((*s & 0xC0) != 0x80)
+			{
+				c = 0xFFFD;
+				break;
+			}
+			c = (c << 6) | (*s++ & 0x3F);
+		}
+		codepoints.push_back(c);
+	}
+}
+
+TextAtlas::TextAtlas() :
+	myPixelSize(0.0f),
+	myScale(0.0f),
+	myLineHeight(0),
+	myBaseline(0),
+	myColor{ 0.0f, 0.0f, 0.0f },
+	myError(nullptr),
+	myWidth(0),
+	myHeight(0),
+	myOutputValid(false),
+	myCookIndex(0),
+	myLastRowsUpdated(0),
+	myLastGlyphMisses(0),
+	myGlyphHits(0),
+	myGlyphMisses(0)
+{
+}
+
+bool
+TextAtlas::loadFont(const TextAtlasSettings& settings)
+{
+	if (settings.fontPath == myFontPath && settings.pixelSize == myPixelSize)
+		return false;
+
+	myGlyphList.clear();
+	myGlyphs.clear();
+
+	if (settings.fontPath != myFontPath)
+	{
+		myFontPath = settings.fontPath;
+		myError = nullptr;
+		if (!myFont.load(myFontPath.c_str()))
+			myError = "Unable to load the font. Only TrueType outline fonts (.ttf) are supported.";
+	}
+
+	myPixelSize = settings.pixelSize;
+	myScale = myFont.scaleForPixelHeight(myPixelSize);
+	myBaseline = static_cast<int32_t>(std::ceil(myFont.ascent() * myScale));
+	int32_t descent = static_cast<int32_t>(std::ceil(-myFont.descent() * myScale));
+	int32_t gap = static_cast<int32_t>(std::round(myFont.lineGap() * myScale));
+	myLineHeight = std::max(1, myBaseline + descent + gap);
+	return true;
+}
+
+void
+TextAtlas::resize(int32_t width, int32_t height)
+{
+	myWidth = width;
+	myHeight = height;
+	myImage.assign(static_cast<size_t>(width) * height * 4, 0.0f);
+}
+
+void
+TextAtlas::reset()
+{
+	myGlyphList.clear();
+	myGlyphs.clear();
+	myRows.clear();
+	std::fill(myImage.begin(), myImage.end(), 0.0f);
+	myOutputValid = false;
+}
+
+TextAtlas::CachedGlyph*
+TextAtlas::findGlyph(uint32_t codepoint)
+{
+	auto it = myGlyphs.find(codepoint);
+	if (it == myGlyphs.end())
+		return nullptr;
+
+	myGlyphList.splice(myGlyphList.begin(), myGlyphList, it->second);
+	return &*it->second;
+}
+
+void
+TextAtlas::evictGlyphs(int32_t capacity)
+{
+	while (static_cast<int32_t>(myGlyphList.size()) > capacity &&
+		myGlyphList.back().lastUsed != myCookIndex)
+	{
+		myGlyphs.erase(myGlyphList.back().codepoint);
+		myGlyphList.pop_back();
+	}
+}
+
+void
+TextAtlas::clearRow(int32_t row)
+{
+	const int32_t top = row * myLineHeight;
+	for (int32_t sy = 0; sy < myLineHeight; sy++)
+	{
+		int32_t y = myHeight - 1 - (top + sy);
+		if (y < 0)
+			break;
+		float* dst = &myImage[static_cast<size_t>(y) * myWidth * 4];
+		std::fill(dst, dst + static_cast<size_t>(myWidth) * 4, 0.0f);
+	}
+}
+
+void
+TextAtlas::drawRow(int32_t row, const std::vector<PlacedGlyph>& glyphs)
+{
+	clearRow(row);
+
+	const int32_t top = row * myLineHeight;
+	for (const PlacedGlyph& placed : glyphs)
+	{
+		const GlyphBitmap& bitmap = *placed.bitmap;
+		const int32_t x0 = placed.x + bitmap.left;
+		const int32_t y0 = myBaseline + bitmap.top;
+
+		for (int32_t by = 0; by < bitmap.height; by++)
+		{
+			int32_t sy = y0 + by;
+			if (sy < 0 || sy >= myLineHeight)
+				continue;
+			int32_t y = myHeight - 1 - (top + sy);
+			if (y < 0)
+				break;
+
+			float* dst = &myImage[static_cast<size_t>(y) * myWidth * 4];
+			const uint8_t* src = &bitmap.coverage[static_cast<size_t>(by) * bitmap.width];
+			const int32_t bxBegin = std::max(0, -x0);
+			const int32_t bxEnd = std::min(bitmap.width, myWidth - x0);
+			for (int32_t bx = bxBegin; bx < bxEnd; bx++)
+			{
+				if (!src[bx])
+					continue;
+
+				// Overlapping glyphs add up their coverage
+				float* p = dst + static_cast<size_t>(x0 + bx) * 4;
+				float a = std::min(1.0f, p[3] + src[bx] * (1.0f / 255.0f));
+				p[0] = myColor[0] * a;
+				p[1] = myColor[1] * a;
+				p[2] = myColor[2] * a;
+				p[3] = a;
+			}
+		}
+	}
+}
+
+bool
+TextAtlas::cook(const TextAtlasSettings& settings, const std::vector<const char*>& rows,
+				const ImageView& output)
+{
+	myCookIndex++;
+	myLastRowsUpdated = 0;
+	myLastGlyphMisses = 0;
+
+	bool relayout = loadFont(settings);
+	if (!myFont.isLoaded())
+		return false;
+
+	if (output.width != myWidth || output.height != myHeight)
+	{
+		resize(output.width, output.height);
+		relayout = true;
+	}
+	if (!std::equal(settings.color, settings.color + 3, myColor))
+	{
+		std::copy(settings.color, settings.color + 3, myColor);
+		relayout = true;
+	}
+	if (relayout)
+	{
+		// Rows are wiped at the new line height, so nothing of the old
+		// layout may be left below them
+		myRows.clear();
+		std::fill(myImage.begin(), myImage.end(), 0.0f);
+	}
+
+	// Lines past the bottom of the image aren't drawn
+	const int32_t maxRows = (myHeight + myLineHeight - 1) / myLineHeight;
+	const int32_t numRows = std::min(static_cast<int32_t>(rows.size()), maxRows);
+
+	bool changed = relayout;
+
+	// Lines that are gone
+	for (int32_t r = numRows; r < static_cast<int32_t>(myRows.size()); r++)
+	{
+		if (!myRows[r].empty())
+		{
+			clearRow(r);
+			changed = true;
+		}
+	}
+	myRows.resize(numRows);
+
+	std::vector<int32_t> dirty;
+	for (int32_t r = 0; r < numRows; r++)
+	{
+		const char* text = rows[r] ? rows[r] : "";
+		if (relayout || myRows[r] != text)
+		{
+			myRows[r] = text;
+			dirty.push_back(r);
+		}
+	}
+
+	if (!dirty.empty())
+	{
+		// Look up every glyph the changed lines need, collecting the ones
+		// that have to be rasterized
+		std::vector<std::vector<uint32_t>> codepoints(dirty.size());
+		std::vector<uint32_t> missing;
+		std::unordered_set<uint32_t> missingSet;
+		for (size_t i = 0; i < dirty.size(); i++)
+		{
+			decodeUTF8(myRows[dirty[i]].c_str(), codepoints[i]);
+			for (uint32_t c : codepoints[i])
+			{
+				CachedGlyph* glyph = findGlyph(c);
+				if (glyph)
+				{
+					glyph->lastUsed = myCookIndex;
+					myGlyphHits++;
+				}
+				else if (missingSet.insert(c).second)
+				{
+					missing.push_back(c);
+				}
+			}
+		}
+
+		std::vector<GlyphBitmap> bitmaps(missing.size());
+		parallelFor(static_cast<int>(missing.size()), [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+				myFont.rasterize(myFont.glyphIndex(missing[i]), myScale, bitmaps[i]);
+		}, 8);
+
+		for (size_t i = 0; i < missing.size(); i++)
+		{
+			myGlyphList.push_front(CachedGlyph());
+			CachedGlyph& glyph = myGlyphList.front();
+			glyph.codepoint = missing[i];
+			glyph.lastUsed = myCookIndex;
+			glyph.bitmap = std::move(bitmaps[i]);
+			myGlyphs[missing[i]] = myGlyphList.begin();
+		}
+		myLastGlyphMisses = static_cast<int32_t>(missing.size());
+		myGlyphMisses += missing.size();
+
+		// Every glyph is cached now and the cache isn't modified until the
+		// lines are drawn, so the lookups below are read only
+		parallelFor(static_cast<int>(dirty.size()), [&](int begin, int end)
+		{
+			std::vector<PlacedGlyph> placed;
+			for (int i = begin; i < end; i++)
+			{
+				placed.clear();
+				float pen = 0.0f;
+				for (uint32_t c : codepoints[i])
+				{
+					const GlyphBitmap& bitmap = myGlyphs.find(c)->second->bitmap;
+					placed.push_back({ &bitmap, static_cast<int32_t>(std::round(pen)) });
+					pen += bitmap.advance;
+				}
+				drawRow(dirty[i], placed);
+			}
+		}, 4);
+
+		myLastRowsUpdated = static_cast<int32_t>(dirty.size());
+		changed = true;
+	}
+
+	evictGlyphs(std::max(settings.glyphCacheSize, 0));
+
+	if (!changed && myOutputValid)
+		return false;
+	myOutputValid = true;
+
+	parallelFor(myHeight, [&](int begin, int end)
+	{
+		const size_t rowFloats = static_cast<size_t>(myWidth) * 4;
+		memcpy(output.row(begin), &myImage[begin * rowFloats], (end - begin) * rowFloats * sizeof(float));
+	}, 64);
+	return true;
+}
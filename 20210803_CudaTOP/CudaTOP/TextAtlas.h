@@ -0,0 +1,120 @@
+/*
+ * Text renderer for the TOP's Text mode.
+ *
+ * Every row of the Text DAT is drawn as one line, top to bottom. Glyphs are
+ * rasterized once and kept in an LRU cache keyed on the code point, so a
+ * cook only rasterizes glyphs it hasn't seen recently. The rendered lines are
+ * kept between cooks and only rows whose text changed are laid out and drawn
+ * again; a cook where no row changed doesn't touch the output at all.
+ *
+ * The output is the text colour premultiplied by the glyph coverage, with the
+ * coverage in alpha.
+ */
+
+#ifndef __TextAtlas__
+#define __TextAtlas__
+
+#include "ResourceCache.h"
+#include "TrueTypeFont.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TextAtlasSettings
+{
+	std::string	fontPath;
+	// Ascent to descent height of a line, in pixels
+	float		pixelSize = 32.0f;
+	// Glyphs kept rasterized. Glyphs used by the current cook are never evicted.
+	int32_t		glyphCacheSize = 256;
+	float		color[3] = { 1.0f, 1.0f, 1.0f };
+};
+
+class TextAtlas
+{
+public:
+	TextAtlas();
+
+	// Draws 'rows' (UTF-8) into 'output'. Returns false without touching
+	// 'output' when nothing changed since the last call, or when the font
+	// couldn't be loaded (see error()).
+	bool		cook(const TextAtlasSettings& settings, const std::vector<const char*>& rows,
+					const ImageView& output);
+
+	const char*	error() const { return myError; }
+
+	// Empties the glyph cache and the rendered lines, the next cook
+	// rasterizes and draws everything again
+	void		reset();
+
+	// Makes the next cook copy the rendered lines into the output again, for
+	// when something else drew over it
+	void		invalidate() { myOutputValid = false; }
+
+	// Rows laid out and drawn by the last cook
+	int32_t		lastRowsUpdated() const { return myLastRowsUpdated; }
+	// Glyphs the last cook had to rasterize
+	int32_t		lastGlyphMisses() const { return myLastGlyphMisses; }
+	int32_t		cachedGlyphs() const { return static_cast<int32_t>(myGlyphs.size()); }
+
+	int64_t		glyphHits() const { return myGlyphHits; }
+	int64_t		glyphMisses() const { return myGlyphMisses; }
+
+private:
+	struct CachedGlyph
+	{
+		uint32_t	codepoint;
+		int64_t		lastUsed;
+		GlyphBitmap	bitmap;
+	};
+
+	// A glyph placed on a line, 'x' is the pen position in pixels
+	struct PlacedGlyph
+	{
+		const GlyphBitmap*	bitmap;
+		int32_t				x;
+	};
+
+	bool		loadFont(const TextAtlasSettings& settings);
+	void		resize(int32_t width, int32_t height);
+
+	// Moves the glyph to the front of the LRU list, nullptr if not cached
+	CachedGlyph*	findGlyph(uint32_t codepoint);
+	void			evictGlyphs(int32_t capacity);
+
+	void		drawRow(int32_t row, const std::vector<PlacedGlyph>& glyphs);
+	void		clearRow(int32_t row);
+
+	TrueTypeFont		myFont;
+	std::string			myFontPath;
+	float				myPixelSize;
+	float				myScale;
+	int32_t				myLineHeight;
+	int32_t				myBaseline;
+	float				myColor[3];
+	const char*			myError;
+
+	// Most recently used first
+	std::list<CachedGlyph>	myGlyphList;
+	std::unordered_map<uint32_t, std::list<CachedGlyph>::iterator>	myGlyphs;
+
+	// Text each line was last drawn with
+	std::vector<std::string>	myRows;
+
+	int32_t				myWidth;
+	int32_t				myHeight;
+	// Rendered lines, row 0 at the bottom like the output
+	std::vector<float>	myImage;
+	// Whether 'output' still holds myImage
+	bool				myOutputValid;
+
+	int64_t				myCookIndex;
+	int32_t				myLastRowsUpdated;
+	int32_t				myLastGlyphMisses;
+	int64_t				myGlyphHits;
+	int64_t				myGlyphMisses;
+};
+
+#endif
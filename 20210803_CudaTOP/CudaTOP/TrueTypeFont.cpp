@@ -0,0 +1,586 @@
+/*
+ * See TrueTypeFont.h
+ */
+
+#include "TrueTypeFont.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string.h>
+
+// Composite glyphs referencing each other deeper than this are broken fonts
+static const int32_t MaxCompositeDepth = 8;
+
+// Maximum distance, in pixels, between a curve and its flattened polyline
+static const float FlattenTolerance = 0.25f;
+
+TrueTypeFont::TrueTypeFont() :
+	myGlyf(0),
+	myLoca(0),
+	myHmtx(0),
+	myCmap(0),
+	myCmapFormat(0),
+	myIndexToLocFormat(0),
+	myNumGlyphs(0),
+	myNumHMetrics(0),
+	myAscent(0),
+	myDescent(0),
+	myLineGap(0)
+{
+}
+
+uint16_t
+TrueTypeFont::u16(uint32_t offset) const
+{
+	if (static_cast<size_t>(offset) + 2 > myData.size())
+		return 0;
+	return static_cast<uint16_t>((myData[offset] << 8) | myData[offset + 1]);
+}
+
+uint32_t
+TrueTypeFont::u32(uint32_t offset) const
+{
+	return (static_cast<uint32_t>(u16(offset)) << 16) | u16(offset + 2);
+}
+
+uint32_t
+TrueTypeFont::findTable(const char* tag) const
+{
+	const uint16_t numTables = u16(4);
+	for (uint16_t i = 0; i < numTables; i++)
+	{
+		uint32_t record = 12 + 16 * i;
+		if (record + 16 > myData.size())
+			break;
+		if (memcmp(&myData[record], tag, 4) == 0)
+			return u32(record + 8);
+	}
+	return 0;
+}
+
+bool
+TrueTypeFont::load(const char* path)
+{
+	myNumGlyphs = 0;
+	myData.clear();
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	myData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+	uint32_t version = u32(0);
+	if (version != 0x00010000 && version != 0x74727565)	// 'true'
+		return false;
+
+	uint32_t head = findTable("head");
+	uint32_t hhea = findTable("hhea");
+	uint32_t maxp = findTable("maxp");
+	myGlyf = findTable("glyf");
+	myLoca = findTable("loca");
+	myHmtx = findTable("hmtx");
+	uint32_t cmap = findTable("cmap");
+	if (!head || !hhea || !maxp || !myGlyf || !myLoca || !myHmtx || !cmap)
+		return false;
+
+	myIndexToLocFormat = i16(head + 50);
+	myAscent = i16(hhea + 4);
+	myDescent = i16(hhea + 6);
+	myLineGap = i16(hhea + 8);
+	myNumHMetrics = u16(hhea + 34);
+
+	// Prefer the full Unicode table, then the BMP one
+	myCmap = 0;
+	myCmapFormat = 0;
+	const uint16_t numSubtables = u16(cmap + 2);
+	for (uint16_t i = 0; i < numSubtables; i++)
+	{
+		uint32_t record = cmap + 4 + 8 * i;
+		uint16_t platform = u16(record);
+		uint16_t encoding = u16(record + 2);
+		uint32_t subtable = cmap + u32(record + 4);
+		uint16_t format = u16(subtable);
+
+		bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+		if (!unicode)
+			continue;
+		if (format == 12 || (format == 4 && myCmapFormat != 12))
+		{
+			myCmap = subtable;
+			myCmapFormat = format;
+		}
+	}
+	if (!myCmap)
+		return false;
+
+	myNumGlyphs = u16(maxp + 4);
+	return myNumGlyphs > 0;
+}
+
+int32_t
+TrueTypeFont::glyphIndex(uint32_t codepoint) const
+{
+	if (myCmapFormat == 12)
+	{
+		uint32_t numGroups = u32(myCmap + 12);
+		// Groups are sorted by start code
+		uint32_t lo = 0, hi = numGroups;
+		while (lo < hi)
+		{
+			uint32_t mid = (lo + hi) / 2;
+			uint32_t group = myCmap + 16 + 12 * mid;
+			uint32_t start = u32(group);
+			uint32_t end = u32(group + 4);
+			if (codepoint < start)
+				hi = mid;
+			else if (codepoint > end)
+				lo = mid + 1;
+			else
+				return static_cast<int32_t>(u32(group + 8) + (codepoint - start));
+		}
+		return 0;
+	}
+
+	if (myCmapFormat == 4 && codepoint <= 0xFFFF)
+	{
+		uint16_t segCount = u16(myCmap + 6) / 2;
+		uint32_t endCodes = myCmap + 14;
+		uint32_t startCodes = endCodes + 2 * segCount + 2;
+		uint32_t idDeltas = startCodes + 2 * segCount;
+		uint32_t idRangeOffsets = idDeltas + 2 * segCount;
+
+		for (uint16_t s = 0; s < segCount; s++)
+		{
+			if (codepoint > u16(endCodes + 2 * s))
+				continue;
+			uint16_t start = u16(startCodes + 2 * s);
+			if (codepoint < start)
+				return 0;
+
+			uint16_t delta = u16(idDeltas + 2 * s);
+			uint16_t rangeOffset = u16(idRangeOffsets + 2 * s);
+			if (rangeOffset == 0)
+				return (codepoint + delta) & 0xFFFF;
+
+			uint16_t glyph = u16(idRangeOffsets + 2 * s + rangeOffset + 2 * (codepoint - start));
+			return glyph ? (glyph + delta) & 0xFFFF : 0;
+		}
+	}
+	return 0;
+}
+
+float
+TrueTypeFont::scaleForPixelHeight(float pixels) const
+{
+	int32_t height = myAscent - myDescent;
+	return height > 0 ? pixels / height : 0.0f;
+}
+
+bool
+TrueTypeFont::glyphRange(int32_t glyph, uint32_t& offset, uint32_t& length) const
+{
+	if (glyph < 0 || glyph >= myNumGlyphs)
+		return false;
+
+	uint32_t start, end;
+	if (myIndexToLocFormat == 0)
+	{
+		start = u16(myLoca + 2 * glyph) * 2u;
+		end = u16(myLoca + 2 * glyph + 2) * 2u;
+	}
+	else
+	{
+		start = u32(myLoca + 4 * glyph);
+		end = u32(myLoca + 4 * glyph + 4);
+	}
+	if (end <= start)
+		return false;
+
+	offset = myGlyf + start;
+	length = end - start;
+	return static_cast<size_t>(offset) + length <= myData.size();
+}
+
+void
+TrueTypeFont::getOutline(int32_t glyph, std::vector<Point>& points,
+						std::vector<int32_t>& contourEnds, int32_t depth) const
+{
+	uint32_t g, length;
+	if (depth > MaxCompositeDepth || !glyphRange(glyph, g, length))
+		return;
+
+	const int16_t numContours = i16(g);
+	if (numContours >= 0)
+	{
+		const uint32_t firstPoint = static_cast<uint32_t>(points.size());
+		uint32_t endPts = g + 10;
+		int32_t numPoints = numContours > 0 ? u16(endPts + 2 * (numContours - 1)) + 1 : 0;
+		uint32_t p = endPts + 2 * numContours;
+		p += 2 + u16(p);	// skip instructions
+
+		std::vector<uint8_t> flags(numPoints);
+		for (int32_t i = 0; i < numPoints; )
+		{
+			uint8_t f = p < myData.size() ? myData[p++] : 0;
+			flags[i++] = f;
+			if (f & 8)
+			{
+				uint8_t repeat = p < myData.size() ? myData[p++] : 0;
+				for (; repeat > 0 && i < numPoints; repeat--)
+					flags[i++] = f;
+			}
+		}
+
+		points.resize(firstPoint + numPoints);
+		int32_t value = 0;
+		for (int32_t i = 0; i < numPoints; i++)
+		{
+			uint8_t f = flags[i];
+			if (f & 2)
+			{
+				int32_t dx = p < myData.size() ? myData[p++] : 0;
+				value += (f & 16) ? dx : -dx;
+			}
+			else if (!(f & 16))
+			{
+				value += i16(p);
+				p += 2;
+			}
+			points[firstPoint + i].x = static_cast<float>(value);
+			points[firstPoint + i].onCurve = (f & 1) != 0;
+		}
+		value = 0;
+		for (int32_t i = 0; i < numPoints; i++)
+		{
+			uint8_t f = flags[i];
+			if (f & 4)
+			{
+				int32_t dy = p < myData.size() ? myData[p++] : 0;
+				value += (f & 32) ? dy : -dy;
+			}
+			else if (!(f & 32))
+			{
+				value += i16(p);
+				p += 2;
+			}
+			points[firstPoint + i].y = static_cast<float>(value);
+		}
+
+		for (int16_t c = 0; c < numContours; c++)
+			contourEnds.push_back(firstPoint + u16(endPts + 2 * c));
+		return;
+	}
+
+	// Composite glyph: transformed copies of other glyphs
+	uint32_t p = g + 10;
+	uint16_t flags;
+	do
+	{
+		flags = u16(p);
+		int32_t component = u16(p + 2);
+		p += 4;
+
+		float dx = 0.0f, dy = 0.0f;
+		if (flags & 1)
+		{
+			dx = i16(p);
+			dy = i16(p + 2);
+			p += 4;
+		}
+		else
+		{
+			dx = static_cast<int8_t>(p < myData.size() ? myData[p] : 0);
+			dy = static_cast<int8_t>(p + 1 < myData.size() ? myData[p + 1] : 0);
+			p += 2;
+		}
+		// Anchor point matching isn't supported, the component stays in place
+		if (!(flags & 2))
+			dx = dy = 0.0f;
+
+		float a = 1.0f, b = 0.0f, c = 0.0f, d = 1.0f;
+		if (flags & 8)
+		{
+			a = d = i16(p) / 16384.0f;
+			p += 2;
+		}
+		else if (flags & 0x40)
+		{
+			a = i16(p) / 16384.0f;
+			d = i16(p + 2) / 16384.0f;
+			p += 4;
+		}
+		else if (flags & 0x80)
+		{
+			a = i16(p) / 16384.0f;
+			b = i16(p + 2) / 16384.0f;
+			c = i16(p + 4) / 16384.0f;
+			d = i16(p + 6) / 16384.0f;
+			p += 8;
+		}
+
+		size_t first = points.size();
+		getOutline(component, points, contourEnds, depth + 1);
+		for (size_t i = first; i < points.size(); i++)
+		{
+			float x = points[i].x;
+			float y = points[i].y;
+			points[i].x = a * x + c * y + dx;
+			points[i].y = b * x + d * y + dy;
+		}
+	} while (flags & 0x20);
+}
+
+namespace
+{
+	// Signed area accumulation rasterizer: every edge adds the coverage it
+	// contributes to the cells it crosses, a running sum then gives the
+	// coverage of each pixel.
+	class Accumulator
+	{
+	public:
+		Accumulator(int32_t width, int32_t height) :
+			myWidth(width),
+			myHeight(height),
+			myCells(static_cast<size_t>(width) * height + 4, 0.0f)
+		{
+		}
+
+		void
+		line(float x0, float y0, float x1, float y1)
+		{
+			if (y0 == y1)
+				return;
+
+			float dir = 1.0f;
+			if (y0 > y1)
+			{
+				std::swap(x0, x1);
+				std::swap(y0, y1);
+				dir = -1.0f;
+			}
+
+			const float dxdy = (x1 - x0) / (y1 - y0);
+			float x = x0;
+			if (y0 < 0.0f)
+			{
+				x -= y0 * dxdy;
+				y0 = 0.0f;
+			}
+
+			const int32_t yEnd = std::min(myHeight, static_cast<int32_t>(std::ceil(y1)));
+			for (int32_t y = static_cast<int32_t>(y0); y < yEnd; y++)
+			{
+				float* row = &myCells[static_cast<size_t>(y) * myWidth];
+				float dy = std::min(static_cast<float>(y + 1), y1) - std::max(static_cast<float>(y), y0);
+				float xNext = x + dxdy * dy;
+				float d = dy * dir;
+
+				float xa = std::min(x, xNext);
+				float xb = std::max(x, xNext);
+				float xaFloor = std::floor(xa);
+				int32_t xai = static_cast<int32_t>(xaFloor);
+				float xbCeil = std::ceil(xb);
+				int32_t xbi = static_cast<int32_t>(xbCeil);
+
+				if (xbi <= xai + 1)
+				{
+					// The edge stays within one pixel column on this row
+					float xm = 0.5f * (x + xNext) - xaFloor;
+					row[xai] += d - d * xm;
+					row[xai + 1] += d * xm;
+				}
+				else
+				{
+					float s = 1.0f / (xb - xa);
+					float xaf = xa - xaFloor;
+					float a0 = 0.5f * s * (1.0f - xaf) * (1.0f - xaf);
+					float xbf = xb - xbCeil + 1.0f;
+					float am = 0.5f * s * xbf * xbf;
+
+					row[xai] += d * a0;
+					if (xbi == xai + 2)
+					{
+						row[xai + 1] += d * (1.0f - a0 - am);
+					}
+					else
+					{
+						float a1 = s * (1.5f - xaf);
+						row[xai + 1] += d * (a1 - a0);
+						for (int32_t xi = xai + 2; xi < xbi - 1; xi++)
+							row[xi] += d * s;
+						float a2 = a1 + (xbi - xai - 3) * s;
+						row[xbi - 1] += d * (1.0f - a2 - am);
+					}
+					row[xbi] += d * am;
+				}
+				x = xNext;
+			}
+		}
+
+		void
+		resolve(std::vector<uint8_t>& coverage) const
+		{
+			coverage.resize(static_cast<size_t>(myWidth) * myHeight);
+			float sum = 0.0f;
+			for (size_t i = 0; i < coverage.size(); i++)
+			{
+				sum += myCells[i];
+				float c = std::min(std::fabs(sum), 1.0f);
+				coverage[i] = static_cast<uint8_t>(c * 255.0f + 0.5f);
+			}
+		}
+
+	private:
+		int32_t				myWidth;
+		int32_t				myHeight;
+		std::vector<float>	myCells;
+	};
+}
+
+void
+TrueTypeFont::rasterize(int32_t glyph, float scale, GlyphBitmap& out) const
+{
+	out = GlyphBitmap();
+
+	if (glyph >= 0 && glyph < myNumGlyphs)
+	{
+		int32_t metric = std::min(glyph, myNumHMetrics - 1);
+		out.advance = u16(myHmtx + 4 * metric) * scale;
+	}
+
+	std::vector<Point> points;
+	std::vector<int32_t> contourEnds;
+	getOutline(glyph, points, contourEnds, 0);
+	if (points.empty())
+		return;
+
+	// Bounds in pixels, y down, with a pixel of margin for the rasterizer
+	float minX = points[0].x, maxX = points[0].x, minY = points[0].y, maxY = points[0].y;
+	for (const Point& pt : points)
+	{
+		minX = std::min(minX, pt.x);
+		maxX = std::max(maxX, pt.x);
+		minY = std::min(minY, pt.y);
+		maxY = std::max(maxY, pt.y);
+	}
+	out.left = static_cast<int32_t>(std::floor(minX * scale));
+	out.top = static_cast<int32_t>(std::floor(-maxY * scale));
+	out.width = static_cast<int32_t>(std::ceil(maxX * scale)) - out.left + 2;
+	out.height = static_cast<int32_t>(std::ceil(-minY * scale)) - out.top + 1;
+
+	Accumulator acc(out.width, out.height);
+	const float maxPX = static_cast<float>(out.width - 2);
+	const float maxPY = static_cast<float>(out.height);
+
+	auto toPixel = [&](float x, float y, float& px, float& py)
+	{
+		px = std::min(std::max(x * scale - out.left, 0.0f), maxPX);
+		py = std::min(std::max(-y * scale - out.top, 0.0f), maxPY);
+	};
+
+	float lastX = 0.0f, lastY = 0.0f;
+	auto lineTo = [&](float x, float y)
+	{
+		float px, py;
+		toPixel(x, y, px, py);
+		acc.line(lastX, lastY, px, py);
+		lastX = px;
+		lastY = py;
+	};
+	auto quadTo = [&](float cx, float cy, float x, float y)
+	{
+		float pcx, pcy, px, py;
+		toPixel(cx, cy, pcx, pcy);
+		toPixel(x, y, px, py);
+
+		// Segments needed for the deviation to stay under the tolerance
+		float ddx = lastX - 2.0f * pcx + px;
+		float ddy = lastY - 2.0f * pcy + py;
+		float dev = std::sqrt(ddx * ddx + ddy * ddy) * 0.25f;
+		int32_t n = 1 + static_cast<int32_t>(std::sqrt(dev / FlattenTolerance));
+
+		float sx = lastX, sy = lastY;
+		for (int32_t i = 1; i <= n; i++)
+		{
+			float t = static_cast<float>(i) / n;
+			float mt = 1.0f - t;
+			float qx = mt * mt * sx + 2.0f * mt * t * pcx + t * t * px;
+			float qy = mt * mt * sy + 2.0f * mt * t * pcy + t * t * py;
+			acc.line(lastX, lastY, qx, qy);
+			lastX = qx;
+			lastY = qy;
+		}
+	};
+
+	int32_t start = 0;
+	for (int32_t end : contourEnds)
+	{
+		const int32_t count = end - start + 1;
+		if (count < 2 || end >= static_cast<int32_t>(points.size()))
+		{
+			start = end + 1;
+			continue;
+		}
+
+		// Start on an on-curve point, or between two off-curve ones
+		int32_t first = -1;
+		for (int32_t i = 0; i < count; i++)
+		{
+			if (points[start + i].onCurve)
+			{
+				first = i;
+				break;
+			}
+		}
+		float startX, startY;
+		if (first >= 0)
+		{
+			startX = points[start + first].x;
+			startY = points[start + first].y;
+		}
+		else
+		{
+			first = 0;
+			startX = 0.5f * (points[start].x + points[start + 1].x);
+			startY = 0.5f * (points[start].y + points[start + 1].y);
+		}
+		toPixel(startX, startY, lastX, lastY);
+
+		bool haveControl = false;
+		float controlX = 0.0f, controlY = 0.0f;
+		for (int32_t k = 1; k <= count; k++)
+		{
+			const Point& pt = points[start + (first + k) % count];
+			if (pt.onCurve)
+			{
+				if (haveControl)
+					quadTo(controlX, controlY, pt.x, pt.y);
+				else
+					lineTo(pt.x, pt.y);
+				haveControl = false;
+			}
+			else
+			{
+				if (haveControl)
+				{
+					// Two off-curve points imply an on-curve one between them
+					float mx = 0.5f * (controlX + pt.x);
+					float my = 0.5f * (controlY + pt.y);
+					quadTo(controlX, controlY, mx, my);
+				}
+				controlX = pt.x;
+				controlY = pt.y;
+				haveControl = true;
+			}
+		}
+		if (haveControl)
+			quadTo(controlX, controlY, startX, startY);
+		else
+			lineTo(startX, startY);
+
+		start = end + 1;
+	}
+
+	acc.resolve(out.coverage);
+}
@@ -0,0 +1,85 @@
+/*
+ * Minimal TrueType reader and glyph rasterizer for the TOP's Text mode.
+ *
+ * Reads fonts with TrueType outlines ('glyf', simple and composite glyphs)
+ * and a format 4 or 12 'cmap'. CFF based .otf files and collections (.ttc)
+ * are not supported, and no hinting or kerning is applied. Outlines are
+ * flattened and rasterized with exact area coverage.
+ */
+
+#ifndef __TrueTypeFont__
+#define __TrueTypeFont__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// 8-bit coverage of one glyph, rows top to bottom. 'left' and 'top' place
+// the bitmap relative to the pen position on the baseline, y pointing down.
+struct GlyphBitmap
+{
+	int32_t					width = 0;
+	int32_t					height = 0;
+	int32_t					left = 0;
+	int32_t					top = 0;
+	float					advance = 0.0f;
+	std::vector<uint8_t>	coverage;
+};
+
+class TrueTypeFont
+{
+public:
+	TrueTypeFont();
+
+	// Reads and validates the font file. Returns false if it can't be used.
+	bool		load(const char* path);
+	bool		isLoaded() const { return myNumGlyphs > 0; }
+
+	// Glyph for a Unicode code point, 0 (the missing glyph) if there is none
+	int32_t		glyphIndex(uint32_t codepoint) const;
+
+	// Scale from font units to pixels for a given ascent-to-descent height
+	float		scaleForPixelHeight(float pixels) const;
+
+	// In font units
+	int32_t		ascent() const { return myAscent; }
+	int32_t		descent() const { return myDescent; }
+	int32_t		lineGap() const { return myLineGap; }
+
+	// Thread safe once load() returned
+	void		rasterize(int32_t glyph, float scale, GlyphBitmap& out) const;
+
+private:
+	struct Point
+	{
+		float	x;
+		float	y;
+		bool	onCurve;
+	};
+
+	// Contours of a glyph in font units, composites resolved
+	void		getOutline(int32_t glyph, std::vector<Point>& points,
+							std::vector<int32_t>& contourEnds, int32_t depth) const;
+	bool		glyphRange(int32_t glyph, uint32_t& offset, uint32_t& length) const;
+
+	uint16_t	u16(uint32_t offset) const;
+	int16_t		i16(uint32_t offset) const { return static_cast<int16_t>(u16(offset)); }
+	uint32_t	u32(uint32_t offset) const;
+	uint32_t	findTable(const char* tag) const;
+
+	std::vector<uint8_t>	myData;
+
+	uint32_t	myGlyf;
+	uint32_t	myLoca;
+	uint32_t	myHmtx;
+	uint32_t	myCmap;
+	int32_t		myCmapFormat;
+	int32_t		myIndexToLocFormat;
+	int32_t		myNumGlyphs;
+	int32_t		myNumHMetrics;
+	int32_t		myAscent;
+	int32_t		myDescent;
+	int32_t		myLineGap;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * CPU equivalents of the kernels in kernel.cu. Each one walks a list of
+ * tiles of a TilePlan, split across threads.
+ */
+
+#include "ResourceCache.h"
+#include "Parallel.h"
+
+static void
+copyTextureRGBA32F(const TileRect& tile, int width, const float* input, const ImageView& output)
+{
+	for (int y = tile.y0; y < tile.y1; y++)
+	{
+		const float* src = input + static_cast<size_t>(y) * width * 4;
+		float* dst = output.row(y);
+
+		for (int x = tile.x0; x < tile.x1; x++)
+		{
+			// Out of range neighbours read as zero, like cudaBoundaryModeZero
+			for (int c = 0; c < 4; c++)
+			{
+				float center = src[x * 4 + c];
+				float right = x + 1 < width ? src[(x + 1) * 4 + c] : 0.0f;
+				float left = x > 0 ? src[(x - 1) * 4 + c] : 0.0f;
+				dst[x * 4 + c] = (center + right + left) / 3.0f;
+			}
+		}
+	}
+}
+
+static void
+makeOutputRed(const TileRect& tile, const ImageView& output)
+{
+	for (int y = tile.y0; y < tile.y1; y++)
+	{
+		float* dst = output.row(y);
+		for (int x = tile.x0; x < tile.x1; x++)
+		{
+			dst[x * 4 + 0] = 1.0f;
+			dst[x * 4 + 1] = 0.0f;
+			dst[x * 4 + 2] = 0.0f;
+			dst[x * 4 + 3] = 1.0f;
+		}
+	}
+}
+
+// Runs the kernel over 'tiles' only, the rest of 'output' is left as is
+void
+doCPUOperation(const TilePlan& plan, const std::vector<int32_t>& tiles, const float* input, const ImageView& output)
+{
+	parallelFor(static_cast<int>(tiles.size()), [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const TileRect& tile = plan.tiles[tiles[i]];
+			if (input)
+				copyTextureRGBA32F(tile, plan.width, input, output);
+			else
+				makeOutputRed(tile, output);
+		}
+	});
+}
@@ -62,14 +62,13 @@ divUp(int a, int b)
 }
 
 
-cudaError_t doCUDAOperation(int width, int height, cudaSurfaceObject_t input, cudaSurfaceObject_t output)
+// gridSize and blockSize come from the TOP's ResourceCache, which only
+// recomputes them when the output resolution changes.
+cudaError_t doCUDAOperation(int width, int height, dim3 gridSize, dim3 blockSize,
+							cudaSurfaceObject_t input, cudaSurfaceObject_t output)
 {
 	cudaError_t cudaStatus;
 
-	dim3 blockSize(16, 16, 1);
-
-	dim3 gridSize(divUp(width, blockSize.x), divUp(height, blockSize.y), 1);
-
 	if (input)
 	{
 		copyTextureRGBA8<<<gridSize, blockSize>>>(width, height, input, output);
@@ -0,0 +1,509 @@
+/*
+ * See BarnesHut.h
+ */
+
+#include "BarnesHut.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+// Levels a Morton code splits into, 21 bits per axis
+static const int32_t MaxDepth = 21;
+// Particles a node has to hold before it's split
+static const int32_t LeafSize = 8;
+
+// Spreads the low 21 bits of v out to every third bit
+static inline uint64_t
+expandBits(uint64_t v)
+{
+	v &= 0x1FFFFF;
+	v = (v | v << 32) & 0x1F00000000FFFFull;
+	v = (v | v << 16) & 0x1F0000FF0000FFull;
+	v = (v | v << 8) & 0x100F00F00F00F00Full;
+	v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+bool
+NBodySettings::needsReset(const NBodySettings& other) const
+{
+	return count != other.count || radius != other.radius || spin != other.spin || mass != other.mass;
+}
+
+BarnesHut::BarnesHut() :
+	myCube(1.0),
+	myKinetic(0.0),
+	myPotential(0.0),
+	myInitialEnergy(0.0),
+	myInteractions(0.0),
+	myBuildTime(0.0),
+	myForceTime(0.0)
+{
+	mySettings.count = 0;
+	myOrigin[0] = myOrigin[1] = myOrigin[2] = 0.0;
+}
+
+void
+BarnesHut::reset(const NBodySettings& settings)
+{
+	mySettings = settings;
+	mySettings.count = std::max(settings.count, 0);
+	mySettings.radius = std::max(settings.radius, 1e-3);
+	mySettings.mass = std::max(settings.mass, 0.0);
+
+	const int32_t n = mySettings.count;
+	myPos.assign(static_cast<size_t>(n) * 3, 0.0);
+	myVel.assign(static_cast<size_t>(n) * 3, 0.0);
+	myAcc.assign(static_cast<size_t>(n) * 3, 0.0);
+	myIds.resize(n);
+
+	// Evenly over the ball, turning as a solid body. Inside a uniform ball
+	// the circular speed grows linearly with the radius.
+	const double r = mySettings.radius;
+	const double omega = mySettings.spin * std::sqrt(mySettings.mass / (r * r * r));
+	std::mt19937 mt(0x5eed);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	for (int32_t i = 0; i < n; i++)
+	{
+		double p[3];
+		do
+		{
+			for (int k = 0; k < 3; k++)
+				p[k] = dist(mt);
+		} while (p[0] * p[0] + p[1] * p[1] + p[2] * p[2] > 1.0);
+
+		for (int k = 0; k < 3; k++)
+			myPos[i * 3 + k] = p[k] * r;
+		myVel[i * 3 + 0] = -omega * myPos[i * 3 + 2];
+		myVel[i * 3 + 2] = omega * myPos[i * 3 + 0];
+		myIds[i] = i;
+	}
+
+	sortParticles();
+	buildTree();
+	computeForces();
+	myKinetic = computeKinetic();
+	myInitialEnergy = myKinetic + myPotential;
+}
+
+void
+BarnesHut::setSettings(const NBodySettings& settings)
+{
+	if (settings.needsReset(mySettings))
+	{
+		reset(settings);
+		return;
+	}
+
+	const bool softening = settings.softening != mySettings.softening;
+	mySettings = settings;
+	if (softening && mySettings.count > 0)
+	{
+		buildTree();
+		computeForces();
+		myInitialEnergy = myKinetic + myPotential;
+	}
+}
+
+double
+BarnesHut::energyDrift() const
+{
+	if (myInitialEnergy == 0.0)
+		return 0.0;
+	return (myKinetic + myPotential - myInitialEnergy) / std::fabs(myInitialEnergy);
+}
+
+double
+BarnesHut::computeKinetic() const
+{
+	const int32_t n = mySettings.count;
+	if (n == 0)
+		return 0.0;
+
+	std::mutex lock;
+	double total = 0.0;
+	parallelFor(n, [&](int begin, int end)
+	{
+		double sum = 0.0;
+		for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+			sum += myVel[i] * myVel[i];
+		std::lock_guard<std::mutex> guard(lock);
+		total += sum;
+	}, 4096);
+	return 0.5 * mySettings.mass / n * total;
+}
+
+void
+BarnesHut::sortParticles()
+{
+	const int32_t n = mySettings.count;
+	if (n == 0)
+		return;
+
+	// Bounding cube, a little larger so no code reaches the top
+	std::mutex lock;
+	double low[3] = { myPos[0], myPos[1], myPos[2] };
+	double high[3] = { myPos[0], myPos[1], myPos[2] };
+	parallelFor(n, [&](int begin, int end)
+	{
+		double lo[3] = { low[0], low[1], low[2] };
+		double hi[3] = { high[0], high[1], high[2] };
+		for (int32_t i = begin; i < end; i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				lo[k] = std::min(lo[k], myPos[i * 3 + k]);
+				hi[k] = std::max(hi[k], myPos[i * 3 + k]);
+			}
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		for (int k = 0; k < 3; k++)
+		{
+			low[k] = std::min(low[k], lo[k]);
+			high[k] = std::max(high[k], hi[k]);
+		}
+	}, 4096);
+	const double extent = std::max(std::max(high[0] - low[0], high[1] - low[1]), high[2] - low[2]);
+	myCube = std::max(extent * 1.001, 1e-9);
+	for (int k = 0; k < 3; k++)
+		myOrigin[k] = low[k];
+
+	const double scale = double(1 << MaxDepth) / myCube;
+	myOrder.resize(n);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			uint64_t code = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const double cell = (myPos[i * 3 + k] - myOrigin[k]) * scale;
+				const uint64_t c = static_cast<uint64_t>(std::min(std::max(cell, 0.0), double((1 << MaxDepth) - 1)));
+				code |= expandBits(c) << (2 - k);
+			}
+			myOrder[i] = { code, i };
+		}
+	}, 4096);
+
+	// Sorted in chunks, which are then merged pairwise. The particles were
+	// in this order last step, so every chunk is nearly sorted already.
+	const int32_t chunks = std::max(1, std::min(parallelWorkerCount(), n / 4096));
+	auto chunkStart = [&](int32_t c)
+	{
+		return myOrder.begin() + static_cast<int64_t>(n) * c / chunks;
+	};
+	parallelFor(chunks, [&](int begin, int end)
+	{
+		for (int32_t c = begin; c < end; c++)
+			std::sort(chunkStart(c), chunkStart(c + 1));
+	});
+	for (int32_t width = 1; width < chunks; width *= 2)
+	{
+		const int32_t merges = (chunks + 2 * width - 1) / (2 * width);
+		parallelFor(merges, [&](int begin, int end)
+		{
+			for (int32_t m = begin; m < end; m++)
+			{
+				const int32_t first = m * 2 * width;
+				const int32_t middle = std::min(first + width, chunks);
+				const int32_t last = std::min(first + 2 * width, chunks);
+				if (middle < last)
+					std::inplace_merge(chunkStart(first), chunkStart(middle), chunkStart(last));
+			}
+		});
+	}
+
+	// Move the particles into that order
+	myCodes.resize(n);
+	myScratch.resize(static_cast<size_t>(n) * 6);
+	myScratchIds.resize(n);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const int32_t from = myOrder[i].second;
+			myCodes[i] = myOrder[i].first;
+			for (int k = 0; k < 3; k++)
+			{
+				myScratch[i * 6 + k] = myPos[from * 3 + k];
+				myScratch[i * 6 + 3 + k] = myVel[from * 3 + k];
+			}
+			myScratchIds[i] = myIds[from];
+		}
+	}, 4096);
+	parallelFor(n, [&](int begin, int end)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				myPos[i * 3 + k] = myScratch[i * 6 + k];
+				myVel[i * 3 + k] = myScratch[i * 6 + 3 + k];
+			}
+		}
+	}, 4096);
+	myIds.swap(myScratchIds);
+}
+
+void
+BarnesHut::buildTree()
+{
+	const int32_t n = mySettings.count;
+	myNodes.resize(1);
+	myLevels.assign(1, 0);
+
+	Node& root = myNodes[0];
+	root.begin = 0;
+	root.end = n;
+	root.size = myCube;
+	root.child = 0;
+	root.children = 0;
+
+	// Split one level at a time: count each node's non-empty octants, give
+	// them consecutive slots, then fill them in
+	for (int32_t level = 0; ; level++)
+	{
+		const int32_t first = myLevels[level];
+		const int32_t last = static_cast<int32_t>(myNodes.size());
+		myLevels.push_back(last);
+		if (level == MaxDepth)
+			break;
+
+		const int32_t shift = 3 * (MaxDepth - 1 - level);
+		auto octantEnd = [&](int32_t from, int32_t end, uint64_t octant)
+		{
+			return static_cast<int32_t>(std::partition_point(myCodes.begin() + from, myCodes.begin() + end,
+				[&](uint64_t code) { return ((code >> shift) & 7) <= octant; }) - myCodes.begin());
+		};
+
+		parallelFor(last - first, [&](int begin, int end)
+		{
+			for (int32_t i = first + begin; i < first + end; i++)
+			{
+				Node& node = myNodes[i];
+				node.children = 0;
+				if (node.end - node.begin <= LeafSize)
+					continue;
+				int32_t from = node.begin;
+				for (uint64_t octant = 0; octant < 8 && from < node.end; octant++)
+				{
+					const int32_t to = octantEnd(from, node.end, octant);
+					if (to > from)
+						node.children++;
+					from = to;
+				}
+			}
+		}, 256);
+
+		int32_t next = last;
+		for (int32_t i = first; i < last; i++)
+		{
+			myNodes[i].child = next;
+			next += myNodes[i].children;
+		}
+		if (next == last)
+			break;
+		myNodes.resize(next);
+
+		parallelFor(last - first, [&](int begin, int end)
+		{
+			for (int32_t i = first + begin; i < first + end; i++)
+			{
+				const Node& node = myNodes[i];
+				int32_t slot = node.child;
+				int32_t from = node.begin;
+				for (uint64_t octant = 0; octant < 8 && from < node.end && node.children > 0; octant++)
+				{
+					const int32_t to = octantEnd(from, node.end, octant);
+					if (to > from)
+					{
+						Node& child = myNodes[slot++];
+						child.begin = from;
+						child.end = to;
+						child.size = 0.5 * node.size;
+						child.child = 0;
+						child.children = 0;
+					}
+					from = to;
+				}
+			}
+		}, 256);
+	}
+
+	// Masses and centres of mass, deepest level first
+	const double mass = n > 0 ? mySettings.mass / n : 0.0;
+	for (int32_t level = static_cast<int32_t>(myLevels.size()) - 2; level >= 0; level--)
+	{
+		const int32_t first = myLevels[level];
+		parallelFor(myLevels[level + 1] - first, [&](int begin, int end)
+		{
+			for (int32_t i = first + begin; i < first + end; i++)
+			{
+				Node& node = myNodes[i];
+				double sum[3] = { 0.0, 0.0, 0.0 };
+				node.mass = 0.0;
+				if (node.children == 0)
+				{
+					for (int32_t p = node.begin; p < node.end; p++)
+					{
+						for (int k = 0; k < 3; k++)
+							sum[k] += myPos[p * 3 + k];
+					}
+					node.mass = mass * (node.end - node.begin);
+					for (int k = 0; k < 3; k++)
+						node.center[k] = node.end > node.begin ? sum[k] / (node.end - node.begin) : 0.0;
+					continue;
+				}
+				for (int32_t c = node.child; c < node.child + node.children; c++)
+				{
+					const Node& child = myNodes[c];
+					node.mass += child.mass;
+					for (int k = 0; k < 3; k++)
+						sum[k] += child.mass * child.center[k];
+				}
+				for (int k = 0; k < 3; k++)
+					node.center[k] = node.mass > 0.0 ? sum[k] / node.mass : 0.0;
+			}
+		}, 256);
+	}
+}
+
+void
+BarnesHut::computeForces()
+{
+	const int32_t n = mySettings.count;
+	const double mass = n > 0 ? mySettings.mass / n : 0.0;
+	const double eps2 = mySettings.softening * mySettings.softening;
+	const double theta2 = std::max(mySettings.theta, 0.0) * std::max(mySettings.theta, 0.0);
+
+	std::mutex lock;
+	double potential = 0.0;
+	int64_t interactions = 0;
+
+	// Neighbouring particles are neighbours in the tree too, so a range of
+	// them walks mostly the same nodes
+	parallelFor(n, [&](int begin, int end)
+	{
+		double localPotential = 0.0;
+		int64_t localInteractions = 0;
+		int32_t stack[8 * (MaxDepth + 1)];
+		for (int32_t i = begin; i < end; i++)
+		{
+			const double* p = &myPos[i * 3];
+			double a[3] = { 0.0, 0.0, 0.0 };
+			double phi = 0.0;
+
+			// Plummer softened point mass m at offset d
+			auto attract = [&](const double* d, double m)
+			{
+				const double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + eps2;
+				if (r2 <= 0.0)
+					return;
+				const double inv = 1.0 / std::sqrt(r2);
+				const double scale = m * inv * inv * inv;
+				a[0] += scale * d[0];
+				a[1] += scale * d[1];
+				a[2] += scale * d[2];
+				phi -= m * inv;
+			};
+
+			int32_t top = 0;
+			stack[top++] = 0;
+			while (top > 0)
+			{
+				const Node& node = myNodes[stack[--top]];
+				if (node.children == 0)
+				{
+					for (int32_t j = node.begin; j < node.end; j++)
+					{
+						if (j == i)
+							continue;
+						const double d[3] = { myPos[j * 3] - p[0], myPos[j * 3 + 1] - p[1], myPos[j * 3 + 2] - p[2] };
+						attract(d, mass);
+					}
+					localInteractions += node.end - node.begin;
+					continue;
+				}
+
+				const double d[3] = { node.center[0] - p[0], node.center[1] - p[1], node.center[2] - p[2] };
+				const double d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+				if (node.size * node.size < theta2 * d2)
+				{
+					attract(d, node.mass);
+					localInteractions++;
+					continue;
+				}
+				for (int32_t c = node.child; c < node.child + node.children; c++)
+					stack[top++] = c;
+			}
+
+			for (int k = 0; k < 3; k++)
+				myAcc[i * 3 + k] = a[k];
+			// Each pair is counted from both ends
+			localPotential += 0.5 * mass * phi;
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		potential += localPotential;
+		interactions += localInteractions;
+	}, 64);
+
+	myPotential = potential;
+	myInteractions = n > 0 ? double(interactions) / n : 0.0;
+}
+
+void
+BarnesHut::kick(double dt)
+{
+	parallelFor(mySettings.count, [&](int begin, int end)
+	{
+		for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+			myVel[i] += myAcc[i] * dt;
+	}, 4096);
+}
+
+void
+BarnesHut::step(int32_t steps)
+{
+	myBuildTime = 0.0;
+	myForceTime = 0.0;
+	if (mySettings.count == 0 || steps <= 0)
+		return;
+
+	typedef std::chrono::steady_clock Clock;
+	auto elapsed = [](Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	};
+
+	const double dt = mySettings.timestep;
+	double interactions = 0.0;
+	for (int32_t s = 0; s < steps; s++)
+	{
+		kick(0.5 * dt);
+		parallelFor(mySettings.count, [&](int begin, int end)
+		{
+			for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+				myPos[i] += myVel[i] * dt;
+		}, 4096);
+
+		Clock::time_point start = Clock::now();
+		sortParticles();
+		buildTree();
+		myBuildTime += elapsed(start);
+
+		start = Clock::now();
+		computeForces();
+		myForceTime += elapsed(start);
+		interactions += myInteractions;
+
+		kick(0.5 * dt);
+	}
+	myInteractions = interactions / steps;
+	myKinetic = computeKinetic();
+}
@@ -0,0 +1,126 @@
+/*
+ * Self-gravitating particles for the DAT's Gravity mode, with forces from a
+ * Barnes-Hut octree.
+ *
+ * Units have G = 1. The particles share 'mass' equally and start spread
+ * evenly over a ball of 'radius', turning around y at 'spin' times the speed
+ * that would keep them on circles.
+ *
+ * The tree is rebuilt every step as a linear octree: the particles are
+ * sorted by the Morton code of their position in the bounding cube, so every
+ * node is a contiguous range of them, and the nodes are split one level at a
+ * time, in parallel over the nodes of the level. The particles stay in that
+ * order between steps, which keeps the sort nearly sorted and the traversal
+ * of neighbouring particles on the same nodes. ids() maps them back.
+ *
+ * A node whose size seen from the particle is under the opening angle
+ * 'theta' acts as a point mass at its centre of mass, 0 opens every node
+ * and gives the exact sum. Forces are Plummer softened by 'softening'.
+ *
+ * Time integration is kick-drift-kick leapfrog, so the total energy should
+ * only wander by the tree's and the time step's errors. energyDrift() is how
+ * far it has gone since the reset, relative to the energy then.
+ */
+
+#ifndef __BarnesHut__
+#define __BarnesHut__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+struct NBodySettings
+{
+	int32_t		count = 10000;
+	double		radius = 1.0;
+	double		spin = 0.5;
+	double		mass = 1.0;
+	double		theta = 0.5;
+	double		softening = 0.02;
+	double		timestep = 0.001;
+
+	// True if changing from 'other' to these needs new particles
+	bool		needsReset(const NBodySettings& other) const;
+};
+
+class BarnesHut
+{
+public:
+	BarnesHut();
+
+	void			reset(const NBodySettings& settings);
+
+	// Applies new settings, resetting only if the particles changed. A new
+	// softening changes the potential, so the energy drift starts over.
+	void			setSettings(const NBodySettings& settings);
+
+	void			step(int32_t steps);
+
+	int32_t			size() const { return mySettings.count; }
+
+	// 3 doubles per particle, in tree order
+	const double*	positions() const { return myPos.data(); }
+	const double*	velocities() const { return myVel.data(); }
+	// Index each particle had at the reset
+	const int32_t*	ids() const { return myIds.data(); }
+
+	double			kineticEnergy() const { return myKinetic; }
+	double			potentialEnergy() const { return myPotential; }
+	double			energyDrift() const;
+
+	int32_t			treeNodes() const { return static_cast<int32_t>(myNodes.size()); }
+	// Mean nodes and particles each particle interacted with in the last step
+	double			interactions() const { return myInteractions; }
+	// Milliseconds spent building trees and computing forces over the last
+	// step() call
+	double			buildTime() const { return myBuildTime; }
+	double			forceTime() const { return myForceTime; }
+
+private:
+	struct Node
+	{
+		double		center[3];
+		double		mass;
+		// Edge of the node's cube
+		double		size;
+		// Particles [begin, end), children [child, child + children)
+		int32_t		begin;
+		int32_t		end;
+		int32_t		child;
+		int32_t		children;
+	};
+
+	void			sortParticles();
+	void			buildTree();
+	void			computeForces();
+	void			kick(double dt);
+	double			computeKinetic() const;
+
+	NBodySettings			mySettings;
+
+	std::vector<double>		myPos;
+	std::vector<double>		myVel;
+	std::vector<double>		myAcc;
+	std::vector<int32_t>	myIds;
+
+	// Morton code of each particle, sorted along with them
+	std::vector<uint64_t>	myCodes;
+	std::vector<std::pair<uint64_t, int32_t>>	myOrder;
+	std::vector<double>		myScratch;
+	std::vector<int32_t>	myScratchIds;
+	double					myOrigin[3];
+	double					myCube;
+
+	// Nodes level by level, level l being [myLevels[l], myLevels[l + 1])
+	std::vector<Node>		myNodes;
+	std::vector<int32_t>	myLevels;
+
+	double					myKinetic;
+	double					myPotential;
+	double					myInitialEnergy;
+	double					myInteractions;
+	double					myBuildTime;
+	double					myForceTime;
+};
+
+#endif
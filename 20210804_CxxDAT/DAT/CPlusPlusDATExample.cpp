@@ -13,6 +13,7 @@
 */
 
 #include "CPlusPlusDATExample.h"
+#include "ThreadPool.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -64,6 +65,7 @@ CreateDATInstance(const OP_NodeInfo* info)
 {
 	// Return a new instance of your class every time this is called.
 	// It will be called once per DAT that is using the .dll
+	ThreadPool::acquire();
 	return new CPlusPlusDATExample(info);
 }
 
@@ -75,6 +77,7 @@ DestroyDATInstance(DAT_CPlusPlusBase* instance)
 	// Touch is shutting down, when the DAT using that instance is deleted, or
 	// if the DAT loads a different DLL
 	delete (CPlusPlusDATExample*)instance;
+	ThreadPool::release();
 }
 
 };
@@ -158,9 +161,35 @@ CPlusPlusDATExample::initializeVoids()
 	}
 }
 
+void
+CPlusPlusDATExample::findAttractors(const OP_SOPInput* sop)
+{
+	// Position is three packed floats
+	static_assert(sizeof(Position) == 3 * sizeof(float), "Position must be three floats");
+	attractIndex.update(sop->opId, sop->totalCooks,
+						reinterpret_cast<const float*>(sop->getPointPositions()), sop->getNumPoints());
+
+	attractQueries.resize(numVoids * 3);
+	attractNearest.resize(numVoids);
+	attractDistance.resize(numVoids);
+	for (int i = 0; i < numVoids; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+			attractQueries[i * 3 + k] = float(x[i][k]);
+	}
+
+	attractIndex.nearest(attractQueries.data(), numVoids, 1, FLT_MAX,
+						attractNearest.data(), attractDistance.data());
+}
+
 void
 CPlusPlusDATExample::updateVoids()
 {
+	// Every void is pulled towards the nearest point of the Attract SOP, as
+	// it was at the start of this step
+	if (attractSOP)
+		findAttractors(attractSOP);
+	const Position* attractors = attractSOP ? attractSOP->getPointPositions() : nullptr;
 
 	double x_coh[3] = {0.0, 0.0, 0.0};
 	double x_sep[3] = {0.0, 0.0, 0.0};
@@ -262,6 +291,13 @@ CPlusPlusDATExample::updateVoids()
 			v[i][k] += alignmentForce*x_ali[k];
 		}
 
+		if (attractors && attractNearest[i] >= 0)
+		{
+			const float* p = &attractors[attractNearest[i]].x;
+			for (int k = 0; k < 3; ++k)
+				v[i][k] += attractForce*(p[k] - x_this[k]);
+		}
+
 		if (dist_center > 1.0)
 		{
 			for (int k = 0; k < 3; ++k)
@@ -288,6 +324,100 @@ CPlusPlusDATExample::updateVoids()
 	}
 }
 
+void
+CPlusPlusDATExample::executeMolecules(DAT_Output* output, const OP_Inputs* inputs)
+{
+	MDSettings settings;
+	settings.count = inputs->getParInt("Molecules");
+	settings.density = inputs->getParDouble("Density");
+	settings.temperature = inputs->getParDouble("Temperature");
+	settings.timestep = inputs->getParDouble("Timestep");
+	settings.cutoff = inputs->getParDouble("Cutoff");
+	settings.skin = inputs->getParDouble("Skin");
+	settings.thermostatMass = inputs->getParDouble("Thermostatmass");
+
+	if (moleculesReset)
+	{
+		molecules.reset(settings);
+		moleculesReset = false;
+	}
+	else
+	{
+		molecules.setSettings(settings);
+	}
+
+	molecules.step(inputs->getParInt("Steps"));
+
+	const int count = molecules.size();
+	const double* pos = molecules.positions();
+	const double* vel = molecules.velocities();
+
+	output->setOutputDataType(DAT_OutDataType::Table);
+	output->setTableSize(count + 1, 6);
+
+	std::array<const char*, 6> columns = { "tx", "ty", "tz", "vx", "vy", "vz"};
+	for (int j = 0; j < 6; ++j)
+		output->setCellString(0, j, columns[j]);
+
+	// Centered on the origin
+	const double center = 0.5 * molecules.boxSize();
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			output->setCellDouble(i + 1, j, pos[i * 3 + j] - center);
+			output->setCellDouble(i + 1, j + 3, vel[i * 3 + j]);
+		}
+	}
+}
+
+void
+CPlusPlusDATExample::executeGravity(DAT_Output* output, const OP_Inputs* inputs)
+{
+	NBodySettings settings;
+	settings.count = inputs->getParInt("Bodies");
+	settings.radius = inputs->getParDouble("Cloudradius");
+	settings.spin = inputs->getParDouble("Spin");
+	settings.mass = inputs->getParDouble("Totalmass");
+	settings.theta = inputs->getParDouble("Openingangle");
+	settings.softening = inputs->getParDouble("Softening");
+	settings.timestep = inputs->getParDouble("Gravitytimestep");
+
+	if (gravityReset)
+	{
+		gravity.reset(settings);
+		gravityReset = false;
+	}
+	else
+	{
+		gravity.setSettings(settings);
+	}
+
+	gravity.step(inputs->getParInt("Gravitysteps"));
+
+	const int count = gravity.size();
+	const double* pos = gravity.positions();
+	const double* vel = gravity.velocities();
+	const int32_t* ids = gravity.ids();
+
+	output->setOutputDataType(DAT_OutDataType::Table);
+	output->setTableSize(count + 1, 6);
+
+	std::array<const char*, 6> columns = { "tx", "ty", "tz", "vx", "vy", "vz"};
+	for (int j = 0; j < 6; ++j)
+		output->setCellString(0, j, columns[j]);
+
+	// The solver keeps the particles in tree order, rows stay in their own
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			output->setCellDouble(ids[i] + 1, j, pos[i * 3 + j]);
+			output->setCellDouble(ids[i] + 1, j + 3, vel[i * 3 + j]);
+		}
+	}
+}
+
 void
 CPlusPlusDATExample::execute(DAT_Output* output,
 							const OP_Inputs* inputs,
@@ -297,10 +427,54 @@ CPlusPlusDATExample::execute(DAT_Output* output,
 
 	if (!output)
 		return;
-	
-	inputs->enablePar("Voids", 1);
-	inputs->enablePar("Maxvel", 1);
-	inputs->enablePar("Minvel", 1);
+
+	myMode = static_cast<DATMode>(inputs->getParInt("Mode"));
+
+	const bool voids = myMode == DATMode::Voids;
+	inputs->enablePar("Voids", voids);
+	inputs->enablePar("Maxvel", voids);
+	inputs->enablePar("Minvel", voids);
+	inputs->enablePar("Cohforce", voids);
+	inputs->enablePar("Sepforce", voids);
+	inputs->enablePar("Aliforce", voids);
+	inputs->enablePar("Bdrforce", voids);
+	inputs->enablePar("Cohdist", voids);
+	inputs->enablePar("Sepdist", voids);
+	inputs->enablePar("Alidist", voids);
+	inputs->enablePar("Attractsop", voids);
+	inputs->enablePar("Attractforce", voids);
+
+	const bool moleculesMode = myMode == DATMode::Molecules;
+	inputs->enablePar("Molecules", moleculesMode);
+	inputs->enablePar("Density", moleculesMode);
+	inputs->enablePar("Temperature", moleculesMode);
+	inputs->enablePar("Timestep", moleculesMode);
+	inputs->enablePar("Cutoff", moleculesMode);
+	inputs->enablePar("Skin", moleculesMode);
+	inputs->enablePar("Thermostatmass", moleculesMode);
+	inputs->enablePar("Steps", moleculesMode);
+
+	const bool gravityMode = myMode == DATMode::Gravity;
+	inputs->enablePar("Bodies", gravityMode);
+	inputs->enablePar("Cloudradius", gravityMode);
+	inputs->enablePar("Spin", gravityMode);
+	inputs->enablePar("Totalmass", gravityMode);
+	inputs->enablePar("Openingangle", gravityMode);
+	inputs->enablePar("Softening", gravityMode);
+	inputs->enablePar("Gravitytimestep", gravityMode);
+	inputs->enablePar("Gravitysteps", gravityMode);
+
+	if (moleculesMode)
+	{
+		executeMolecules(output, inputs);
+		return;
+	}
+
+	if (gravityMode)
+	{
+		executeGravity(output, inputs);
+		return;
+	}
 
 	int numVoids = inputs->getParInt("Voids");
 	this->maxVelocity = inputs->getParDouble("Maxvel");
@@ -312,6 +486,8 @@ CPlusPlusDATExample::execute(DAT_Output* output,
 	this->cohesionDistance = inputs->getParDouble("Cohdist");
 	this->separationDistance = inputs->getParDouble("Sepdist");
 	this->alignmentDistance = inputs->getParDouble("Alidist");
+	this->attractSOP = inputs->getParSOP("Attractsop");
+	this->attractForce = inputs->getParDouble("Attractforce");
 
 	if (numVoids != this->numVoids) {
 		this->numVoids = numVoids;
@@ -328,7 +504,11 @@ int32_t
 CPlusPlusDATExample::getNumInfoCHOPChans(void* reserved1)
 {
 	// We return the number of channel we want to output to any Info CHOP
-	// connected to the CHOP. In this example we are just going to send one channel.
+	// connected to the CHOP. Molecules and Gravity modes add their own.
+	if (myMode == DATMode::Molecules)
+		return 9;
+	if (myMode == DATMode::Gravity)
+		return 12;
 	return 4;
 }
 
@@ -362,6 +542,90 @@ CPlusPlusDATExample::getInfoCHOPChan(int32_t index,
 		chan->name->setString(myChopChanName.c_str());
 		chan->value = myChopChanVal;
 	}
+
+	if (myMode == DATMode::Molecules)
+	{
+		if (index == 4)
+		{
+			chan->name->setString("temperature");
+			chan->value = (float)molecules.temperature();
+		}
+
+		if (index == 5)
+		{
+			chan->name->setString("kineticEnergy");
+			chan->value = (float)molecules.kineticEnergy();
+		}
+
+		if (index == 6)
+		{
+			chan->name->setString("potentialEnergy");
+			chan->value = (float)molecules.potentialEnergy();
+		}
+
+		if (index == 7)
+		{
+			chan->name->setString("pairsPerStep");
+			chan->value = (float)molecules.pairsPerStep();
+		}
+
+		if (index == 8)
+		{
+			chan->name->setString("neighborListBuilds");
+			chan->value = (float)molecules.listBuilds();
+		}
+	}
+
+	if (myMode == DATMode::Gravity)
+	{
+		if (index == 4)
+		{
+			chan->name->setString("kineticEnergy");
+			chan->value = (float)gravity.kineticEnergy();
+		}
+
+		if (index == 5)
+		{
+			chan->name->setString("potentialEnergy");
+			chan->value = (float)gravity.potentialEnergy();
+		}
+
+		if (index == 6)
+		{
+			chan->name->setString("totalEnergy");
+			chan->value = (float)(gravity.kineticEnergy() + gravity.potentialEnergy());
+		}
+
+		if (index == 7)
+		{
+			chan->name->setString("energyDrift");
+			chan->value = (float)gravity.energyDrift();
+		}
+
+		if (index == 8)
+		{
+			chan->name->setString("treeNodes");
+			chan->value = (float)gravity.treeNodes();
+		}
+
+		if (index == 9)
+		{
+			chan->name->setString("interactionsPerBody");
+			chan->value = (float)gravity.interactions();
+		}
+
+		if (index == 10)
+		{
+			chan->name->setString("buildMs");
+			chan->value = (float)gravity.buildTime();
+		}
+
+		if (index == 11)
+		{
+			chan->name->setString("forceMs");
+			chan->value = (float)gravity.forceTime();
+		}
+	}
 }
 
 bool
@@ -444,6 +708,21 @@ CPlusPlusDATExample::getInfoDATEntries(int32_t index,
 void
 CPlusPlusDATExample::setupParameters(OP_ParameterManager* manager, void* reserved1)
 {
+	// Mode
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Mode";
+		sp.label = "Mode";
+
+		sp.defaultValue = "Voids";
+
+		const char *names[] = { "Voids", "Molecules", "Gravity" };
+		const char *labels[] = { "Voids", "Molecules", "Gravity" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
 
 	// Number of Voids
 	{
@@ -585,6 +864,301 @@ CPlusPlusDATExample::setupParameters(OP_ParameterManager* manager, void* reserve
 		assert(res == OP_ParAppendResult::Success);
 	}
 
+	// Attract SOP
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Attractsop";
+		sp.label = "Attract SOP";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Attract Force
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Attractforce";
+		np.label = "Attract Force";
+		np.defaultValues[0] = 0.01;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Number of Molecules
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Molecules";
+		np.label = "Molecules";
+		np.page = "Molecules";
+		np.defaultValues[0] = 500;
+		np.minValues[0] = 2;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 2;
+		np.maxSliders[0] = 10000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Density, in reduced units
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Density";
+		np.label = "Density";
+		np.page = "Molecules";
+		np.defaultValues[0] = 0.8;
+		np.minValues[0] = 0.01;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.01;
+		np.maxSliders[0] = 1.2;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Thermostat temperature
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Temperature";
+		np.label = "Temperature";
+		np.page = "Molecules";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 3.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Time Step
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Timestep";
+		np.label = "Time Step";
+		np.page = "Molecules";
+		np.defaultValues[0] = 0.005;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.01;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Cutoff of the potential
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cutoff";
+		np.label = "Cutoff";
+		np.page = "Molecules";
+		np.defaultValues[0] = 2.5;
+		np.minValues[0] = 1.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 1.0;
+		np.maxSliders[0] = 4.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Verlet list skin
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Skin";
+		np.label = "Skin";
+		np.page = "Molecules";
+		np.defaultValues[0] = 0.3;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Nose-Hoover thermostat mass
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Thermostatmass";
+		np.label = "Thermostat Mass";
+		np.page = "Molecules";
+		np.defaultValues[0] = 10.0;
+		np.minValues[0] = 0.01;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 100.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Steps per Cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Steps";
+		np.label = "Steps per Cook";
+		np.page = "Molecules";
+		np.defaultValues[0] = 4;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 20;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Number of Bodies
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Bodies";
+		np.label = "Bodies";
+		np.page = "Gravity";
+		np.defaultValues[0] = 10000;
+		np.minValues[0] = 2;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 2;
+		np.maxSliders[0] = 50000;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Radius of the starting ball
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cloudradius";
+		np.label = "Cloud Radius";
+		np.page = "Gravity";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.001;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Starting spin, 1 is circular orbits
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Spin";
+		np.label = "Spin";
+		np.page = "Gravity";
+		np.defaultValues[0] = 0.5;
+		np.minSliders[0] = -1.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Mass shared by the bodies
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Totalmass";
+		np.label = "Total Mass";
+		np.page = "Gravity";
+		np.defaultValues[0] = 1.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Opening angle, 0 sums every pair
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Openingangle";
+		np.label = "Opening Angle";
+		np.page = "Gravity";
+		np.defaultValues[0] = 0.5;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.5;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Plummer softening length
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Softening";
+		np.label = "Softening";
+		np.page = "Gravity";
+		np.defaultValues[0] = 0.02;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.2;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Time Step
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Gravitytimestep";
+		np.label = "Time Step";
+		np.page = "Gravity";
+		np.defaultValues[0] = 0.001;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.01;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Steps per Cook
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Gravitysteps";
+		np.label = "Steps per Cook";
+		np.page = "Gravity";
+		np.defaultValues[0] = 1;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 20;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
 	// pulse
 	{
 		OP_NumericParameter	np;
@@ -603,5 +1177,7 @@ CPlusPlusDATExample::pulsePressed(const char* name, void* reserved1)
 	if (!strcmp(name, "Reset"))
 	{
 		myOffset = 0.0;
+		moleculesReset = true;
+		gravityReset = true;
 	}
 }
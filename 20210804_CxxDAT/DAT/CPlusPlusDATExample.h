@@ -13,13 +13,32 @@
 */
 
 #include "DAT_CPlusPlusBase.h"
+#include "PointIndex.h"
+#include "MolecularDynamics.h"
+#include "BarnesHut.h"
 #include <string>
+#include <vector>
 
 /*
  This is a basic sample project to represent the usage of CPlusPlus DAT API.
  To get more help about these functions, look at DAT_CPlusPlusBase.h
+
+ The Mode menu picks what the table holds. Voids is a flock of boids.
+ Molecules is a Lennard-Jones fluid (see MolecularDynamics.h) advanced
+ Steps per Cook steps every cook, whose temperature, energies and pair count
+ go to the Info CHOP.
+ Gravity is a self-gravitating cloud (see BarnesHut.h) with forces from an
+ octree, its energies, energy drift and timings going to the Info CHOP. Rows
+ keep the particle order whatever the tree does.
 */
 
+enum class DATMode
+{
+	Voids = 0,
+	Molecules,
+	Gravity,
+};
+
 class CPlusPlusDATExample : public DAT_CPlusPlusBase
 {
 public:
@@ -54,6 +73,11 @@ private:
 
 	void                initializeVoids();
 	void                updateVoids();
+	// Finds the Attract SOP point nearest to every void
+	void                findAttractors(const OP_SOPInput* sop);
+
+	void                executeMolecules(DAT_Output* output, const OP_Inputs* inputs);
+	void                executeGravity(DAT_Output* output, const OP_Inputs* inputs);
 
 	// We don't need to store this pointer, but we do for the example.
 	// The OP_NodeInfo class store information about the node that's using
@@ -98,5 +122,21 @@ private:
 	const double alignmentAngle = PI/3.0;
 	
 	int numVoids = 0;
+
+	// Points of the Attract SOP, indexed once per SOP cook
+	PointIndex          attractIndex;
+	const OP_SOPInput*  attractSOP = nullptr;
+	double              attractForce = 0.0;
+	std::vector<float>  attractQueries;
+	std::vector<int32_t> attractNearest;
+	std::vector<float>  attractDistance;
+
+	DATMode             myMode = DATMode::Voids;
+
+	MolecularDynamics   molecules;
+	bool                moleculesReset = true;
+
+	BarnesHut           gravity;
+	bool                gravityReset = true;
 	
 };
@@ -0,0 +1,389 @@
+/*
+ * See MolecularDynamics.h
+ */
+
+#include "MolecularDynamics.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+// Sums fn(begin, end) over parallel ranges of [0, count)
+template <typename F>
+static double
+parallelSum(int count, F&& fn, int minPerTask)
+{
+	std::mutex lock;
+	double total = 0.0;
+	parallelFor(count, [&](int begin, int end)
+	{
+		const double partial = fn(begin, end);
+		std::lock_guard<std::mutex> guard(lock);
+		total += partial;
+	}, minPerTask);
+	return total;
+}
+
+bool
+MDSettings::needsReset(const MDSettings& other) const
+{
+	return count != other.count || density != other.density;
+}
+
+MolecularDynamics::MolecularDynamics() :
+	myBox(0.0),
+	myCutoff(0.0),
+	mySkin(0.0),
+	myXi(0.0),
+	myCellsPerAxis(1),
+	myListBuilds(0),
+	myKinetic(0.0),
+	myPotential(0.0),
+	myPairs(0)
+{
+	mySettings.count = 0;
+}
+
+void
+MolecularDynamics::reset(const MDSettings& settings)
+{
+	mySettings = settings;
+	mySettings.count = std::max(settings.count, 0);
+	mySettings.density = std::max(settings.density, 1e-3);
+
+	const int32_t n = mySettings.count;
+	myBox = std::cbrt(n / mySettings.density);
+	myXi = 0.0;
+	myPos.assign(static_cast<size_t>(n) * 3, 0.0);
+	myVel.assign(static_cast<size_t>(n) * 3, 0.0);
+	myForce.assign(static_cast<size_t>(n) * 3, 0.0);
+
+	// Simple cubic lattice with just enough sites per axis
+	int32_t perAxis = 1;
+	while (perAxis * perAxis * perAxis < n)
+		perAxis++;
+	const double spacing = myBox / perAxis;
+	for (int32_t i = 0; i < n; i++)
+	{
+		myPos[i * 3 + 0] = (i % perAxis + 0.5) * spacing;
+		myPos[i * 3 + 1] = ((i / perAxis) % perAxis + 0.5) * spacing;
+		myPos[i * 3 + 2] = (i / (perAxis * perAxis) + 0.5) * spacing;
+	}
+
+	// Maxwell-Boltzmann velocities without drift, scaled to the exact
+	// temperature
+	std::mt19937 mt{ std::random_device{}() };
+	std::normal_distribution<double> dist(0.0, 1.0);
+	double drift[3] = { 0.0, 0.0, 0.0 };
+	for (int32_t i = 0; i < n; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			myVel[i * 3 + k] = dist(mt);
+			drift[k] += myVel[i * 3 + k] / n;
+		}
+	}
+	for (int32_t i = 0; i < n; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			myVel[i * 3 + k] -= drift[k];
+	}
+
+	const double current = n > 1 ? 2.0 * computeKinetic(myVel) / (3.0 * n - 3.0) : 0.0;
+	const double scale = current > 0.0 ? std::sqrt(mySettings.temperature / current) : 0.0;
+	for (double& v : myVel)
+		v *= scale;
+
+	updateRanges();
+	buildLists();
+	computeForces();
+	myKinetic = computeKinetic(myVel);
+}
+
+void
+MolecularDynamics::setSettings(const MDSettings& settings)
+{
+	if (settings.needsReset(mySettings))
+	{
+		reset(settings);
+		return;
+	}
+
+	const bool ranges = settings.cutoff != mySettings.cutoff || settings.skin != mySettings.skin;
+	mySettings = settings;
+	if (ranges)
+	{
+		updateRanges();
+		buildLists();
+		computeForces();
+	}
+}
+
+void
+MolecularDynamics::updateRanges()
+{
+	const double half = 0.5 * myBox;
+	myCutoff = std::min(std::max(mySettings.cutoff, 0.0), half);
+	mySkin = std::min(std::max(mySettings.skin, 0.0), half - myCutoff);
+
+	// With fewer than 3 cells per axis the neighbouring cells would repeat,
+	// so everything goes in one cell instead
+	const double range = myCutoff + mySkin;
+	myCellsPerAxis = range > 0.0 ? static_cast<int32_t>(myBox / range) : 1;
+	if (myCellsPerAxis < 3)
+		myCellsPerAxis = 1;
+}
+
+double
+MolecularDynamics::wrapDelta(double d) const
+{
+	return d - myBox * std::floor(d / myBox + 0.5);
+}
+
+double
+MolecularDynamics::temperature() const
+{
+	const int32_t n = mySettings.count;
+	return n > 1 ? 2.0 * myKinetic / (3.0 * n - 3.0) : 0.0;
+}
+
+double
+MolecularDynamics::computeKinetic(const std::vector<double>& vel) const
+{
+	return parallelSum(mySettings.count, [&](int begin, int end)
+	{
+		double sum = 0.0;
+		for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+			sum += vel[i] * vel[i];
+		return 0.5 * sum;
+	}, 4096);
+}
+
+bool
+MolecularDynamics::needsListBuild() const
+{
+	const double limit2 = 0.25 * mySkin * mySkin;
+	std::atomic<bool> moved(false);
+	parallelFor(mySettings.count, [&](int begin, int end)
+	{
+		for (int i = begin; i < end && !moved; i++)
+		{
+			double d2 = 0.0;
+			for (int k = 0; k < 3; k++)
+			{
+				const double d = wrapDelta(myPos[i * 3 + k] - myListPos[i * 3 + k]);
+				d2 += d * d;
+			}
+			if (d2 > limit2)
+				moved = true;
+		}
+	}, 4096);
+	return moved;
+}
+
+void
+MolecularDynamics::buildLists()
+{
+	const int32_t n = mySettings.count;
+	const int32_t perAxis = myCellsPerAxis;
+	const int32_t numCells = perAxis * perAxis * perAxis;
+	myListBuilds++;
+
+	// Counting sort of the particles into cells
+	myParticleCell.resize(n);
+	myCellStart.assign(static_cast<size_t>(numCells) + 1, 0);
+	for (int32_t i = 0; i < n; i++)
+	{
+		int32_t c[3];
+		for (int k = 0; k < 3; k++)
+		{
+			c[k] = static_cast<int32_t>(myPos[i * 3 + k] / myBox * perAxis);
+			c[k] = std::min(std::max(c[k], 0), perAxis - 1);
+		}
+		myParticleCell[i] = (c[2] * perAxis + c[1]) * perAxis + c[0];
+		myCellStart[myParticleCell[i] + 1]++;
+	}
+	for (int32_t c = 0; c < numCells; c++)
+		myCellStart[c + 1] += myCellStart[c];
+
+	myCellParticles.resize(n);
+	{
+		std::vector<int32_t> fill(myCellStart.begin(), myCellStart.end() - 1);
+		for (int32_t i = 0; i < n; i++)
+			myCellParticles[fill[myParticleCell[i]]++] = i;
+	}
+
+	const double range2 = (myCutoff + mySkin) * (myCutoff + mySkin);
+	const int32_t reach = perAxis > 1 ? 1 : 0;
+
+	// Calls fn(j) for every particle within range of particle i
+	auto forNeighbors = [&](int32_t i, int32_t cell, auto&& fn)
+	{
+		const int32_t cx = cell % perAxis;
+		const int32_t cy = (cell / perAxis) % perAxis;
+		const int32_t cz = cell / (perAxis * perAxis);
+		const double* p = &myPos[i * 3];
+		for (int32_t dz = -reach; dz <= reach; dz++)
+		for (int32_t dy = -reach; dy <= reach; dy++)
+		for (int32_t dx = -reach; dx <= reach; dx++)
+		{
+			const int32_t other = ((((cz + dz + perAxis) % perAxis) * perAxis +
+									(cy + dy + perAxis) % perAxis) * perAxis +
+									(cx + dx + perAxis) % perAxis);
+			for (int32_t s = myCellStart[other]; s < myCellStart[other + 1]; s++)
+			{
+				const int32_t j = myCellParticles[s];
+				if (j == i)
+					continue;
+				const double* q = &myPos[j * 3];
+				const double x = wrapDelta(q[0] - p[0]);
+				const double y = wrapDelta(q[1] - p[1]);
+				const double z = wrapDelta(q[2] - p[2]);
+				if (x * x + y * y + z * z < range2)
+					fn(j);
+			}
+		}
+	};
+
+	// Count, then fill, one cell per task
+	myNeighborStart.assign(static_cast<size_t>(n) + 1, 0);
+	parallelFor(numCells, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			for (int32_t s = myCellStart[c]; s < myCellStart[c + 1]; s++)
+			{
+				const int32_t i = myCellParticles[s];
+				int32_t count = 0;
+				forNeighbors(i, c, [&](int32_t) { count++; });
+				myNeighborStart[i + 1] = count;
+			}
+		}
+	});
+	for (int32_t i = 0; i < n; i++)
+		myNeighborStart[i + 1] += myNeighborStart[i];
+
+	myNeighbors.resize(myNeighborStart[n]);
+	parallelFor(numCells, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			for (int32_t s = myCellStart[c]; s < myCellStart[c + 1]; s++)
+			{
+				const int32_t i = myCellParticles[s];
+				int32_t* out = &myNeighbors[myNeighborStart[i]];
+				forNeighbors(i, c, [&](int32_t j) { *out++ = j; });
+			}
+		}
+	});
+
+	myListPos = myPos;
+}
+
+void
+MolecularDynamics::computeForces()
+{
+	const int32_t numCells = static_cast<int32_t>(myCellStart.size()) - 1;
+	const double cutoff2 = myCutoff * myCutoff;
+	const double inv6 = cutoff2 > 0.0 ? 1.0 / (cutoff2 * cutoff2 * cutoff2) : 0.0;
+	const double shift = 4.0 * (inv6 * inv6 - inv6);
+
+	std::mutex lock;
+	double potential = 0.0;
+	int64_t pairs = 0;
+
+	parallelFor(numCells, [&](int begin, int end)
+	{
+		double localPotential = 0.0;
+		int64_t localPairs = 0;
+		for (int c = begin; c < end; c++)
+		{
+			for (int32_t s = myCellStart[c]; s < myCellStart[c + 1]; s++)
+			{
+				const int32_t i = myCellParticles[s];
+				const double* p = &myPos[i * 3];
+				double f[3] = { 0.0, 0.0, 0.0 };
+
+				for (int32_t e = myNeighborStart[i]; e < myNeighborStart[i + 1]; e++)
+				{
+					const double* q = &myPos[myNeighbors[e] * 3];
+					const double x = wrapDelta(p[0] - q[0]);
+					const double y = wrapDelta(p[1] - q[1]);
+					const double z = wrapDelta(p[2] - q[2]);
+					const double r2 = x * x + y * y + z * z;
+					if (r2 >= cutoff2 || r2 <= 0.0)
+						continue;
+
+					const double ir2 = 1.0 / r2;
+					const double ir6 = ir2 * ir2 * ir2;
+					const double scale = 24.0 * ir2 * ir6 * (2.0 * ir6 - 1.0);
+					f[0] += scale * x;
+					f[1] += scale * y;
+					f[2] += scale * z;
+
+					// Each pair is visited from both ends
+					localPotential += 0.5 * (4.0 * (ir6 * ir6 - ir6) - shift);
+					localPairs++;
+				}
+
+				myForce[i * 3 + 0] = f[0];
+				myForce[i * 3 + 1] = f[1];
+				myForce[i * 3 + 2] = f[2];
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		potential += localPotential;
+		pairs += localPairs;
+	});
+
+	myPotential = potential;
+	myPairs = pairs / 2;
+}
+
+void
+MolecularDynamics::step(int32_t steps)
+{
+	const int32_t n = mySettings.count;
+	if (n == 0)
+		return;
+
+	const double dt = mySettings.timestep;
+	const double halfDt = 0.5 * dt;
+	const double target = (3.0 * n - 3.0) * mySettings.temperature;
+	const double mass = std::max(mySettings.thermostatMass, 1e-6);
+
+	for (int32_t s = 0; s < steps; s++)
+	{
+		// Half kick with the thermostat friction, then drift
+		myXi += halfDt / mass * (2.0 * myKinetic - target);
+		const double xi = myXi;
+		parallelFor(n, [&](int begin, int end)
+		{
+			for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+			{
+				myVel[i] += halfDt * (myForce[i] - xi * myVel[i]);
+				const double x = myPos[i] + dt * myVel[i];
+				myPos[i] = x - myBox * std::floor(x / myBox);
+			}
+		}, 4096);
+
+		if (needsListBuild())
+			buildLists();
+		computeForces();
+
+		// Second half kick, implicit in the friction
+		myXi += halfDt / mass * (2.0 * computeKinetic(myVel) - target);
+		const double damping = 1.0 / (1.0 + halfDt * myXi);
+		parallelFor(n, [&](int begin, int end)
+		{
+			for (size_t i = static_cast<size_t>(begin) * 3; i < static_cast<size_t>(end) * 3; i++)
+				myVel[i] = (myVel[i] + halfDt * myForce[i]) * damping;
+		}, 4096);
+
+		myKinetic = computeKinetic(myVel);
+	}
+}
@@ -0,0 +1,113 @@
+/*
+ * Lennard-Jones molecular dynamics in a periodic cube, for the DAT's
+ * Molecules mode.
+ *
+ * Everything is in reduced units: sigma, epsilon, the particle mass and
+ * Boltzmann's constant are 1. The potential is cut off at 'cutoff' and
+ * shifted so it is 0 there.
+ *
+ * Particles are binned into cells at least cutoff + skin wide, and each gets
+ * a Verlet list of the particles within cutoff + skin from the neighbouring
+ * cells. The lists are only rebuilt once some particle moved more than half
+ * the skin since the last build. Lists are full (every pair is stored in both
+ * particles' lists) so forces can be computed one cell per task without two
+ * threads writing the same particle.
+ *
+ * Time integration is velocity Verlet with a Nose-Hoover thermostat holding
+ * the temperature at 'temperature'.
+ */
+
+#ifndef __MolecularDynamics__
+#define __MolecularDynamics__
+
+#include <stdint.h>
+#include <vector>
+
+struct MDSettings
+{
+	int32_t		count = 500;
+	// Particles per unit volume, sets the box size
+	double		density = 0.8;
+	double		temperature = 1.0;
+	double		timestep = 0.005;
+	double		cutoff = 2.5;
+	double		skin = 0.3;
+	// Nose-Hoover thermostat mass, larger couples more loosely
+	double		thermostatMass = 10.0;
+
+	// True if changing from 'other' to these needs a new lattice
+	bool		needsReset(const MDSettings& other) const;
+};
+
+class MolecularDynamics
+{
+public:
+	MolecularDynamics();
+
+	// Puts the particles on a cubic lattice with random velocities at the
+	// settings' temperature
+	void			reset(const MDSettings& settings);
+
+	// Applies new settings, resetting only if the count or density changed
+	void			setSettings(const MDSettings& settings);
+
+	void			step(int32_t steps);
+
+	int32_t			size() const { return mySettings.count; }
+	double			boxSize() const { return myBox; }
+
+	// 3 doubles per particle. Positions are wrapped into [0, boxSize).
+	const double*	positions() const { return myPos.data(); }
+	const double*	velocities() const { return myVel.data(); }
+
+	double			temperature() const;
+	double			kineticEnergy() const { return myKinetic; }
+	double			potentialEnergy() const { return myPotential; }
+	// Pairs within the cutoff in the last step
+	int64_t			pairsPerStep() const { return myPairs; }
+	int64_t			listBuilds() const { return myListBuilds; }
+
+private:
+	// Cutoff and skin limited to half the box, for the minimum image
+	void			updateRanges();
+
+	bool			needsListBuild() const;
+	void			buildLists();
+	void			computeForces();
+	double			computeKinetic(const std::vector<double>& vel) const;
+
+	// Wraps a difference of positions to the nearest periodic image
+	double			wrapDelta(double d) const;
+
+	MDSettings				mySettings;
+	double					myBox;
+	double					myCutoff;
+	double					mySkin;
+	// Nose-Hoover friction
+	double					myXi;
+
+	std::vector<double>		myPos;
+	std::vector<double>		myVel;
+	std::vector<double>		myForce;
+
+	// Cells per axis, and the particles of each cell as cellStart offsets
+	// into cellParticles
+	int32_t					myCellsPerAxis;
+	std::vector<int32_t>	myCellStart;
+	std::vector<int32_t>	myCellParticles;
+	std::vector<int32_t>	myParticleCell;
+
+	// Verlet lists, particle i's neighbours are
+	// myNeighbors[myNeighborStart[i] .. myNeighborStart[i + 1] - 1]
+	std::vector<int32_t>	myNeighborStart;
+	std::vector<int32_t>	myNeighbors;
+	// Positions at the last list build
+	std::vector<double>		myListPos;
+	int64_t					myListBuilds;
+
+	double					myKinetic;
+	double					myPotential;
+	int64_t					myPairs;
+};
+
+#endif
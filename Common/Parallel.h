@@ -0,0 +1,65 @@
+/*
+ * Small helpers for splitting CPU work across threads inside a cook.
+ *
+ * parallelFor() hands out contiguous [begin, end) ranges so callers can keep
+ * per-range scratch state on the stack. The ranges run on the plugin's
+ * shared ThreadPool (see ThreadPool.h) rather than threads of their own. The
+ * calling thread always runs the first range itself, so a single-range loop
+ * never touches another thread, and while the others run it helps with
+ * whatever is queued.
+ */
+
+#ifndef __Parallel__
+#define __Parallel__
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+inline int
+parallelWorkerCount()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? static_cast<int>(n) : 1;
+}
+
+// Calls fn(begin, end) for contiguous ranges covering [0, count).
+// At most parallelWorkerCount() ranges are used, and no range is smaller
+// than minPerTask items (except the last one). Without a running pool it's
+// a single fn(0, count).
+template <typename F>
+void
+parallelFor(int count, F&& fn, int minPerTask = 1, TaskPriority priority = TaskPriority::Normal)
+{
+	if (count <= 0)
+		return;
+
+	int tasks = std::min(parallelWorkerCount(), (count + minPerTask - 1) / std::max(minPerTask, 1));
+	tasks = std::max(tasks, 1);
+
+	if (tasks == 1 || ThreadPool::workers() == 0)
+	{
+		fn(0, count);
+		return;
+	}
+
+	int perTask = (count + tasks - 1) / tasks;
+
+	TaskCounter counter;
+	for (int t = 1; t < tasks; t++)
+	{
+		int begin = t * perTask;
+		int end = std::min(count, begin + perTask);
+		if (begin >= end)
+			break;
+		ThreadPool::submit([&fn, begin, end]() { fn(begin, end); }, priority, counter);
+	}
+
+	fn(0, std::min(count, perTask));
+
+	ThreadPool::wait(counter);
+}
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * See PointIndex.h
+ */
+
+#include "PointIndex.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+
+// Ranges are split on the calling thread down to this many per worker, then
+// the subtrees are built in parallel
+static const int32_t RangesPerWorker = 4;
+
+PointIndex::PointIndex() :
+	myCount(0),
+	mySourceId(0),
+	mySourceCooks(-1),
+	myBuilds(0),
+	myInput(nullptr)
+{
+}
+
+bool
+PointIndex::update(uint32_t sourceId, int64_t sourceCooks, const float* xyz, int32_t count)
+{
+	if (sourceId == mySourceId && sourceCooks == mySourceCooks && count == myCount)
+		return false;
+
+	mySourceId = sourceId;
+	mySourceCooks = sourceCooks;
+	build(xyz, count);
+	return true;
+}
+
+void
+PointIndex::splitRange(int32_t begin, int32_t end)
+{
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int32_t i = begin; i < end; i++)
+	{
+		const float* p = myInput + static_cast<size_t>(myOrder[i]) * 3;
+		for (int a = 0; a < 3; a++)
+		{
+			lo[a] = std::min(lo[a], p[a]);
+			hi[a] = std::max(hi[a], p[a]);
+		}
+	}
+
+	int32_t axis = 0;
+	for (int a = 1; a < 3; a++)
+	{
+		if (hi[a] - lo[a] > hi[axis] - lo[axis])
+			axis = a;
+	}
+
+	const int32_t mid = (begin + end) / 2;
+	const float* input = myInput;
+	std::nth_element(myOrder.begin() + begin, myOrder.begin() + mid, myOrder.begin() + end,
+		[input, axis](int32_t a, int32_t b)
+		{
+			return input[static_cast<size_t>(a) * 3 + axis] < input[static_cast<size_t>(b) * 3 + axis];
+		});
+	myAxes[mid] = static_cast<uint8_t>(axis);
+}
+
+void
+PointIndex::buildRange(int32_t begin, int32_t end)
+{
+	if (end - begin <= LeafSize)
+		return;
+
+	splitRange(begin, end);
+	const int32_t mid = (begin + end) / 2;
+	buildRange(begin, mid);
+	buildRange(mid + 1, end);
+}
+
+void
+PointIndex::build(const float* xyz, int32_t count)
+{
+	myCount = std::max(0, count);
+	myBuilds++;
+	myInput = xyz;
+
+	myOrder.resize(myCount);
+	for (int32_t i = 0; i < myCount; i++)
+		myOrder[i] = i;
+	myAxes.assign(myCount, 0);
+
+	// Split breadth first until there are enough independent ranges to keep
+	// every worker busy
+	std::vector<std::pair<int32_t, int32_t>> ranges(1, std::make_pair(0, myCount));
+	const size_t wanted = static_cast<size_t>(parallelWorkerCount()) * RangesPerWorker;
+	while (ranges.size() < wanted)
+	{
+		std::vector<std::pair<int32_t, int32_t>> next;
+		for (const auto& r : ranges)
+		{
+			if (r.second - r.first <= LeafSize)
+			{
+				next.push_back(r);
+				continue;
+			}
+			splitRange(r.first, r.second);
+			const int32_t mid = (r.first + r.second) / 2;
+			next.emplace_back(r.first, mid);
+			next.emplace_back(mid + 1, r.second);
+		}
+		if (next.size() == ranges.size())
+			break;
+		ranges.swap(next);
+	}
+
+	parallelFor(static_cast<int>(ranges.size()), [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			buildRange(ranges[i].first, ranges[i].second);
+	});
+
+	// Gather the positions in tree order so queries walk contiguous memory
+	myPoints.resize(static_cast<size_t>(myCount) * 3);
+	parallelFor(myCount, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const float* p = xyz + static_cast<size_t>(myOrder[i]) * 3;
+			myPoints[i * 3 + 0] = p[0];
+			myPoints[i * 3 + 1] = p[1];
+			myPoints[i * 3 + 2] = p[2];
+		}
+	}, 4096);
+
+	myInput = nullptr;
+}
+
+static inline float
+distance2(const float* a, const float* b)
+{
+	const float dx = a[0] - b[0];
+	const float dy = a[1] - b[1];
+	const float dz = a[2] - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// Inserts into the sorted list of the 'found' nearest so far, capped at 'k'
+static inline void
+insertNearest(int32_t index, float d2, int32_t k, int32_t* indices, float* dist2, int32_t& found, float& worst)
+{
+	int32_t i = found < k ? found++ : k - 1;
+	while (i > 0 && dist2[i - 1] > d2)
+	{
+		dist2[i] = dist2[i - 1];
+		indices[i] = indices[i - 1];
+		i--;
+	}
+	dist2[i] = d2;
+	indices[i] = index;
+	if (found == k)
+		worst = dist2[k - 1];
+}
+
+void
+PointIndex::searchNearest(int32_t begin, int32_t end, const float* q, int32_t k,
+						int32_t* indices, float* dist2, int32_t& found, float& worst) const
+{
+	if (end - begin <= LeafSize)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			const float d2 = distance2(q, &myPoints[i * 3]);
+			if (d2 < worst)
+				insertNearest(myOrder[i], d2, k, indices, dist2, found, worst);
+		}
+		return;
+	}
+
+	const int32_t mid = (begin + end) / 2;
+	const int32_t axis = myAxes[mid];
+	const float diff = q[axis] - coord(mid, axis);
+
+	const float d2 = distance2(q, &myPoints[mid * 3]);
+	if (d2 < worst)
+		insertNearest(myOrder[mid], d2, k, indices, dist2, found, worst);
+
+	if (diff < 0.0f)
+	{
+		searchNearest(begin, mid, q, k, indices, dist2, found, worst);
+		if (diff * diff < worst)
+			searchNearest(mid + 1, end, q, k, indices, dist2, found, worst);
+	}
+	else
+	{
+		searchNearest(mid + 1, end, q, k, indices, dist2, found, worst);
+		if (diff * diff < worst)
+			searchNearest(begin, mid, q, k, indices, dist2, found, worst);
+	}
+}
+
+void
+PointIndex::nearest(const float* queries, int32_t count, int32_t k, float maxDistance,
+					int32_t* indices, float* distances) const
+{
+	if (k <= 0)
+		return;
+
+	const float maxDist2 = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+
+	parallelFor(count, [&](int begin, int end)
+	{
+		for (int q = begin; q < end; q++)
+		{
+			int32_t* idx = indices + static_cast<size_t>(q) * k;
+			float* dist = distances + static_cast<size_t>(q) * k;
+
+			int32_t found = 0;
+			float worst = maxDist2;
+			if (myCount > 0)
+				searchNearest(0, myCount, queries + static_cast<size_t>(q) * 3, k, idx, dist, found, worst);
+
+			for (int32_t i = 0; i < found; i++)
+				dist[i] = std::sqrt(dist[i]);
+			for (int32_t i = found; i < k; i++)
+			{
+				idx[i] = -1;
+				dist[i] = 0.0f;
+			}
+		}
+	}, 64);
+}
+
+void
+PointIndex::searchRadius(int32_t begin, int32_t end, const float* q, float radius2,
+						std::vector<int32_t>& out) const
+{
+	if (end - begin <= LeafSize)
+	{
+		for (int32_t i = begin; i < end; i++)
+		{
+			if (distance2(q, &myPoints[i * 3]) <= radius2)
+				out.push_back(myOrder[i]);
+		}
+		return;
+	}
+
+	const int32_t mid = (begin + end) / 2;
+	const int32_t axis = myAxes[mid];
+	const float diff = q[axis] - coord(mid, axis);
+
+	if (distance2(q, &myPoints[mid * 3]) <= radius2)
+		out.push_back(myOrder[mid]);
+
+	if (diff <= 0.0f || diff * diff <= radius2)
+		searchRadius(begin, mid, q, radius2, out);
+	if (diff >= 0.0f || diff * diff <= radius2)
+		searchRadius(mid + 1, end, q, radius2, out);
+}
+
+void
+PointIndex::radius(const float* queries, int32_t count, float radius, PointRadiusResult& result) const
+{
+	const int32_t partitions = parallelWorkerCount();
+	result.partitions.resize(partitions);
+	result.counts.resize(count);
+
+	const float radius2 = radius * radius;
+
+	// Each partition owns a contiguous run of queries and gathers their
+	// results in its own buffer
+	parallelFor(partitions, [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			std::vector<int32_t>& out = result.partitions[p];
+			out.clear();
+
+			const int32_t q0 = static_cast<int32_t>(static_cast<int64_t>(count) * p / partitions);
+			const int32_t q1 = static_cast<int32_t>(static_cast<int64_t>(count) * (p + 1) / partitions);
+			for (int32_t q = q0; q < q1; q++)
+			{
+				const size_t before = out.size();
+				if (myCount > 0)
+					searchRadius(0, myCount, queries + static_cast<size_t>(q) * 3, radius2, out);
+				result.counts[q] = static_cast<int32_t>(out.size() - before);
+			}
+		}
+	});
+
+	result.offsets.resize(static_cast<size_t>(count) + 1);
+	result.offsets[0] = 0;
+	for (int32_t q = 0; q < count; q++)
+		result.offsets[q + 1] = result.offsets[q] + result.counts[q];
+
+	result.indices.resize(result.offsets[count]);
+	parallelFor(partitions, [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			const int32_t q0 = static_cast<int32_t>(static_cast<int64_t>(count) * p / partitions);
+			std::copy(result.partitions[p].begin(), result.partitions[p].end(),
+					result.indices.begin() + result.offsets[q0]);
+		}
+	});
+}
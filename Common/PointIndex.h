@@ -0,0 +1,90 @@
+/*
+ * k-d tree over a set of 3D points, for batched nearest neighbour and radius
+ * queries from the CHOP and DAT plugins.
+ *
+ * The tree is implicit: the points are reordered so that the median of every
+ * range sits in its middle, with the axis it splits on stored next to it, so
+ * building allocates nothing but the reordered copy and disjoint ranges can
+ * be built on different threads. Ranges of LeafSize points or fewer are
+ * scanned linearly.
+ *
+ * For SOP inputs, update() takes the SOP's opId and totalCooks and only
+ * rebuilds when either changed, so any number of queries in a cook share one
+ * build. Positions are passed as 3 floats per point, which is the layout of
+ * OP_SOPInput::getPointPositions().
+ */
+
+#ifndef __PointIndex__
+#define __PointIndex__
+
+#include <stdint.h>
+#include <vector>
+
+// Result of a batched radius query. Query q found
+// indices[offsets[q]] .. indices[offsets[q + 1] - 1]. Reuse one between
+// calls to keep its buffers.
+struct PointRadiusResult
+{
+	std::vector<int32_t>	offsets;
+	std::vector<int32_t>	indices;
+
+	// Per-thread buffers the results are gathered in
+	std::vector<std::vector<int32_t>>	partitions;
+	std::vector<int32_t>	counts;
+};
+
+class PointIndex
+{
+public:
+	static const int32_t	LeafSize = 8;
+
+	PointIndex();
+
+	// Rebuilds from 'xyz' if 'sourceId' or 'sourceCooks' differ from the
+	// last update. Returns true if it rebuilt.
+	bool			update(uint32_t sourceId, int64_t sourceCooks, const float* xyz, int32_t count);
+
+	// Always rebuilds, e.g. for points that move every cook
+	void			build(const float* xyz, int32_t count);
+
+	int32_t			size() const { return myCount; }
+	int64_t			builds() const { return myBuilds; }
+
+	// For each of the 'count' query points (3 floats each) finds up to 'k'
+	// points within 'maxDistance', nearest first. Writes k indices (into the
+	// points given to build) and distances per query, -1 and 0 where fewer
+	// were found.
+	void			nearest(const float* queries, int32_t count, int32_t k, float maxDistance,
+							int32_t* indices, float* distances) const;
+
+	// Every point within 'radius' of each query point, in no particular order
+	void			radius(const float* queries, int32_t count, float radius, PointRadiusResult& result) const;
+
+private:
+	// Splits [begin, end) at its median along its widest axis
+	void			splitRange(int32_t begin, int32_t end);
+	void			buildRange(int32_t begin, int32_t end);
+
+	void			searchNearest(int32_t begin, int32_t end, const float* q, int32_t k,
+								int32_t* indices, float* dist2, int32_t& found, float& worst) const;
+	void			searchRadius(int32_t begin, int32_t end, const float* q, float radius2,
+								std::vector<int32_t>& out) const;
+
+	float			coord(int32_t slot, int32_t axis) const { return myPoints[slot * 3 + axis]; }
+
+	int32_t					myCount;
+	uint32_t				mySourceId;
+	int64_t					mySourceCooks;
+	int64_t					myBuilds;
+
+	// Input positions while building, the order points are reordered through
+	const float*			myInput;
+	std::vector<int32_t>	myOrder;
+
+	// Points in tree order, their index in the input, and the split axis of
+	// each range's median
+	std::vector<float>		myPoints;
+	std::vector<uint8_t>	myAxes;
+};
+
+#endif
@@ -0,0 +1,503 @@
+/*
+ * See RayCaster.h
+ */
+
+#include "RayCaster.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+
+// SAH bins per split, and the depth past which splits fall back to the median
+// so the traversal stack can't overflow
+static const int	SplitBins = 12;
+static const int32_t	MaxSAHDepth = 64;
+static const int	StackSize = 128;
+
+// Four floats, one per ray of a packet, and a mask over them
+#if SIMD_X86
+
+struct F4
+{
+	__m128	v;
+};
+
+struct M4
+{
+	__m128	v;
+};
+
+static inline F4 splat(float f) { return { _mm_set1_ps(f) }; }
+static inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+static inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+static inline F4 operator*(F4 a, F4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+static inline F4 lmin(F4 a, F4 b) { return { _mm_min_ps(a.v, b.v) }; }
+static inline F4 lmax(F4 a, F4 b) { return { _mm_max_ps(a.v, b.v) }; }
+static inline F4 lrcp(F4 a) { return { _mm_div_ps(_mm_set1_ps(1.0f), a.v) }; }
+static inline F4 labs(F4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+static inline M4 operator<(F4 a, F4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+static inline M4 operator<=(F4 a, F4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+static inline M4 operator>(F4 a, F4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+static inline M4 operator>=(F4 a, F4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+static inline M4 operator&(M4 a, M4 b) { return { _mm_and_ps(a.v, b.v) }; }
+static inline F4 select(M4 m, F4 a, F4 b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+static inline int bits(M4 m) { return _mm_movemask_ps(m.v); }
+static inline float lane(F4 a, int i) { alignas(16) float f[4]; _mm_store_ps(f, a.v); return f[i]; }
+
+#else
+
+struct F4
+{
+	float	v[4];
+};
+
+struct M4
+{
+	bool	v[4];
+};
+
+#define LANES(expr) { for (int i = 0; i < 4; i++) r.v[i] = (expr); } return r;
+
+static inline F4 splat(float f) { F4 r; LANES(f) }
+static inline F4 operator+(F4 a, F4 b) { F4 r; LANES(a.v[i] + b.v[i]) }
+static inline F4 operator-(F4 a, F4 b) { F4 r; LANES(a.v[i] - b.v[i]) }
+static inline F4 operator*(F4 a, F4 b) { F4 r; LANES(a.v[i] * b.v[i]) }
+static inline F4 lmin(F4 a, F4 b) { F4 r; LANES(std::min(a.v[i], b.v[i])) }
+static inline F4 lmax(F4 a, F4 b) { F4 r; LANES(std::max(a.v[i], b.v[i])) }
+static inline F4 lrcp(F4 a) { F4 r; LANES(1.0f / a.v[i]) }
+static inline F4 labs(F4 a) { F4 r; LANES(std::fabs(a.v[i])) }
+static inline M4 operator<(F4 a, F4 b) { M4 r; LANES(a.v[i] < b.v[i]) }
+static inline M4 operator<=(F4 a, F4 b) { M4 r; LANES(a.v[i] <= b.v[i]) }
+static inline M4 operator>(F4 a, F4 b) { M4 r; LANES(a.v[i] > b.v[i]) }
+static inline M4 operator>=(F4 a, F4 b) { M4 r; LANES(a.v[i] >= b.v[i]) }
+static inline M4 operator&(M4 a, M4 b) { M4 r; LANES(a.v[i] && b.v[i]) }
+static inline F4 select(M4 m, F4 a, F4 b) { F4 r; LANES(m.v[i] ? a.v[i] : b.v[i]) }
+static inline int bits(M4 m) { return m.v[0] | (m.v[1] << 1) | (m.v[2] << 2) | (m.v[3] << 3); }
+static inline float lane(F4 a, int i) { return a.v[i]; }
+
+#undef LANES
+
+#endif
+
+static inline F4
+load4(const float v[4])
+{
+#if SIMD_X86
+	return { _mm_loadu_ps(v) };
+#else
+	return { { v[0], v[1], v[2], v[3] } };
+#endif
+}
+
+RayCaster::RayCaster() :
+	mySourceId(0),
+	mySourceCooks(-1),
+	myBuilds(0)
+{
+}
+
+bool
+RayCaster::needsBuild(uint32_t sourceId, int64_t sourceCooks) const
+{
+	return sourceId != mySourceId || sourceCooks != mySourceCooks;
+}
+
+void
+RayCaster::build(uint32_t sourceId, int64_t sourceCooks, const float* xyz,
+				const int32_t* indices, const int32_t* polyOffsets, const int32_t* polySizes,
+				int32_t numPolys)
+{
+	mySourceId = sourceId;
+	mySourceCooks = sourceCooks;
+	myBuilds++;
+
+	// Where each polygon's fan starts
+	std::vector<int32_t> firstTri(static_cast<size_t>(std::max(numPolys, 0)) + 1, 0);
+	for (int32_t p = 0; p < numPolys; p++)
+		firstTri[p + 1] = firstTri[p] + std::max(polySizes[p] - 2, 0);
+	const int32_t numTris = firstTri[std::max(numPolys, 0)];
+
+	std::vector<float> corners(static_cast<size_t>(numTris) * 9);
+	std::vector<float> centroids(static_cast<size_t>(numTris) * 3);
+	std::vector<float> bounds(static_cast<size_t>(numTris) * 6);
+	std::vector<int32_t> prims(numTris);
+
+	parallelFor(numPolys, [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			const int32_t* poly = indices + polyOffsets[p];
+			for (int32_t v = 1; v + 1 < polySizes[p]; v++)
+			{
+				const int32_t t = firstTri[p] + v - 1;
+				const float* c[3] =
+				{
+					xyz + static_cast<size_t>(poly[0]) * 3,
+					xyz + static_cast<size_t>(poly[v]) * 3,
+					xyz + static_cast<size_t>(poly[v + 1]) * 3
+				};
+				for (int a = 0; a < 3; a++)
+				{
+					corners[t * 9 + a] = c[0][a];
+					corners[t * 9 + 3 + a] = c[1][a];
+					corners[t * 9 + 6 + a] = c[2][a];
+					centroids[t * 3 + a] = (c[0][a] + c[1][a] + c[2][a]) * (1.0f / 3.0f);
+					bounds[t * 6 + a] = std::min(c[0][a], std::min(c[1][a], c[2][a]));
+					bounds[t * 6 + 3 + a] = std::max(c[0][a], std::max(c[1][a], c[2][a]));
+				}
+				prims[t] = p;
+			}
+		}
+	}, 256);
+
+	myOrder.resize(numTris);
+	for (int32_t t = 0; t < numTris; t++)
+		myOrder[t] = t;
+
+	myNodes.clear();
+	myNodes.reserve(numTris > 0 ? static_cast<size_t>(numTris) * 2 / LeafSize + 1 : 1);
+	if (numTris > 0)
+		buildNode(0, numTris, 0, centroids, bounds);
+
+	// Gather the triangles in leaf order, as v0, edges and normal
+	myTris.resize(static_cast<size_t>(numTris) * TriFloats);
+	myTriPrims.resize(numTris);
+	parallelFor(numTris, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const float* c = &corners[static_cast<size_t>(myOrder[i]) * 9];
+			float* dst = &myTris[static_cast<size_t>(i) * TriFloats];
+			for (int a = 0; a < 3; a++)
+			{
+				dst[a] = c[a];
+				dst[3 + a] = c[3 + a] - c[a];
+				dst[6 + a] = c[6 + a] - c[a];
+			}
+
+			float n[3] =
+			{
+				dst[4] * dst[8] - dst[5] * dst[7],
+				dst[5] * dst[6] - dst[3] * dst[8],
+				dst[3] * dst[7] - dst[4] * dst[6]
+			};
+			const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			const float inv = len > 0.0f ? 1.0f / len : 0.0f;
+			for (int a = 0; a < 3; a++)
+				dst[9 + a] = n[a] * inv;
+
+			myTriPrims[i] = prims[myOrder[i]];
+		}
+	}, 4096);
+}
+
+int32_t
+RayCaster::buildNode(int32_t begin, int32_t end, int32_t depth, const std::vector<float>& centroids,
+					const std::vector<float>& bounds)
+{
+	const int32_t index = static_cast<int32_t>(myNodes.size());
+	myNodes.push_back(Node());
+
+	float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int32_t i = begin; i < end; i++)
+	{
+		const float* b = &bounds[static_cast<size_t>(myOrder[i]) * 6];
+		const float* c = &centroids[static_cast<size_t>(myOrder[i]) * 3];
+		for (int a = 0; a < 3; a++)
+		{
+			bmin[a] = std::min(bmin[a], b[a]);
+			bmax[a] = std::max(bmax[a], b[3 + a]);
+			cmin[a] = std::min(cmin[a], c[a]);
+			cmax[a] = std::max(cmax[a], c[a]);
+		}
+	}
+
+	{
+		Node& node = myNodes[index];
+		for (int a = 0; a < 3; a++)
+		{
+			node.bmin[a] = bmin[a];
+			node.bmax[a] = bmax[a];
+		}
+		node.first = begin;
+		node.count = end - begin;
+		node.axis = 0;
+	}
+
+	const int32_t count = end - begin;
+	if (count <= LeafSize)
+		return index;
+
+	int32_t axis = 0;
+	for (int a = 1; a < 3; a++)
+	{
+		if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis])
+			axis = a;
+	}
+	const float extent = cmax[axis] - cmin[axis];
+
+	int32_t mid = -1;
+	if (extent > 0.0f && depth < MaxSAHDepth)
+	{
+		// Bin the centroids and pick the bin boundary with the lowest
+		// surface area cost
+		int32_t binCounts[SplitBins] = {};
+		float binMin[SplitBins][3];
+		float binMax[SplitBins][3];
+		for (int b = 0; b < SplitBins; b++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				binMin[b][a] = FLT_MAX;
+				binMax[b][a] = -FLT_MAX;
+			}
+		}
+
+		const float scale = SplitBins / extent;
+		auto binOf = [&](int32_t tri)
+		{
+			const int b = static_cast<int>((centroids[static_cast<size_t>(tri) * 3 + axis] - cmin[axis]) * scale);
+			return std::min(b, SplitBins - 1);
+		};
+
+		for (int32_t i = begin; i < end; i++)
+		{
+			const int b = binOf(myOrder[i]);
+			const float* tb = &bounds[static_cast<size_t>(myOrder[i]) * 6];
+			binCounts[b]++;
+			for (int a = 0; a < 3; a++)
+			{
+				binMin[b][a] = std::min(binMin[b][a], tb[a]);
+				binMax[b][a] = std::max(binMax[b][a], tb[3 + a]);
+			}
+		}
+
+		auto area = [](const float* lo, const float* hi)
+		{
+			const float dx = hi[0] - lo[0];
+			const float dy = hi[1] - lo[1];
+			const float dz = hi[2] - lo[2];
+			return dx * dy + dy * dz + dz * dx;
+		};
+
+		// Cost of everything right of each boundary, swept from the right
+		float rightCost[SplitBins];
+		{
+			float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			int32_t n = 0;
+			for (int b = SplitBins - 1; b > 0; b--)
+			{
+				n += binCounts[b];
+				for (int a = 0; a < 3; a++)
+				{
+					lo[a] = std::min(lo[a], binMin[b][a]);
+					hi[a] = std::max(hi[a], binMax[b][a]);
+				}
+				rightCost[b] = n > 0 ? n * area(lo, hi) : 0.0f;
+			}
+		}
+
+		float bestCost = FLT_MAX;
+		int bestBin = -1;
+		{
+			float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			int32_t n = 0;
+			for (int b = 1; b < SplitBins; b++)
+			{
+				n += binCounts[b - 1];
+				for (int a = 0; a < 3; a++)
+				{
+					lo[a] = std::min(lo[a], binMin[b - 1][a]);
+					hi[a] = std::max(hi[a], binMax[b - 1][a]);
+				}
+				if (n == 0 || n == count)
+					continue;
+				const float cost = n * area(lo, hi) + rightCost[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestBin = b;
+				}
+			}
+		}
+
+		if (bestBin > 0)
+		{
+			const int32_t* split = std::partition(myOrder.data() + begin, myOrder.data() + end,
+				[&](int32_t tri) { return binOf(tri) < bestBin; });
+			mid = static_cast<int32_t>(split - myOrder.data());
+		}
+	}
+
+	if (mid <= begin || mid >= end)
+	{
+		// Coincident centroids or too deep, split the range in half
+		mid = (begin + end) / 2;
+		std::nth_element(myOrder.begin() + begin, myOrder.begin() + mid, myOrder.begin() + end,
+			[&](int32_t a, int32_t b)
+			{
+				return centroids[static_cast<size_t>(a) * 3 + axis] < centroids[static_cast<size_t>(b) * 3 + axis];
+			});
+	}
+
+	buildNode(begin, mid, depth + 1, centroids, bounds);
+	const int32_t right = buildNode(mid, end, depth + 1, centroids, bounds);
+
+	Node& node = myNodes[index];
+	node.first = right;
+	node.count = 0;
+	node.axis = axis;
+	return index;
+}
+
+void
+RayCaster::castPacket(const float* origins, const float* directions, int32_t first, int32_t count,
+					RayHit* hits) const
+{
+	// Lanes past 'count' repeat the last ray and are dropped at the end
+	float o[3][4];
+	float d[3][4];
+	float id[3][4];
+	for (int i = 0; i < 4; i++)
+	{
+		const size_t r = static_cast<size_t>(first + std::min(i, count - 1)) * 3;
+		for (int a = 0; a < 3; a++)
+		{
+			o[a][i] = origins[r + a];
+			d[a][i] = directions[r + a];
+			// Keep the slab test free of 0 * inf
+			const float safe = std::fabs(d[a][i]) > 1e-20f ? d[a][i] : (d[a][i] < 0.0f ? -1e-20f : 1e-20f);
+			id[a][i] = 1.0f / safe;
+		}
+	}
+
+	const F4 ox = load4(o[0]), oy = load4(o[1]), oz = load4(o[2]);
+	const F4 dx = load4(d[0]), dy = load4(d[1]), dz = load4(d[2]);
+	const F4 ix = load4(id[0]), iy = load4(id[1]), iz = load4(id[2]);
+	const F4 zero = splat(0.0f);
+	const F4 one = splat(1.0f);
+
+	F4 tHit = splat(FLT_MAX);
+	F4 uHit = zero;
+	F4 vHit = zero;
+	int32_t triHit[4] = { -1, -1, -1, -1 };
+
+	int32_t stack[StackSize];
+	int32_t top = 0;
+	if (!myNodes.empty())
+		stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const Node& node = myNodes[stack[--top]];
+
+		const F4 t0x = (splat(node.bmin[0]) - ox) * ix, t1x = (splat(node.bmax[0]) - ox) * ix;
+		const F4 t0y = (splat(node.bmin[1]) - oy) * iy, t1y = (splat(node.bmax[1]) - oy) * iy;
+		const F4 t0z = (splat(node.bmin[2]) - oz) * iz, t1z = (splat(node.bmax[2]) - oz) * iz;
+		const F4 tNear = lmax(lmax(lmin(t0x, t1x), lmin(t0y, t1y)), lmax(lmin(t0z, t1z), zero));
+		const F4 tFar = lmin(lmin(lmax(t0x, t1x), lmax(t0y, t1y)), lmin(lmax(t0z, t1z), tHit));
+		if (!bits(tNear <= tFar))
+			continue;
+
+		if (node.count == 0)
+		{
+			// Visit the child nearer along the packet's first ray first
+			const int32_t left = static_cast<int32_t>(&node - myNodes.data()) + 1;
+			if (d[node.axis][0] < 0.0f)
+			{
+				stack[top++] = left;
+				stack[top++] = node.first;
+			}
+			else
+			{
+				stack[top++] = node.first;
+				stack[top++] = left;
+			}
+			continue;
+		}
+
+		for (int32_t t = node.first; t < node.first + node.count; t++)
+		{
+			// Moller-Trumbore against all four rays, hitting both sides
+			const float* tri = &myTris[static_cast<size_t>(t) * TriFloats];
+			const F4 e1x = splat(tri[3]), e1y = splat(tri[4]), e1z = splat(tri[5]);
+			const F4 e2x = splat(tri[6]), e2y = splat(tri[7]), e2z = splat(tri[8]);
+
+			const F4 px = dy * e2z - dz * e2y;
+			const F4 py = dz * e2x - dx * e2z;
+			const F4 pz = dx * e2y - dy * e2x;
+			const F4 det = e1x * px + e1y * py + e1z * pz;
+			M4 valid = labs(det) > splat(1e-12f);
+			const F4 invDet = lrcp(select(valid, det, one));
+
+			const F4 sx = ox - splat(tri[0]);
+			const F4 sy = oy - splat(tri[1]);
+			const F4 sz = oz - splat(tri[2]);
+			const F4 u = (sx * px + sy * py + sz * pz) * invDet;
+			valid = valid & (u >= zero) & (u <= one);
+			if (!bits(valid))
+				continue;
+
+			const F4 qx = sy * e1z - sz * e1y;
+			const F4 qy = sz * e1x - sx * e1z;
+			const F4 qz = sx * e1y - sy * e1x;
+			const F4 v = (dx * qx + dy * qy + dz * qz) * invDet;
+			const F4 dist = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+			valid = valid & (v >= zero) & (u + v <= one) & (dist > zero) & (dist < tHit);
+
+			const int mask = bits(valid);
+			if (!mask)
+				continue;
+
+			tHit = select(valid, dist, tHit);
+			uHit = select(valid, u, uHit);
+			vHit = select(valid, v, vHit);
+			for (int i = 0; i < 4; i++)
+			{
+				if (mask & (1 << i))
+					triHit[i] = t;
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		RayHit& hit = hits[first + i];
+		if (triHit[i] < 0)
+		{
+			hit = RayHit();
+			hit.primitive = -1;
+			continue;
+		}
+
+		const float* tri = &myTris[static_cast<size_t>(triHit[i]) * TriFloats];
+		const float t = lane(tHit, i);
+		for (int a = 0; a < 3; a++)
+		{
+			hit.position[a] = o[a][i] + d[a][i] * t;
+			hit.normal[a] = tri[9 + a];
+		}
+		hit.u = lane(uHit, i);
+		hit.v = lane(vHit, i);
+		hit.length = t * std::sqrt(d[0][i] * d[0][i] + d[1][i] * d[1][i] + d[2][i] * d[2][i]);
+		hit.primitive = myTriPrims[triHit[i]];
+	}
+}
+
+void
+RayCaster::cast(const float* origins, const float* directions, int32_t count, RayHit* hits) const
+{
+	const int32_t packets = (count + 3) / 4;
+	parallelFor(packets, [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+			castPacket(origins, directions, p * 4, std::min(4, count - p * 4), hits);
+	}, 16);
+}
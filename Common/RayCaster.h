@@ -0,0 +1,93 @@
+/*
+ * Casts batches of rays against the polygons of a SOP, as a batched
+ * replacement for OP_SOPInput::sendRay().
+ *
+ * Polygons are fan-triangulated into a BVH (binned SAH, up to LeafSize
+ * triangles per leaf) that is kept until the SOP cooks again. Rays are traced
+ * in packets of four through the same traversal, one SSE lane per ray on x86,
+ * and the packets are spread across threads. Consecutive rays in a batch
+ * should be roughly coherent (neighbouring pixels, agents in one flock) for
+ * packets to pay off.
+ *
+ * Hits match sendRay(): the hit position, the distance to it along the ray,
+ * the polygon's geometric normal, the hit's u and v inside the triangle of
+ * the polygon's fan it landed in, and the primitive index. Both sides of a
+ * polygon are hit.
+ */
+
+#ifndef __RayCaster__
+#define __RayCaster__
+
+#include <stdint.h>
+#include <vector>
+
+struct RayHit
+{
+	float		position[3];
+	float		normal[3];
+	float		u;
+	float		v;
+	float		length;
+	// -1 if the ray hit nothing
+	int32_t		primitive;
+};
+
+class RayCaster
+{
+public:
+	static const int32_t	LeafSize = 4;
+
+	RayCaster();
+
+	// True if the geometry last built from isn't 'sourceId' at 'sourceCooks'
+	bool			needsBuild(uint32_t sourceId, int64_t sourceCooks) const;
+
+	// Builds the BVH from 'numPolys' polygons. Polygon i has polySizes[i]
+	// point indices starting at indices[polyOffsets[i]], into 'xyz' which
+	// holds 3 floats per point. Polygons with fewer than 3 points are skipped.
+	void			build(uint32_t sourceId, int64_t sourceCooks, const float* xyz,
+							const int32_t* indices, const int32_t* polyOffsets, const int32_t* polySizes,
+							int32_t numPolys);
+
+	// Traces 'count' rays, 3 floats of origin and of direction each. The
+	// directions don't need to be normalized.
+	void			cast(const float* origins, const float* directions, int32_t count, RayHit* hits) const;
+
+	int32_t			numTriangles() const { return static_cast<int32_t>(myTriPrims.size()); }
+	int64_t			builds() const { return myBuilds; }
+
+private:
+	struct Node
+	{
+		float		bmin[3];
+		float		bmax[3];
+		// Leaves: first triangle and count. Inner nodes: count is 0, the
+		// left child follows the node and 'first' is the right child.
+		int32_t		first;
+		int32_t		count;
+		int32_t		axis;
+	};
+
+	// Appends the subtree over myOrder[begin, end) and returns its root
+	int32_t			buildNode(int32_t begin, int32_t end, int32_t depth, const std::vector<float>& centroids,
+							const std::vector<float>& bounds);
+
+	// Traces rays [first, first + count), count being at most 4
+	void			castPacket(const float* origins, const float* directions, int32_t first, int32_t count,
+							RayHit* hits) const;
+
+	uint32_t				mySourceId;
+	int64_t					mySourceCooks;
+	int64_t					myBuilds;
+
+	std::vector<Node>		myNodes;
+	// Triangles in leaf order: v0, the edges v1 - v0 and v2 - v0 and the unit
+	// normal, TriFloats floats each
+	static const int32_t	TriFloats = 12;
+	std::vector<float>		myTris;
+	std::vector<int32_t>	myTriPrims;
+	// Maps leaf order to the order triangles were generated in while building
+	std::vector<int32_t>	myOrder;
+};
+
+#endif
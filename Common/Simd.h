@@ -0,0 +1,64 @@
+/*
+ * Runtime detection of the vector instruction sets we have hand-written
+ * paths for.
+ *
+ * The plugins are built without /arch:AVX2 (or -mavx2) so they still load on
+ * older machines. Functions that use AVX2 intrinsics are marked with
+ * SIMD_TARGET_AVX2 and are only called after simdHasAVX2() returned true.
+ */
+
+#ifndef __Simd__
+#define __Simd__
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define SIMD_X86 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		// MSVC always allows AVX2 intrinsics, no per-function target needed
+		#define SIMD_TARGET_AVX2
+	#else
+		#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+	#endif
+#else
+	#define SIMD_X86 0
+	#define SIMD_TARGET_AVX2
+#endif
+
+// True if the CPU and OS support AVX2 and FMA.
+inline bool
+simdHasAVX2()
+{
+#if SIMD_X86
+	static const bool hasAVX2 = []()
+	{
+	#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!fma || !osxsave)
+			return false;
+
+		// The OS has to save the YMM registers on context switches
+		if ((_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	#endif
+	}();
+	return hasAVX2;
+#else
+	return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,313 @@
+/*
+ * See ThreadPool.h
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct PoolTask
+{
+	std::function<void()>	task;
+	TaskCounter*			counter;
+};
+
+struct PoolQueue
+{
+	std::mutex				lock;
+	std::deque<PoolTask>	tasks[NumTaskPriorities];
+};
+
+struct PoolState
+{
+	// Guards starting and stopping, and the users count
+	std::mutex				lifetime;
+	int						users = 0;
+
+	std::vector<std::thread>	threads;
+	// One per worker, then the one shared by every other thread
+	std::vector<std::unique_ptr<PoolQueue>>	queues;
+	std::atomic<bool>		running{ false };
+	std::atomic<bool>		stopping{ false };
+	// Tasks queued and not yet taken
+	std::atomic<int32_t>	queued{ 0 };
+
+	std::mutex				sleepLock;
+	std::condition_variable	wake;
+
+	~PoolState()
+	{
+		// Instances are destroyed before the plugin is unloaded, so this only
+		// happens if one leaked, and joining while unloading can deadlock
+		for (std::thread& thread : threads)
+			thread.detach();
+	}
+};
+
+static PoolState&
+poolState()
+{
+	static PoolState state;
+	return state;
+}
+
+// Index of the worker running on this thread, -1 on any other thread
+static thread_local int theWorker = -1;
+
+static void
+wakeWorkers(PoolState& state, bool all)
+{
+	// Taking the lock orders this after a worker's check of its wait
+	// condition, so the notification can't slip in before it sleeps
+	{
+		std::lock_guard<std::mutex> guard(state.sleepLock);
+	}
+	if (all)
+		state.wake.notify_all();
+	else
+		state.wake.notify_one();
+}
+
+static bool
+popTask(PoolQueue& queue, int priority, bool newest, PoolTask& out)
+{
+	std::lock_guard<std::mutex> guard(queue.lock);
+	std::deque<PoolTask>& tasks = queue.tasks[priority];
+	if (tasks.empty())
+		return false;
+	if (newest)
+	{
+		out = std::move(tasks.back());
+		tasks.pop_back();
+	}
+	else
+	{
+		out = std::move(tasks.front());
+		tasks.pop_front();
+	}
+	return true;
+}
+
+// Takes the most urgent task this thread should run next
+static bool
+takeTask(PoolState& state, PoolTask& out)
+{
+	if (state.queued.load(std::memory_order_acquire) <= 0)
+		return false;
+
+	const int self = theWorker;
+	const int workers = static_cast<int>(state.threads.size());
+	for (int p = 0; p < NumTaskPriorities; p++)
+	{
+		bool found = self >= 0 && popTask(*state.queues[self], p, true, out);
+		if (!found)
+			found = popTask(*state.queues[workers], p, false, out);
+		for (int k = 1; !found && k <= workers; k++)
+		{
+			const int victim = (std::max(self, 0) + k) % workers;
+			if (victim != self)
+				found = popTask(*state.queues[victim], p, false, out);
+		}
+		if (found)
+		{
+			state.queued.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+ThreadPool::runTask(PoolTask& task)
+{
+	task.task();
+	task.counter->myPending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void
+ThreadPool::workerLoop(int index)
+{
+	PoolState& state = poolState();
+	theWorker = index;
+	for (;;)
+	{
+		PoolTask task;
+		if (takeTask(state, task))
+		{
+			runTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(state.sleepLock);
+		state.wake.wait(lock, [&state]()
+		{
+			return state.stopping.load() || state.queued.load() > 0;
+		});
+		// Whatever is still queued runs before the worker leaves
+		if (state.stopping.load() && state.queued.load() <= 0)
+			return;
+	}
+}
+
+void
+ThreadPool::acquire()
+{
+	PoolState& state = poolState();
+	std::lock_guard<std::mutex> guard(state.lifetime);
+	if (state.users++ > 0)
+		return;
+
+	// The thread cooking a node works too, so one fewer than the cores
+	const unsigned int cores = std::thread::hardware_concurrency();
+	const int workers = cores > 1 ? static_cast<int>(cores) - 1 : 0;
+	if (workers == 0)
+		return;
+
+	state.stopping = false;
+	state.queued = 0;
+	state.queues.clear();
+	for (int i = 0; i <= workers; i++)
+		state.queues.emplace_back(new PoolQueue);
+	for (int i = 0; i < workers; i++)
+		state.threads.emplace_back(&ThreadPool::workerLoop, i);
+	state.running = true;
+}
+
+void
+ThreadPool::release()
+{
+	PoolState& state = poolState();
+	std::lock_guard<std::mutex> guard(state.lifetime);
+	if (state.users == 0 || --state.users > 0 || !state.running)
+		return;
+
+	state.running = false;
+	state.stopping = true;
+	wakeWorkers(state, true);
+	for (std::thread& thread : state.threads)
+		thread.join();
+	state.threads.clear();
+	state.queues.clear();
+}
+
+int
+ThreadPool::workers()
+{
+	PoolState& state = poolState();
+	return state.running.load(std::memory_order_acquire) ? static_cast<int>(state.threads.size()) : 0;
+}
+
+void
+ThreadPool::submit(std::function<void()> task, TaskPriority priority, TaskCounter& counter)
+{
+	PoolState& state = poolState();
+	if (!state.running.load(std::memory_order_acquire))
+	{
+		task();
+		return;
+	}
+
+	counter.myPending.fetch_add(1, std::memory_order_acq_rel);
+	const int queue = theWorker >= 0 ? theWorker : static_cast<int>(state.threads.size());
+	{
+		PoolQueue& target = *state.queues[queue];
+		std::lock_guard<std::mutex> guard(target.lock);
+		target.tasks[static_cast<int>(priority)].push_back(PoolTask{ std::move(task), &counter });
+	}
+	state.queued.fetch_add(1, std::memory_order_acq_rel);
+	wakeWorkers(state, false);
+}
+
+void
+ThreadPool::wait(TaskCounter& counter)
+{
+	PoolState& state = poolState();
+	while (!counter.done())
+	{
+		// The tasks left may be running on other threads, or queued behind
+		// others this thread can help with
+		PoolTask task;
+		if (takeTask(state, task))
+			runTask(task);
+		else
+			std::this_thread::yield();
+	}
+}
+
+int32_t
+TaskGraph::add(std::function<void()> task, TaskPriority priority)
+{
+	Node node;
+	node.task = std::move(task);
+	node.priority = priority;
+	myNodes.push_back(std::move(node));
+	return static_cast<int32_t>(myNodes.size()) - 1;
+}
+
+void
+TaskGraph::precede(int32_t before, int32_t task)
+{
+	myNodes[before].next.push_back(task);
+	myNodes[task].before++;
+}
+
+void
+TaskGraph::clear()
+{
+	myNodes.clear();
+}
+
+void
+TaskGraph::runNode(int32_t i, Clock::time_point deadline, TaskCounter& counter)
+{
+	Node& node = myNodes[i];
+	const bool skip = mySkipped[i].load(std::memory_order_acquire) || Clock::now() > deadline;
+	if (!skip)
+	{
+		node.task();
+		node.ran = true;
+	}
+
+	for (int32_t next : node.next)
+	{
+		if (skip)
+			mySkipped[next].store(true, std::memory_order_release);
+		if (myWaiting[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			ThreadPool::submit([this, next, deadline, &counter]() { runNode(next, deadline, counter); },
+				myNodes[next].priority, counter);
+		}
+	}
+}
+
+bool
+TaskGraph::run(Clock::time_point deadline)
+{
+	const int32_t n = size();
+	myWaiting.reset(new std::atomic<int32_t>[n]);
+	mySkipped.reset(new std::atomic<bool>[n]);
+	for (int32_t i = 0; i < n; i++)
+	{
+		myWaiting[i] = myNodes[i].before;
+		mySkipped[i] = false;
+		myNodes[i].ran = false;
+	}
+
+	TaskCounter counter;
+	for (int32_t i = 0; i < n; i++)
+	{
+		if (myNodes[i].before == 0)
+		{
+			ThreadPool::submit([this, i, deadline, &counter]() { runNode(i, deadline, counter); },
+				myNodes[i].priority, counter);
+		}
+	}
+	ThreadPool::wait(counter);
+
+	// Tasks in a cycle are never ready, so they count as not run too
+	return std::all_of(myNodes.begin(), myNodes.end(), [](const Node& node) { return node.ran; });
+}
@@ -0,0 +1,128 @@
+/*
+ * Work-stealing thread pool shared by every instance of a plugin, so dozens
+ * of nodes cooking at once don't each bring their own threads.
+ *
+ * The pool starts when the first instance calls acquire(), from
+ * Create*Instance(), and its threads are joined when the last one calls
+ * release() from Destroy*Instance(). Outside of that window, tasks simply
+ * run on the thread that submits them, so nothing ever depends on the pool
+ * being up.
+ *
+ * Every worker has its own queues, one per priority. A worker takes its own
+ * newest task first, which is usually the one whose data is still in its
+ * cache, and when it has none steals the oldest of another worker's, which
+ * tends to be the biggest piece of work left. Threads that aren't workers,
+ * like the one cooking a node, queue their tasks in a shared queue. Higher
+ * priorities are always taken first, wherever they are queued.
+ *
+ * A thread waiting on its tasks runs queued tasks instead of blocking, so a
+ * parallelFor() inside a task can't starve the pool.
+ *
+ * TaskGraph runs tasks that depend on each other, each one as soon as the
+ * ones it needs have finished, and can be given the cook's deadline: tasks
+ * that haven't started by then are skipped, along with everything that
+ * needs them.
+ */
+
+#ifndef __ThreadPool__
+#define __ThreadPool__
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+enum class TaskPriority
+{
+	High = 0,
+	Normal,
+	Low,
+};
+
+static const int NumTaskPriorities = 3;
+
+struct PoolTask;
+
+// Tasks of one batch that haven't finished yet
+class TaskCounter
+{
+public:
+	TaskCounter() : myPending(0) {}
+
+	bool			done() const { return myPending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class ThreadPool;
+
+	std::atomic<int32_t>	myPending;
+};
+
+class ThreadPool
+{
+public:
+	// Counts a plugin instance using the pool, starting it for the first
+	static void		acquire();
+	// Stops the pool once the last instance has released it
+	static void		release();
+
+	// Worker threads, 0 when the pool isn't running
+	static int		workers();
+
+	// Queues 'task', counting it in 'counter' until it has run. Runs it
+	// right away when the pool isn't running.
+	static void		submit(std::function<void()> task, TaskPriority priority, TaskCounter& counter);
+
+	// Returns once every task counted in 'counter' has run, running queued
+	// tasks meanwhile
+	static void		wait(TaskCounter& counter);
+
+private:
+	static void		workerLoop(int index);
+	static void		runTask(PoolTask& task);
+};
+
+class TaskGraph
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// Adds a task, returning its index
+	int32_t			add(std::function<void()> task, TaskPriority priority = TaskPriority::Normal);
+	// 'task' only starts once 'before' has finished
+	void			precede(int32_t before, int32_t task);
+	void			clear();
+
+	int32_t			size() const { return static_cast<int32_t>(myNodes.size()); }
+
+	// Runs every task, each once all those before it have finished. Tasks
+	// that haven't started by 'deadline' are skipped with the ones after
+	// them. Returns true if every task ran.
+	bool			run(Clock::time_point deadline = Clock::time_point::max());
+
+	// Whether the task ran in the last run()
+	bool			ran(int32_t task) const { return myNodes[task].ran; }
+
+private:
+	struct Node
+	{
+		std::function<void()>	task;
+		TaskPriority			priority;
+		std::vector<int32_t>	next;
+		int32_t					before = 0;
+		bool					ran = false;
+	};
+
+	// Runs or skips node 'i', then queues the nodes it was the last one
+	// holding back
+	void			runNode(int32_t i, Clock::time_point deadline, TaskCounter& counter);
+
+	std::vector<Node>						myNodes;
+	// Per node, how many before it haven't finished, and whether one of them
+	// was skipped
+	std::unique_ptr<std::atomic<int32_t>[]>	myWaiting;
+	std::unique_ptr<std::atomic<bool>[]>	mySkipped;
+};
+
+#endif